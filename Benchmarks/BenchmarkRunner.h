@@ -0,0 +1,119 @@
+//
+//  BenchmarkRunner.h
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+//  Description: Runs named benchmarks repeatedly, summarizes their timings with percentiles and
+//               compares them with a previous report. Reports are JSON so that runs can be stored
+//               as baselines and compared by scripts.
+//
+
+#import <Foundation/Foundation.h>
+
+@class Directory;
+
+@interface BenchmarkCase : NSObject
+
+@property (readonly) NSString *name;
+
+@property (readonly) void (^measure)(void);
+
+/**
+ Called once before the first run (including warm-up runs). Not timed.
+ */
+@property (nonatomic, copy) void (^prepare)(void);
+
+/**
+ Called before each run. Not timed.
+ */
+@property (nonatomic, copy) void (^setUp)(void);
+
+/**
+ Called after each run. Not timed.
+ */
+@property (nonatomic, copy) void (^tearDown)(void);
+
+/**
+ The number of operations performed by each run, used to report throughput (1 by default).
+ */
+@property (nonatomic) NSUInteger operationCount;
+
+@end
+
+@interface BenchmarkResult : NSObject
+
+@property (readonly) NSString *name;
+
+/**
+ The duration of each run, in seconds, in the order they ran.
+ */
+@property (readonly) NSArray<NSNumber *> *samples;
+
+@property (readonly) NSUInteger operationCount;
+
+/**
+ Returns the duration below which the specified percentage of runs finished (nearest rank).
+ */
+- (double)percentile:(double)percentage;
+
+@property (readonly) double mean;
+
+@property (readonly) double standardDeviation;
+
+- (NSDictionary *)dictionaryRepresentation;
+
+@end
+
+@interface BenchmarkRunner : NSObject
+
+#pragma mark Lifetime
+
+/**
+ Creates a runner whose benchmarks create their files in the scratch directory.
+ */
+- (id)initWithScratchDirectory:(Directory *)scratchDirectory;
+
+#pragma mark Configuration
+
+@property (readonly) Directory *scratchDirectory;
+
+/**
+ The number of timed runs of each benchmark (10 by default).
+ */
+@property (nonatomic) NSUInteger iterations;
+
+/**
+ The number of untimed runs before the timed ones (1 by default).
+ */
+@property (nonatomic) NSUInteger warmUpIterations;
+
+/**
+ When set, only benchmarks whose name contains this string run.
+ */
+@property (nonatomic, copy) NSString *filter;
+
+#pragma mark Running
+
+- (BenchmarkCase *)addBenchmark:(NSString *)name measure:(void (^)(void))measure;
+
+/**
+ Runs the benchmarks in the order they were added, logging progress to stderr.
+ */
+- (NSArray<BenchmarkResult *> *)run;
+
+#pragma mark Reports
+
+/**
+ Returns a report of the results. When a baseline report is given, the report also compares each result's
+ median with the baseline's: changes beyond the threshold (0.1 for 10%) are reported as regressions or improvements.
+ */
++ (NSDictionary *)reportWithResults:(NSArray<BenchmarkResult *> *)results baseline:(NSDictionary *)baseline threshold:(double)threshold;
+
+/**
+ Returns the names of the benchmarks that regressed in a report made with a baseline.
+ */
++ (NSArray<NSString *> *)regressionsInReport:(NSDictionary *)report;
+
+@end
@@ -0,0 +1,213 @@
+//
+//  BenchmarkRunner.m
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+
+#import <math.h>
+#import <stdio.h>
+#import "BenchmarkRunner.h"
+#import "Directory.h"
+#import "NSException+FilesAdditions.h"
+
+#define BenchmarkReportVersion 1
+
+#pragma mark - Benchmark Cases
+
+@implementation BenchmarkCase
+
+- (id)initWithName:(NSString *)name measure:(void (^)(void))measure
+{
+	self = [super init];
+	if (self)
+	{
+		_name = [name copy];
+		_measure = [measure copy];
+		_operationCount = 1;
+	}
+	return self;
+}
+
+@end
+
+#pragma mark - Benchmark Results
+
+@implementation BenchmarkResult
+{
+	NSArray<NSNumber *> *_sortedSamples;
+}
+
+- (id)initWithName:(NSString *)name samples:(NSArray<NSNumber *> *)samples operationCount:(NSUInteger)operationCount
+{
+	self = [super init];
+	if (self)
+	{
+		_name = name;
+		_samples = [samples copy];
+		_sortedSamples = [samples sortedArrayUsingSelector:@selector(compare:)];
+		_operationCount = operationCount;
+
+		double sum = 0, squares = 0;
+		for (NSNumber *sample in samples) sum += [sample doubleValue];
+		_mean = sum / [samples count];
+
+		for (NSNumber *sample in samples) squares += ([sample doubleValue] - _mean) * ([sample doubleValue] - _mean);
+		_standardDeviation = ([samples count] > 1 ? sqrt(squares / ([samples count] - 1)) : 0);
+	}
+	return self;
+}
+
+- (double)percentile:(double)percentage
+{
+	NSUInteger count = [_sortedSamples count];
+	NSUInteger rank = (NSUInteger)ceil(percentage / 100.0 * count);
+
+	return [_sortedSamples[MIN(MAX(rank, (NSUInteger)1), count) - 1] doubleValue];
+}
+
+- (NSDictionary *)dictionaryRepresentation
+{
+	double median = [self percentile:50];
+
+	return @{ @"name": _name,
+	          @"iterations": @([_samples count]),
+	          @"operations": @(_operationCount),
+	          @"unit": @"s",
+	          @"min": [_sortedSamples firstObject],
+	          @"p50": @(median),
+	          @"p90": @([self percentile:90]),
+	          @"p99": @([self percentile:99]),
+	          @"max": [_sortedSamples lastObject],
+	          @"mean": @(_mean),
+	          @"stddev": @(_standardDeviation),
+	          @"operationsPerSecond": @(median > 0 ? _operationCount / median : 0),
+	          @"samples": _samples };
+}
+
+@end
+
+#pragma mark - Benchmark Runner
+
+@implementation BenchmarkRunner
+{
+	NSMutableArray<BenchmarkCase *> *_cases;
+}
+
+#pragma mark Lifetime
+
+- (id)initWithScratchDirectory:(Directory *)scratchDirectory
+{
+	if (scratchDirectory == nil) @throw [NSException exceptionWithReason:@"Scratch directory is nil"];
+
+	self = [super init];
+	if (self)
+	{
+		_scratchDirectory = scratchDirectory;
+		_iterations = 10;
+		_warmUpIterations = 1;
+		_cases = [NSMutableArray array];
+	}
+	return self;
+}
+
+#pragma mark Running
+
+- (BenchmarkCase *)addBenchmark:(NSString *)name measure:(void (^)(void))measure
+{
+	BenchmarkCase *benchmark = [[BenchmarkCase alloc] initWithName:name measure:measure];
+	[_cases addObject:benchmark];
+	return benchmark;
+}
+
+- (NSArray<BenchmarkResult *> *)run
+{
+	if (_iterations == 0) @throw [NSException exceptionWithReason:@"At least one iteration is required"];
+
+	NSMutableArray<BenchmarkResult *> *results = [NSMutableArray array];
+
+	for (BenchmarkCase *benchmark in _cases)
+	{
+		if (_filter && [[benchmark name] rangeOfString:_filter].location == NSNotFound) continue;
+
+		fprintf(stderr, "%-40s ", [[benchmark name] UTF8String]);
+		fflush(stderr);
+
+		@autoreleasepool
+		{
+			if ([benchmark prepare]) [benchmark prepare]();
+
+			NSMutableArray<NSNumber *> *samples = [NSMutableArray arrayWithCapacity:_iterations];
+
+			for (NSUInteger i = 0; i < _warmUpIterations + _iterations; i++)
+			{
+				@autoreleasepool
+				{
+					if ([benchmark setUp]) [benchmark setUp]();
+
+					NSTimeInterval start = [[NSProcessInfo processInfo] systemUptime];
+					[benchmark measure]();
+					NSTimeInterval duration = [[NSProcessInfo processInfo] systemUptime] - start;
+
+					if ([benchmark tearDown]) [benchmark tearDown]();
+					if (i >= _warmUpIterations) [samples addObject:@(duration)];
+				}
+			}
+
+			BenchmarkResult *result = [[BenchmarkResult alloc] initWithName:[benchmark name] samples:samples operationCount:[benchmark operationCount]];
+			[results addObject:result];
+
+			fprintf(stderr, "p50 %10.3f ms   p90 %10.3f ms\n", [result percentile:50] * 1000, [result percentile:90] * 1000);
+		}
+	}
+
+	return results;
+}
+
+#pragma mark Reports
+
++ (NSDictionary *)reportWithResults:(NSArray<BenchmarkResult *> *)results baseline:(NSDictionary *)baseline threshold:(double)threshold
+{
+	NSMutableDictionary *report = [NSMutableDictionary dictionary];
+	NSProcessInfo *processInfo = [NSProcessInfo processInfo];
+
+	report[@"version"] = @(BenchmarkReportVersion);
+	report[@"date"] = [[NSDate date] description];
+	report[@"host"] = @{ @"system": [processInfo operatingSystemVersionString], @"processors": @([processInfo activeProcessorCount]) };
+	report[@"benchmarks"] = [results valueForKey:@"dictionaryRepresentation"];
+
+	if (baseline == nil) return report;
+
+	NSMutableDictionary<NSString *, NSDictionary *> *baselineBenchmarks = [NSMutableDictionary dictionary];
+	for (NSDictionary *benchmark in baseline[@"benchmarks"]) baselineBenchmarks[benchmark[@"name"]] = benchmark;
+
+	NSMutableArray *comparison = [NSMutableArray array];
+
+	for (BenchmarkResult *result in results)
+	{
+		double baselineMedian = [baselineBenchmarks[[result name]][@"p50"] doubleValue];
+		if (baselineMedian <= 0) continue;
+
+		double ratio = [result percentile:50] / baselineMedian;
+		NSString *status = (ratio > 1 + threshold ? @"regressed" : (ratio < 1 - threshold ? @"improved" : @"unchanged"));
+
+		[comparison addObject:@{ @"name": [result name], @"baselineP50": @(baselineMedian), @"p50": @([result percentile:50]), @"ratio": @(ratio), @"status": status }];
+	}
+
+	report[@"threshold"] = @(threshold);
+	report[@"comparison"] = comparison;
+	return report;
+}
+
++ (NSArray<NSString *> *)regressionsInReport:(NSDictionary *)report
+{
+	NSMutableArray<NSString *> *regressions = [NSMutableArray array];
+
+	for (NSDictionary *entry in report[@"comparison"])
+		if ([entry[@"status"] isEqualToString:@"regressed"]) [regressions addObject:entry[@"name"]];
+
+	return regressions;
+}
+
+@end
@@ -0,0 +1,22 @@
+//
+//  DirectoryBenchmarks.h
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+//  Description: Listing directories of 1k to 1M entries and copying or moving trees of small files.
+//
+
+#import <Foundation/Foundation.h>
+
+@class BenchmarkRunner;
+
+@interface DirectoryBenchmarks : NSObject
+
+/**
+ Registers listing benchmarks for directories of up to the specified number of entries (1k, 100k and 1M).
+ */
++ (void)registerWithRunner:(BenchmarkRunner *)runner maximumEntryCount:(NSUInteger)maximumEntryCount;
+
+@end
@@ -0,0 +1,122 @@
+//
+//  DirectoryBenchmarks.m
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+
+#import <fcntl.h>
+#import <unistd.h>
+#import "DirectoryBenchmarks.h"
+#import "BenchmarkRunner.h"
+#import "Directory.h"
+#import "File.h"
+
+#define DirectoryBenchmarksTreeDirectoryCount 10
+#define DirectoryBenchmarksTreeFileCount 1000
+#define DirectoryBenchmarksTreeFileSize 1024
+
+@implementation DirectoryBenchmarks
+
++ (NSString *)nameForCount:(NSUInteger)count
+{
+	return (count >= 1000000 ? [NSString stringWithFormat:@"%luM", (unsigned long)(count / 1000000)] : [NSString stringWithFormat:@"%luk", (unsigned long)(count / 1000)]);
+}
+
++ (void)registerWithRunner:(BenchmarkRunner *)runner maximumEntryCount:(NSUInteger)maximumEntryCount
+{
+	Directory *directory = [[runner scratchDirectory] subdirectory:@"Directory Benchmarks"];
+
+	[self registerListingWithRunner:runner directory:directory maximumEntryCount:maximumEntryCount];
+	[self registerCopyingAndMovingWithRunner:runner directory:directory];
+}
+
+#pragma mark Listing
+
++ (void)createEntries:(NSUInteger)count inDirectory:(Directory *)directory
+{
+	// Entries are created with POSIX calls since creating a million File instances would dominate the preparation
+	NSString *path = [[directory create] absolutePath];
+
+	for (NSUInteger i = 0; i < count; i++)
+	{
+		NSString *entryPath = [path stringByAppendingPathComponent:[NSString stringWithFormat:@"Entry %lu", (unsigned long)i]];
+		int descriptor = open([entryPath fileSystemRepresentation], O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+		if (descriptor < 0) { NSLog(@"Could not create %@", entryPath); return; }
+		close(descriptor);
+	}
+}
+
++ (void)registerListingWithRunner:(BenchmarkRunner *)runner directory:(Directory *)directory maximumEntryCount:(NSUInteger)maximumEntryCount
+{
+	NSUInteger counts[] = { 1000, 100000, 1000000 };
+
+	for (NSUInteger i = 0; i < sizeof(counts) / sizeof(counts[0]); i++)
+	{
+		NSUInteger count = counts[i];
+		if (count > maximumEntryCount) break;
+
+		Directory *entries = [directory subdirectory:[NSString stringWithFormat:@"Entries %lu", (unsigned long)count]];
+
+		// Shared by the items and files benchmarks
+		void (^prepare)(void) = ^
+		{
+			if (![[entries file:[NSString stringWithFormat:@"Entry %lu", (unsigned long)(count - 1)]] exists]) [self createEntries:count inDirectory:entries];
+		};
+
+		BenchmarkCase *items = [runner addBenchmark:[NSString stringWithFormat:@"directory.items.%@", [self nameForCount:count]] measure:^
+		{
+			if ([[entries items] count] != count) NSLog(@"Unexpected item count in %@", entries);
+		}];
+		[items setPrepare:prepare];
+		[items setOperationCount:count];
+
+		BenchmarkCase *files = [runner addBenchmark:[NSString stringWithFormat:@"directory.files.%@", [self nameForCount:count]] measure:^
+		{
+			if ([[entries files] count] != count) NSLog(@"Unexpected file count in %@", entries);
+		}];
+		[files setPrepare:prepare];
+		[files setOperationCount:count];
+	}
+}
+
+#pragma mark Copying and Moving
+
++ (void)registerCopyingAndMovingWithRunner:(BenchmarkRunner *)runner directory:(Directory *)directory
+{
+	Directory *source = [directory subdirectory:@"Tree"];
+	Directory *destination = [directory subdirectory:@"Tree Destination"];
+
+	void (^prepare)(void) = ^
+	{
+		if ([source exists]) return;
+
+		NSData *data = [NSMutableData dataWithLength:DirectoryBenchmarksTreeFileSize];
+
+		for (NSUInteger i = 0; i < DirectoryBenchmarksTreeFileCount; i++)
+		{
+			Directory *subdirectory = [[source subdirectoryWithFormat:@"Directory %lu", (unsigned long)(i % DirectoryBenchmarksTreeDirectoryCount)] create];
+			[[subdirectory fileWithFormat:@"File %lu", (unsigned long)i] writeData:data];
+		}
+	};
+
+	BenchmarkCase *copying = [runner addBenchmark:@"directory.copyTo.smallFiles" measure:^
+	{
+		if (![source copyTo:destination overwrite:NO]) NSLog(@"Could not copy %@", source);
+	}];
+	[copying setPrepare:prepare];
+	[copying setTearDown:^{ [destination delete]; }];
+	[copying setOperationCount:DirectoryBenchmarksTreeFileCount];
+
+	// Moves back and forth; the move back is not timed
+	BenchmarkCase *moving = [runner addBenchmark:@"directory.moveTo.smallFiles" measure:^
+	{
+		if (![source moveTo:destination overwrite:NO]) NSLog(@"Could not move %@", source);
+	}];
+	[moving setPrepare:prepare];
+	[moving setTearDown:^{ [destination moveTo:source overwrite:NO]; }];
+	[moving setOperationCount:DirectoryBenchmarksTreeFileCount];
+}
+
+@end
@@ -0,0 +1,19 @@
+//
+//  FileBenchmarks.h
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+//  Description: Reading, writing, copying, moving and archiving single files of various sizes.
+//
+
+#import <Foundation/Foundation.h>
+
+@class BenchmarkRunner;
+
+@interface FileBenchmarks : NSObject
+
++ (void)registerWithRunner:(BenchmarkRunner *)runner;
+
+@end
@@ -0,0 +1,146 @@
+//
+//  FileBenchmarks.m
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+
+#import "FileBenchmarks.h"
+#import "BenchmarkRunner.h"
+#import "Directory.h"
+#import "File.h"
+
+#define FileBenchmarksLargeFileSize (64 * 1024 * 1024)
+#define FileBenchmarksArchiveEntryCount 10000
+
+@implementation FileBenchmarks
+
++ (NSData *)dataWithLength:(NSUInteger)length
+{
+	NSMutableData *data = [NSMutableData dataWithLength:length];
+	uint32_t *words = [data mutableBytes];
+	uint32_t state = 2463534242u;
+
+	// Not compressible or deduplicated by the file system, and the same for every run
+	for (NSUInteger i = 0; i < length / sizeof(uint32_t); i++)
+	{
+		state ^= state << 13; state ^= state >> 17; state ^= state << 5;
+		words[i] = state;
+	}
+
+	return data;
+}
+
++ (NSString *)nameForSize:(NSUInteger)size
+{
+	return (size >= 1024 * 1024 ? [NSString stringWithFormat:@"%luMB", (unsigned long)(size / (1024 * 1024))] : [NSString stringWithFormat:@"%luKB", (unsigned long)(size / 1024)]);
+}
+
++ (void)registerWithRunner:(BenchmarkRunner *)runner
+{
+	Directory *directory = [[runner scratchDirectory] subdirectory:@"File Benchmarks"];
+
+	[self registerReadingAndWritingWithRunner:runner directory:directory];
+	[self registerCopyingAndMovingWithRunner:runner directory:directory];
+	[self registerArchivingWithRunner:runner directory:directory];
+}
+
++ (void)registerReadingAndWritingWithRunner:(BenchmarkRunner *)runner directory:(Directory *)directory
+{
+	// Small sizes are repeated so that each run is long enough to time reliably
+	NSUInteger sizes[] = { 4 * 1024, 1024 * 1024, FileBenchmarksLargeFileSize };
+	NSUInteger repetitions[] = { 1000, 20, 1 };
+
+	for (NSUInteger i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+	{
+		NSUInteger size = sizes[i];
+		NSUInteger count = repetitions[i];
+		File *file = [directory file:[NSString stringWithFormat:@"Data %@", [self nameForSize:size]]];
+		__block NSData *data;
+
+		BenchmarkCase *reading = [runner addBenchmark:[NSString stringWithFormat:@"file.readData.%@", [self nameForSize:size]] measure:^
+		{
+			for (NSUInteger j = 0; j < count; j++)
+				if ([file readData] == nil) NSLog(@"Could not read %@", file);
+		}];
+		[reading setPrepare:^
+		{
+			[directory create];
+			[file writeData:[self dataWithLength:size] overwrite:YES];
+		}];
+		[reading setOperationCount:count];
+
+		BenchmarkCase *writing = [runner addBenchmark:[NSString stringWithFormat:@"file.writeData.%@", [self nameForSize:size]] measure:^
+		{
+			for (NSUInteger j = 0; j < count; j++)
+				if (![file writeData:data overwrite:YES]) NSLog(@"Could not write %@", file);
+		}];
+		[writing setPrepare:^
+		{
+			[directory create];
+			data = [self dataWithLength:size];
+		}];
+		[writing setOperationCount:count];
+	}
+}
+
++ (void)registerCopyingAndMovingWithRunner:(BenchmarkRunner *)runner directory:(Directory *)directory
+{
+	NSString *sizeName = [self nameForSize:FileBenchmarksLargeFileSize];
+	File *source = [directory file:@"Large"];
+	File *destination = [directory file:@"Large Destination"];
+
+	void (^prepare)(void) = ^
+	{
+		[directory create];
+		if (![source exists]) [source writeData:[self dataWithLength:FileBenchmarksLargeFileSize] overwrite:YES];
+	};
+
+	BenchmarkCase *copying = [runner addBenchmark:[NSString stringWithFormat:@"file.copyTo.%@", sizeName] measure:^
+	{
+		if (![source copyTo:destination overwrite:NO]) NSLog(@"Could not copy %@", source);
+	}];
+	[copying setPrepare:prepare];
+	[copying setTearDown:^{ [destination delete]; }];
+
+	// Moves back and forth; the move back is not timed
+	BenchmarkCase *moving = [runner addBenchmark:[NSString stringWithFormat:@"file.moveTo.%@", sizeName] measure:^
+	{
+		if (![source moveTo:destination overwrite:NO]) NSLog(@"Could not move %@", source);
+	}];
+	[moving setPrepare:prepare];
+	[moving setTearDown:^{ [destination moveTo:source overwrite:NO]; }];
+}
+
++ (void)registerArchivingWithRunner:(BenchmarkRunner *)runner directory:(Directory *)directory
+{
+	File *file = [directory file:@"Archive"];
+	__block NSDictionary *object;
+
+	void (^prepare)(void) = ^
+	{
+		NSMutableDictionary *dictionary = [NSMutableDictionary dictionaryWithCapacity:FileBenchmarksArchiveEntryCount];
+
+		for (NSUInteger i = 0; i < FileBenchmarksArchiveEntryCount; i++)
+			dictionary[[NSString stringWithFormat:@"Key %lu", (unsigned long)i]] = @[@(i), [NSString stringWithFormat:@"Value %lu", (unsigned long)i], @(i * 0.5)];
+
+		object = dictionary;
+		[directory create];
+		[file archive:object overwrite:YES];
+	};
+
+	BenchmarkCase *archiving = [runner addBenchmark:@"file.archive" measure:^
+	{
+		if (![file archive:object overwrite:YES]) NSLog(@"Could not archive to %@", file);
+	}];
+	[archiving setPrepare:prepare];
+
+	BenchmarkCase *unarchiving = [runner addBenchmark:@"file.unarchive" measure:^
+	{
+		if ([file unarchive] == nil) NSLog(@"Could not unarchive %@", file);
+	}];
+	[unarchiving setPrepare:prepare];
+}
+
+@end
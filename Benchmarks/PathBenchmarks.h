@@ -0,0 +1,19 @@
+//
+//  PathBenchmarks.h
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+//  Description: Path construction, absolute paths, hashing and distinct collections of paths.
+//
+
+#import <Foundation/Foundation.h>
+
+@class BenchmarkRunner;
+
+@interface PathBenchmarks : NSObject
+
++ (void)registerWithRunner:(BenchmarkRunner *)runner;
+
+@end
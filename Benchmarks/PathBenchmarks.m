@@ -0,0 +1,85 @@
+//
+//  PathBenchmarks.m
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+
+#import "PathBenchmarks.h"
+#import "BenchmarkRunner.h"
+#import "File.h"
+#import "NSArray+FilesAdditions.h"
+
+#define PathBenchmarksPathCount 100000
+
+@implementation PathBenchmarks
+
++ (NSArray<NSString *> *)pathStringsWithPrefix:(NSString *)prefix count:(NSUInteger)count
+{
+	NSMutableArray<NSString *> *strings = [NSMutableArray arrayWithCapacity:count];
+
+	for (NSUInteger i = 0; i < count; i++)
+		[strings addObject:[NSString stringWithFormat:@"%@Level %lu/Nested %lu/Item %lu.txt", prefix, (unsigned long)(i % 10), (unsigned long)(i % 100), (unsigned long)i]];
+
+	return strings;
+}
+
++ (NSArray<File *> *)filesWithPathStrings:(NSArray<NSString *> *)strings
+{
+	NSMutableArray<File *> *files = [NSMutableArray arrayWithCapacity:[strings count]];
+	for (NSString *string in strings) [files addObject:[File fileWithPath:string]];
+	return files;
+}
+
++ (void)registerWithRunner:(BenchmarkRunner *)runner
+{
+	__block NSArray<NSString *> *absoluteStrings;
+	__block NSArray<File *> *relativeFiles;
+	__block NSArray<File *> *absoluteFiles;
+	__block NSArray<File *> *duplicatedFiles;
+
+	// Construction
+
+	BenchmarkCase *construction = [runner addBenchmark:@"path.construction" measure:^
+	{
+		for (NSString *string in absoluteStrings) [File fileWithPath:string];
+	}];
+	[construction setPrepare:^{ absoluteStrings = [self pathStringsWithPrefix:@"/Benchmarks/" count:PathBenchmarksPathCount]; }];
+	[construction setOperationCount:PathBenchmarksPathCount];
+
+	// Absolute paths (relative paths are resolved against the current directory)
+
+	BenchmarkCase *absolutePath = [runner addBenchmark:@"path.absolutePath" measure:^
+	{
+		for (File *file in relativeFiles) [file absolutePath];
+	}];
+	[absolutePath setPrepare:^{ relativeFiles = [self filesWithPathStrings:[self pathStringsWithPrefix:@"" count:PathBenchmarksPathCount]]; }];
+	[absolutePath setOperationCount:PathBenchmarksPathCount];
+
+	// Hashing
+
+	BenchmarkCase *hash = [runner addBenchmark:@"path.hash" measure:^
+	{
+		NSUInteger combined = 0;
+		for (File *file in absoluteFiles) combined ^= [file hash];
+		if (combined == 1) NSLog(@"Unlikely hash combination");
+	}];
+	[hash setPrepare:^{ absoluteFiles = [self filesWithPathStrings:[self pathStringsWithPrefix:@"/Benchmarks/" count:PathBenchmarksPathCount]]; }];
+	[hash setOperationCount:PathBenchmarksPathCount];
+
+	// Distinct (half of the files are separate instances with the same path as another)
+
+	BenchmarkCase *distinct = [runner addBenchmark:@"array.files_distinct" measure:^
+	{
+		[duplicatedFiles files_distinct];
+	}];
+	[distinct setPrepare:^
+	{
+		NSArray<NSString *> *strings = [self pathStringsWithPrefix:@"/Benchmarks/" count:PathBenchmarksPathCount / 2];
+		duplicatedFiles = [[self filesWithPathStrings:strings] arrayByAddingObjectsFromArray:[self filesWithPathStrings:strings]];
+	}];
+	[distinct setOperationCount:PathBenchmarksPathCount];
+}
+
+@end
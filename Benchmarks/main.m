@@ -0,0 +1,95 @@
+//
+//  main.m
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+//  Description: Runs the benchmarks and writes a JSON report. Arguments (all optional):
+//
+//                 -iterations 10              Timed runs per benchmark
+//                 -warmUpIterations 1         Untimed runs per benchmark
+//                 -filter directory.          Only runs benchmarks whose name contains the string
+//                 -maximumEntryCount 1000000  Skips directory listings larger than this
+//                 -output report.json         Writes the report to a file instead of stdout
+//                 -baseline baseline.json     Compares medians with a previous report
+//                 -threshold 0.1              Relative change reported as a regression or improvement
+//
+//               Exits with status 1 when a benchmark regressed compared to the baseline.
+//
+
+#import <Foundation/Foundation.h>
+#import "BenchmarkRunner.h"
+#import "DirectoryBenchmarks.h"
+#import "FileBenchmarks.h"
+#import "PathBenchmarks.h"
+#import "Directory.h"
+#import "File.h"
+
+int main(int argc, const char *argv[])
+{
+	@autoreleasepool
+	{
+		NSUserDefaults *arguments = [NSUserDefaults standardUserDefaults];
+		NSError *error = nil;
+
+		NSDictionary *baseline = nil;
+		if ([arguments stringForKey:@"baseline"])
+		{
+			NSData *data = [[File fileWithPath:[arguments stringForKey:@"baseline"]] readData:&error];
+			baseline = (data ? [NSJSONSerialization JSONObjectWithData:data options:0 error:&error] : nil);
+
+			if (![baseline isKindOfClass:[NSDictionary class]])
+			{
+				NSLog(@"Could not read baseline: %@", error);
+				return 2;
+			}
+		}
+
+		NSString *scratchName = [NSString stringWithFormat:@"Files Benchmarks %d", [[NSProcessInfo processInfo] processIdentifier]];
+		Directory *scratchDirectory = [[[Directory directoryWithPath:NSTemporaryDirectory()] subdirectory:scratchName] create];
+
+		BenchmarkRunner *runner = [[BenchmarkRunner alloc] initWithScratchDirectory:scratchDirectory];
+		if ([arguments objectForKey:@"iterations"]) [runner setIterations:[arguments integerForKey:@"iterations"]];
+		if ([arguments objectForKey:@"warmUpIterations"]) [runner setWarmUpIterations:[arguments integerForKey:@"warmUpIterations"]];
+		[runner setFilter:[arguments stringForKey:@"filter"]];
+
+		NSUInteger maximumEntryCount = ([arguments objectForKey:@"maximumEntryCount"] ? [arguments integerForKey:@"maximumEntryCount"] : 1000000);
+
+		[PathBenchmarks registerWithRunner:runner];
+		[FileBenchmarks registerWithRunner:runner];
+		[DirectoryBenchmarks registerWithRunner:runner maximumEntryCount:maximumEntryCount];
+
+		NSArray<BenchmarkResult *> *results = [runner run];
+		[scratchDirectory delete];
+
+		double threshold = ([arguments objectForKey:@"threshold"] ? [arguments doubleForKey:@"threshold"] : 0.1);
+		NSDictionary *report = [BenchmarkRunner reportWithResults:results baseline:baseline threshold:threshold];
+
+		NSData *json = [NSJSONSerialization dataWithJSONObject:report options:NSJSONWritingPrettyPrinted error:&error];
+		if (json == nil)
+		{
+			NSLog(@"Could not serialize report: %@", error);
+			return 2;
+		}
+
+		if ([arguments stringForKey:@"output"])
+		{
+			if (![[File fileWithPath:[arguments stringForKey:@"output"]] writeData:json overwrite:YES error:&error])
+			{
+				NSLog(@"Could not write report: %@", error);
+				return 2;
+			}
+		}
+		else
+		{
+			[[NSFileHandle fileHandleWithStandardOutput] writeData:json];
+			[[NSFileHandle fileHandleWithStandardOutput] writeData:[@"\n" dataUsingEncoding:NSUTF8StringEncoding]];
+		}
+
+		NSArray<NSString *> *regressions = [BenchmarkRunner regressionsInReport:report];
+		for (NSString *name in regressions) fprintf(stderr, "Regressed: %s\n", [name UTF8String]);
+
+		return ([regressions count] > 0 ? 1 : 0);
+	}
+}
@@ -8,9 +8,25 @@
 
 #import <Foundation/Foundation.h>
 
+/**
+ The userInfo key under which errors created with +errorWithUnderlyingErrors:description: list all of their underlying errors.
+ */
+extern NSString * const FilesUnderlyingErrorsKey;
+
 @interface NSError (FilesAdditions)
 
 + (instancetype)errorWithDescription:(NSString *)format, ... NS_FORMAT_FUNCTION(1, 2);
 + (instancetype)errorWithCode:(NSInteger)code description:(NSString *)format, ... NS_FORMAT_FUNCTION(2, 3);
 
+/**
+ Returns an error in NSPOSIXErrorDomain whose description ends with the system's message for the errno value.
+ */
++ (instancetype)errorWithPOSIXCode:(int)code description:(NSString *)format, ... NS_FORMAT_FUNCTION(2, 3);
+
+/**
+ Returns an error that stands for several errors. The first one is available under NSUnderlyingErrorKey
+ and all of them under FilesUnderlyingErrorsKey.
+ */
++ (instancetype)errorWithUnderlyingErrors:(NSArray<NSError *> *)errors description:(NSString *)format, ... NS_FORMAT_FUNCTION(2, 3);
+
 @end
@@ -6,11 +6,14 @@
 //  Copyright (c) 2013 irradiated.net. All rights reserved.
 //
 
+#import <string.h>
 #import "NSError+FilesAdditions.h"
 #import "NSException+FilesAdditions.h"
 
 #define FilesErrorDomain @"FilesErrorDomain"
 
+NSString * const FilesUnderlyingErrorsKey = @"FilesUnderlyingErrors";
+
 @implementation NSError (FilesAdditions)
 
 + (instancetype)errorWithDescription:(NSString *)format, ...
@@ -33,6 +36,37 @@
 	return error;
 }
 
++ (instancetype)errorWithPOSIXCode:(int)code description:(NSString *)format, ...
+{
+	if (!format) @throw [NSException exceptionWithReason:@"Nil format string when generating error!"];
+	
+	va_list args;
+	va_start(args, format);
+	NSString *description = [[NSString alloc] initWithFormat:format arguments:args];
+	va_end(args);
+	
+	description = [NSString stringWithFormat:@"%@ (%s)", description, strerror(code)];
+	NSDictionary *userInfo = @{ NSLocalizedDescriptionKey : description };
+	return [NSError errorWithDomain:NSPOSIXErrorDomain code:code userInfo:userInfo];
+}
+
++ (instancetype)errorWithUnderlyingErrors:(NSArray<NSError *> *)errors description:(NSString *)format, ...
+{
+	if (!format) @throw [NSException exceptionWithReason:@"Nil format string when generating error!"];
+	
+	va_list args;
+	va_start(args, format);
+	NSString *description = [[NSString alloc] initWithFormat:format arguments:args];
+	va_end(args);
+	
+	NSMutableDictionary *userInfo = [NSMutableDictionary dictionary];
+	userInfo[NSLocalizedDescriptionKey] = description;
+	userInfo[FilesUnderlyingErrorsKey] = [errors copy] ?: @[];
+	if ([errors count] > 0) userInfo[NSUnderlyingErrorKey] = errors[0];
+	
+	return [NSError errorWithDomain:FilesErrorDomain code:0 userInfo:userInfo];
+}
+
 + (instancetype)errorWithCode:(NSInteger)code format:(NSString *)format arguments:(va_list)args
 {
 	if (!format) @throw [NSException exceptionWithReason:@"Nil format string when generating error!"];
@@ -0,0 +1,76 @@
+//
+//  CopyEngine.h
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+//  Description: Copies directory trees with several worker threads. Directories are created
+//               as soon as they are found and their contents are copied concurrently; the
+//               attributes of copied directories are restored once everything is in place.
+//
+
+#import <Foundation/Foundation.h>
+
+@class Directory;
+
+@interface CopyEngine : NSObject
+
+#pragma mark Lifetime
+
+/**
+ Creates an engine that copies with the specified number of worker threads (0 uses one per processor).
+ */
+- (id)initWithWorkerCount:(NSUInteger)workerCount;
+
+#pragma mark Configuration
+
+/**
+ The number of worker threads used to copy.
+ */
+@property (readonly) NSUInteger workerCount;
+
+/**
+ Whether existing items in the destination are replaced. When NO, items that already exist are reported as errors.
+ */
+@property (nonatomic) BOOL overwrite;
+
+#pragma mark Copying
+
+/**
+ Copies the contents of the source directory into the destination directory (created if needed).
+ Copying continues past failures; if any item could not be copied, the returned error lists every
+ failure under FilesUnderlyingErrorsKey. An engine performs one copy at a time.
+ */
+- (BOOL)copyContentsOfDirectory:(Directory *)source toDirectory:(Directory *)destination error:(NSError **)error;
+
+#pragma mark Statistics
+
+// These describe the last copy performed by the engine.
+
+/**
+ The number of bytes of file data copied.
+ */
+@property (readonly) unsigned long long copiedByteCount;
+
+/**
+ The number of files, symbolic links and directories copied.
+ */
+@property (readonly) unsigned long long copiedItemCount;
+
+/**
+ The time taken by the copy, in seconds.
+ */
+@property (readonly) NSTimeInterval duration;
+
+/**
+ The rate at which file data was copied, in bytes per second.
+ */
+@property (readonly) double throughput;
+
+/**
+ Errors for the items that could not be copied.
+ */
+@property (readonly) NSArray<NSError *> *errors;
+
+@end
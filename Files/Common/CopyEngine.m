@@ -0,0 +1,354 @@
+//
+//  CopyEngine.m
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+
+#import <dirent.h>
+#import <errno.h>
+#import <fcntl.h>
+#import <limits.h>
+#import <pthread.h>
+#import <sys/stat.h>
+#import <unistd.h>
+#import "CopyEngine.h"
+#import "Directory.h"
+#import "DirectoryHandle+Internal.h"
+#import "FileCopier+Internal.h"
+#import "WorkerPool.h"
+#import "Path+Internal.h"
+#import "NSError+FilesAdditions.h"
+#import "NSException+FilesAdditions.h"
+
+#if defined(__APPLE__)
+#define CopyEngineAccessTime(info) ((info).st_atimespec)
+#define CopyEngineModificationTime(info) ((info).st_mtimespec)
+#else
+#define CopyEngineAccessTime(info) ((info).st_atim)
+#define CopyEngineModificationTime(info) ((info).st_mtim)
+#endif
+
+#pragma mark - Pending Directory Attributes
+
+// Copied directories stay writable while their contents are being copied and only receive
+// the source's permissions and dates at the end (children before parents, so that creating
+// items in a directory doesn't change its modification date after it was restored).
+@interface CopyEngineDirectoryAttributes : NSObject
+
+@property (readonly) NSData *path;
+@property (readonly) NSUInteger depth;
+@property (readonly) struct stat info;
+
+@end
+
+@implementation CopyEngineDirectoryAttributes
+
+- (id)initWithPath:(NSData *)path depth:(NSUInteger)depth info:(struct stat)info
+{
+	self = [super init];
+	if (self)
+	{
+		_path = path;
+		_depth = depth;
+		_info = info;
+	}
+	return self;
+}
+
+@end
+
+#pragma mark - Copy Engine
+
+@implementation CopyEngine
+{
+	WorkerPool *_pool;
+	pthread_mutex_t _lock;
+	NSMutableArray<NSError *> *_mutableErrors;
+	NSMutableArray<CopyEngineDirectoryAttributes *> *_directoryAttributes;
+}
+
+#pragma mark Lifetime
+
+- (id)init
+{
+	return [self initWithWorkerCount:0];
+}
+
+- (id)initWithWorkerCount:(NSUInteger)workerCount
+{
+	self = [super init];
+	if (self)
+	{
+		_workerCount = (workerCount > 0 ? workerCount : [WorkerPool defaultWorkerCount]);
+		_mutableErrors = [NSMutableArray array];
+		_directoryAttributes = [NSMutableArray array];
+		pthread_mutex_init(&_lock, NULL);
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	pthread_mutex_destroy(&_lock);
+}
+
+#pragma mark Copying
+
+- (BOOL)copyContentsOfDirectory:(Directory *)source toDirectory:(Directory *)destination error:(NSError **)error
+{
+	if (source == nil || destination == nil)
+		@throw [NSException exceptionWithReason:@"Source and destination directories are required"];
+
+	[self resetStatistics];
+	NSTimeInterval start = [[NSProcessInfo processInfo] systemUptime];
+
+	NSError *openError = nil;
+	DirectoryHandle *sourceHandle = [source open:&openError];
+	DirectoryHandle *destinationHandle = (sourceHandle && [destination create] ? [destination open:&openError] : nil);
+
+	if (destinationHandle == nil)
+	{
+		[self recordError:openError ?: [NSError errorWithDescription:@"Could not create destination directory %@", [destination absolutePath]]];
+	}
+	else
+	{
+		_pool = [[WorkerPool alloc] initWithWorkerCount:_workerCount];
+		[_pool addTask:^{ [self copyDirectory:sourceHandle toDirectory:destinationHandle depth:1]; }];
+		[_pool waitUntilAllTasksAreFinished];
+		_pool = nil;
+
+		[self restoreDirectoryAttributes];
+	}
+
+	_duration = [[NSProcessInfo processInfo] systemUptime] - start;
+
+	if ([_mutableErrors count] > 0)
+	{
+		if (error) *error = [NSError errorWithUnderlyingErrors:_mutableErrors description:@"Could not copy %lu item(s) from %@ to %@", (unsigned long)[_mutableErrors count], [source absolutePath], [destination absolutePath]];
+		return NO;
+	}
+
+	return YES;
+}
+
+#pragma mark Statistics
+
+- (double)throughput
+{
+	return (_duration > 0 ? _copiedByteCount / _duration : 0);
+}
+
+- (NSArray<NSError *> *)errors
+{
+	return [_mutableErrors copy];
+}
+
+#pragma mark Private (Workers)
+
+// Runs on a worker thread. Every item is addressed relative to the open source and destination
+// directories, so the kernel never resolves full paths and paths are only built to report errors.
+// Subdirectories are created before being handed to the pool, so a directory always exists by the
+// time anything is copied into it; they are only opened by the task that copies them so that
+// subdirectories waiting in the queue don't hold descriptors.
+- (void)copyDirectory:(DirectoryHandle *)source toDirectory:(DirectoryHandle *)destination depth:(NSUInteger)depth
+{
+	int sourceDescriptor = [source fileDescriptor];
+	int destinationDescriptor = [destination fileDescriptor];
+
+	// The stream gets its own descriptor so that closing it leaves the handle open for queued file copies
+	int streamDescriptor = openat(sourceDescriptor, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	DIR *stream = (streamDescriptor >= 0 ? fdopendir(streamDescriptor) : NULL);
+
+	if (stream == NULL)
+	{
+		int code = errno;
+		if (streamDescriptor >= 0) close(streamDescriptor);
+		[self recordErrorWithCode:code description:@"Could not read contents of directory at path %@", [source path]];
+		return;
+	}
+
+	unsigned long long itemCount = 0;
+	struct dirent *entry;
+
+	while (YES)
+	{
+		errno = 0;
+		if ((entry = readdir(stream)) == NULL)
+		{
+			int code = errno;
+			if (code != 0) [self recordErrorWithCode:code description:@"Could not read contents of directory at path %@", [source path]];
+			break;
+		}
+
+		const char *name = entry->d_name;
+		if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+
+		struct stat info;
+		if (fstatat(sourceDescriptor, name, &info, AT_SYMLINK_NOFOLLOW) != 0)
+		{
+			[self recordCopyErrorWithCode:errno name:name source:source destination:destination];
+			continue;
+		}
+
+		if (S_ISDIR(info.st_mode))
+		{
+			if (![self createDirectoryNamed:name inDirectoryDescriptor:destinationDescriptor])
+			{
+				[self recordCopyErrorWithCode:errno name:name source:source destination:destination];
+				continue;
+			}
+
+			itemCount++;
+			NSData *nameRepresentation = [NSData dataWithBytes:name length:strlen(name) + 1];
+			[self addAttributes:[[CopyEngineDirectoryAttributes alloc] initWithPath:PathRepresentationByAppendingName([destination pathRepresentation], name) depth:depth info:info]];
+			[_pool addTask:^{ [self copyDirectoryNamed:nameRepresentation inDirectory:source toDirectory:destination depth:depth + 1]; }];
+		}
+		else if (S_ISREG(info.st_mode))
+		{
+			NSData *nameRepresentation = [NSData dataWithBytes:name length:strlen(name) + 1];
+			[_pool addTask:^{ [self copyFileNamed:nameRepresentation inDirectory:source toDirectory:destination]; }];
+		}
+		else if (S_ISLNK(info.st_mode))
+		{
+			if ([self copySymbolicLinkNamed:name inDirectoryDescriptor:sourceDescriptor toDirectoryDescriptor:destinationDescriptor info:&info])
+				itemCount++;
+			else
+				[self recordCopyErrorWithCode:errno name:name source:source destination:destination];
+		}
+		else
+		{
+			[self recordCopyErrorWithCode:ENOTSUP name:name source:source destination:destination];
+		}
+	}
+
+	closedir(stream);
+
+	pthread_mutex_lock(&_lock);
+	_copiedItemCount += itemCount;
+	pthread_mutex_unlock(&_lock);
+}
+
+- (void)copyDirectoryNamed:(NSData *)nameRepresentation inDirectory:(DirectoryHandle *)source toDirectory:(DirectoryHandle *)destination depth:(NSUInteger)depth
+{
+	const char *name = [nameRepresentation bytes];
+
+	DirectoryHandle *sourceDirectory = [source openSubdirectoryWithName:name];
+	DirectoryHandle *destinationDirectory = (sourceDirectory ? [destination openSubdirectoryWithName:name] : nil);
+
+	if (destinationDirectory == nil)
+	{
+		[self recordCopyErrorWithCode:errno name:name source:source destination:destination];
+		return;
+	}
+
+	[self copyDirectory:sourceDirectory toDirectory:destinationDirectory depth:depth];
+}
+
+- (void)copyFileNamed:(NSData *)nameRepresentation inDirectory:(DirectoryHandle *)source toDirectory:(DirectoryHandle *)destination
+{
+	const char *name = [nameRepresentation bytes];
+	unsigned long long byteCount = 0;
+	FileCopyMethod method = FileCopierCopyItemAt([source fileDescriptor], name, [destination fileDescriptor], name, _overwrite, FileCopyMethodClone, &byteCount);
+
+	if (method == FileCopyMethodNone)
+	{
+		[self recordCopyErrorWithCode:errno name:name source:source destination:destination];
+		return;
+	}
+
+	pthread_mutex_lock(&_lock);
+	_copiedByteCount += byteCount;
+	_copiedItemCount++;
+	pthread_mutex_unlock(&_lock);
+}
+
+- (BOOL)copySymbolicLinkNamed:(const char *)name inDirectoryDescriptor:(int)sourceDescriptor toDirectoryDescriptor:(int)destinationDescriptor info:(const struct stat *)info
+{
+	char target[PATH_MAX + 1];
+	ssize_t length = readlinkat(sourceDescriptor, name, target, PATH_MAX);
+	if (length < 0) return NO;
+	target[length] = '\0';
+
+	BOOL created = (symlinkat(target, destinationDescriptor, name) == 0);
+	if (!created && errno == EEXIST && _overwrite && PathRemoveItemAt(destinationDescriptor, name))
+		created = (symlinkat(target, destinationDescriptor, name) == 0);
+
+	if (!created) return NO;
+
+	struct timespec times[2] = { CopyEngineAccessTime(*info), CopyEngineModificationTime(*info) };
+	utimensat(destinationDescriptor, name, times, AT_SYMLINK_NOFOLLOW);
+
+	return YES;
+}
+
+- (BOOL)createDirectoryNamed:(const char *)name inDirectoryDescriptor:(int)descriptor
+{
+	if (mkdirat(descriptor, name, S_IRWXU) == 0) return YES;
+	if (errno != EEXIST || !_overwrite || !PathRemoveItemAt(descriptor, name)) return NO;
+
+	return (mkdirat(descriptor, name, S_IRWXU) == 0);
+}
+
+#pragma mark Private (Bookkeeping)
+
+- (void)resetStatistics
+{
+	[_mutableErrors removeAllObjects];
+	[_directoryAttributes removeAllObjects];
+	_copiedByteCount = 0;
+	_copiedItemCount = 0;
+	_duration = 0;
+}
+
+- (void)addAttributes:(CopyEngineDirectoryAttributes *)attributes
+{
+	pthread_mutex_lock(&_lock);
+	[_directoryAttributes addObject:attributes];
+	pthread_mutex_unlock(&_lock);
+}
+
+- (void)restoreDirectoryAttributes
+{
+	NSSortDescriptor *deepestFirst = [NSSortDescriptor sortDescriptorWithKey:@"depth" ascending:NO];
+
+	for (CopyEngineDirectoryAttributes *attributes in [_directoryAttributes sortedArrayUsingDescriptors:@[deepestFirst]])
+	{
+		struct stat info = [attributes info];
+		struct timespec times[2] = { CopyEngineAccessTime(info), CopyEngineModificationTime(info) };
+		const char *path = [[attributes path] bytes];
+
+		if (chmod(path, info.st_mode & 07777) != 0 || utimensat(AT_FDCWD, path, times, 0) != 0)
+			[self recordErrorWithCode:errno description:@"Could not restore attributes of directory %@", PathStringWithRepresentation(path)];
+	}
+
+	[_directoryAttributes removeAllObjects];
+}
+
+- (void)recordCopyErrorWithCode:(int)code name:(const char *)name source:(DirectoryHandle *)source destination:(DirectoryHandle *)destination
+{
+	NSData *sourcePath = PathRepresentationByAppendingName([source pathRepresentation], name);
+	NSData *destinationPath = PathRepresentationByAppendingName([destination pathRepresentation], name);
+
+	[self recordErrorWithCode:code description:@"Could not copy item at path %@ to %@", PathStringWithRepresentation([sourcePath bytes]), PathStringWithRepresentation([destinationPath bytes])];
+}
+
+- (void)recordErrorWithCode:(int)code description:(NSString *)format, ...
+{
+	va_list args;
+	va_start(args, format);
+	NSString *description = [[NSString alloc] initWithFormat:format arguments:args];
+	va_end(args);
+
+	[self recordError:[NSError errorWithPOSIXCode:code description:@"%@", description]];
+}
+
+- (void)recordError:(NSError *)error
+{
+	pthread_mutex_lock(&_lock);
+	[_mutableErrors addObject:error];
+	pthread_mutex_unlock(&_lock);
+}
+
+@end
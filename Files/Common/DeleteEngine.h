@@ -0,0 +1,81 @@
+//
+//  DeleteEngine.h
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+//  Description: Removes directory trees with several worker threads. Items are unlinked relative
+//               to their open parent directory without being stat'ed first, subdirectories are
+//               emptied concurrently and each one is removed as soon as its last child is gone.
+//
+
+#import <Foundation/Foundation.h>
+
+@class Directory;
+@class Path;
+
+@interface DeleteEngine : NSObject
+
+#pragma mark Lifetime
+
+/**
+ Creates an engine that deletes with the specified number of worker threads (0 uses one per processor).
+ Worker threads are only started when a tree has subdirectories.
+ */
+- (id)initWithWorkerCount:(NSUInteger)workerCount;
+
+#pragma mark Configuration
+
+/**
+ The number of worker threads used to delete.
+ */
+@property (readonly) NSUInteger workerCount;
+
+#pragma mark Deleting
+
+/**
+ Removes the item, with its contents if it is a directory. An item that does not exist counts as deleted.
+ Deletion continues past failures; if any item could not be removed, the returned error lists every failure
+ under FilesUnderlyingErrorsKey. An engine performs one deletion at a time.
+ */
+- (BOOL)deleteItem:(Path *)item error:(NSError **)error;
+
+/**
+ Removes everything inside the directory, leaving it empty.
+ */
+- (BOOL)deleteContentsOfDirectory:(Directory *)directory error:(NSError **)error;
+
+/**
+ Renames the item aside (to a hidden name in the same directory) and returns immediately, then removes it
+ on a background thread. The item's path is free to be reused as soon as this returns. The completion
+ (which can be nil) is called on the background thread with nil or the error describing the failures.
+ Background deletions run to completion even if the engine is released.
+ */
+- (BOOL)deleteItemInBackground:(Path *)item completion:(void (^)(NSError *error))completion error:(NSError **)error;
+
+/**
+ Blocks until every deletion started with -deleteItemInBackground:completion:error: has finished.
+ */
+- (void)waitUntilBackgroundDeletionsAreFinished;
+
+#pragma mark Statistics
+
+// These describe the last deletion performed by the engine (background deletions not included).
+
+/**
+ The number of files, symbolic links and directories removed.
+ */
+@property (readonly) unsigned long long deletedItemCount;
+
+/**
+ The time taken by the deletion, in seconds.
+ */
+@property (readonly) NSTimeInterval duration;
+
+/**
+ Errors for the items that could not be removed.
+ */
+@property (readonly) NSArray<NSError *> *errors;
+
+@end
@@ -0,0 +1,422 @@
+//
+//  DeleteEngine.m
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+
+#import <dirent.h>
+#import <errno.h>
+#import <fcntl.h>
+#import <pthread.h>
+#import <string.h>
+#import <unistd.h>
+#import "DeleteEngine.h"
+#import "Directory.h"
+#import "DirectoryHandle+Internal.h"
+#import "WorkerPool.h"
+#import "Path+Internal.h"
+#import "NSError+FilesAdditions.h"
+#import "NSException+FilesAdditions.h"
+
+#pragma mark - Directories Being Removed
+
+// A directory can only be removed once everything inside it is gone, including the contents of
+// subdirectories emptied by other workers. Each directory counts its own scan plus its unfinished
+// subdirectories; whoever brings the count to zero removes it and then signals its parent.
+@interface DeleteEngineDirectory : NSObject
+{
+	@public
+	DeleteEngineDirectory *_parent;
+	NSData *_name; // Relative to the parent (or the full path for the top directory); nil when the directory is only emptied
+	DirectoryHandle *_handle;
+	int32_t _pendingCount;
+	BOOL _failed;
+}
+
+@end
+
+@implementation DeleteEngineDirectory
+
+- (id)initWithParent:(DeleteEngineDirectory *)parent name:(NSData *)name
+{
+	self = [super init];
+	if (self)
+	{
+		_parent = parent;
+		_name = name;
+		_pendingCount = 1;
+	}
+	return self;
+}
+
+- (int)parentDescriptor
+{
+	return (_parent ? [_parent->_handle fileDescriptor] : AT_FDCWD);
+}
+
+- (NSData *)pathRepresentation
+{
+	return (_parent ? PathRepresentationByAppendingName([_parent->_handle pathRepresentation], [_name bytes]) : _name);
+}
+
+@end
+
+#pragma mark - Delete Engine
+
+@implementation DeleteEngine
+{
+	WorkerPool *_pool;
+	WorkerPool *_backgroundPool;
+	pthread_mutex_t _lock;
+	NSMutableArray<NSError *> *_mutableErrors;
+}
+
+#pragma mark Lifetime
+
+- (id)init
+{
+	return [self initWithWorkerCount:0];
+}
+
+- (id)initWithWorkerCount:(NSUInteger)workerCount
+{
+	self = [super init];
+	if (self)
+	{
+		_workerCount = (workerCount > 0 ? workerCount : [WorkerPool defaultWorkerCount]);
+		_mutableErrors = [NSMutableArray array];
+		pthread_mutex_init(&_lock, NULL);
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	pthread_mutex_destroy(&_lock);
+}
+
+#pragma mark Deleting
+
+- (BOOL)deleteItem:(Path *)item error:(NSError **)error
+{
+	if (item == nil) @throw [NSException exceptionWithReason:@"Item is nil"];
+
+	return [self deleteItemAtPath:[item absolutePath] describedAsPath:[item absolutePath] error:error];
+}
+
+- (BOOL)deleteContentsOfDirectory:(Directory *)directory error:(NSError **)error
+{
+	if (directory == nil) @throw [NSException exceptionWithReason:@"Directory is nil"];
+
+	[self resetStatistics];
+	NSTimeInterval start = [[NSProcessInfo processInfo] systemUptime];
+
+	NSError *openError = nil;
+	DirectoryHandle *handle = [directory open:&openError];
+
+	if (handle == nil)
+	{
+		[self recordError:openError];
+	}
+	else
+	{
+		DeleteEngineDirectory *root = [[DeleteEngineDirectory alloc] initWithParent:nil name:nil];
+		root->_handle = handle;
+		[self removeTreeFromDirectory:root];
+	}
+
+	_duration = [[NSProcessInfo processInfo] systemUptime] - start;
+	return [self succeededForPath:[directory absolutePath] error:error];
+}
+
+- (BOOL)deleteItemInBackground:(Path *)item completion:(void (^)(NSError *error))completion error:(NSError **)error
+{
+	if (item == nil) @throw [NSException exceptionWithReason:@"Item is nil"];
+
+	NSString *path = [item absolutePath];
+	NSString *asidePath = nil;
+	BOOL renamed = NO;
+
+	static volatile uint32_t counter = 0;
+
+	// The hidden name is in the same directory, so renaming never crosses file systems
+	for (int attempt = 0; !renamed && attempt < 100; attempt++)
+	{
+		NSString *asideName = [NSString stringWithFormat:@".%@.%ld.%u.deleting", [path lastPathComponent], (long)getpid(), __sync_fetch_and_add(&counter, 1)];
+		asidePath = [[path stringByDeletingLastPathComponent] stringByAppendingPathComponent:asideName];
+		renamed = PathRenameItem([path fileSystemRepresentation], [asidePath fileSystemRepresentation], NO);
+		if (!renamed && errno != EEXIST) break;
+	}
+
+	if (!renamed && errno != ENOENT)
+	{
+		int code = errno;
+		if (error) *error = [NSError errorWithPOSIXCode:code description:@"Could not move item at path %@ aside to delete it", path];
+		return NO;
+	}
+
+	NSUInteger workerCount = _workerCount;
+
+	[[self backgroundPool] addTask:^
+	{
+		NSError *deletionError = nil;
+		if (renamed) [[[DeleteEngine alloc] initWithWorkerCount:workerCount] deleteItemAtPath:asidePath describedAsPath:path error:&deletionError];
+		if (completion) completion(deletionError);
+	}];
+
+	return YES;
+}
+
+- (void)waitUntilBackgroundDeletionsAreFinished
+{
+	pthread_mutex_lock(&_lock);
+	WorkerPool *pool = _backgroundPool;
+	pthread_mutex_unlock(&_lock);
+
+	[pool waitUntilAllTasksAreFinished];
+}
+
+#pragma mark Statistics
+
+- (NSArray<NSError *> *)errors
+{
+	return [_mutableErrors copy];
+}
+
+#pragma mark Private (Deleting)
+
+- (BOOL)deleteItemAtPath:(NSString *)path describedAsPath:(NSString *)describedPath error:(NSError **)error
+{
+	[self resetStatistics];
+	NSTimeInterval start = [[NSProcessInfo processInfo] systemUptime];
+
+	NSData *representation = PathRepresentationWithString(path);
+	[self removeItemAtRepresentation:representation];
+
+	_duration = [[NSProcessInfo processInfo] systemUptime] - start;
+	return [self succeededForPath:describedPath error:error];
+}
+
+// There is no existence check: the unlink itself reports whether the item was there
+- (void)removeItemAtRepresentation:(NSData *)representation
+{
+	const char *path = [representation bytes];
+
+	if (unlink(path) == 0) { _deletedItemCount++; return; }
+	if (errno == ENOENT) return;
+
+	// unlink() fails with EISDIR on Linux and EPERM on Apple platforms for directories
+	int code = errno;
+	if (code != EISDIR && code != EPERM) { [self recordErrorWithCode:code path:path]; return; }
+
+	int descriptor = open(path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+
+	if (descriptor < 0)
+	{
+		// Not a directory after all: the original error was a genuine permission error
+		if (errno != ENOTDIR && errno != ELOOP) code = errno;
+		[self recordErrorWithCode:code path:path];
+		return;
+	}
+
+	DeleteEngineDirectory *root = [[DeleteEngineDirectory alloc] initWithParent:nil name:representation];
+	root->_handle = [[DirectoryHandle alloc] initWithDescriptor:descriptor pathRepresentation:representation];
+	[self removeTreeFromDirectory:root];
+}
+
+// The top directory is read on the calling thread; workers are only started if it has subdirectories
+- (void)removeTreeFromDirectory:(DeleteEngineDirectory *)root
+{
+	[self emptyDirectory:root];
+
+	[_pool waitUntilAllTasksAreFinished];
+	_pool = nil;
+}
+
+- (void)addTask:(void (^)(void))task
+{
+	// Only the calling thread gets here before the pool exists, while it reads the top directory
+	if (_pool == nil) _pool = [[WorkerPool alloc] initWithWorkerCount:_workerCount];
+	[_pool addTask:task];
+}
+
+- (WorkerPool *)backgroundPool
+{
+	pthread_mutex_lock(&_lock);
+	if (_backgroundPool == nil) _backgroundPool = [[WorkerPool alloc] initWithWorkerCount:1];
+	WorkerPool *pool = _backgroundPool;
+	pthread_mutex_unlock(&_lock);
+
+	return pool;
+}
+
+#pragma mark Private (Workers)
+
+// Files and links are unlinked right away. The entry type saves a stat for every item: only entries
+// that are directories (or of unknown type and refused by unlink) are handed to the pool.
+- (void)emptyDirectory:(DeleteEngineDirectory *)directory
+{
+	int descriptor = [directory->_handle fileDescriptor];
+
+	// The stream gets its own descriptor so that closing it leaves the handle open for subdirectories
+	int streamDescriptor = openat(descriptor, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	DIR *stream = (streamDescriptor >= 0 ? fdopendir(streamDescriptor) : NULL);
+
+	if (stream == NULL)
+	{
+		int code = errno;
+		if (streamDescriptor >= 0) close(streamDescriptor);
+		[self recordErrorWithCode:code path:[[directory->_handle pathRepresentation] bytes]];
+		directory->_failed = YES;
+		[self finishDirectory:directory];
+		return;
+	}
+
+	unsigned long long deletedCount = 0;
+	struct dirent *entry;
+
+	while (YES)
+	{
+		errno = 0;
+		if ((entry = readdir(stream)) == NULL) break;
+
+		const char *name = entry->d_name;
+		if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+
+		if (entry->d_type != DT_DIR)
+		{
+			if (unlinkat(descriptor, name, 0) == 0) { deletedCount++; continue; }
+			if (errno == ENOENT) continue;
+
+			if (entry->d_type != DT_UNKNOWN || (errno != EISDIR && errno != EPERM))
+			{
+				[self recordErrorWithCode:errno path:[PathRepresentationByAppendingName([directory->_handle pathRepresentation], name) bytes]];
+				directory->_failed = YES;
+				continue;
+			}
+		}
+
+		DeleteEngineDirectory *subdirectory = [[DeleteEngineDirectory alloc] initWithParent:directory name:[NSData dataWithBytes:name length:strlen(name) + 1]];
+		__sync_add_and_fetch(&directory->_pendingCount, 1);
+		[self addTask:^{ [self openAndEmptyDirectory:subdirectory]; }];
+	}
+
+	if (errno != 0)
+	{
+		[self recordErrorWithCode:errno path:[[directory->_handle pathRepresentation] bytes]];
+		directory->_failed = YES;
+	}
+
+	closedir(stream);
+
+	[self addDeletedItemCount:deletedCount];
+	[self finishDirectory:directory];
+}
+
+- (void)openAndEmptyDirectory:(DeleteEngineDirectory *)directory
+{
+	directory->_handle = [directory->_parent->_handle openSubdirectoryWithName:[directory->_name bytes]];
+
+	if (directory->_handle == nil)
+	{
+		int code = errno;
+
+		// Out of descriptors: remove the subtree serially, which keeps one descriptor open per level
+		if ((code == EMFILE || code == ENFILE) && PathRemoveItemAt([directory parentDescriptor], [directory->_name bytes]))
+		{
+			[self addDeletedItemCount:1];
+		}
+		else if (code != ENOENT)
+		{
+			[self recordErrorWithCode:code path:[[directory pathRepresentation] bytes]];
+			directory->_failed = YES;
+		}
+
+		// Either way, there is nothing left for this directory to remove
+		directory->_name = nil;
+		[self finishDirectory:directory];
+		return;
+	}
+
+	[self emptyDirectory:directory];
+}
+
+// Called once the directory's own scan or one of its subdirectories is done
+- (void)finishDirectory:(DeleteEngineDirectory *)directory
+{
+	while (directory && __sync_sub_and_fetch(&directory->_pendingCount, 1) == 0)
+	{
+		DeleteEngineDirectory *parent = directory->_parent;
+
+		[directory->_handle close];
+
+		// A failure anywhere below means the directory can't be empty, which isn't worth another error
+		if (!directory->_failed && directory->_name && ![self removeEmptiedDirectory:directory])
+			directory->_failed = YES;
+
+		if (directory->_failed && parent) parent->_failed = YES;
+		directory = parent;
+	}
+}
+
+- (BOOL)removeEmptiedDirectory:(DeleteEngineDirectory *)directory
+{
+	int parentDescriptor = [directory parentDescriptor];
+	const char *name = [directory->_name bytes];
+
+	if (unlinkat(parentDescriptor, name, AT_REMOVEDIR) == 0) { [self addDeletedItemCount:1]; return YES; }
+	if (errno == ENOENT) return YES;
+
+	// Items were added while the directory was emptied, or skipped because it changed while being read
+	if ((errno == ENOTEMPTY || errno == EEXIST) && PathRemoveItemAt(parentDescriptor, name))
+	{
+		[self addDeletedItemCount:1];
+		return YES;
+	}
+
+	[self recordErrorWithCode:errno path:[[directory pathRepresentation] bytes]];
+	return NO;
+}
+
+#pragma mark Private (Bookkeeping)
+
+- (void)resetStatistics
+{
+	[_mutableErrors removeAllObjects];
+	_deletedItemCount = 0;
+	_duration = 0;
+}
+
+- (void)addDeletedItemCount:(unsigned long long)count
+{
+	pthread_mutex_lock(&_lock);
+	_deletedItemCount += count;
+	pthread_mutex_unlock(&_lock);
+}
+
+- (BOOL)succeededForPath:(NSString *)path error:(NSError **)error
+{
+	if ([_mutableErrors count] > 0)
+	{
+		if (error) *error = [NSError errorWithUnderlyingErrors:_mutableErrors description:@"Could not delete %lu item(s) at path %@", (unsigned long)[_mutableErrors count], path];
+		return NO;
+	}
+
+	return YES;
+}
+
+- (void)recordErrorWithCode:(int)code path:(const char *)path
+{
+	[self recordError:[NSError errorWithPOSIXCode:code description:@"Could not delete item at path %@", PathStringWithRepresentation(path)]];
+}
+
+- (void)recordError:(NSError *)error
+{
+	pthread_mutex_lock(&_lock);
+	[_mutableErrors addObject:error];
+	pthread_mutex_unlock(&_lock);
+}
+
+@end
@@ -8,6 +8,15 @@
 
 #import <Foundation/Foundation.h>
 #import "Path.h"
+#import "DirectoryEnumerator.h"
+#import "PathMatcher.h"
+#import "DiskUsage.h"
+#import "CopyEngine.h"
+#import "DeleteEngine.h"
+#import "DirectoryHandle.h"
+#import "DirectorySnapshot.h"
+#import "DuplicateFinder.h"
+#import "FileHasher.h"
 
 @interface Directory : Path
 
@@ -34,38 +43,163 @@
 - (NSArray<File *> *)files;
 
 /**
- Returns only files with the specified extension.
+ Returns only files with the specified extension. Names are tested as they are read, so only matching files are created.
  */
 - (NSArray<File *> *)filesWithExtension:(NSString *)extension;
 
+/**
+ Returns the files matching the glob pattern (see PathMatcher). Patterns containing "/" are matched against
+ paths relative to the directory and search subdirectories; other patterns match the names of the directory's
+ own files.
+ */
+- (NSArray<File *> *)filesMatching:(NSString *)pattern;
+
 /**
  Returns an array of Directory objects, one for each directory in the directory.
  */
 - (NSArray<Directory *> *)subdirectories;
 
+#pragma mark Item Information
+
+/**
+ Returns information about every item in the directory, keyed by item name. Each item is stat'ed relative
+ to the open directory (no path lookups) and no File or Directory instances are created.
+ */
+- (NSDictionary<NSString *, FileInfo *> *)itemInfos;
+
+/**
+ Calls the block with the name and information of each item in the directory as it is read from disk.
+ Items that disappear while being enumerated are skipped.
+ */
+- (BOOL)enumerateItemInfosUsingBlock:(void (^)(NSString *name, FileInfo *info, BOOL *stop))block error:(NSError **)error;
+
+#pragma mark Opening
+
+/**
+ Opens the directory so that its children can be read, created, removed and renamed relative to its
+ descriptor instead of by path. Prefer this when performing many operations in the same directory.
+ */
+- (DirectoryHandle *)open:(NSError **)error;
+
+#pragma mark Disk Usage
+
+/**
+ Returns the total size and item counts of the directory's contents, walking subdirectories in parallel.
+ Check the result's errors to know whether every item could be read.
+ */
+- (DiskUsage *)diskUsage;
+
+/**
+ Returns the total size and item counts of the directory's contents using the specified number of
+ worker threads (0 uses one per processor).
+ */
+- (DiskUsage *)diskUsageWithOptions:(DiskUsageOptions)options workerCount:(NSUInteger)workerCount;
+
+#pragma mark Snapshots
+
+/**
+ Records the path, inode, size and modification time of every item in the directory tree, to be saved
+ and later compared with another snapshot of the same directory.
+ */
+- (DirectorySnapshot *)snapshot:(NSError **)error;
+
+#pragma mark Hashing
+
+/**
+ Hashes every file in the directory tree (symbolic links are not followed), reading at most concurrentReads
+ files at once (0 uses one per processor). Returns the digests keyed by path relative to the directory.
+ Returns nil if the directory can't be read; files that could not be hashed are described in errors.
+ */
+- (NSDictionary<NSString *, NSData *> *)digestsOfFilesWithAlgorithm:(FileHashAlgorithm)algorithm concurrentReads:(NSUInteger)concurrentReads errors:(NSArray<NSError *> **)errors;
+
+/**
+ Returns the groups of files with identical contents in the directory tree, reading as little as possible:
+ only files of the same size are read, and only files whose first and last bytes match are read whole.
+ Use a DuplicateFinder to know which files could not be read.
+ */
+- (NSArray<NSArray<File *> *> *)duplicateFiles:(NSError **)error;
+
+#pragma mark Enumeration
+
+/**
+ Returns an enumerator that lazily returns File and Directory instances for the items in the directory.
+ */
+- (DirectoryEnumerator *)enumerator;
+
+/**
+ Returns an enumerator that lazily returns items of the specified kind ([File class], [Directory class] or nil for both).
+ */
+- (DirectoryEnumerator *)enumeratorForItemsOfKind:(Class)kind options:(DirectoryEnumerationOptions)options;
+
+/**
+ Returns an enumerator that lazily returns the items of the specified kind that the matcher matches.
+ */
+- (DirectoryEnumerator *)enumeratorForItemsMatching:(PathMatcher *)matcher kind:(Class)kind options:(DirectoryEnumerationOptions)options;
+
+/**
+ Calls the block with each item of the specified kind as it is read from disk.
+ Setting skipDescendants to YES prevents a recursive enumeration from descending into the item.
+ Returns NO if the directory (or, when recursing, one of its subdirectories) could not be read.
+ */
+- (BOOL)enumerateItemsOfKind:(Class)kind options:(DirectoryEnumerationOptions)options usingBlock:(void (^)(Path *item, BOOL *skipDescendants, BOOL *stop))block error:(NSError **)error;
+
 #pragma mark Creating Other Directories
 
 - (Directory *)subdirectory:(NSString *)name;
 
+/**
+ Returns one Directory per name. Only the names are validated: the directory's own path is shared by all of them.
+ */
+- (NSArray<Directory *> *)subdirectoriesNamed:(NSArray<NSString *> *)names;
+
 - (Directory *)subdirectoryWithFormat:(NSString *)format, ... NS_FORMAT_FUNCTION(1,2);
 
 - (Directory *)subdirectoryWithNumericSuffixIfExists:(NSString *)name;
 
+/**
+ Creates a subdirectory with the name, adding a numeric suffix if the name is taken. The name is claimed
+ atomically, so concurrent threads and processes always get different subdirectories.
+ */
+- (Directory *)createSubdirectoryWithNumericSuffixIfExists:(NSString *)name error:(NSError **)error;
+
 
 #pragma mark Creating Files
 
 - (File *)file:(NSString *)name;
 
+/**
+ Returns one File per name. Only the names are validated: the directory's own path is shared by all of them.
+ */
+- (NSArray<File *> *)filesNamed:(NSArray<NSString *> *)names;
+
 - (File *)fileWithFormat:(NSString *)format, ... NS_FORMAT_FUNCTION(1,2);
 
 - (File *)fileWithName:(NSString *)name extension:(NSString *)extension;
 
 - (File *)fileWithNumberSuffixIfExists:(NSString *)name;
 
+/**
+ Creates an empty file with the name, adding a numeric suffix if the name is taken. The name is claimed
+ atomically, so concurrent threads and processes always get different files.
+ */
+- (File *)createFileWithNumericSuffixIfExists:(NSString *)name error:(NSError **)error;
+
 #pragma mark Operations
 
 - (BOOL)deleteContents;
 
+/**
+ Removes everything inside the directory with a DeleteEngine (one worker per processor), continuing past
+ items that cannot be removed; the returned error then lists all of them under FilesUnderlyingErrorsKey.
+ */
+- (BOOL)deleteContents:(NSError **)error;
+
+/**
+ Renames the directory aside and removes it on a background thread, so that this returns immediately
+ however large the tree is. The completion (which can be nil) is called on that thread.
+ */
+- (BOOL)deleteInBackgroundWithCompletion:(void (^)(NSError *error))completion error:(NSError **)error;
+
 /**
  Creates the directory if it does not exist.
  */
@@ -81,6 +215,13 @@
  */
 - (Directory *)copyContentsTo:(Directory *)destination overwrite:(BOOL)overwrite;
 
+/**
+ Copies the contents of the directory in another directory using a CopyEngine with one worker per processor.
+ Copying continues past items that cannot be copied; the returned error then lists all of them under FilesUnderlyingErrorsKey.
+ Use a CopyEngine directly to choose the number of workers or to obtain throughput statistics.
+ */
+- (Directory *)copyContentsTo:(Directory *)destination overwrite:(BOOL)overwrite error:(NSError **)error;
+
 /**
  Copies the directory into another directory.
  */
@@ -105,6 +246,7 @@
 
 /**
  Moves the directory in another directory, optionally overwriting any existing directory.
+ Within a volume this is a single rename; the data is only copied (then deleted) when moving to another volume.
  */
 - (Directory *)moveTo:(Directory *)destination overwrite:(BOOL)overwrite error:(NSError **)error;
 
@@ -6,8 +6,13 @@
 //  Copyright (c) 2013 irradiated.net. All rights reserved.
 //
 
+#import <dirent.h>
+#import <errno.h>
 #import "Directory.h"
 #import "File.h"
+#import "FileInfo.h"
+#import "Path+Internal.h"
+#import "UniqueNameAllocator.h"
 #import "NSError+FilesAdditions.h"
 #import "NSException+FilesAdditions.h"
 
@@ -43,8 +48,8 @@
 
 - (BOOL)isEmpty
 {
-	if (![self isDirectory]) return NO;
-	return [[self items] count] == 0;
+	DirectoryEnumerator *enumerator = [self enumerator];
+	return [enumerator nextObject] == nil && [enumerator error] == nil;
 }
 
 - (NSArray<Path *> *)items
@@ -59,15 +64,23 @@
 
 - (NSArray<File *> *)filesWithExtension:(NSString *)extension
 {
-	NSMutableArray *filesWithExtension = [NSMutableArray array];
+	// Files without an extension have a nil extension, which was never equal to anything
+	if ([extension length] == 0) return @[];
 	
-	for (File *file in [self files])
-	{
-		if ([[file extension] isEqualToString:extension])
-			[filesWithExtension addObject:file];
-	}
+	// Like -pathExtension, hidden files have extensions too, but a name that is only a period and the extension doesn't
+	NSString *pattern = [@"?*." stringByAppendingString:[PathMatcher escapedPattern:extension]];
+	PathMatcher *matcher = [[PathMatcher alloc] initWithPattern:pattern options:PathMatcherMatchHidden];
+	DirectoryEnumerator *enumerator = [self enumeratorForItemsMatching:matcher kind:[File class] options:DirectoryEnumerationOptionsNone];
+	
+	return [enumerator allObjects];
+}
+
+- (NSArray<File *> *)filesMatching:(NSString *)pattern
+{
+	PathMatcher *matcher = [PathMatcher matcherWithPattern:pattern];
+	DirectoryEnumerationOptions options = ([matcher matchesRelativePaths] ? DirectoryEnumerationRecursive : DirectoryEnumerationOptionsNone);
 	
-	return [filesWithExtension copy];
+	return [self itemsMatching:matcher kind:[File class] options:options];
 }
 
 - (NSArray<Directory *> *)subdirectories
@@ -77,10 +90,31 @@
 
 - (NSArray *)itemsOfKind:(Class)kind
 {
-	NSFileManager *manager = [NSFileManager defaultManager];
+	return [self itemsMatching:nil kind:kind options:DirectoryEnumerationOptionsNone];
+}
+
+- (NSArray *)itemsMatching:(PathMatcher *)matcher kind:(Class)kind options:(DirectoryEnumerationOptions)options
+{
+	DirectoryEnumerator *enumerator = [self enumeratorForItemsMatching:matcher kind:kind options:options];
+	NSArray *items = [enumerator allObjects];
+	
+	if ([enumerator error])
+	{
+		NSLog(@"Error reading contents of directory at path: %@ %@", [self absolutePath], [[enumerator error] description]);
+		return nil;
+	}
+	
+	return items;
+}
+
+#pragma mark Item Information
+
+- (NSDictionary<NSString *, FileInfo *> *)itemInfos
+{
+	NSMutableDictionary *infos = [NSMutableDictionary dictionary];
 	
 	NSError *error = nil;
-	NSArray *itemNames = [manager contentsOfDirectoryAtPath:[self absolutePath] error:&error];
+	[self enumerateItemInfosUsingBlock:^(NSString *name, FileInfo *info, BOOL *stop) { infos[name] = info; } error:&error];
 	
 	if (error)
 	{
@@ -88,36 +122,184 @@
 		return nil;
 	}
 	
-	NSMutableArray *items = [NSMutableArray array];
-	for (NSString *itemName in itemNames)
+	return [infos copy];
+}
+
+- (BOOL)enumerateItemInfosUsingBlock:(void (^)(NSString *name, FileInfo *info, BOOL *stop))block error:(NSError **)error
+{
+	DIR *stream = opendir([[self absolutePath] fileSystemRepresentation]);
+	
+	if (stream == NULL)
+	{
+		if (error) *error = [NSError errorWithPOSIXCode:errno description:@"Could not read contents of directory at path %@", [self absolutePath]];
+		return NO;
+	}
+	
+	NSFileManager *manager = [NSFileManager defaultManager];
+	int descriptor = dirfd(stream);
+	BOOL stop = NO;
+	int code = 0;
+	
+	while (!stop)
 	{
-		BOOL itemIsDirectory;
-		NSString *itemPath = [[self absolutePath] stringByAppendingPathComponent:itemName];
-		[manager fileExistsAtPath:itemPath isDirectory:&itemIsDirectory];
+		// readdir returns NULL both at the end and on failure, which only errno tells apart
+		errno = 0;
+		struct dirent *entry = readdir(stream);
 		
-		Path *item = (itemIsDirectory ? [Directory directoryWithPath:itemPath] : [File fileWithPath:itemPath]);
+		if (entry == NULL)
+		{
+			code = errno;
+			break;
+		}
 		
-		if (item == nil) continue;
+		const char *name = entry->d_name;
+		if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
 		
-		// Add the item to the array or not depending on the kind of item wanted
-		if (kind == nil)
+		@autoreleasepool
 		{
-			[items addObject:item];
+			FileInfo *info = [FileInfo infoForItemNamed:name inDirectoryDescriptor:descriptor error:nil];
+			if (info == nil) continue;
+			
+			block([manager stringWithFileSystemRepresentation:name length:strlen(name)], info, &stop);
 		}
-		else if ([item isKindOfClass:kind])
+	}
+	
+	closedir(stream);
+	
+	if (code != 0)
+	{
+		if (error) *error = [NSError errorWithPOSIXCode:code description:@"Could not read contents of directory at path %@", [self absolutePath]];
+		return NO;
+	}
+	
+	return YES;
+}
+
+#pragma mark Opening
+
+- (DirectoryHandle *)open:(NSError **)error
+{
+	return [DirectoryHandle handleForDirectory:self error:error];
+}
+
+#pragma mark Disk Usage
+
+- (DiskUsage *)diskUsage
+{
+	return [self diskUsageWithOptions:DiskUsageOptionsNone workerCount:0];
+}
+
+- (DiskUsage *)diskUsageWithOptions:(DiskUsageOptions)options workerCount:(NSUInteger)workerCount
+{
+	return [DiskUsage diskUsageOfDirectoryAtPath:[self absolutePath] options:options workerCount:workerCount];
+}
+
+#pragma mark Snapshots
+
+- (DirectorySnapshot *)snapshot:(NSError **)error
+{
+	return [DirectorySnapshot snapshotOfDirectory:self workerCount:0 error:error];
+}
+
+#pragma mark Hashing
+
+- (NSDictionary<NSString *, NSData *> *)digestsOfFilesWithAlgorithm:(FileHashAlgorithm)algorithm concurrentReads:(NSUInteger)concurrentReads errors:(NSArray<NSError *> **)errors
+{
+	NSError *error = nil;
+	DirectorySnapshot *snapshot = [self snapshot:&error];
+	
+	if (snapshot == nil)
+	{
+		if (errors) *errors = @[error];
+		return nil;
+	}
+	
+	NSMutableArray<File *> *files = [NSMutableArray arrayWithCapacity:[snapshot count]];
+	NSMutableDictionary<NSString *, NSString *> *relativePaths = [NSMutableDictionary dictionaryWithCapacity:[snapshot count]];
+	
+	for (NSUInteger i = 0; i < [snapshot count]; i++)
+	{
+		DirectorySnapshotEntry *entry = [snapshot entryAtIndex:i];
+		if ([entry type] != DirectorySnapshotItemTypeFile) continue;
+		
+		File *file = [File itemWithAbsoluteParentPath:[self absolutePath] name:[entry path]];
+		relativePaths[[file absolutePath]] = [entry path];
+		[files addObject:file];
+	}
+	
+	NSArray<NSError *> *hashingErrors = nil;
+	NSDictionary<NSString *, NSData *> *digests = [FileHasher digestsOfFiles:files algorithm:algorithm concurrentReads:concurrentReads errors:&hashingErrors];
+	NSMutableDictionary<NSString *, NSData *> *relativeDigests = [NSMutableDictionary dictionaryWithCapacity:[digests count]];
+	
+	[digests enumerateKeysAndObjectsUsingBlock:^(NSString *path, NSData *digest, BOOL *stop)
+	{
+		relativeDigests[relativePaths[path]] = digest;
+	}];
+	
+	if (errors) *errors = [[snapshot errors] arrayByAddingObjectsFromArray:hashingErrors];
+	return relativeDigests;
+}
+
+- (NSArray<NSArray<File *> *> *)duplicateFiles:(NSError **)error
+{
+	return [[[DuplicateFinder alloc] initWithWorkerCount:0] duplicatesInDirectory:self error:error];
+}
+
+#pragma mark Enumeration
+
+- (DirectoryEnumerator *)enumerator
+{
+	return [self enumeratorForItemsOfKind:nil options:DirectoryEnumerationOptionsNone];
+}
+
+- (DirectoryEnumerator *)enumeratorForItemsOfKind:(Class)kind options:(DirectoryEnumerationOptions)options
+{
+	return [[DirectoryEnumerator alloc] initWithDirectory:self kind:kind options:options];
+}
+
+- (DirectoryEnumerator *)enumeratorForItemsMatching:(PathMatcher *)matcher kind:(Class)kind options:(DirectoryEnumerationOptions)options
+{
+	return [[DirectoryEnumerator alloc] initWithDirectory:self kind:kind options:options matcher:matcher];
+}
+
+- (BOOL)enumerateItemsOfKind:(Class)kind options:(DirectoryEnumerationOptions)options usingBlock:(void (^)(Path *item, BOOL *skipDescendants, BOOL *stop))block error:(NSError **)error
+{
+	DirectoryEnumerator *enumerator = [self enumeratorForItemsOfKind:kind options:options];
+	
+	Path *item;
+	while ((item = [enumerator nextObject]))
+	{
+		BOOL skipDescendants = NO;
+		BOOL stop = NO;
+		
+		@autoreleasepool
 		{
-			[items addObject:item];
+			block(item, &skipDescendants, &stop);
 		}
+		
+		if (stop) break;
+		if (skipDescendants) [enumerator skipDescendants];
 	}
 	
-	return [items copy];
+	if ([enumerator error])
+	{
+		if (error) *error = [enumerator error];
+		return NO;
+	}
+	
+	return YES;
 }
 
 #pragma mark Creating Other Directories
 
 - (Directory *)subdirectory:(NSString *)name
 {
-	return [Directory directoryWithPath:[[self subitem:name] absolutePath]];
+	return [Directory itemWithAbsoluteParentPath:[self absolutePath] name:name];
+}
+
+- (NSArray<Directory *> *)subdirectoriesNamed:(NSArray<NSString *> *)names
+{
+	return [self itemsOfClass:[Directory class] named:names];
 }
 
 - (Directory *)subdirectoryWithFormat:(NSString *)format, ...
@@ -136,11 +318,22 @@
 	return [Directory directoryWithPath:[path absolutePath]];
 }
 
+- (Directory *)createSubdirectoryWithNumericSuffixIfExists:(NSString *)name error:(NSError **)error
+{
+	NSString *claimedName = [[UniqueNameAllocator sharedAllocator] claimName:name inDirectoryAtPath:[self absolutePath] directory:YES error:error];
+	return (claimedName ? [self subdirectory:claimedName] : nil);
+}
+
 #pragma mark Creating Files
 
 - (File *)file:(NSString *)name
 {
-	return [File fileWithPath:[[self subitem:name] absolutePath]];
+	return [File itemWithAbsoluteParentPath:[self absolutePath] name:name];
+}
+
+- (NSArray<File *> *)filesNamed:(NSArray<NSString *> *)names
+{
+	return [self itemsOfClass:[File class] named:names];
 }
 
 - (File *)fileWithFormat:(NSString *)format, ...
@@ -165,20 +358,50 @@
 	return [File fileWithPath:[path absolutePath]];
 }
 
-#pragma mark Operations
+- (File *)createFileWithNumericSuffixIfExists:(NSString *)name error:(NSError **)error
+{
+	NSString *claimedName = [[UniqueNameAllocator sharedAllocator] claimName:name inDirectoryAtPath:[self absolutePath] directory:NO error:error];
+	return (claimedName ? [self file:claimedName] : nil);
+}
 
-- (BOOL)deleteContents
+- (NSArray *)itemsOfClass:(Class)class named:(NSArray<NSString *> *)names
 {
-	if (![self isDirectory]) return NO;
-	
-	__block BOOL success = YES;
+	NSString *absolutePath = [self absolutePath];
+	NSMutableArray *items = [NSMutableArray arrayWithCapacity:[names count]];
 	
-	NSArray *items = [self items];
-	
-	for (Path *item in items)
-		success &= [item delete];
+	for (NSString *name in names)
+	{
+		Path *item = [class itemWithAbsoluteParentPath:absolutePath name:name];
+		if (item) [items addObject:item];
+	}
 	
-	return success;
+	return [items copy];
+}
+
+#pragma mark Operations
+
+- (BOOL)deleteContents
+{
+	NSError *error = nil;
+	BOOL deleted = [self deleteContents:&error];
+	if (!deleted) NSLog(@"%@", [error description]);
+	return deleted;
+}
+
+- (BOOL)deleteContents:(NSError **)error
+{
+	return [[[DeleteEngine alloc] initWithWorkerCount:0] deleteContentsOfDirectory:self error:error];
+}
+
+// Overriden to remove subdirectories in parallel
+- (BOOL)delete:(NSError **)error
+{
+	return [[[DeleteEngine alloc] initWithWorkerCount:0] deleteItem:self error:error];
+}
+
+- (BOOL)deleteInBackgroundWithCompletion:(void (^)(NSError *error))completion error:(NSError **)error
+{
+	return [[[DeleteEngine alloc] initWithWorkerCount:0] deleteItemInBackground:self completion:completion error:error];
 }
 
 - (Directory *)create
@@ -233,29 +456,12 @@
 		return nil;
 	}
 	
-	NSMutableArray *errors = [NSMutableArray array];
+	CopyEngine *engine = [[CopyEngine alloc] initWithWorkerCount:0];
+	[engine setOverwrite:overwrite];
 	
-	for (Path *item in [self items])
-	{
-		Path *subitem = nil;
-		if ([item isKindOfClass:[Directory class]])
-		{
-			subitem = [destination subdirectory:[item name]];
-		}
-		else if ([item isKindOfClass:[File class]])
-		{
-			subitem = [destination file:[item name]];
-		}
-		
-		NSError *error;
-		[item copyTo:subitem overwrite:overwrite error:&error];
-		
-		if (error) [errors addObject:error];
-	}
-	
-	if ([errors count] > 0)
+	NSError *innerError = nil;
+	if (![engine copyContentsOfDirectory:self toDirectory:destination error:&innerError])
 	{
-		NSError *innerError = errors[0];
 		NSLog(@"%@", [innerError description]);
 		if (error) *error = innerError;
 		return nil;
@@ -320,6 +526,21 @@
 		return nil;
 	}
 	
+	if (![destination createParentDirectory:error]) return nil;
+	
+	// Moving within a volume is a single metadata change however large the tree; only moves across volumes copy data
+	if (PathRenameItem([[self absolutePath] fileSystemRepresentation], [[destination absolutePath] fileSystemRepresentation], overwrite))
+		return destination;
+	
+	if (errno != EXDEV)
+	{
+		int code = errno;
+		NSError *innerError = [NSError errorWithPOSIXCode:code description:@"Could not move directory at path %@ to %@", [self absolutePath], [destination absolutePath]];
+		NSLog(@"%@", [innerError description]);
+		if (error) *error = innerError;
+		return nil;
+	}
+	
 	NSError *innerError = nil;
 	Directory *outputDirectory = [self copyTo:destination overwrite:overwrite error:&innerError];
 	
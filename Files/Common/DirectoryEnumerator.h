@@ -0,0 +1,69 @@
+//
+//  DirectoryEnumerator.h
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+//  Description: Streams the contents of a directory straight from readdir(),
+//               using each entry's d_type so that no per-entry stat is needed.
+//
+
+#import <Foundation/Foundation.h>
+
+@class Path;
+@class Directory;
+@class PathMatcher;
+
+typedef NS_OPTIONS(NSUInteger, DirectoryEnumerationOptions)
+{
+	DirectoryEnumerationOptionsNone = 0,
+
+	/**
+	 Descends into subdirectories. Symbolic links to directories are returned but never followed.
+	 */
+	DirectoryEnumerationRecursive = 1 << 0
+};
+
+@interface DirectoryEnumerator : NSEnumerator
+
+#pragma mark Lifetime
+
+/**
+ Creates an enumerator for the items of the specified directory.
+ Pass nil as the kind to obtain every item, or [File class] / [Directory class] to only obtain items of that kind.
+ */
+- (id)initWithDirectory:(Directory *)directory kind:(Class)kind options:(DirectoryEnumerationOptions)options;
+
+/**
+ Creates an enumerator that only returns the items matched by the matcher (nil for all items). Names are
+ matched as they are read, before any object is created; items are only stat'ed for the matcher's predicates
+ once their name matched. Recursive enumerations still descend into directories that don't match, except
+ those a path pattern excludes entirely.
+ */
+- (id)initWithDirectory:(Directory *)directory kind:(Class)kind options:(DirectoryEnumerationOptions)options matcher:(PathMatcher *)matcher;
+
+#pragma mark Enumeration
+
+/**
+ Returns the next File or Directory instance, or nil once the enumeration is complete.
+ */
+- (Path *)nextObject;
+
+/**
+ Prevents the enumerator from descending into the directory that was last returned by -nextObject.
+ */
+- (void)skipDescendants;
+
+/**
+ The depth of the item that was last returned by -nextObject (1 for direct children of the directory).
+ */
+- (NSUInteger)level;
+
+/**
+ The first error encountered while reading directories, if any.
+ If the enumerated directory itself cannot be read, no items are returned and this is set.
+ */
+- (NSError *)error;
+
+@end
@@ -0,0 +1,270 @@
+//
+//  DirectoryEnumerator.m
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+
+#import <dirent.h>
+#import <errno.h>
+#import <fcntl.h>
+#import <sys/stat.h>
+#import "DirectoryEnumerator.h"
+#import "Directory.h"
+#import "File.h"
+#import "PathMatcher+Internal.h"
+#import "Path+Internal.h"
+#import "NSError+FilesAdditions.h"
+
+#pragma mark - Open Directory Frame
+
+@interface DirectoryEnumeratorFrame : NSObject
+
+@property (readonly) DIR *stream;
+@property (readonly) NSString *path;
+@property (readonly) NSData *relativePath; // Only tracked for path patterns
+
+@end
+
+@implementation DirectoryEnumeratorFrame
+
+- (id)initWithStream:(DIR *)stream path:(NSString *)path relativePath:(NSData *)relativePath
+{
+	self = [super init];
+	if (self)
+	{
+		_stream = stream;
+		_path = path;
+		_relativePath = relativePath;
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	closedir(_stream);
+}
+
+@end
+
+#pragma mark - Directory Enumerator
+
+@implementation DirectoryEnumerator
+{
+	Class _kind;
+	DirectoryEnumerationOptions _options;
+	PathMatcher *_matcher;
+	BOOL _tracksRelativePaths;
+	NSMutableData *_relativePath;
+	NSMutableArray<DirectoryEnumeratorFrame *> *_frames;
+	NSString *_pendingDirectoryPath;
+	NSData *_pendingRelativePath;
+	NSUInteger _level;
+	NSError *_error;
+}
+
+#pragma mark Lifetime
+
+- (id)initWithDirectory:(Directory *)directory kind:(Class)kind options:(DirectoryEnumerationOptions)options
+{
+	return [self initWithDirectory:directory kind:kind options:options matcher:nil];
+}
+
+- (id)initWithDirectory:(Directory *)directory kind:(Class)kind options:(DirectoryEnumerationOptions)options matcher:(PathMatcher *)matcher
+{
+	self = [super init];
+	if (self)
+	{
+		_kind = kind;
+		_options = options;
+		_matcher = matcher;
+		_tracksRelativePaths = [matcher matchesRelativePaths];
+		_relativePath = [NSMutableData data];
+		_frames = [NSMutableArray array];
+
+		[self pushDirectoryAtPath:[directory absolutePath] relativePath:(_tracksRelativePaths ? [NSData data] : nil)];
+	}
+	return self;
+}
+
+#pragma mark Enumeration
+
+- (Path *)nextObject
+{
+	if (_pendingDirectoryPath)
+	{
+		[self pushDirectoryAtPath:_pendingDirectoryPath relativePath:_pendingRelativePath];
+		_pendingDirectoryPath = nil;
+		_pendingRelativePath = nil;
+	}
+
+	NSFileManager *manager = [NSFileManager defaultManager];
+
+	while ([_frames count] > 0)
+	{
+		DirectoryEnumeratorFrame *frame = [_frames lastObject];
+
+		errno = 0;
+		struct dirent *entry = readdir([frame stream]);
+
+		if (entry == NULL)
+		{
+			if (errno != 0) [self recordErrorWithCode:errno path:[frame path]];
+			[_frames removeLastObject];
+			continue;
+		}
+
+		const char *name = entry->d_name;
+		if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+
+		size_t nameLength = strlen(name);
+		BOOL nameMatches = YES;
+
+		// The name is tested first so that items that don't match cost neither a stat nor an object
+		if (_matcher)
+		{
+			if (_tracksRelativePaths) [self setRelativePathInFrame:frame name:name length:nameLength];
+			nameMatches = [_matcher matchesName:name length:nameLength relativePath:[_relativePath bytes] length:[_relativePath length]];
+			if (!nameMatches && !(_options & DirectoryEnumerationRecursive)) continue;
+		}
+
+		BOOL isDirectory = NO;
+		BOOL isSymbolicLink = NO;
+		if (![self resolveEntry:entry inFrame:frame isDirectory:&isDirectory isSymbolicLink:&isSymbolicLink]) continue;
+
+		BOOL descend = isDirectory && !isSymbolicLink && (_options & DirectoryEnumerationRecursive);
+		if (descend && _tracksRelativePaths) descend = [_matcher mayMatchInsideDirectoryAtRelativePath:[_relativePath bytes] length:[_relativePath length]];
+
+		Class itemClass = (isDirectory ? [Directory class] : [File class]);
+		BOOL wanted = nameMatches && (_kind == nil || [itemClass isSubclassOfClass:_kind]);
+		if (wanted && [_matcher needsItemInfo]) wanted = [self entryNamed:name inFrame:frame matchesInfoOf:_matcher];
+
+		if (!wanted && !descend) continue;
+
+		NSString *itemName = [manager stringWithFileSystemRepresentation:name length:nameLength];
+		NSData *relativePath = (_tracksRelativePaths ? [_relativePath copy] : nil);
+
+		if (!wanted)
+		{
+			// Items that are filtered out are never seen by the caller, so they can't be skipped either.
+			[self pushDirectoryAtPath:[[frame path] stringByAppendingPathComponent:itemName] relativePath:relativePath];
+			continue;
+		}
+
+		Path *item = [itemClass itemWithAbsoluteParentPath:[frame path] name:itemName];
+		if (item == nil) continue;
+
+		_level = [_frames count];
+
+		if (descend)
+		{
+			_pendingDirectoryPath = [item absolutePath];
+			_pendingRelativePath = relativePath;
+		}
+
+		return item;
+	}
+
+	return nil;
+}
+
+- (void)skipDescendants
+{
+	_pendingDirectoryPath = nil;
+	_pendingRelativePath = nil;
+}
+
+- (NSUInteger)level
+{
+	return _level;
+}
+
+- (NSError *)error
+{
+	return _error;
+}
+
+#pragma mark Private
+
+- (void)pushDirectoryAtPath:(NSString *)path relativePath:(NSData *)relativePath
+{
+	DIR *stream = opendir([path fileSystemRepresentation]);
+
+	if (stream == NULL)
+	{
+		[self recordErrorWithCode:errno path:path];
+		return;
+	}
+
+	[_frames addObject:[[DirectoryEnumeratorFrame alloc] initWithStream:stream path:path relativePath:relativePath]];
+}
+
+// Builds the item's relative path in a reused buffer, so testing a path pattern allocates nothing
+- (void)setRelativePathInFrame:(DirectoryEnumeratorFrame *)frame name:(const char *)name length:(size_t)length
+{
+	NSData *parentPath = [frame relativePath];
+	[_relativePath setLength:0];
+
+	if ([parentPath length] > 0)
+	{
+		[_relativePath appendData:parentPath];
+		[_relativePath appendBytes:"/" length:1];
+	}
+
+	[_relativePath appendBytes:name length:length];
+}
+
+- (BOOL)entryNamed:(const char *)name inFrame:(DirectoryEnumeratorFrame *)frame matchesInfoOf:(PathMatcher *)matcher
+{
+	int directoryDescriptor = dirfd([frame stream]);
+	struct stat info;
+
+	// Links are checked for what they point to, like they are reported (dangling links for themselves)
+	if (fstatat(directoryDescriptor, name, &info, 0) != 0 && fstatat(directoryDescriptor, name, &info, AT_SYMLINK_NOFOLLOW) != 0) return NO;
+
+	return [matcher matchesInfo:&info];
+}
+
+// The entry type normally comes for free with readdir(). Only file systems that don't fill in d_type
+// (DT_UNKNOWN) and symbolic links (which must be resolved to tell what they point to) cost a stat.
+- (BOOL)resolveEntry:(struct dirent *)entry inFrame:(DirectoryEnumeratorFrame *)frame isDirectory:(BOOL *)isDirectory isSymbolicLink:(BOOL *)isSymbolicLink
+{
+	unsigned char type = entry->d_type;
+
+	if (type == DT_DIR) { *isDirectory = YES; return YES; }
+	if (type == DT_REG) { *isDirectory = NO; return YES; }
+
+	int directoryDescriptor = dirfd([frame stream]);
+	struct stat info;
+
+	if (type == DT_UNKNOWN)
+	{
+		if (fstatat(directoryDescriptor, entry->d_name, &info, AT_SYMLINK_NOFOLLOW) != 0) return NO;
+		if (!S_ISLNK(info.st_mode))
+		{
+			*isDirectory = S_ISDIR(info.st_mode);
+			return YES;
+		}
+	}
+
+	if (type == DT_LNK || type == DT_UNKNOWN)
+	{
+		// Links are reported as what they point to (dangling links are reported as files)
+		*isSymbolicLink = YES;
+		*isDirectory = (fstatat(directoryDescriptor, entry->d_name, &info, 0) == 0 && S_ISDIR(info.st_mode));
+		return YES;
+	}
+
+	// Sockets, FIFOs, devices, etc.
+	*isDirectory = NO;
+	return YES;
+}
+
+- (void)recordErrorWithCode:(int)code path:(NSString *)path
+{
+	if (_error) return;
+	_error = [NSError errorWithPOSIXCode:code description:@"Could not read contents of directory at path %@", path];
+}
+
+@end
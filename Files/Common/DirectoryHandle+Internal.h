@@ -0,0 +1,31 @@
+//
+//  DirectoryHandle+Internal.h
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+//  Description: Lower-level access to directory handles for the multi-threaded engines. Not part of the public interface.
+//
+
+#import "DirectoryHandle.h"
+
+@interface DirectoryHandle (Internal)
+
+/**
+ Wraps an open directory descriptor, which the handle then owns. The path is a null-terminated representation.
+ */
+- (id)initWithDescriptor:(int)descriptor pathRepresentation:(NSData *)pathRepresentation;
+
+/**
+ Opens the subdirectory with the specified file system name. Returns nil with errno set on failure.
+ Symbolic links are not followed.
+ */
+- (DirectoryHandle *)openSubdirectoryWithName:(const char *)name;
+
+/**
+ The null-terminated file system representation of the directory's path.
+ */
+@property (readonly) NSData *pathRepresentation;
+
+@end
@@ -0,0 +1,80 @@
+//
+//  DirectoryHandle.h
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+//  Description: An open directory. Operations on its children are performed relative to the directory's
+//               descriptor (openat, fstatat, unlinkat, mkdirat, renameat), so the kernel never walks the
+//               directory's path again and no path strings are built.
+//
+
+#import <Foundation/Foundation.h>
+
+@class Directory;
+@class FileInfo;
+
+@interface DirectoryHandle : NSObject
+
+#pragma mark Lifetime
+
+/**
+ Opens the directory. The handle keeps referring to the same directory even if it is moved or renamed.
+ */
++ (instancetype)handleForDirectory:(Directory *)directory error:(NSError **)error;
+
+/**
+ Closes the directory. Handles are closed automatically when deallocated; none of the other methods can be
+ called after closing.
+ */
+- (void)close;
+
+#pragma mark Information
+
+/**
+ The path of the directory when it was opened (used in error descriptions).
+ */
+@property (readonly) NSString *path;
+
+@property (readonly) int fileDescriptor;
+
+#pragma mark Children
+
+// Names must be single path components.
+
+/**
+ Returns the names of the items in the directory, in the order they are read from disk.
+ */
+- (NSArray<NSString *> *)itemNames:(NSError **)error;
+
+/**
+ Obtains information about the item with the specified name without following symbolic links.
+ */
+- (FileInfo *)infoForItemNamed:(NSString *)name error:(NSError **)error;
+
+- (DirectoryHandle *)openSubdirectoryNamed:(NSString *)name error:(NSError **)error;
+
+/**
+ Creates the subdirectory (unless a directory with that name already exists) and opens it.
+ */
+- (DirectoryHandle *)createSubdirectoryNamed:(NSString *)name error:(NSError **)error;
+
+- (NSData *)readDataOfFileNamed:(NSString *)name error:(NSError **)error;
+
+/**
+ Removes the item with the specified name. Directories are removed with their contents.
+ */
+- (BOOL)removeItemNamed:(NSString *)name error:(NSError **)error;
+
+/**
+ Removes every item in the directory, continuing past items that can't be removed.
+ */
+- (BOOL)removeContents:(NSError **)error;
+
+/**
+ Renames the item to newName in the destination directory (which can be the receiver).
+ */
+- (BOOL)moveItemNamed:(NSString *)name toDirectory:(DirectoryHandle *)destination newName:(NSString *)newName overwrite:(BOOL)overwrite error:(NSError **)error;
+
+@end
@@ -0,0 +1,242 @@
+//
+//  DirectoryHandle.m
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+
+#import <dirent.h>
+#import <errno.h>
+#import <fcntl.h>
+#import <string.h>
+#import <sys/stat.h>
+#import <unistd.h>
+#import "DirectoryHandle.h"
+#import "DirectoryHandle+Internal.h"
+#import "Directory.h"
+#import "File+Internal.h"
+#import "FileInfo.h"
+#import "Path+Internal.h"
+#import "NSError+FilesAdditions.h"
+#import "NSException+FilesAdditions.h"
+
+#define DirectoryHandleOpenFlags (O_RDONLY | O_DIRECTORY | O_CLOEXEC)
+
+@implementation DirectoryHandle
+{
+	int _descriptor;
+	NSData *_pathRepresentation;
+}
+
+#pragma mark Lifetime
+
++ (instancetype)handleForDirectory:(Directory *)directory error:(NSError **)error
+{
+	if (directory == nil) @throw [NSException exceptionWithReason:@"Directory is nil"];
+
+	NSData *representation = PathRepresentationWithString([directory absolutePath]);
+	int descriptor = open([representation bytes], DirectoryHandleOpenFlags);
+
+	if (descriptor < 0)
+	{
+		int code = errno;
+		if (error) *error = [NSError errorWithPOSIXCode:code description:@"Could not open directory at path %@", [directory absolutePath]];
+		return nil;
+	}
+
+	return [[self alloc] initWithDescriptor:descriptor pathRepresentation:representation];
+}
+
+- (id)initWithDescriptor:(int)descriptor pathRepresentation:(NSData *)pathRepresentation
+{
+	self = [super init];
+	if (self)
+	{
+		_descriptor = descriptor;
+		_pathRepresentation = pathRepresentation;
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	[self close];
+}
+
+- (void)close
+{
+	if (_descriptor >= 0) close(_descriptor);
+	_descriptor = -1;
+}
+
+#pragma mark Information
+
+- (NSString *)path
+{
+	return PathStringWithRepresentation([_pathRepresentation bytes]);
+}
+
+- (NSData *)pathRepresentation
+{
+	return _pathRepresentation;
+}
+
+- (int)fileDescriptor
+{
+	if (_descriptor < 0) @throw [NSException exceptionWithReason:@"Directory handle for %@ is closed", [self path]];
+	return _descriptor;
+}
+
+#pragma mark Children
+
+- (NSArray<NSString *> *)itemNames:(NSError **)error
+{
+	// The stream gets its own descriptor so that reading it doesn't move (or close) the handle's descriptor
+	int descriptor = openat([self fileDescriptor], ".", DirectoryHandleOpenFlags);
+	DIR *stream = (descriptor >= 0 ? fdopendir(descriptor) : NULL);
+
+	if (stream == NULL)
+	{
+		int code = errno;
+		if (descriptor >= 0) close(descriptor);
+		if (error) *error = [NSError errorWithPOSIXCode:code description:@"Could not read contents of directory at path %@", [self path]];
+		return nil;
+	}
+
+	NSFileManager *manager = [NSFileManager defaultManager];
+	NSMutableArray *names = [NSMutableArray array];
+	struct dirent *entry;
+
+	int code = 0;
+
+	while (YES)
+	{
+		errno = 0;
+		if ((entry = readdir(stream)) == NULL) { code = errno; break; }
+
+		const char *name = entry->d_name;
+		if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+
+		[names addObject:[manager stringWithFileSystemRepresentation:name length:strlen(name)]];
+	}
+
+	closedir(stream);
+
+	if (code != 0)
+	{
+		if (error) *error = [NSError errorWithPOSIXCode:code description:@"Could not read contents of directory at path %@", [self path]];
+		return nil;
+	}
+
+	return names;
+}
+
+- (FileInfo *)infoForItemNamed:(NSString *)name error:(NSError **)error
+{
+	return [FileInfo infoForItemNamed:[self representationOfName:name] inDirectoryDescriptor:[self fileDescriptor] error:error];
+}
+
+- (DirectoryHandle *)openSubdirectoryNamed:(NSString *)name error:(NSError **)error
+{
+	DirectoryHandle *handle = [self openSubdirectoryWithName:[self representationOfName:name]];
+
+	if (handle == nil)
+	{
+		int code = errno;
+		if (error) *error = [NSError errorWithPOSIXCode:code description:@"Could not open directory %@ in %@", name, [self path]];
+	}
+
+	return handle;
+}
+
+- (DirectoryHandle *)createSubdirectoryNamed:(NSString *)name error:(NSError **)error
+{
+	const char *representation = [self representationOfName:name];
+
+	// Creating first and opening second means an existing directory costs a failed mkdirat() rather than a stat
+	if (mkdirat([self fileDescriptor], representation, S_IRWXU | S_IRWXG | S_IRWXO) != 0 && errno != EEXIST)
+	{
+		int code = errno;
+		if (error) *error = [NSError errorWithPOSIXCode:code description:@"Could not create directory %@ in %@", name, [self path]];
+		return nil;
+	}
+
+	return [self openSubdirectoryNamed:name error:error];
+}
+
+- (NSData *)readDataOfFileNamed:(NSString *)name error:(NSError **)error
+{
+	int descriptor = openat([self fileDescriptor], [self representationOfName:name], O_RDONLY | O_CLOEXEC);
+
+	struct stat info;
+	NSMutableData *data = [NSMutableData data];
+	BOOL success = (descriptor >= 0 && fstat(descriptor, &info) == 0 && FileReadDescriptorIntoBuffer(descriptor, &info, data));
+
+	int code = errno;
+	if (descriptor >= 0) close(descriptor);
+
+	if (!success)
+	{
+		if (error) *error = [NSError errorWithPOSIXCode:code description:@"Could not read file %@ in %@", name, [self path]];
+		return nil;
+	}
+
+	return data;
+}
+
+- (BOOL)removeItemNamed:(NSString *)name error:(NSError **)error
+{
+	if (PathRemoveItemAt([self fileDescriptor], [self representationOfName:name])) return YES;
+
+	int code = errno;
+	if (error) *error = [NSError errorWithPOSIXCode:code description:@"Could not remove item %@ in %@", name, [self path]];
+	return NO;
+}
+
+- (BOOL)removeContents:(NSError **)error
+{
+	if (PathRemoveDirectoryContents([self fileDescriptor])) return YES;
+
+	int code = errno;
+	if (error) *error = [NSError errorWithPOSIXCode:code description:@"Could not remove contents of directory %@", [self path]];
+	return NO;
+}
+
+- (BOOL)moveItemNamed:(NSString *)name toDirectory:(DirectoryHandle *)destination newName:(NSString *)newName overwrite:(BOOL)overwrite error:(NSError **)error
+{
+	if (destination == nil) @throw [NSException exceptionWithReason:@"Destination is nil"];
+
+	// Both names are converted before renaming: the representations are autoreleased
+	const char *source = [self representationOfName:name];
+	const char *target = [destination representationOfName:newName];
+
+	if (PathRenameItemAt([self fileDescriptor], source, [destination fileDescriptor], target, overwrite)) return YES;
+
+	int code = errno;
+	if (error) *error = [NSError errorWithPOSIXCode:code description:@"Could not move item %@ in %@ to %@ in %@", name, [self path], newName, [destination path]];
+	return NO;
+}
+
+#pragma mark Internal
+
+- (DirectoryHandle *)openSubdirectoryWithName:(const char *)name
+{
+	int descriptor = openat([self fileDescriptor], name, DirectoryHandleOpenFlags | O_NOFOLLOW);
+	if (descriptor < 0) return nil;
+
+	return [[DirectoryHandle alloc] initWithDescriptor:descriptor pathRepresentation:PathRepresentationByAppendingName(_pathRepresentation, name)];
+}
+
+#pragma mark Private
+
+// Names are used relative to the descriptor, so anything that would reach outside the directory is a programming error
+- (const char *)representationOfName:(NSString *)name
+{
+	if ([name length] == 0 || [name isEqualToString:@"."] || [name isEqualToString:@".."] || [name rangeOfString:@"/"].location != NSNotFound)
+		@throw [NSException exceptionWithReason:@"Invalid item name \"%@\": names must be single path components", name];
+
+	return [name fileSystemRepresentation];
+}
+
+@end
@@ -0,0 +1,128 @@
+//
+//  DirectorySnapshot.h
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+//  Description: The state of every item in a directory tree (relative path, inode, size, modification
+//               time and type), sorted by path in a compact binary layout that is also the file format,
+//               so saved snapshots are memory-mapped rather than parsed. Two snapshots are compared with
+//               a single merge over both.
+//
+
+#import <Foundation/Foundation.h>
+
+@class Directory;
+@class File;
+
+typedef NS_ENUM(uint32_t, DirectorySnapshotItemType)
+{
+	DirectorySnapshotItemTypeFile = 0,
+	DirectorySnapshotItemTypeDirectory,
+	DirectorySnapshotItemTypeSymbolicLink,
+	DirectorySnapshotItemTypeOther
+};
+
+@interface DirectorySnapshotEntry : NSObject
+
+/**
+ The item's path relative to the snapshot's directory.
+ */
+@property (readonly) NSString *path;
+
+@property (readonly) DirectorySnapshotItemType type;
+@property (readonly) unsigned long long inode;
+@property (readonly) unsigned long long size;
+
+/**
+ The item's modification time, in nanoseconds since 1970.
+ */
+@property (readonly) long long modificationTime;
+
+@end
+
+@interface DirectorySnapshotRename : NSObject
+
+@property (readonly) DirectorySnapshotEntry *source;
+@property (readonly) DirectorySnapshotEntry *destination;
+
+@end
+
+/**
+ The changes between an older and a newer snapshot. Entries come from the newer snapshot, except for removed entries.
+ */
+@interface DirectorySnapshotDiff : NSObject
+
+@property (readonly) NSArray<DirectorySnapshotEntry *> *addedEntries;
+@property (readonly) NSArray<DirectorySnapshotEntry *> *removedEntries;
+
+/**
+ Items whose size or modification time changed, or that were replaced by another item of the same type.
+ */
+@property (readonly) NSArray<DirectorySnapshotEntry *> *modifiedEntries;
+
+/**
+ Items found at another path with the same inode, type (and for files, size and modification time).
+ Renamed items are not listed as added or removed.
+ */
+@property (readonly) NSArray<DirectorySnapshotRename *> *renamedEntries;
+
+/**
+ Whether nothing changed.
+ */
+- (BOOL)isEmpty;
+
+@end
+
+@interface DirectorySnapshot : NSObject
+
+#pragma mark Creation
+
+/**
+ Records every item in the directory tree, walking subdirectories in parallel with the specified number of worker
+ threads (0 uses one per processor). Symbolic links are recorded but not followed. Fails only if the directory itself
+ can't be read; check the snapshot's errors to know whether some of its subdirectories couldn't be.
+ */
++ (instancetype)snapshotOfDirectory:(Directory *)directory workerCount:(NSUInteger)workerCount error:(NSError **)error;
+
+/**
+ Loads a snapshot saved with -writeToFile:error:. The file is memory-mapped rather than copied, but every record is
+ validated when loading, so the whole file is read once.
+ */
++ (instancetype)snapshotWithContentsOfFile:(File *)file error:(NSError **)error;
+
+#pragma mark Saving
+
+/**
+ Atomically saves the snapshot. Snapshots are saved in the byte order of the machine that created them.
+ */
+- (BOOL)writeToFile:(File *)file error:(NSError **)error;
+
+#pragma mark Entries
+
+@property (readonly) NSUInteger count;
+
+/**
+ Returns the entry at the specified index, entries being sorted by the bytes of their path.
+ */
+- (DirectorySnapshotEntry *)entryAtIndex:(NSUInteger)index;
+
+/**
+ Returns the entry for the specified relative path (found by binary search), or nil.
+ */
+- (DirectorySnapshotEntry *)entryForPath:(NSString *)path;
+
+/**
+ Errors for the subdirectories that could not be read while taking the snapshot (not saved).
+ */
+@property (readonly) NSArray<NSError *> *errors;
+
+#pragma mark Comparison
+
+/**
+ Returns what changed between an older snapshot and the receiver, in time proportional to the number of entries.
+ */
+- (DirectorySnapshotDiff *)differenceFromSnapshot:(DirectorySnapshot *)olderSnapshot;
+
+@end
@@ -0,0 +1,568 @@
+//
+//  DirectorySnapshot.m
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+
+#import <dirent.h>
+#import <errno.h>
+#import <fcntl.h>
+#import <pthread.h>
+#import <stdint.h>
+#import <stdlib.h>
+#import <string.h>
+#import <sys/stat.h>
+#import <unistd.h>
+#import "DirectorySnapshot.h"
+#import "Directory.h"
+#import "DirectoryHandle+Internal.h"
+#import "File.h"
+#import "WorkerPool.h"
+#import "Path+Internal.h"
+#import "NSError+FilesAdditions.h"
+#import "NSException+FilesAdditions.h"
+
+#if defined(__APPLE__)
+#define DirectorySnapshotModificationTime(info) ((info).st_mtimespec)
+#else
+#define DirectorySnapshotModificationTime(info) ((info).st_mtim)
+#endif
+
+#define DirectorySnapshotMagic "FSNAPSHT"
+#define DirectorySnapshotVersion 1
+
+// The file format (and the in-memory layout): a header, the records sorted by path, then the
+// paths the records point to, relative to the directory and without terminators.
+typedef struct
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t recordSize;
+	uint64_t count;
+	uint64_t pathsLength;
+} DirectorySnapshotHeader;
+
+typedef struct
+{
+	uint64_t inode;
+	uint64_t size;
+	int64_t modificationTime;
+	uint32_t pathOffset;
+	uint32_t pathLength;
+	uint32_t type;
+	uint32_t reserved;
+} DirectorySnapshotRecord;
+
+static int DirectorySnapshotComparePaths(const char *first, uint32_t firstLength, const char *second, uint32_t secondLength);
+static NSData *DirectorySnapshotSortedData(NSData *records, NSData *paths);
+static BOOL DirectorySnapshotIsValid(NSData *data);
+
+#pragma mark - Entries
+
+@implementation DirectorySnapshotEntry
+
+- (id)initWithRecord:(const DirectorySnapshotRecord *)record paths:(const char *)paths
+{
+	self = [super init];
+	if (self)
+	{
+		_path = [[NSFileManager defaultManager] stringWithFileSystemRepresentation:paths + record->pathOffset length:record->pathLength];
+		_type = (DirectorySnapshotItemType)record->type;
+		_inode = record->inode;
+		_size = record->size;
+		_modificationTime = record->modificationTime;
+	}
+	return self;
+}
+
+- (NSString *)description
+{
+	return [NSString stringWithFormat:@"<%@ %@ inode: %llu size: %llu>", NSStringFromClass([self class]), _path, _inode, _size];
+}
+
+@end
+
+@implementation DirectorySnapshotRename
+
+- (id)initWithSource:(DirectorySnapshotEntry *)source destination:(DirectorySnapshotEntry *)destination
+{
+	self = [super init];
+	if (self)
+	{
+		_source = source;
+		_destination = destination;
+	}
+	return self;
+}
+
+- (NSString *)description
+{
+	return [NSString stringWithFormat:@"<%@ %@ -> %@>", NSStringFromClass([self class]), [_source path], [_destination path]];
+}
+
+@end
+
+#pragma mark - Differences
+
+@implementation DirectorySnapshotDiff
+
+- (id)initWithAddedEntries:(NSArray *)added removedEntries:(NSArray *)removed modifiedEntries:(NSArray *)modified renamedEntries:(NSArray *)renamed
+{
+	self = [super init];
+	if (self)
+	{
+		_addedEntries = added;
+		_removedEntries = removed;
+		_modifiedEntries = modified;
+		_renamedEntries = renamed;
+	}
+	return self;
+}
+
+- (BOOL)isEmpty
+{
+	return ([_addedEntries count] == 0 && [_removedEntries count] == 0 && [_modifiedEntries count] == 0 && [_renamedEntries count] == 0);
+}
+
+@end
+
+#pragma mark - Snapshot Builder
+
+// Each worker lists one directory into local buffers and merges them once, so the lock is taken once per directory.
+@interface DirectorySnapshotBuilder : NSObject
+{
+	@public
+	NSMutableArray<NSError *> *_errors;
+}
+
+@end
+
+@implementation DirectorySnapshotBuilder
+{
+	WorkerPool *_pool;
+	pthread_mutex_t _lock;
+	NSMutableData *_records;
+	NSMutableData *_paths;
+}
+
+- (id)init
+{
+	self = [super init];
+	if (self)
+	{
+		_records = [NSMutableData data];
+		_paths = [NSMutableData data];
+		_errors = [NSMutableArray array];
+		pthread_mutex_init(&_lock, NULL);
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	pthread_mutex_destroy(&_lock);
+}
+
+- (NSData *)dataForDirectory:(DirectoryHandle *)directory workerCount:(NSUInteger)workerCount
+{
+	_pool = [[WorkerPool alloc] initWithWorkerCount:workerCount];
+	[_pool addTask:^{ [self scanDirectory:directory relativePath:[NSData data]]; }];
+	[_pool waitUntilAllTasksAreFinished];
+	_pool = nil;
+
+	return DirectorySnapshotSortedData(_records, _paths);
+}
+
+// Runs on a worker thread
+- (void)scanDirectory:(DirectoryHandle *)directory relativePath:(NSData *)relativePath
+{
+	int descriptor = [directory fileDescriptor];
+
+	// The stream gets its own descriptor so that closing it leaves the handle open for subdirectories
+	int streamDescriptor = openat(descriptor, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	DIR *stream = (streamDescriptor >= 0 ? fdopendir(streamDescriptor) : NULL);
+
+	if (stream == NULL)
+	{
+		int code = errno;
+		if (streamDescriptor >= 0) close(streamDescriptor);
+		[self recordErrorWithCode:code path:[directory pathRepresentation]];
+		return;
+	}
+
+	NSMutableData *records = [NSMutableData data];
+	NSMutableData *paths = [NSMutableData data];
+	struct dirent *entry;
+
+	while (YES)
+	{
+		errno = 0;
+		if ((entry = readdir(stream)) == NULL)
+		{
+			int code = errno;
+			if (code != 0) [self recordErrorWithCode:code path:[directory pathRepresentation]];
+			break;
+		}
+
+		const char *name = entry->d_name;
+		if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+
+		struct stat info;
+		if (fstatat(descriptor, name, &info, AT_SYMLINK_NOFOLLOW) != 0)
+		{
+			// Items removed since the directory was read are simply not part of the tree anymore
+			if (errno != ENOENT) [self recordErrorWithCode:errno path:PathRepresentationByAppendingName([directory pathRepresentation], name)];
+			continue;
+		}
+
+		NSMutableData *itemPath = [NSMutableData dataWithData:relativePath];
+		if ([itemPath length] > 0) [itemPath appendBytes:"/" length:1];
+		[itemPath appendBytes:name length:strlen(name)];
+
+		DirectorySnapshotRecord record;
+		record.inode = (uint64_t)info.st_ino;
+		record.size = (uint64_t)info.st_size;
+		record.modificationTime = (int64_t)DirectorySnapshotModificationTime(info).tv_sec * 1000000000LL + DirectorySnapshotModificationTime(info).tv_nsec;
+		record.pathOffset = (uint32_t)[paths length];
+		record.pathLength = (uint32_t)[itemPath length];
+		record.type = (S_ISREG(info.st_mode) ? DirectorySnapshotItemTypeFile : S_ISDIR(info.st_mode) ? DirectorySnapshotItemTypeDirectory : S_ISLNK(info.st_mode) ? DirectorySnapshotItemTypeSymbolicLink : DirectorySnapshotItemTypeOther);
+		record.reserved = 0;
+
+		[records appendBytes:&record length:sizeof(record)];
+		[paths appendData:itemPath];
+
+		if (S_ISDIR(info.st_mode))
+		{
+			NSData *nameRepresentation = [NSData dataWithBytes:name length:strlen(name) + 1];
+			[_pool addTask:^{ [self scanSubdirectoryNamed:nameRepresentation inDirectory:directory relativePath:itemPath]; }];
+		}
+	}
+
+	closedir(stream);
+	[self mergeRecords:records paths:paths];
+}
+
+- (void)scanSubdirectoryNamed:(NSData *)nameRepresentation inDirectory:(DirectoryHandle *)directory relativePath:(NSData *)relativePath
+{
+	DirectoryHandle *subdirectory = [directory openSubdirectoryWithName:[nameRepresentation bytes]];
+
+	if (subdirectory == nil)
+	{
+		if (errno != ENOENT) [self recordErrorWithCode:errno path:PathRepresentationByAppendingName([directory pathRepresentation], [nameRepresentation bytes])];
+		return;
+	}
+
+	[self scanDirectory:subdirectory relativePath:relativePath];
+}
+
+- (void)mergeRecords:(NSData *)records paths:(NSData *)paths
+{
+	pthread_mutex_lock(&_lock);
+
+	// Path offsets are 32-bit to keep records small, which limits a snapshot to 4 GB of paths
+	if ((unsigned long long)[_paths length] + [paths length] > UINT32_MAX)
+	{
+		pthread_mutex_unlock(&_lock);
+		[self recordErrorWithCode:EFBIG path:nil];
+		return;
+	}
+
+	uint32_t base = (uint32_t)[_paths length];
+	NSUInteger start = [_records length];
+
+	[_paths appendData:paths];
+	[_records appendData:records];
+
+	DirectorySnapshotRecord *merged = (DirectorySnapshotRecord *)((char *)[_records mutableBytes] + start);
+	for (NSUInteger i = 0; i < [records length] / sizeof(DirectorySnapshotRecord); i++)
+		merged[i].pathOffset += base;
+
+	pthread_mutex_unlock(&_lock);
+}
+
+- (void)recordErrorWithCode:(int)code path:(NSData *)path
+{
+	NSError *error = (path ? [NSError errorWithPOSIXCode:code description:@"Could not take snapshot of item at path %@", PathStringWithRepresentation([path bytes])]
+	                       : [NSError errorWithPOSIXCode:code description:@"Could not take snapshot: too many items"]);
+
+	pthread_mutex_lock(&_lock);
+	[_errors addObject:error];
+	pthread_mutex_unlock(&_lock);
+}
+
+@end
+
+#pragma mark - Directory Snapshot
+
+@implementation DirectorySnapshot
+{
+	NSData *_data;
+	const DirectorySnapshotRecord *_records;
+	const char *_paths;
+}
+
+#pragma mark Creation
+
++ (instancetype)snapshotOfDirectory:(Directory *)directory workerCount:(NSUInteger)workerCount error:(NSError **)error
+{
+	if (directory == nil) @throw [NSException exceptionWithReason:@"Directory is nil"];
+
+	DirectoryHandle *handle = [directory open:error];
+	if (handle == nil) return nil;
+
+	DirectorySnapshotBuilder *builder = [[DirectorySnapshotBuilder alloc] init];
+	NSData *data = [builder dataForDirectory:handle workerCount:workerCount];
+
+	if (data == nil)
+	{
+		if (error) *error = [NSError errorWithPOSIXCode:ENOMEM description:@"Could not take snapshot of directory at path %@", [directory absolutePath]];
+		return nil;
+	}
+
+	return [[self alloc] initWithData:data errors:builder->_errors];
+}
+
++ (instancetype)snapshotWithContentsOfFile:(File *)file error:(NSError **)error
+{
+	if (file == nil) @throw [NSException exceptionWithReason:@"File is nil"];
+
+	NSData *data = [file readDataWithOptions:FileReadingMapped mappingThreshold:0 error:error];
+	if (data == nil) return nil;
+
+	if (!DirectorySnapshotIsValid(data))
+	{
+		if (error) *error = [NSError errorWithDescription:@"The file at path %@ is not a valid directory snapshot", [file absolutePath]];
+		return nil;
+	}
+
+	return [[self alloc] initWithData:data errors:@[]];
+}
+
+- (id)initWithData:(NSData *)data errors:(NSArray<NSError *> *)errors
+{
+	self = [super init];
+	if (self)
+	{
+		_data = data;
+		_errors = [errors copy];
+		_count = (NSUInteger)((const DirectorySnapshotHeader *)[data bytes])->count;
+		_records = (const DirectorySnapshotRecord *)((const char *)[data bytes] + sizeof(DirectorySnapshotHeader));
+		_paths = (const char *)(_records + _count);
+	}
+	return self;
+}
+
+#pragma mark Saving
+
+- (BOOL)writeToFile:(File *)file error:(NSError **)error
+{
+	if (file == nil) @throw [NSException exceptionWithReason:@"File is nil"];
+
+	return [file writeData:_data overwrite:YES error:error];
+}
+
+#pragma mark Entries
+
+- (DirectorySnapshotEntry *)entryAtIndex:(NSUInteger)index
+{
+	if (index >= _count) @throw [NSException exceptionWithReason:@"Index %lu is beyond the snapshot's %lu entries", (unsigned long)index, (unsigned long)_count];
+
+	return [[DirectorySnapshotEntry alloc] initWithRecord:&_records[index] paths:_paths];
+}
+
+- (DirectorySnapshotEntry *)entryForPath:(NSString *)path
+{
+	const char *representation = [path fileSystemRepresentation];
+	uint32_t length = (uint32_t)strlen(representation);
+	NSUInteger low = 0, high = _count;
+
+	while (low < high)
+	{
+		NSUInteger middle = low + (high - low) / 2;
+		const DirectorySnapshotRecord *record = &_records[middle];
+		int order = DirectorySnapshotComparePaths(_paths + record->pathOffset, record->pathLength, representation, length);
+
+		if (order == 0) return [[DirectorySnapshotEntry alloc] initWithRecord:record paths:_paths];
+		if (order < 0) low = middle + 1; else high = middle;
+	}
+
+	return nil;
+}
+
+#pragma mark Comparison
+
+- (DirectorySnapshotDiff *)differenceFromSnapshot:(DirectorySnapshot *)olderSnapshot
+{
+	if (olderSnapshot == nil) @throw [NSException exceptionWithReason:@"Snapshot is nil"];
+
+	const DirectorySnapshotRecord *oldRecords = olderSnapshot->_records;
+	const char *oldPaths = olderSnapshot->_paths;
+	NSUInteger oldCount = olderSnapshot->_count;
+
+	NSMutableIndexSet *added = [NSMutableIndexSet indexSet];
+	NSMutableIndexSet *removed = [NSMutableIndexSet indexSet];
+	NSMutableIndexSet *modified = [NSMutableIndexSet indexSet];
+
+	// Both snapshots are sorted by path, so a single pass pairs up the entries
+	for (NSUInteger i = 0, j = 0; i < oldCount || j < _count; )
+	{
+		int order;
+
+		if (i == oldCount) order = 1;
+		else if (j == _count) order = -1;
+		else order = DirectorySnapshotComparePaths(oldPaths + oldRecords[i].pathOffset, oldRecords[i].pathLength, _paths + _records[j].pathOffset, _records[j].pathLength);
+
+		if (order < 0) { [removed addIndex:i++]; continue; }
+		if (order > 0) { [added addIndex:j++]; continue; }
+
+		const DirectorySnapshotRecord *previous = &oldRecords[i];
+		const DirectorySnapshotRecord *current = &_records[j];
+
+		if (previous->type != current->type)
+		{
+			[removed addIndex:i];
+			[added addIndex:j];
+		}
+		else if (previous->inode != current->inode || previous->size != current->size || previous->modificationTime != current->modificationTime)
+		{
+			[modified addIndex:j];
+		}
+
+		i++, j++;
+	}
+
+	// Renames keep the inode (and a file's size and modification time), which pairs removed entries with added ones
+	NSMutableDictionary<NSNumber *, NSNumber *> *removedByInode = [NSMutableDictionary dictionaryWithCapacity:[removed count]];
+	[removed enumerateIndexesUsingBlock:^(NSUInteger index, BOOL *stop) { if (!removedByInode[@(oldRecords[index].inode)]) removedByInode[@(oldRecords[index].inode)] = @(index); }];
+
+	NSMutableArray<DirectorySnapshotRename *> *renamed = [NSMutableArray array];
+	NSMutableIndexSet *renamedSources = [NSMutableIndexSet indexSet];
+	NSMutableIndexSet *renamedDestinations = [NSMutableIndexSet indexSet];
+
+	[added enumerateIndexesUsingBlock:^(NSUInteger index, BOOL *stop)
+	{
+		const DirectorySnapshotRecord *current = &_records[index];
+		NSNumber *match = removedByInode[@(current->inode)];
+		if (match == nil) return;
+
+		const DirectorySnapshotRecord *previous = &oldRecords[[match unsignedIntegerValue]];
+		if (previous->type != current->type) return;
+		if (current->type != DirectorySnapshotItemTypeDirectory && (previous->size != current->size || previous->modificationTime != current->modificationTime)) return;
+
+		DirectorySnapshotEntry *source = [[DirectorySnapshotEntry alloc] initWithRecord:previous paths:oldPaths];
+		DirectorySnapshotEntry *destination = [[DirectorySnapshotEntry alloc] initWithRecord:current paths:_paths];
+		[renamed addObject:[[DirectorySnapshotRename alloc] initWithSource:source destination:destination]];
+
+		[removedByInode removeObjectForKey:@(current->inode)];
+		[renamedSources addIndex:[match unsignedIntegerValue]];
+		[renamedDestinations addIndex:index];
+	}];
+
+	[removed removeIndexes:renamedSources];
+	[added removeIndexes:renamedDestinations];
+
+	return [[DirectorySnapshotDiff alloc] initWithAddedEntries:[self entriesAtIndexes:added]
+	                                            removedEntries:[olderSnapshot entriesAtIndexes:removed]
+	                                           modifiedEntries:[self entriesAtIndexes:modified]
+	                                            renamedEntries:renamed];
+}
+
+#pragma mark Private
+
+- (NSArray<DirectorySnapshotEntry *> *)entriesAtIndexes:(NSIndexSet *)indexes
+{
+	NSMutableArray *entries = [NSMutableArray arrayWithCapacity:[indexes count]];
+	[indexes enumerateIndexesUsingBlock:^(NSUInteger index, BOOL *stop) { [entries addObject:[[DirectorySnapshotEntry alloc] initWithRecord:&_records[index] paths:_paths]]; }];
+	return entries;
+}
+
+@end
+
+#pragma mark - Format Primitives
+
+// Paths are ordered by their bytes, a prefix coming before the paths it starts
+static int DirectorySnapshotComparePaths(const char *first, uint32_t firstLength, const char *second, uint32_t secondLength)
+{
+	int order = memcmp(first, second, MIN(firstLength, secondLength));
+	if (order != 0) return order;
+
+	return (firstLength < secondLength ? -1 : (firstLength > secondLength ? 1 : 0));
+}
+
+typedef struct
+{
+	const char *path;
+	uint32_t length;
+	uint32_t index;
+} DirectorySnapshotSortKey;
+
+static int DirectorySnapshotCompareSortKeys(const void *first, const void *second)
+{
+	const DirectorySnapshotSortKey *firstKey = first, *secondKey = second;
+	return DirectorySnapshotComparePaths(firstKey->path, firstKey->length, secondKey->path, secondKey->length);
+}
+
+// Lays out the unsorted records and paths gathered by the workers in the file format, sorted by path.
+// The paths are rewritten in the same order so that reading entries in order reads the paths in order.
+static NSData *DirectorySnapshotSortedData(NSData *records, NSData *paths)
+{
+	size_t count = [records length] / sizeof(DirectorySnapshotRecord);
+	const DirectorySnapshotRecord *unsortedRecords = [records bytes];
+	const char *unsortedPaths = [paths bytes];
+
+	DirectorySnapshotSortKey *keys = malloc(MAX(count, (size_t)1) * sizeof(DirectorySnapshotSortKey));
+	if (keys == NULL) return nil;
+
+	for (size_t i = 0; i < count; i++)
+		keys[i] = (DirectorySnapshotSortKey){ unsortedPaths + unsortedRecords[i].pathOffset, unsortedRecords[i].pathLength, (uint32_t)i };
+
+	qsort(keys, count, sizeof(DirectorySnapshotSortKey), DirectorySnapshotCompareSortKeys);
+
+	NSMutableData *data = [NSMutableData dataWithLength:sizeof(DirectorySnapshotHeader) + count * sizeof(DirectorySnapshotRecord) + [paths length]];
+	DirectorySnapshotHeader *header = [data mutableBytes];
+	DirectorySnapshotRecord *sortedRecords = (DirectorySnapshotRecord *)(header + 1);
+	char *sortedPaths = (char *)(sortedRecords + count);
+
+	memcpy(header->magic, DirectorySnapshotMagic, sizeof(header->magic));
+	header->version = DirectorySnapshotVersion;
+	header->recordSize = sizeof(DirectorySnapshotRecord);
+	header->count = count;
+	header->pathsLength = [paths length];
+
+	uint32_t offset = 0;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		sortedRecords[i] = unsortedRecords[keys[i].index];
+		sortedRecords[i].pathOffset = offset;
+		memcpy(sortedPaths + offset, keys[i].path, keys[i].length);
+		offset += keys[i].length;
+	}
+
+	free(keys);
+	return data;
+}
+
+static BOOL DirectorySnapshotIsValid(NSData *data)
+{
+	if ([data length] < sizeof(DirectorySnapshotHeader)) return NO;
+
+	const DirectorySnapshotHeader *header = [data bytes];
+	if (memcmp(header->magic, DirectorySnapshotMagic, sizeof(header->magic)) != 0) return NO;
+
+	// A snapshot saved on a machine with the other byte order fails here
+	if (header->version != DirectorySnapshotVersion || header->recordSize != sizeof(DirectorySnapshotRecord)) return NO;
+
+	uint64_t available = [data length] - sizeof(DirectorySnapshotHeader);
+	if (header->count > available / sizeof(DirectorySnapshotRecord)) return NO;
+	if (header->pathsLength != available - header->count * sizeof(DirectorySnapshotRecord)) return NO;
+
+	const DirectorySnapshotRecord *records = (const DirectorySnapshotRecord *)(header + 1);
+
+	for (uint64_t i = 0; i < header->count; i++)
+		if ((uint64_t)records[i].pathOffset + records[i].pathLength > header->pathsLength) return NO;
+
+	return YES;
+}
@@ -0,0 +1,63 @@
+//
+//  DiskUsage.h
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+//  Description: The total size and item counts of a directory tree, computed by walking
+//               subdirectories in parallel.
+//
+
+#import <Foundation/Foundation.h>
+
+typedef NS_OPTIONS(NSUInteger, DiskUsageOptions)
+{
+	DiskUsageOptionsNone = 0,
+
+	/**
+	 Does not descend into (or count) directories that are mount points for other file systems.
+	 */
+	DiskUsageStayOnFileSystem = 1 << 0
+};
+
+@interface DiskUsage : NSObject
+
+#pragma mark Computation
+
+/**
+ Computes the disk usage of the contents of the directory at the specified absolute path using the specified
+ number of worker threads (0 uses one per processor). Symbolic links are counted but never followed, and files
+ with several hard links in the tree are only counted once.
+ */
++ (instancetype)diskUsageOfDirectoryAtPath:(NSString *)path options:(DiskUsageOptions)options workerCount:(NSUInteger)workerCount;
+
+#pragma mark Results
+
+/**
+ The sum of the sizes of all items in the tree, as reported by the file system (like du --apparent-size).
+ */
+@property (readonly) unsigned long long apparentSize;
+
+/**
+ The number of bytes actually allocated on disk for all items in the tree (like du).
+ */
+@property (readonly) unsigned long long allocatedSize;
+
+/**
+ The number of non-directory items (files, symbolic links, etc.) in the tree.
+ */
+@property (readonly) unsigned long long fileCount;
+
+/**
+ The number of directories in the tree, not counting the directory itself.
+ */
+@property (readonly) unsigned long long directoryCount;
+
+/**
+ Errors for the items that could not be read. When this is not empty, the other results only
+ account for the part of the tree that could be read.
+ */
+@property (readonly) NSArray<NSError *> *errors;
+
+@end
@@ -0,0 +1,170 @@
+//
+//  DiskUsage.m
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+
+#import <dirent.h>
+#import <errno.h>
+#import <fcntl.h>
+#import <pthread.h>
+#import <sys/stat.h>
+#import "DiskUsage.h"
+#import "WorkerPool.h"
+#import "Path+Internal.h"
+#import "NSError+FilesAdditions.h"
+
+@implementation DiskUsage
+{
+	DiskUsageOptions _options;
+	WorkerPool *_pool;
+	dev_t _device;
+
+	pthread_mutex_t _lock;
+	NSMutableSet *_linkedInodes;
+	NSMutableArray<NSError *> *_mutableErrors;
+}
+
+#pragma mark Computation
+
++ (instancetype)diskUsageOfDirectoryAtPath:(NSString *)path options:(DiskUsageOptions)options workerCount:(NSUInteger)workerCount
+{
+	DiskUsage *usage = [[self alloc] initWithOptions:options];
+	[usage computeForDirectoryAtPath:path workerCount:workerCount];
+	return usage;
+}
+
+- (id)initWithOptions:(DiskUsageOptions)options
+{
+	self = [super init];
+	if (self)
+	{
+		_options = options;
+		_linkedInodes = [NSMutableSet set];
+		_mutableErrors = [NSMutableArray array];
+		pthread_mutex_init(&_lock, NULL);
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	pthread_mutex_destroy(&_lock);
+}
+
+- (void)computeForDirectoryAtPath:(NSString *)path workerCount:(NSUInteger)workerCount
+{
+	const char *representation = [path fileSystemRepresentation];
+
+	struct stat info;
+	if (stat(representation, &info) != 0)
+	{
+		[self recordErrorWithCode:errno path:representation];
+		return;
+	}
+
+	_device = info.st_dev;
+	_pool = [[WorkerPool alloc] initWithWorkerCount:workerCount];
+
+	NSData *rootPath = PathRepresentationWithString(path);
+	[_pool addTask:^{ [self scanDirectoryAtPath:rootPath]; }];
+	[_pool waitUntilAllTasksAreFinished];
+
+	_pool = nil;
+}
+
+#pragma mark Results
+
+- (NSArray<NSError *> *)errors
+{
+	return [_mutableErrors copy];
+}
+
+#pragma mark Private
+
+// Runs on a worker thread. Totals are accumulated locally and merged once per directory, and
+// subdirectories are handed back to the pool as they are found so that idle workers can steal them.
+- (void)scanDirectoryAtPath:(NSData *)path
+{
+	DIR *stream = opendir([path bytes]);
+
+	if (stream == NULL)
+	{
+		[self recordErrorWithCode:errno path:[path bytes]];
+		return;
+	}
+
+	int descriptor = dirfd(stream);
+	unsigned long long apparentSize = 0, allocatedSize = 0, fileCount = 0, directoryCount = 0;
+	struct dirent *entry;
+
+	while (YES)
+	{
+		errno = 0;
+		if ((entry = readdir(stream)) == NULL) break;
+
+		const char *name = entry->d_name;
+		if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+
+		struct stat info;
+		if (fstatat(descriptor, name, &info, AT_SYMLINK_NOFOLLOW) != 0)
+		{
+			// Items removed since the directory was read are simply not part of the tree anymore
+			if (errno != ENOENT) [self recordErrorWithCode:errno path:[PathRepresentationByAppendingName(path, name) bytes]];
+			continue;
+		}
+
+		if (S_ISDIR(info.st_mode))
+		{
+			if ((_options & DiskUsageStayOnFileSystem) && info.st_dev != _device) continue;
+
+			directoryCount++;
+			NSData *subdirectoryPath = PathRepresentationByAppendingName(path, name);
+			[_pool addTask:^{ [self scanDirectoryAtPath:subdirectoryPath]; }];
+		}
+		else
+		{
+			if (info.st_nlink > 1 && ![self claimInode:info.st_ino device:info.st_dev]) continue;
+			fileCount++;
+		}
+
+		apparentSize += (unsigned long long)info.st_size;
+		allocatedSize += (unsigned long long)info.st_blocks * 512;
+	}
+
+	if (errno != 0) [self recordErrorWithCode:errno path:[path bytes]];
+	closedir(stream);
+
+	pthread_mutex_lock(&_lock);
+	_apparentSize += apparentSize;
+	_allocatedSize += allocatedSize;
+	_fileCount += fileCount;
+	_directoryCount += directoryCount;
+	pthread_mutex_unlock(&_lock);
+}
+
+// Returns YES the first time a given hard-linked file is seen
+- (BOOL)claimInode:(ino_t)inode device:(dev_t)device
+{
+	NSArray *key = @[@((unsigned long long)device), @((unsigned long long)inode)];
+
+	pthread_mutex_lock(&_lock);
+	BOOL claimed = ![_linkedInodes containsObject:key];
+	if (claimed) [_linkedInodes addObject:key];
+	pthread_mutex_unlock(&_lock);
+
+	return claimed;
+}
+
+- (void)recordErrorWithCode:(int)code path:(const char *)path
+{
+	NSError *error = [NSError errorWithPOSIXCode:code description:@"Could not compute disk usage for item at path %@", PathStringWithRepresentation(path)];
+
+	pthread_mutex_lock(&_lock);
+	[_mutableErrors addObject:error];
+	pthread_mutex_unlock(&_lock);
+}
+
+@end
@@ -0,0 +1,72 @@
+//
+//  DuplicateFinder.h
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+//  Description: Finds groups of files with identical contents in a directory tree through successive
+//               stages that each read more of fewer files: sizes (from a snapshot, no reads), then a
+//               hash of the first and last few kilobytes, then a full SHA-256 of the files still alike.
+//
+
+#import <Foundation/Foundation.h>
+
+@class Directory;
+@class File;
+
+@interface DuplicateFinder : NSObject
+
+#pragma mark Lifetime
+
+/**
+ Creates a finder that runs each stage with the specified number of worker threads (0 uses one per processor).
+ The number of workers is also the maximum number of files read at once.
+ */
+- (id)initWithWorkerCount:(NSUInteger)workerCount;
+
+#pragma mark Configuration
+
+@property (readonly) NSUInteger workerCount;
+
+/**
+ The number of bytes hashed at each end of a file in the partial stage, 4 KB by default. Files up to twice
+ this size are read whole in that stage and never reach the full stage.
+ */
+@property (nonatomic) NSUInteger partialHashLength;
+
+#pragma mark Finding
+
+/**
+ Returns the groups of identical files in the directory tree. Groups are sorted by the path of their first file
+ and files within a group by path. Empty files and symbolic links are ignored. Paths that are hard links to the
+ same file are reported once (the first path), since they share their data already.
+ Fails only if the directory can't be read; files that could not be read are described in errors.
+ */
+- (NSArray<NSArray<File *> *> *)duplicatesInDirectory:(Directory *)directory error:(NSError **)error;
+
+#pragma mark Statistics
+
+// These describe the last search performed by the finder.
+
+/**
+ The number of files whose ends were hashed (files sharing their size with another file).
+ */
+@property (readonly) unsigned long long partiallyHashedFileCount;
+
+/**
+ The number of files that were hashed whole after their ends matched another file's.
+ */
+@property (readonly) unsigned long long fullyHashedFileCount;
+
+/**
+ The time taken by the search, in seconds.
+ */
+@property (readonly) NSTimeInterval duration;
+
+/**
+ Errors for the items that could not be read. Files that could not be read are not part of any group.
+ */
+@property (readonly) NSArray<NSError *> *errors;
+
+@end
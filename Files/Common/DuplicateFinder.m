@@ -0,0 +1,361 @@
+//
+//  DuplicateFinder.m
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+
+#import <errno.h>
+#import <fcntl.h>
+#import <pthread.h>
+#import <stdlib.h>
+#import <sys/stat.h>
+#import <unistd.h>
+#import "DuplicateFinder.h"
+#import "Directory.h"
+#import "DirectorySnapshot.h"
+#import "File.h"
+#import "FileHasher.h"
+#import "WorkerPool.h"
+#import "Path+Internal.h"
+#import "NSError+FilesAdditions.h"
+#import "NSException+FilesAdditions.h"
+
+#define DuplicateFinderDefaultPartialHashLength (4 * 1024)
+
+typedef struct
+{
+	unsigned long long size;
+	unsigned long long inode;
+	NSUInteger index;
+} DuplicateFinderCandidate;
+
+static int DuplicateFinderCompareCandidates(const void *first, const void *second);
+static BOOL DuplicateFinderAreSameFile(File *first, File *second);
+static NSData *DuplicateFinderPartialDigest(File *file, unsigned long long size, NSUInteger length);
+static NSArray<NSArray<NSNumber *> *> *DuplicateFinderSplitGroups(NSArray<NSArray<NSNumber *> *> *groups, NSDictionary<NSNumber *, NSData *> *digests);
+
+@implementation DuplicateFinder
+{
+	pthread_mutex_t _lock;
+	NSMutableArray<NSError *> *_mutableErrors;
+}
+
+#pragma mark Lifetime
+
+- (id)init
+{
+	return [self initWithWorkerCount:0];
+}
+
+- (id)initWithWorkerCount:(NSUInteger)workerCount
+{
+	self = [super init];
+	if (self)
+	{
+		_workerCount = (workerCount > 0 ? workerCount : [WorkerPool defaultWorkerCount]);
+		_partialHashLength = DuplicateFinderDefaultPartialHashLength;
+		_mutableErrors = [NSMutableArray array];
+		pthread_mutex_init(&_lock, NULL);
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	pthread_mutex_destroy(&_lock);
+}
+
+#pragma mark Configuration
+
+- (void)setPartialHashLength:(NSUInteger)partialHashLength
+{
+	if (partialHashLength == 0) @throw [NSException exceptionWithReason:@"The partial hash length must be greater than zero"];
+
+	_partialHashLength = partialHashLength;
+}
+
+#pragma mark Finding
+
+- (NSArray<NSArray<File *> *> *)duplicatesInDirectory:(Directory *)directory error:(NSError **)error
+{
+	if (directory == nil) @throw [NSException exceptionWithReason:@"Directory is nil"];
+
+	_partiallyHashedFileCount = 0;
+	_fullyHashedFileCount = 0;
+	[_mutableErrors removeAllObjects];
+	NSTimeInterval start = [[NSProcessInfo processInfo] systemUptime];
+
+	DirectorySnapshot *snapshot = [DirectorySnapshot snapshotOfDirectory:directory workerCount:_workerCount error:error];
+
+	if (snapshot == nil)
+	{
+		_duration = [[NSProcessInfo processInfo] systemUptime] - start;
+		return nil;
+	}
+
+	[_mutableErrors addObjectsFromArray:[snapshot errors]];
+
+	NSMutableDictionary<NSNumber *, File *> *files = [NSMutableDictionary dictionary];
+	NSMutableDictionary<NSNumber *, NSNumber *> *sizes = [NSMutableDictionary dictionary];
+
+	// Stage 1: sizes come from the snapshot, so files with a unique size are never opened
+	NSArray<NSArray<NSNumber *> *> *groups = [self sizeGroupsInSnapshot:snapshot directory:directory files:files sizes:sizes];
+
+	// Stage 2: the ends of each file. Small files are read whole here, which settles their groups right away.
+	NSDictionary<NSNumber *, NSData *> *partialDigests = [self partialDigestsOfFilesInGroups:groups files:files sizes:sizes];
+	groups = DuplicateFinderSplitGroups(groups, partialDigests);
+
+	NSMutableArray<NSArray<NSNumber *> *> *settledGroups = [NSMutableArray array];
+	NSMutableArray<NSArray<NSNumber *> *> *remainingGroups = [NSMutableArray array];
+
+	for (NSArray<NSNumber *> *group in groups)
+	{
+		BOOL readWhole = ([sizes[[group firstObject]] unsignedLongLongValue] <= 2 * (unsigned long long)_partialHashLength);
+		[(readWhole ? settledGroups : remainingGroups) addObject:group];
+	}
+
+	// Stage 3: a full hash of the files whose size and ends match
+	NSDictionary<NSNumber *, NSData *> *fullDigests = [self fullDigestsOfFilesInGroups:remainingGroups files:files];
+	[settledGroups addObjectsFromArray:DuplicateFinderSplitGroups(remainingGroups, fullDigests)];
+
+	// Snapshot indexes follow the order of paths
+	[settledGroups sortUsingComparator:^NSComparisonResult(NSArray<NSNumber *> *first, NSArray<NSNumber *> *second)
+	{
+		return [[first firstObject] compare:[second firstObject]];
+	}];
+
+	NSMutableArray<NSArray<File *> *> *duplicates = [NSMutableArray arrayWithCapacity:[settledGroups count]];
+	for (NSArray<NSNumber *> *group in settledGroups) [duplicates addObject:[files objectsForKeys:group notFoundMarker:[NSNull null]]];
+
+	_duration = [[NSProcessInfo processInfo] systemUptime] - start;
+	return duplicates;
+}
+
+#pragma mark Statistics
+
+- (NSArray<NSError *> *)errors
+{
+	return [_mutableErrors copy];
+}
+
+#pragma mark Stages
+
+- (NSArray<NSArray<NSNumber *> *> *)sizeGroupsInSnapshot:(DirectorySnapshot *)snapshot directory:(Directory *)directory files:(NSMutableDictionary<NSNumber *, File *> *)files sizes:(NSMutableDictionary<NSNumber *, NSNumber *> *)sizes
+{
+	NSUInteger entryCount = [snapshot count];
+	DuplicateFinderCandidate *candidates = malloc(MAX(entryCount, (NSUInteger)1) * sizeof(DuplicateFinderCandidate));
+	NSUInteger count = 0;
+
+	if (candidates == NULL) @throw [NSException exceptionWithReason:@"Could not allocate %lu candidates", (unsigned long)entryCount];
+
+	for (NSUInteger i = 0; i < entryCount; i++)
+	{
+		DirectorySnapshotEntry *entry = [snapshot entryAtIndex:i];
+		if ([entry type] != DirectorySnapshotItemTypeFile || [entry size] == 0) continue;
+
+		candidates[count++] = (DuplicateFinderCandidate){ [entry size], [entry inode], i };
+	}
+
+	// Sorting by size then inode puts hard links to the same file next to each other, the first path leading
+	qsort(candidates, count, sizeof(DuplicateFinderCandidate), DuplicateFinderCompareCandidates);
+
+	NSString *root = [directory absolutePath];
+	NSMutableArray<NSArray<NSNumber *> *> *groups = [NSMutableArray array];
+
+	for (NSUInteger start = 0, end; start < count; start = end)
+	{
+		for (end = start + 1; end < count && candidates[end].size == candidates[start].size; end++);
+		if (end - start < 2) continue;
+
+		NSMutableArray<NSNumber *> *group = [NSMutableArray arrayWithCapacity:end - start];
+		File *linkedFile = nil;
+
+		for (NSUInteger i = start; i < end; i++)
+		{
+			NSNumber *index = @(candidates[i].index);
+			File *file = [File itemWithAbsoluteParentPath:root name:[[snapshot entryAtIndex:candidates[i].index] path]];
+
+			// Inodes are only unique per file system, so equal inodes are confirmed before skipping a link
+			if (i > start && candidates[i].inode == candidates[i - 1].inode && DuplicateFinderAreSameFile(linkedFile, file)) continue;
+
+			linkedFile = file;
+			files[index] = file;
+			[group addObject:index];
+		}
+
+		if ([group count] < 2) continue;
+
+		for (NSNumber *index in group) sizes[index] = @(candidates[start].size);
+		[groups addObject:[group sortedArrayUsingSelector:@selector(compare:)]];
+	}
+
+	free(candidates);
+	return groups;
+}
+
+- (NSDictionary<NSNumber *, NSData *> *)partialDigestsOfFilesInGroups:(NSArray<NSArray<NSNumber *> *> *)groups files:(NSDictionary<NSNumber *, File *> *)files sizes:(NSDictionary<NSNumber *, NSNumber *> *)sizes
+{
+	NSMutableDictionary<NSNumber *, NSData *> *digests = [NSMutableDictionary dictionary];
+	WorkerPool *pool = [[WorkerPool alloc] initWithWorkerCount:_workerCount];
+	NSUInteger length = _partialHashLength;
+
+	for (NSArray<NSNumber *> *group in groups)
+	{
+		for (NSNumber *index in group)
+		{
+			File *file = files[index];
+			unsigned long long size = [sizes[index] unsignedLongLongValue];
+			_partiallyHashedFileCount++;
+
+			[pool addTask:^{
+				NSData *digest = DuplicateFinderPartialDigest(file, size, length);
+				NSError *error = (digest ? nil : [NSError errorWithPOSIXCode:errno description:@"Could not read %@ to compare it", [file absolutePath]]);
+
+				pthread_mutex_lock(&_lock);
+				if (digest) digests[index] = digest; else [_mutableErrors addObject:error];
+				pthread_mutex_unlock(&_lock);
+			}];
+		}
+	}
+
+	[pool waitUntilAllTasksAreFinished];
+	return digests;
+}
+
+- (NSDictionary<NSNumber *, NSData *> *)fullDigestsOfFilesInGroups:(NSArray<NSArray<NSNumber *> *> *)groups files:(NSDictionary<NSNumber *, File *> *)files
+{
+	NSMutableArray<File *> *filesToHash = [NSMutableArray array];
+	NSMutableDictionary<NSString *, NSNumber *> *indexes = [NSMutableDictionary dictionary];
+
+	for (NSArray<NSNumber *> *group in groups)
+	{
+		for (NSNumber *index in group)
+		{
+			[filesToHash addObject:files[index]];
+			indexes[[files[index] absolutePath]] = index;
+		}
+	}
+
+	if ([filesToHash count] == 0) return @{};
+	_fullyHashedFileCount = [filesToHash count];
+
+	NSArray<NSError *> *errors = nil;
+	NSDictionary<NSString *, NSData *> *digestsByPath = [FileHasher digestsOfFiles:filesToHash algorithm:FileHashAlgorithmSHA256 concurrentReads:_workerCount errors:&errors];
+	[_mutableErrors addObjectsFromArray:errors];
+
+	NSMutableDictionary<NSNumber *, NSData *> *digests = [NSMutableDictionary dictionaryWithCapacity:[digestsByPath count]];
+	[digestsByPath enumerateKeysAndObjectsUsingBlock:^(NSString *path, NSData *digest, BOOL *stop) { digests[indexes[path]] = digest; }];
+
+	return digests;
+}
+
+@end
+
+#pragma mark - Primitives
+
+static int DuplicateFinderCompareCandidates(const void *first, const void *second)
+{
+	const DuplicateFinderCandidate *a = first, *b = second;
+
+	if (a->size != b->size) return (a->size < b->size ? -1 : 1);
+	if (a->inode != b->inode) return (a->inode < b->inode ? -1 : 1);
+	return (a->index < b->index ? -1 : (a->index > b->index ? 1 : 0));
+}
+
+static BOOL DuplicateFinderAreSameFile(File *first, File *second)
+{
+	struct stat firstInfo, secondInfo;
+
+	return (lstat([[first absolutePath] fileSystemRepresentation], &firstInfo) == 0 &&
+	        lstat([[second absolutePath] fileSystemRepresentation], &secondInfo) == 0 &&
+	        firstInfo.st_dev == secondInfo.st_dev && firstInfo.st_ino == secondInfo.st_ino);
+}
+
+static BOOL DuplicateFinderReadAt(int descriptor, char *bytes, size_t count, off_t offset, size_t *readCount)
+{
+	size_t done = 0;
+
+	while (done < count)
+	{
+		ssize_t result = pread(descriptor, bytes + done, count - done, offset + (off_t)done);
+		if (result < 0 && errno == EINTR) continue;
+		if (result < 0) return NO;
+		if (result == 0) break; // The file shrank since the snapshot: what was read is hashed
+		done += (size_t)result;
+	}
+
+	*readCount = done;
+	return YES;
+}
+
+// Returns the SHA-256 of files up to twice the length (read whole, so the digest is final), or else
+// the XXH64 of the first and last length bytes. Returns nil with errno set on failure.
+static NSData *DuplicateFinderPartialDigest(File *file, unsigned long long size, NSUInteger length)
+{
+	int descriptor = open([[file absolutePath] fileSystemRepresentation], O_RDONLY | O_CLOEXEC);
+	if (descriptor < 0) return nil;
+
+	BOOL readWhole = (size <= 2 * (unsigned long long)length);
+	NSMutableData *buffer = [NSMutableData dataWithLength:(readWhole ? (NSUInteger)size : 2 * length)];
+	char *bytes = [buffer mutableBytes];
+	size_t headCount = 0, tailCount = 0;
+
+	BOOL success = (readWhole ? DuplicateFinderReadAt(descriptor, bytes, (size_t)size, 0, &headCount)
+	                          : (DuplicateFinderReadAt(descriptor, bytes, length, 0, &headCount) &&
+	                             DuplicateFinderReadAt(descriptor, bytes + length, length, (off_t)(size - length), &tailCount)));
+
+	int code = errno;
+	close(descriptor);
+
+	if (!success)
+	{
+		errno = code;
+		return nil;
+	}
+
+	if (readWhole)
+	{
+		[buffer setLength:headCount];
+		return [FileHasher digestOfData:buffer algorithm:FileHashAlgorithmSHA256];
+	}
+
+	if (headCount < length) memmove(bytes + headCount, bytes + length, tailCount);
+	[buffer setLength:headCount + tailCount];
+	return [FileHasher digestOfData:buffer algorithm:FileHashAlgorithmXXH64];
+}
+
+// Splits each group into the members that share a digest, dropping members without one and groups left with a single member
+static NSArray<NSArray<NSNumber *> *> *DuplicateFinderSplitGroups(NSArray<NSArray<NSNumber *> *> *groups, NSDictionary<NSNumber *, NSData *> *digests)
+{
+	NSMutableArray<NSArray<NSNumber *> *> *splitGroups = [NSMutableArray array];
+
+	for (NSArray<NSNumber *> *group in groups)
+	{
+		NSMutableDictionary<NSData *, NSMutableArray<NSNumber *> *> *subgroups = [NSMutableDictionary dictionary];
+		NSMutableArray<NSMutableArray<NSNumber *> *> *orderedSubgroups = [NSMutableArray array];
+
+		for (NSNumber *index in group)
+		{
+			NSData *digest = digests[index];
+			if (digest == nil) continue;
+
+			NSMutableArray<NSNumber *> *subgroup = subgroups[digest];
+
+			if (subgroup == nil)
+			{
+				subgroup = [NSMutableArray array];
+				subgroups[digest] = subgroup;
+				[orderedSubgroups addObject:subgroup];
+			}
+
+			[subgroup addObject:index];
+		}
+
+		for (NSArray<NSNumber *> *subgroup in orderedSubgroups)
+			if ([subgroup count] > 1) [splitGroups addObject:subgroup];
+	}
+
+	return splitGroups;
+}
@@ -0,0 +1,18 @@
+//
+//  File+Internal.h
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+//  Description: File reading primitives shared with the library's other classes. Not part of the public interface.
+//
+
+#import <sys/stat.h>
+#import "File.h"
+
+/**
+ Reads the open file (whose information is passed to size the buffer) into buffer, replacing its contents.
+ Returns NO with errno set on failure.
+ */
+extern BOOL FileReadDescriptorIntoBuffer(int descriptor, const struct stat *info, NSMutableData *buffer);
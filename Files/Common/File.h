@@ -8,6 +8,78 @@
 
 #import <Foundation/Foundation.h>
 #import "Path.h"
+#import "FileAppender.h"
+#import "FileCopier.h"
+#import "FileDecodeCache.h"
+#import "FileHasher.h"
+#import "FileIOQueue.h"
+#import "FileReader.h"
+
+/**
+ Options for -readDataWithOptions:error:.
+ */
+typedef NS_OPTIONS(NSUInteger, FileReadingOptions)
+{
+	FileReadingOptionsNone = 0,
+	
+	/**
+	 The file is mapped in memory instead of being copied to the heap, so its pages are only loaded when accessed
+	 and can be dropped by the system under memory pressure. Files smaller than the mapping threshold are read normally.
+	 The file must not be truncated while the returned data is in use.
+	 */
+	FileReadingMapped = 1 << 0,
+	
+	/**
+	 The mapped bytes will be accessed from start to end (aggressive read-ahead, pages released once read).
+	 */
+	FileReadingSequential = 1 << 1,
+	
+	/**
+	 The mapped bytes will all be needed soon, so the system starts loading them right away.
+	 */
+	FileReadingWillNeed = 1 << 2
+};
+
+/**
+ The size below which mapped reads fall back to a plain read, which is cheaper for small files.
+ */
+extern const unsigned long long FileReadingDefaultMappingThreshold;
+
+/**
+ How far written data is pushed towards permanent storage before a write returns. Writes are atomic at every
+ level: readers see either the previous contents or the new ones, never a partial file.
+ */
+typedef NS_ENUM(NSInteger, FileWritingDurability)
+{
+	/**
+	 The data is handed to the system, which writes it back on its own schedule.
+	 */
+	FileWritingDurabilityNone = 0,
+	
+	/**
+	 The file's data is forced to storage (fdatasync()) before it replaces the previous file.
+	 */
+	FileWritingDurabilityData,
+	
+	/**
+	 The file's data and the parent directory entry are forced to storage, so the new file survives a crash.
+	 */
+	FileWritingDurabilityFull
+};
+
+/**
+ How -archive:overwrite:compression:error: stores archives. Compressed archives start with a small header, so
+ -unarchive recognizes them and decompresses them transparently; archives without it are read as before.
+ */
+typedef NS_ENUM(NSInteger, FileArchiveCompression)
+{
+	FileArchiveCompressionNone = 0,
+	
+	/**
+	 Deflated with zlib at its fastest level, through a small buffer straight to the file.
+	 */
+	FileArchiveCompressionZlib
+};
 
 @interface File : Path
 
@@ -53,6 +125,12 @@
  */
 - (File *)copyTo:(Path *)destination overwrite:(BOOL)overwrite error:(NSError **)error;
 
+/**
+ Copies the file like -copyTo:overwrite:error: and reports how the data was copied. The cheapest method the
+ file system supports is used: a copy-on-write clone, then an in-kernel copy, then a user-space copy.
+ */
+- (File *)copyTo:(Path *)destination overwrite:(BOOL)overwrite method:(FileCopyMethod *)method error:(NSError **)error;
+
 
 /**
  Moves the file in a directory or to the specified file path.
@@ -66,6 +144,7 @@
 
 /**
  Moves the file in a directory or to the specified file path, optionally overwriting any existing file.
+ Within a volume this is a single rename; the data is only copied (then deleted) when moving to another volume.
  */
 - (File *)moveTo:(Path *)destination overwrite:(BOOL)overwrite error:(NSError **)error;
 
@@ -75,14 +154,78 @@
 
 - (NSData *)readData:(NSError **)error;
 
+/**
+ Reads the file as described by the options, mapping it in memory when it is at least
+ FileReadingDefaultMappingThreshold bytes long and FileReadingMapped is specified.
+ */
+- (NSData *)readDataWithOptions:(FileReadingOptions)options error:(NSError **)error;
+
+/**
+ Reads the file as described by the options, mapping it in memory when it is at least threshold bytes long.
+ */
+- (NSData *)readDataWithOptions:(FileReadingOptions)options mappingThreshold:(unsigned long long)threshold error:(NSError **)error;
+
+/**
+ Reads the file into buffer, replacing its contents. Reusing the same buffer across reads avoids
+ allocating memory unless a file is larger than any previously read.
+ */
+- (BOOL)readDataIntoBuffer:(NSMutableData *)buffer error:(NSError **)error;
+
 - (BOOL)writeData:(NSData *)data;
 
 - (BOOL)writeData:(NSData *)data overwrite:(BOOL)overwrite;
 
+/**
+ Writes the data atomically through a temporary file that replaces any existing item in a single rename.
+ */
 - (BOOL)writeData:(NSData *)data overwrite:(BOOL)overwrite error:(NSError **)error;
 
+/**
+ Writes the data atomically like -writeData:overwrite:error:, forcing it to storage as specified.
+ */
+- (BOOL)writeData:(NSData *)data overwrite:(BOOL)overwrite durability:(FileWritingDurability)durability error:(NSError **)error;
+
 - (NSOutputStream *)outputStreamToAppend:(BOOL)append;
 
+/**
+ Opens the file for buffered appending, creating it if needed. Prefer this to -outputStreamToAppend:
+ when writing many small records.
+ */
+- (FileAppender *)appender:(NSError **)error;
+
+#pragma mark Asynchronous Operations
+
+// These run on +[FileIOQueue sharedQueue], which batches reads through io_uring where available.
+// Completion handlers are called on an internal thread.
+
+- (void)readDataWithCompletion:(void (^)(NSData *data, NSError *error))completion;
+
+- (void)writeData:(NSData *)data overwrite:(BOOL)overwrite completion:(void (^)(BOOL success, NSError *error))completion;
+
+- (void)copyTo:(Path *)destination overwrite:(BOOL)overwrite completion:(void (^)(File *copy, NSError *error))completion;
+
+#pragma mark Streaming
+
+/**
+ Reads the file in chunks of the specified size through a single reused buffer. The chunk is only
+ valid during the block. Use a FileReader to read a byte range of the file.
+ */
+- (BOOL)enumerateChunksOfSize:(NSUInteger)chunkSize usingBlock:(void (^)(NSData *chunk, unsigned long long offset, BOOL *stop))block error:(NSError **)error;
+
+/**
+ Reads the file line by line as UTF-8, without loading it all in memory. Lines end with "\n" or "\r\n".
+ Use a FileReader to read a byte range of the file, raw line data or another encoding.
+ */
+- (BOOL)enumerateLinesUsingBlock:(void (^)(NSString *line, BOOL *stop))block error:(NSError **)error;
+
+#pragma mark Hashing
+
+/**
+ Returns the digest of the file's contents, streamed through a fixed-size buffer rather than read whole.
+ Use +[FileHasher digestsOfFiles:algorithm:concurrentReads:errors:] to hash many files at once.
+ */
+- (NSData *)digestWithAlgorithm:(FileHashAlgorithm)algorithm error:(NSError **)error;
+
 #pragma mark Keyed Archiving / Unarchiving
 
 /**
@@ -102,13 +245,20 @@
  */
 - (BOOL)archive:(id<NSCoding>)object overwrite:(BOOL)overwrite error:(NSError **)error;
 
+/**
+ Archives the object in the file like -archive:overwrite:error:, optionally compressed.
+ */
+- (BOOL)archive:(id<NSCoding>)object overwrite:(BOOL)overwrite compression:(FileArchiveCompression)compression error:(NSError **)error;
+
 /**
  Unarchives the file into an instance of the object that was originally archived.
  */
 - (id)unarchive;
 
 /**
- Unarchives the file into an instance of the object that was originally archived.
+ Unarchives the file into an instance of the object that was originally archived, decompressing it if needed.
+ When the shared FileDecodeCache is enabled, immutable objects (including containers that only hold immutable
+ objects) are shared with other callers until the file changes. Anything else is decoded again for every call.
  */
 - (id)unarchive:(NSError **)error;
 
@@ -149,18 +299,49 @@
 
 #pragma mark Reading/Writing Arrays
 
+/**
+ Reads an array from an XML or binary property list file, detecting the format.
+ */
 - (NSArray *)readArray;
 
+/**
+ Reads an array like -readArray, except that a binary property list is mapped in memory and its elements are only
+ decoded when accessed. XML property lists are parsed fully. The file must not change while the array is in use.
+ */
+- (NSArray *)readArrayLazily;
+
 - (BOOL)writeArray:(NSArray *)array;
 
 - (BOOL)writeArray:(NSArray *)array overwrite:(BOOL)overwrite;
 
+/**
+ Writes the array as a property list in the specified format (XML or binary). Binary files are smaller and faster to
+ write and read than XML ones, and can be read lazily.
+ */
+- (BOOL)writeArray:(NSArray *)array overwrite:(BOOL)overwrite format:(NSPropertyListFormat)format;
+
 #pragma mark Reading/Writing Dictionaries
 
+/**
+ Reads a dictionary from an XML or binary property list file, detecting the format.
+ */
 - (NSDictionary *)readDictionary;
 
+/**
+ Reads a dictionary like -readDictionary, except that a binary property list is mapped in memory and only the values
+ looked up are decoded (keys are matched without being decoded). XML property lists are parsed fully. The file must
+ not change while the dictionary is in use.
+ */
+- (NSDictionary *)readDictionaryLazily;
+
 - (BOOL)writeDictionary:(NSDictionary *)dictionary;
 
 - (BOOL)writeDictionary:(NSDictionary *)dictionary overwrite:(BOOL)overwrite;
 
+/**
+ Writes the dictionary as a property list in the specified format (XML or binary). Binary files are smaller and faster
+ to write and read than XML ones, and can be read lazily.
+ */
+- (BOOL)writeDictionary:(NSDictionary *)dictionary overwrite:(BOOL)overwrite format:(NSPropertyListFormat)format;
+
 @end
@@ -6,11 +6,40 @@
 //  Copyright (c) 2013 irradiated.net. All rights reserved.
 //
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // O_TMPFILE
+#endif
+
+#import <errno.h>
+#import <fcntl.h>
+#import <limits.h>
+#import <stdint.h>
+#import <stdio.h>
+#import <string.h>
+#import <sys/mman.h>
+#import <sys/stat.h>
+#import <unistd.h>
 #import "File.h"
+#import "File+Internal.h"
 #import "Directory.h"
+#import "FileCompression.h"
+#import "LazyPropertyList.h"
+#import "MappedData.h"
+#import "Path+Internal.h"
 #import "NSError+FilesAdditions.h"
 #import "NSException+FilesAdditions.h"
 
+// Mapping a file costs a system call plus a page fault per page touched, which only pays off once
+// the file is large enough that copying it to the heap dominates
+const unsigned long long FileReadingDefaultMappingThreshold = 256 * 1024;
+
+// Writes the contents of a new file to its descriptor, returning NO with errno set on failure
+typedef BOOL (^FileContentsWriter)(int descriptor);
+
+static BOOL FileObjectIsImmutable(id object);
+static BOOL FileWriteAll(int descriptor, const char *bytes, size_t length);
+static BOOL FileWriteItemAtomically(const char *path, FileContentsWriter writer, BOOL overwrite, FileWritingDurability durability);
+
 @implementation File
 
 #pragma mark Creation
@@ -97,6 +126,11 @@
 }
 
 - (File *)copyTo:(Path *)destination overwrite:(BOOL)overwrite error:(NSError **)error
+{
+	return [self copyTo:destination overwrite:overwrite method:NULL error:error];
+}
+
+- (File *)copyTo:(Path *)destination overwrite:(BOOL)overwrite method:(FileCopyMethod *)method error:(NSError **)error
 {
     if (destination == nil)
     @throw [NSException exceptionWithReason:@"Destination is nil"];
@@ -105,27 +139,21 @@
     if ([[destination absolutePath] isEqual:[self absolutePath]])
     @throw [NSException exceptionWithReason:@"Trying to copy to same path"];
     
-    if ([destination isKindOfClass:[Directory class]])
-    {
-        Directory *directory = (Directory *)destination;
-        
-        // If overwriting and we need to create a directory, delete whatever's at the path directory points to
-        if (overwrite) [directory delete];
-        
-        destination = [directory file:[self name]];
-    }
+    File *destinationFile = [self destinationFileForPath:destination overwrite:overwrite];
+    if (![destinationFile createParentDirectory:error]) return nil;
     
     NSError *innerError = nil;
-    Path *path = [super copyTo:destination overwrite:overwrite error:&innerError];
+    FileCopyMethod usedMethod = [FileCopier copyFileAtPath:[self absolutePath] toPath:[destinationFile absolutePath] overwrite:overwrite firstMethod:FileCopyMethodClone error:&innerError];
+    if (method) *method = usedMethod;
     
-    if (path == nil || innerError)
+    if (usedMethod == FileCopyMethodNone)
     {
         NSLog(@"%@", [innerError description]);
         if (error) *error = innerError;
         return nil;
     }
     
-    return [File fileWithPath:[path absolutePath]];
+    return destinationFile;
 }
 
 - (File *)moveTo:(Path *)destination
@@ -155,8 +183,24 @@
 		return nil;
 	}
 	
+	File *destinationFile = [self destinationFileForPath:destination overwrite:overwrite];
+	if (![destinationFile createParentDirectory:error]) return nil;
+	
+	// Moving within a volume is a single metadata change; only moves across volumes copy data
+	if (PathRenameItem([[self absolutePath] fileSystemRepresentation], [[destinationFile absolutePath] fileSystemRepresentation], overwrite))
+		return destinationFile;
+	
+	if (errno != EXDEV)
+	{
+		int code = errno;
+		NSError *innerError = [NSError errorWithPOSIXCode:code description:@"Could not move file at path %@ to %@", [self absolutePath], [destinationFile absolutePath]];
+		NSLog(@"%@", [innerError description]);
+		if (error) *error = innerError;
+		return nil;
+	}
+	
 	NSError *innerError = nil;
-	File *outputFile = [self copyTo:destination overwrite:overwrite error:&innerError];
+	File *outputFile = [self copyTo:destinationFile overwrite:overwrite error:&innerError];
 	
 	if (innerError)
 	{
@@ -187,19 +231,77 @@
 
 - (NSData *)readData:(NSError **)error
 {
-	NSData *data = [NSData dataWithContentsOfFile:[self absolutePath]];
+	return [self readDataWithOptions:FileReadingOptionsNone error:error];
+}
+
+- (NSData *)readDataWithOptions:(FileReadingOptions)options error:(NSError **)error
+{
+	return [self readDataWithOptions:options mappingThreshold:FileReadingDefaultMappingThreshold error:error];
+}
+
+- (NSData *)readDataWithOptions:(FileReadingOptions)options mappingThreshold:(unsigned long long)threshold error:(NSError **)error
+{
+	NSData *data = nil;
+	struct stat info;
+	int descriptor = open([[self absolutePath] fileSystemRepresentation], O_RDONLY | O_CLOEXEC);
+	
+	if (descriptor >= 0 && fstat(descriptor, &info) == 0)
+	{
+		unsigned long long size = (unsigned long long)info.st_size;
+		BOOL map = ((options & FileReadingMapped) && S_ISREG(info.st_mode) && size > 0 && size >= threshold && size <= SIZE_MAX);
+		
+		MappedData *mappedData = (map ? [[MappedData alloc] initWithFileDescriptor:descriptor length:(size_t)size] : nil);
+		
+		if (mappedData)
+		{
+			if (options & FileReadingSequential) [mappedData advise:MADV_SEQUENTIAL];
+			if (options & FileReadingWillNeed) [mappedData advise:MADV_WILLNEED];
+			data = mappedData;
+		}
+		else
+		{
+			// Also used when mapping fails, since some file systems don't support it
+			NSMutableData *buffer = [NSMutableData data];
+			if (FileReadDescriptorIntoBuffer(descriptor, &info, buffer)) data = buffer;
+		}
+	}
+	
+	int code = errno;
+	if (descriptor >= 0) close(descriptor);
 	
 	if (!data)
 	{
-		NSString *description = [NSString stringWithFormat:@"Could not read data from %@", [self absolutePath]];
-		NSLog(@"%@", description);
-		if (error) *error = [NSError errorWithDescription:@"%@", description];
+		NSError *innerError = [NSError errorWithPOSIXCode:code description:@"Could not read data from %@", [self absolutePath]];
+		NSLog(@"%@", [innerError description]);
+		if (error) *error = innerError;
 		return nil;
 	}
 	
 	return data;
 }
 
+- (BOOL)readDataIntoBuffer:(NSMutableData *)buffer error:(NSError **)error
+{
+	if (buffer == nil) @throw [NSException exceptionWithReason:@"No buffer to read into!"];
+	
+	struct stat info;
+	int descriptor = open([[self absolutePath] fileSystemRepresentation], O_RDONLY | O_CLOEXEC);
+	BOOL success = (descriptor >= 0 && fstat(descriptor, &info) == 0 && FileReadDescriptorIntoBuffer(descriptor, &info, buffer));
+	
+	int code = errno;
+	if (descriptor >= 0) close(descriptor);
+	
+	if (!success)
+	{
+		NSError *innerError = [NSError errorWithPOSIXCode:code description:@"Could not read data from %@", [self absolutePath]];
+		NSLog(@"%@", [innerError description]);
+		if (error) *error = innerError;
+		return NO;
+	}
+	
+	return YES;
+}
+
 - (BOOL)writeData:(NSData *)data
 {
 	return [self writeData:data overwrite:NO];
@@ -212,37 +314,41 @@
 
 - (BOOL)writeData:(NSData *)data overwrite:(BOOL)overwrite error:(NSError **)error
 {
-    if (data == nil) @throw [NSException exceptionWithReason:@"No data to write!"];
-    
-    if (!overwrite && [self itemExists])
-    {
-        NSString *description = [NSString stringWithFormat:@"Can't write data: A file already exists at path %@", [self absolutePath]];
-        NSLog(@"%@", description);
-        if (error) *error = [NSError errorWithDescription:@"%@", description];
-        return NO;
-    }
-    
-    if (overwrite)
-    {
-        if (![self delete])
-        {
-            NSString *description = [NSString stringWithFormat:@"Could not delete existing file at path %@", [self absolutePath]];
-            NSLog(@"%@", description);
-            if (error) *error = [NSError errorWithDescription:@"%@", description];
-            return NO;
-        }
-    }
-    
-    Directory *parent = [self parent];
-    if (![parent create])
-    {
-        NSString *description = [NSString stringWithFormat:@"Could not create intermediary directories for path %@", [parent absolutePath]];
-        NSLog(@"%@", description);
-        if (error) *error = [NSError errorWithDescription:@"%@", description];
-        return NO;
-    }
-    
-    return [data writeToFile:[self absolutePath] atomically:YES];
+	return [self writeData:data overwrite:overwrite durability:FileWritingDurabilityNone error:error];
+}
+
+- (BOOL)writeData:(NSData *)data overwrite:(BOOL)overwrite durability:(FileWritingDurability)durability error:(NSError **)error
+{
+	if (data == nil) @throw [NSException exceptionWithReason:@"No data to write!"];
+	
+	return [self writeContentsUsingWriter:^BOOL(int descriptor) { return FileWriteAll(descriptor, [data bytes], [data length]); } overwrite:overwrite durability:durability error:error];
+}
+
+- (BOOL)writeContentsUsingWriter:(FileContentsWriter)writer overwrite:(BOOL)overwrite durability:(FileWritingDurability)durability error:(NSError **)error
+{
+	const char *path = [[self absolutePath] fileSystemRepresentation];
+	BOOL written = FileWriteItemAtomically(path, writer, overwrite, durability);
+	
+	// Intermediary directories are only looked at once they turn out to be missing
+	if (!written && errno == ENOENT)
+	{
+		if (![self createParentDirectory:error]) return NO;
+		written = FileWriteItemAtomically(path, writer, overwrite, durability);
+	}
+	
+	if (!written)
+	{
+		int code = errno;
+		NSError *innerError = (code == EEXIST ?
+			[NSError errorWithPOSIXCode:code description:@"Can't write data: A file already exists at path %@", [self absolutePath]] :
+			[NSError errorWithPOSIXCode:code description:@"Could not write data to %@", [self absolutePath]]);
+		
+		NSLog(@"%@", [innerError description]);
+		if (error) *error = innerError;
+		return NO;
+	}
+	
+	return YES;
 }
 
 - (NSOutputStream *)outputStreamToAppend:(BOOL)append
@@ -250,6 +356,47 @@
 	return [NSOutputStream outputStreamToFileAtPath:[self absolutePath] append:append];
 }
 
+- (FileAppender *)appender:(NSError **)error
+{
+	return [FileAppender appenderWithFile:self error:error];
+}
+
+#pragma mark Asynchronous Operations
+
+- (void)readDataWithCompletion:(void (^)(NSData *data, NSError *error))completion
+{
+	[[FileIOQueue sharedQueue] readDataOfFile:self completion:completion];
+}
+
+- (void)writeData:(NSData *)data overwrite:(BOOL)overwrite completion:(void (^)(BOOL success, NSError *error))completion
+{
+	[[FileIOQueue sharedQueue] writeData:data toFile:self overwrite:overwrite completion:completion];
+}
+
+- (void)copyTo:(Path *)destination overwrite:(BOOL)overwrite completion:(void (^)(File *copy, NSError *error))completion
+{
+	[[FileIOQueue sharedQueue] copyFile:self to:destination overwrite:overwrite completion:completion];
+}
+
+#pragma mark Streaming
+
+- (BOOL)enumerateChunksOfSize:(NSUInteger)chunkSize usingBlock:(void (^)(NSData *chunk, unsigned long long offset, BOOL *stop))block error:(NSError **)error
+{
+	return [[FileReader readerWithFile:self] enumerateChunksOfSize:chunkSize usingBlock:block error:error];
+}
+
+- (BOOL)enumerateLinesUsingBlock:(void (^)(NSString *line, BOOL *stop))block error:(NSError **)error
+{
+	return [[FileReader readerWithFile:self] enumerateLinesUsingBlock:block error:error];
+}
+
+#pragma mark Hashing
+
+- (NSData *)digestWithAlgorithm:(FileHashAlgorithm)algorithm error:(NSError **)error
+{
+	return [FileHasher digestOfFile:self algorithm:algorithm error:error];
+}
+
 #pragma mark Keyed Archiving / Unarchiving
 
 - (BOOL)archive:(id<NSCoding>)object
@@ -264,7 +411,12 @@
 
 - (BOOL)archive:(id<NSCoding>)object overwrite:(BOOL)overwrite error:(NSError **)error
 {
-	return [self archiveInternal:object overwrite:overwrite format:NSPropertyListBinaryFormat_v1_0 error:error];
+	return [self archiveInternal:object overwrite:overwrite format:NSPropertyListBinaryFormat_v1_0 compression:FileArchiveCompressionNone error:error];
+}
+
+- (BOOL)archive:(id<NSCoding>)object overwrite:(BOOL)overwrite compression:(FileArchiveCompression)compression error:(NSError **)error
+{
+	return [self archiveInternal:object overwrite:overwrite format:NSPropertyListBinaryFormat_v1_0 compression:compression error:error];
 }
 
 - (id)unarchive
@@ -274,7 +426,16 @@
 
 - (id)unarchive:(NSError **)error
 {
-	return [self unarchiveInternalWithError:error];
+	FileDecodeCache *cache = [FileDecodeCache sharedCache];
+	if (![cache isEnabled]) return [self unarchiveInternalWithDecodedLength:NULL error:error];
+	
+	return [cache objectForFile:self kind:@"archive" decoder:^id(unsigned long long *cost, NSError **decodeError)
+	{
+		// Archives can hold mutable objects, which callers would see each other change if they were shared
+		id object = [self unarchiveInternalWithDecodedLength:cost error:decodeError];
+		if (object && !FileObjectIsImmutable(object)) *cost = FileDecodeCacheUnsharedCost;
+		return object;
+	} error:error];
 }
 
 #pragma mark Keyed Archiving / Unarchiving (Plist)
@@ -291,7 +452,7 @@
 
 - (BOOL)archiveAsXMLPlist:(id<NSCoding>)object overwrite:(BOOL)overwrite error:(NSError **)error
 {
-	return [self archiveInternal:object overwrite:overwrite format:NSPropertyListXMLFormat_v1_0 error:error];
+	return [self archiveInternal:object overwrite:overwrite format:NSPropertyListXMLFormat_v1_0 compression:FileArchiveCompressionNone error:error];
 }
 
 - (id)unarchiveFromXMLPlist
@@ -301,22 +462,37 @@
 
 - (id)unarchiveFromXMLPlist:(NSError **)error
 {
-	return [self unarchiveInternalWithError:error];
+	return [self unarchive:error];
 }
 
 #pragma mark Keyed Archiving / Unarchiving (Internal)
 
-- (BOOL)archiveInternal:(id<NSCoding>)object overwrite:(BOOL)overwrite format:(NSPropertyListFormat)format error:(NSError **)error
+- (BOOL)archiveInternal:(id<NSCoding>)object overwrite:(BOOL)overwrite format:(NSPropertyListFormat)format compression:(FileArchiveCompression)compression error:(NSError **)error
 {
 	NSError *innerError = nil;
-	
 	NSMutableData *data = [NSMutableData data];
-	NSKeyedArchiver *archiver = [[NSKeyedArchiver alloc] initForWritingWithMutableData:data];
-	[archiver setOutputFormat:format];
-	[archiver encodeObject:object forKey:@"root"];
-	[archiver finishEncoding];
 	
-	BOOL success = [self writeData:data overwrite:overwrite error:&innerError];
+	// The archiver's object table is released before writing, leaving only the encoded data in memory
+	@autoreleasepool
+	{
+		NSKeyedArchiver *archiver = [[NSKeyedArchiver alloc] initForWritingWithMutableData:data];
+		[archiver setOutputFormat:format];
+		[archiver encodeObject:object forKey:@"root"];
+		[archiver finishEncoding];
+	}
+	
+	BOOL success;
+	
+	if (compression == FileArchiveCompressionZlib)
+	{
+		// Deflated straight to the file through a small buffer rather than into another copy of the archive
+		FileContentsWriter writer = ^BOOL(int descriptor) { return FileCompressionWriteDeflated(descriptor, [data bytes], [data length]); };
+		success = [self writeContentsUsingWriter:writer overwrite:overwrite durability:FileWritingDurabilityNone error:&innerError];
+	}
+	else
+	{
+		success = [self writeData:data overwrite:overwrite error:&innerError];
+	}
 	
 	if (innerError)
 	{
@@ -327,13 +503,17 @@
 	return success;
 }
 
-- (id<NSCoding>)unarchiveInternalWithError:(NSError **)error
+/**
+ Reports the length of the archive that was decoded, inflated if it was compressed.
+ */
+- (id<NSCoding>)unarchiveInternalWithDecodedLength:(unsigned long long *)decodedLength error:(NSError **)error
 {
 	NSError *innerError = nil;
 	id<NSCoding> object = nil;
 	
 	@try
 	{
+		// Read to the heap rather than mapped, so that another process truncating the file can't crash the decoding
 		NSData *data = [self readData:&innerError];
 		
 		if (!data)
@@ -342,6 +522,21 @@
 			return nil;
 		}
 		
+		if (FileCompressionIsCompressed(data))
+		{
+			data = FileCompressionInflate(data);
+			
+			if (!data)
+			{
+				int code = errno;
+				NSError *inflateError = [NSError errorWithPOSIXCode:code description:@"Could not decompress archive %@", [self absolutePath]];
+				NSLog(@"%@", [inflateError description]);
+				if (error) *error = inflateError;
+				return nil;
+			}
+		}
+		
+		if (decodedLength) *decodedLength = [data length];
 		object = [NSKeyedUnarchiver unarchiveObjectWithData:data];
 		
 		if (!object)
@@ -372,9 +567,9 @@
 
 - (NSString *)readStringWithEncoding:(NSStringEncoding)encoding
 {
-	NSError *error;
-	NSString *string = [NSString stringWithContentsOfFile:[self absolutePath] encoding:encoding error:&error];
-	if (error) NSLog(@"Could not read contents of file %@ with encoding %lu", [self path], (unsigned long)encoding);
+	NSData *data = [self readData:nil];
+	NSString *string = (data ? [[NSString alloc] initWithData:data encoding:encoding] : nil);
+	if (!string) NSLog(@"Could not read contents of file %@ with encoding %lu", [self path], (unsigned long)encoding);
 	return string;
 }
 
@@ -382,40 +577,309 @@
 
 - (NSArray *)readArray
 {
-	NSArray *array = [NSArray arrayWithContentsOfFile:[self absolutePath]];
+	NSArray *array = [self readPropertyListOfClass:[NSArray class]];
+	if (!array) NSLog(@"Could not load array from file %@", [self path]);
+	return array;
+}
+
+- (NSArray *)readArrayLazily
+{
+	NSArray *array = [self decodePropertyListOfClass:[NSArray class] lazily:YES decodedLength:NULL];
 	if (!array) NSLog(@"Could not load array from file %@", [self path]);
 	return array;
 }
 
 - (BOOL)writeArray:(NSArray *)array
 {
-	return [array writeToFile:[self absolutePath] atomically:YES];
+	return [self writeArray:array overwrite:YES];
 }
 
 - (BOOL)writeArray:(NSArray *)array overwrite:(BOOL)overwrite
 {
-	if (!overwrite && [self exists]) return NO;
-	return [array writeToFile:[self absolutePath] atomically:YES];
+	return [self writePropertyList:array overwrite:overwrite format:NSPropertyListXMLFormat_v1_0];
+}
+
+- (BOOL)writeArray:(NSArray *)array overwrite:(BOOL)overwrite format:(NSPropertyListFormat)format
+{
+	return [self writePropertyList:array overwrite:overwrite format:format];
 }
 
 #pragma mark Reading/Writing Dictionaries
 
 - (NSDictionary *)readDictionary
 {
-	NSDictionary *dictionary = [NSDictionary dictionaryWithContentsOfFile:[self absolutePath]];
+	NSDictionary *dictionary = [self readPropertyListOfClass:[NSDictionary class]];
+	if (!dictionary) NSLog(@"Could not load dictionary from file %@", [self path]);
+	return dictionary;
+}
+
+- (NSDictionary *)readDictionaryLazily
+{
+	NSDictionary *dictionary = [self decodePropertyListOfClass:[NSDictionary class] lazily:YES decodedLength:NULL];
 	if (!dictionary) NSLog(@"Could not load dictionary from file %@", [self path]);
 	return dictionary;
 }
 
 - (BOOL)writeDictionary:(NSDictionary *)dictionary
 {
-	return [dictionary writeToFile:[self absolutePath] atomically:YES];
+	return [self writeDictionary:dictionary overwrite:YES];
 }
 
 - (BOOL)writeDictionary:(NSDictionary *)dictionary overwrite:(BOOL)overwrite
 {
-	if (!overwrite && [self exists]) return NO;
-	return [dictionary writeToFile:[self absolutePath] atomically:YES];
+	return [self writePropertyList:dictionary overwrite:overwrite format:NSPropertyListXMLFormat_v1_0];
+}
+
+- (BOOL)writeDictionary:(NSDictionary *)dictionary overwrite:(BOOL)overwrite format:(NSPropertyListFormat)format
+{
+	return [self writePropertyList:dictionary overwrite:overwrite format:format];
+}
+
+#pragma mark Private
+
+- (id)readPropertyListOfClass:(Class)class
+{
+	FileDecodeCache *cache = [FileDecodeCache sharedCache];
+	if (![cache isEnabled]) return [self decodePropertyListOfClass:class lazily:NO decodedLength:NULL];
+	
+	return [cache objectForFile:self kind:NSStringFromClass(class) decoder:^id(unsigned long long *cost, NSError **error) { return [self decodePropertyListOfClass:class lazily:NO decodedLength:cost]; } error:nil];
+}
+
+- (id)decodePropertyListOfClass:(Class)class lazily:(BOOL)lazily decodedLength:(unsigned long long *)decodedLength
+{
+	// Mapping is only used when asked for, since another process truncating a mapped file crashes its readers
+	NSData *data = [self readDataWithOptions:(lazily ? FileReadingMapped : FileReadingOptionsNone) error:nil];
+	if (!data) return nil;
+	if (decodedLength) *decodedLength = [data length];
+	
+	// Only binary property lists can be decoded on access; anything else is parsed fully
+	id propertyList = (lazily ? LazyPropertyListWithData(data) : nil);
+	if (!propertyList) propertyList = [NSPropertyListSerialization propertyListWithData:data options:NSPropertyListImmutable format:NULL error:nil];
+	
+	return ([propertyList isKindOfClass:class] ? propertyList : nil);
+}
+
+- (BOOL)writePropertyList:(id)propertyList overwrite:(BOOL)overwrite format:(NSPropertyListFormat)format
+{
+	NSError *error = nil;
+	NSData *data = [NSPropertyListSerialization dataWithPropertyList:propertyList format:format options:0 error:&error];
+	
+	if (!data)
+	{
+		NSLog(@"Could not serialize property list for file %@: %@", [self path], error);
+		return NO;
+	}
+	
+	return [self writeData:data overwrite:overwrite error:nil];
+}
+
+- (File *)destinationFileForPath:(Path *)destination overwrite:(BOOL)overwrite
+{
+	if (![destination isKindOfClass:[Directory class]]) return [File fileWithPath:[destination absolutePath]];
+	
+	Directory *directory = (Directory *)destination;
+	
+	// If overwriting and we need to create a directory, delete whatever's at the path directory points to
+	if (overwrite) [directory delete];
+	
+	return [directory file:[self name]];
 }
 
 @end
+
+#pragma mark - Reading Primitive
+
+BOOL FileReadDescriptorIntoBuffer(int descriptor, const struct stat *info, NSMutableData *buffer)
+{
+	// One extra byte lets the end of file be detected without growing the buffer; files that report
+	// a wrong size (procfs, files being appended to) simply grow it
+	NSUInteger length = 0;
+	[buffer setLength:(NSUInteger)MAX(info->st_size, (off_t)0) + 1];
+	
+	while (YES)
+	{
+		if (length == [buffer length]) [buffer setLength:length * 2];
+		
+		ssize_t count = read(descriptor, (char *)[buffer mutableBytes] + length, [buffer length] - length);
+		if (count < 0 && errno == EINTR) continue;
+		if (count < 0) return NO;
+		if (count == 0) break;
+		
+		length += (NSUInteger)count;
+	}
+	
+	[buffer setLength:length];
+	return YES;
+}
+
+#pragma mark - Decoding Primitive
+
+/**
+ Whether the object and everything it contains can be shared safely. Immutable Foundation objects return
+ themselves from -copy; containers must also hold only immutable objects.
+ */
+static BOOL FileObjectIsImmutable(id object)
+{
+	if (![object conformsToProtocol:@protocol(NSCopying)] || [object copy] != object) return NO;
+	
+	if ([object isKindOfClass:[NSDictionary class]])
+	{
+		for (id key in object)
+			if (!FileObjectIsImmutable(object[key])) return NO;
+	}
+	else if ([object isKindOfClass:[NSArray class]] || [object isKindOfClass:[NSSet class]] || [object isKindOfClass:[NSOrderedSet class]])
+	{
+		for (id element in object)
+			if (!FileObjectIsImmutable(element)) return NO;
+	}
+	
+	return YES;
+}
+
+#pragma mark - Writing Primitive
+
+static BOOL FileWriteAll(int descriptor, const char *bytes, size_t length)
+{
+	while (length > 0)
+	{
+		ssize_t written = write(descriptor, bytes, length);
+		if (written < 0 && errno == EINTR) continue;
+		if (written < 0) return NO;
+		
+		bytes += written;
+		length -= (size_t)written;
+	}
+	
+	return YES;
+}
+
+static int FileSyncData(int descriptor)
+{
+#if defined(__APPLE__)
+	return fsync(descriptor);
+#else
+	return fdatasync(descriptor);
+#endif
+}
+
+static BOOL FileSyncDirectory(const char *path)
+{
+	int descriptor = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (descriptor < 0) return NO;
+	
+	BOOL synced = (fsync(descriptor) == 0);
+	int code = errno;
+	close(descriptor);
+	errno = code;
+	
+	return synced;
+}
+
+// Writes the contents, syncs them as required by the durability and closes the descriptor (even on failure)
+static BOOL FileWriteAndClose(int descriptor, FileContentsWriter writer, FileWritingDurability durability)
+{
+	BOOL success = (writer(descriptor) && (durability == FileWritingDurabilityNone || FileSyncData(descriptor) == 0));
+	int code = errno;
+	
+	if (close(descriptor) != 0 && success)
+	{
+		success = NO;
+		code = errno;
+	}
+	
+	errno = code;
+	return success;
+}
+
+// Creates a uniquely named hidden file next to path (name points to the last component of path)
+static int FileOpenTemporaryFile(const char *path, const char *name, char *temporaryPath, size_t size)
+{
+	static volatile uint32_t counter = 0;
+	
+	for (int attempt = 0; attempt < 100; attempt++)
+	{
+		unsigned int unique = __sync_fetch_and_add(&counter, 1);
+		int length = snprintf(temporaryPath, size, "%.*s.%.200s.%ld.%u.tmp", (int)(name - path), path, name, (long)getpid(), unique);
+		if (length < 0 || (size_t)length >= size) { errno = ENAMETOOLONG; return -1; }
+		
+		int descriptor = open(temporaryPath, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+		if (descriptor >= 0 || errno != EEXIST) return descriptor;
+	}
+	
+	return -1;
+}
+
+#if defined(O_TMPFILE)
+// An unnamed file only gets a name once it is complete, and linkat() refuses to replace an existing
+// item, so nothing needs to be renamed or cleaned up. Fails with ENOTSUP where this isn't possible.
+static BOOL FileWriteUnnamedFile(const char *parent, const char *path, FileContentsWriter writer, FileWritingDurability durability)
+{
+	int descriptor = open(parent, O_TMPFILE | O_WRONLY | O_CLOEXEC, 0666);
+	
+	if (descriptor < 0)
+	{
+		if (errno == EISDIR || errno == EOPNOTSUPP || errno == EINVAL) errno = ENOTSUP;
+		return NO;
+	}
+	
+	if (!writer(descriptor) || (durability != FileWritingDurabilityNone && FileSyncData(descriptor) != 0))
+	{
+		int code = errno;
+		close(descriptor);
+		errno = code;
+		return NO;
+	}
+	
+	char descriptorPath[64];
+	snprintf(descriptorPath, sizeof(descriptorPath), "/proc/self/fd/%d", descriptor);
+	
+	BOOL linked = (linkat(AT_FDCWD, descriptorPath, AT_FDCWD, path, AT_SYMLINK_FOLLOW) == 0);
+	int code = errno;
+	close(descriptor);
+	
+	// Without /proc, the file can't be given a name
+	errno = (linked || code == EEXIST ? code : ENOTSUP);
+	return linked;
+}
+#endif
+
+static BOOL FileWriteItemAtomically(const char *path, FileContentsWriter writer, BOOL overwrite, FileWritingDurability durability)
+{
+	const char *name = strrchr(path, '/');
+	size_t parentLength = (name == path ? 1 : (size_t)(name - path));
+	char parent[PATH_MAX];
+	
+	if (name == NULL || name[1] == '\0' || parentLength >= sizeof(parent)) { errno = EINVAL; return NO; }
+	
+	memcpy(parent, path, parentLength);
+	parent[parentLength] = '\0';
+	name++;
+	
+	BOOL written = NO;
+	
+#if defined(O_TMPFILE)
+	if (!overwrite)
+	{
+		written = FileWriteUnnamedFile(parent, path, writer, durability);
+		if (!written && errno != ENOTSUP) return NO;
+	}
+#endif
+	
+	if (!written)
+	{
+		char temporaryPath[PATH_MAX];
+		int descriptor = FileOpenTemporaryFile(path, name, temporaryPath, sizeof(temporaryPath));
+		if (descriptor < 0) return NO;
+		
+		if (!FileWriteAndClose(descriptor, writer, durability) || !PathRenameItem(temporaryPath, path, overwrite))
+		{
+			int code = errno;
+			unlink(temporaryPath);
+			errno = code;
+			return NO;
+		}
+	}
+	
+	// The new name only survives a crash once the directory holding it has been synced too
+	return (durability != FileWritingDurabilityFull || FileSyncDirectory(parent));
+}
@@ -0,0 +1,110 @@
+//
+//  FileAppender.h
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+//  Description: Appends to a file through a large in-memory buffer, so that many small records become
+//               a few large writes. Can be shared between threads.
+//
+
+#import <Foundation/Foundation.h>
+
+@class File;
+
+/**
+ When appended data is forced to permanent storage (it always reaches the system when the buffer is written).
+ */
+typedef NS_ENUM(NSInteger, FileAppenderSyncPolicy)
+{
+	/**
+	 Data is never forced to storage; the system writes it back on its own schedule.
+	 */
+	FileAppenderSyncNone = 0,
+	
+	/**
+	 Data is forced to storage every syncByteInterval bytes or syncTimeInterval seconds (whichever comes first)
+	 and when the appender is closed. Intervals are checked when appending; no background thread is involved.
+	 */
+	FileAppenderSyncPeriodically,
+	
+	/**
+	 Data is forced to storage when the appender is closed.
+	 */
+	FileAppenderSyncOnClose
+};
+
+@interface FileAppender : NSObject
+
+#pragma mark Lifetime
+
+/**
+ Opens the file for appending with the default buffer size (1 MB), creating it and its parent directories if needed.
+ */
++ (instancetype)appenderWithFile:(File *)file error:(NSError **)error;
+
+/**
+ Opens the file for appending with the specified buffer size, creating it and its parent directories if needed.
+ */
+- (id)initWithFile:(File *)file bufferSize:(NSUInteger)bufferSize error:(NSError **)error;
+
+#pragma mark Configuration
+
+@property (readonly) File *file;
+
+@property (readonly) NSUInteger bufferSize;
+
+/**
+ Defaults to FileAppenderSyncNone. The sync settings should be set before the appender is shared between threads.
+ */
+@property (nonatomic) FileAppenderSyncPolicy syncPolicy;
+
+/**
+ The number of bytes written between syncs with FileAppenderSyncPeriodically. Defaults to 16 MB.
+ */
+@property (nonatomic) unsigned long long syncByteInterval;
+
+/**
+ The time between syncs with FileAppenderSyncPeriodically, in seconds. Defaults to 1 second.
+ */
+@property (nonatomic) NSTimeInterval syncTimeInterval;
+
+/**
+ Reserves storage for length more bytes past the end of the file without changing its size, which makes
+ appends cheaper and limits fragmentation. Fails on file systems that don't support it.
+ */
+- (BOOL)preallocateLength:(unsigned long long)length error:(NSError **)error;
+
+#pragma mark Appending
+
+// Appending methods can be called from any thread. Records larger than the buffer are written directly
+// (along with the buffered bytes, in a single system call) instead of being copied.
+
+- (BOOL)appendData:(NSData *)data error:(NSError **)error;
+
+- (BOOL)appendBytes:(const void *)bytes length:(NSUInteger)length error:(NSError **)error;
+
+/**
+ Appends the string encoded as UTF-8.
+ */
+- (BOOL)appendString:(NSString *)string error:(NSError **)error;
+
+/**
+ Writes the buffered bytes to the file.
+ */
+- (BOOL)flush:(NSError **)error;
+
+/**
+ Writes the buffered bytes to the file and forces them to permanent storage, whatever the sync policy.
+ */
+- (BOOL)synchronize:(NSError **)error;
+
+/**
+ Flushes the buffered bytes (syncing them unless the policy is FileAppenderSyncNone) and closes the file.
+ The appender can't be used afterwards. Appenders that are deallocated without being closed are closed
+ the same way, without reporting errors.
+ */
+- (BOOL)close:(NSError **)error;
+
+@end
@@ -0,0 +1,368 @@
+//
+//  FileAppender.m
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // fallocate()
+#endif
+
+#import <errno.h>
+#import <fcntl.h>
+#import <pthread.h>
+#import <stdlib.h>
+#import <string.h>
+#import <sys/stat.h>
+#import <sys/uio.h>
+#import <time.h>
+#import <unistd.h>
+#if defined(__APPLE__)
+#import <mach/mach_time.h>
+#endif
+#import "FileAppender.h"
+#import "File.h"
+#import "Path+Internal.h"
+#import "NSError+FilesAdditions.h"
+#import "NSException+FilesAdditions.h"
+
+#define FileAppenderDefaultBufferSize (1024 * 1024)
+#define FileAppenderDefaultSyncByteInterval (16 * 1024 * 1024)
+
+static NSTimeInterval FileAppenderCurrentTime(void);
+static BOOL FileAppenderWriteVectors(int descriptor, struct iovec *vectors, int count);
+static int FileAppenderSyncData(int descriptor);
+
+@implementation FileAppender
+{
+	int _descriptor;
+	
+	// Appending threads only copy into the buffer while holding the buffer lock. The thread that fills it
+	// swaps in a spare buffer and writes the full one, taking the write lock before releasing the buffer
+	// lock so that buffers reach the file in the order they were filled.
+	pthread_mutex_t _bufferLock;
+	pthread_mutex_t _writeLock;
+	char *_buffer;
+	size_t _bufferLength;
+	char *_spareBuffer;
+	
+	// Guarded by the write lock
+	unsigned long long _bytesSinceSync;
+	
+	// Written under the write lock but also read by appending threads, which only hold the buffer lock,
+	// so it is only accessed atomically
+	NSTimeInterval _lastSyncTime;
+}
+
+#pragma mark Lifetime
+
++ (instancetype)appenderWithFile:(File *)file error:(NSError **)error
+{
+	return [[self alloc] initWithFile:file bufferSize:FileAppenderDefaultBufferSize error:error];
+}
+
+- (id)initWithFile:(File *)file bufferSize:(NSUInteger)bufferSize error:(NSError **)error
+{
+	if (file == nil) @throw [NSException exceptionWithReason:@"File is nil"];
+	if (bufferSize == 0) @throw [NSException exceptionWithReason:@"Buffer size must be greater than zero"];
+	
+	self = [super init];
+	if (self)
+	{
+		_file = file;
+		_bufferSize = bufferSize;
+		_syncByteInterval = FileAppenderDefaultSyncByteInterval;
+		_syncTimeInterval = 1;
+		_descriptor = -1;
+		_lastSyncTime = FileAppenderCurrentTime();
+		pthread_mutex_init(&_bufferLock, NULL);
+		pthread_mutex_init(&_writeLock, NULL);
+		
+		if (![file createParentDirectory:error]) return nil;
+		
+		_buffer = malloc(bufferSize);
+		if (_buffer == NULL)
+		{
+			[self failWithCode:ENOMEM error:error description:@"Could not open file %@ for appending", [_file absolutePath]];
+			return nil;
+		}
+		
+		_descriptor = open([[file absolutePath] fileSystemRepresentation], O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+		if (_descriptor < 0)
+		{
+			int code = errno;
+			[self failWithCode:code error:error description:@"Could not open file %@ for appending", [_file absolutePath]];
+			return nil;
+		}
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	if (_descriptor >= 0) [self close:nil];
+	
+	pthread_mutex_destroy(&_bufferLock);
+	pthread_mutex_destroy(&_writeLock);
+	free(_buffer);
+	free(_spareBuffer);
+}
+
+#pragma mark Configuration
+
+- (BOOL)preallocateLength:(unsigned long long)length error:(NSError **)error
+{
+	if (_descriptor < 0) @throw [NSException exceptionWithReason:@"Appender is closed"];
+	
+	struct stat info;
+	int result = fstat(_descriptor, &info);
+	
+#if defined(__APPLE__)
+	if (result == 0)
+	{
+		// Contiguous space is preferable but not required
+		fstore_t store = { F_ALLOCATECONTIG | F_ALLOCATEALL, F_PEOFPOSMODE, 0, (off_t)length, 0 };
+		result = fcntl(_descriptor, F_PREALLOCATE, &store);
+		
+		if (result != 0)
+		{
+			store.fst_flags = F_ALLOCATEALL;
+			result = fcntl(_descriptor, F_PREALLOCATE, &store);
+		}
+	}
+#else
+	// Keeping the size unchanged matters: appends go to the end of the file, not the end of the allocation
+	if (result == 0) result = fallocate(_descriptor, FALLOC_FL_KEEP_SIZE, info.st_size, (off_t)length);
+#endif
+	
+	if (result != 0)
+	{
+		int code = errno;
+		return [self failWithCode:code error:error description:@"Could not preallocate space for file %@", [_file absolutePath]];
+	}
+	
+	return YES;
+}
+
+#pragma mark Appending
+
+- (BOOL)appendData:(NSData *)data error:(NSError **)error
+{
+	return [self appendBytes:[data bytes] length:[data length] error:error];
+}
+
+- (BOOL)appendString:(NSString *)string error:(NSError **)error
+{
+	// Encoded as data rather than a C string, which would end at an embedded NUL character
+	return [self appendData:[string dataUsingEncoding:NSUTF8StringEncoding] error:error];
+}
+
+- (BOOL)appendBytes:(const void *)bytes length:(NSUInteger)length error:(NSError **)error
+{
+	if (length == 0) return YES;
+	
+	pthread_mutex_lock(&_bufferLock);
+	[self unlockAndThrowIfClosed];
+	
+	if (length > _bufferSize - _bufferLength)
+		return [self writeBufferAndBytes:bytes length:length synchronize:NO error:error];
+	
+	memcpy(_buffer + _bufferLength, bytes, length);
+	_bufferLength += length;
+	
+	BOOL syncIsDue = (_syncPolicy == FileAppenderSyncPeriodically && FileAppenderCurrentTime() - [self lastSyncTime] >= _syncTimeInterval);
+	if (syncIsDue) return [self writeBufferAndBytes:NULL length:0 synchronize:NO error:error];
+	
+	pthread_mutex_unlock(&_bufferLock);
+	return YES;
+}
+
+- (BOOL)flush:(NSError **)error
+{
+	pthread_mutex_lock(&_bufferLock);
+	[self unlockAndThrowIfClosed];
+	
+	return [self writeBufferAndBytes:NULL length:0 synchronize:NO error:error];
+}
+
+- (BOOL)synchronize:(NSError **)error
+{
+	pthread_mutex_lock(&_bufferLock);
+	[self unlockAndThrowIfClosed];
+	
+	return [self writeBufferAndBytes:NULL length:0 synchronize:YES error:error];
+}
+
+- (BOOL)close:(NSError **)error
+{
+	pthread_mutex_lock(&_bufferLock);
+	[self unlockAndThrowIfClosed];
+	
+	BOOL success = [self writeBufferAndBytes:NULL length:0 synchronize:(_syncPolicy != FileAppenderSyncNone) error:error];
+	
+	pthread_mutex_lock(&_bufferLock);
+	pthread_mutex_lock(&_writeLock);
+	
+	int code = (close(_descriptor) == 0 ? 0 : errno);
+	if (code != 0 && success)
+		success = [self failWithCode:code error:error description:@"Could not close file %@", [_file absolutePath]];
+	
+	_descriptor = -1;
+	
+	pthread_mutex_unlock(&_writeLock);
+	pthread_mutex_unlock(&_bufferLock);
+	
+	return success;
+}
+
+#pragma mark Private
+
+// Must be called with the buffer lock held, which it releases. Writes the buffered bytes followed
+// by the specified bytes (which can be NULL) without copying them.
+- (BOOL)writeBufferAndBytes:(const void *)bytes length:(size_t)length synchronize:(BOOL)synchronize error:(NSError **)error
+{
+	char *buffer = _buffer;
+	size_t bufferLength = _bufferLength;
+	
+	if (bufferLength > 0)
+	{
+		char *replacement = (_spareBuffer ? _spareBuffer : malloc(_bufferSize));
+		
+		if (replacement == NULL)
+		{
+			pthread_mutex_unlock(&_bufferLock);
+			return [self failWithCode:ENOMEM error:error description:@"Could not append to file %@", [_file absolutePath]];
+		}
+		
+		_buffer = replacement;
+		_bufferLength = 0;
+		_spareBuffer = NULL;
+	}
+	
+	pthread_mutex_lock(&_writeLock);
+	pthread_mutex_unlock(&_bufferLock);
+	
+	struct iovec vectors[2] = { { buffer, bufferLength }, { (void *)bytes, length } };
+	int code = 0;
+	
+	if (bufferLength + length > 0)
+	{
+		if (FileAppenderWriteVectors(_descriptor, (bufferLength > 0 ? vectors : vectors + 1), (bufferLength > 0 ? 2 : 1)))
+			_bytesSinceSync += bufferLength + length;
+		else
+			code = errno;
+	}
+	
+	NSTimeInterval now = FileAppenderCurrentTime();
+	BOOL periodicSyncIsDue = (_syncPolicy == FileAppenderSyncPeriodically && _bytesSinceSync > 0 && (_bytesSinceSync >= _syncByteInterval || now - [self lastSyncTime] >= _syncTimeInterval));
+	
+	if (code == 0 && (synchronize || periodicSyncIsDue))
+	{
+		if (FileAppenderSyncData(_descriptor) == 0)
+		{
+			_bytesSinceSync = 0;
+			__atomic_store(&_lastSyncTime, &now, __ATOMIC_RELAXED);
+		}
+		else
+		{
+			code = errno;
+		}
+	}
+	
+	pthread_mutex_unlock(&_writeLock);
+	
+	if (bufferLength > 0)
+	{
+		pthread_mutex_lock(&_bufferLock);
+		if (_spareBuffer == NULL) _spareBuffer = buffer; else free(buffer);
+		pthread_mutex_unlock(&_bufferLock);
+	}
+	
+	if (code != 0) return [self failWithCode:code error:error description:@"Could not append to file %@", [_file absolutePath]];
+	
+	return YES;
+}
+
+- (NSTimeInterval)lastSyncTime
+{
+	NSTimeInterval time;
+	__atomic_load(&_lastSyncTime, &time, __ATOMIC_RELAXED);
+	return time;
+}
+
+// Must be called with the buffer lock held
+- (void)unlockAndThrowIfClosed
+{
+	if (_descriptor >= 0) return;
+	
+	pthread_mutex_unlock(&_bufferLock);
+	@throw [NSException exceptionWithReason:@"Appender is closed"];
+}
+
+- (BOOL)failWithCode:(int)code error:(NSError **)error description:(NSString *)format, ...
+{
+	va_list args;
+	va_start(args, format);
+	NSString *description = [[NSString alloc] initWithFormat:format arguments:args];
+	va_end(args);
+	
+	NSError *innerError = [NSError errorWithPOSIXCode:code description:@"%@", description];
+	NSLog(@"%@", [innerError description]);
+	if (error) *error = innerError;
+	return NO;
+}
+
+@end
+
+#pragma mark - Primitives
+
+static NSTimeInterval FileAppenderCurrentTime(void)
+{
+#if defined(__APPLE__)
+	static mach_timebase_info_data_t timebase;
+	if (timebase.denom == 0) mach_timebase_info(&timebase);
+	return (NSTimeInterval)mach_absolute_time() * timebase.numer / timebase.denom / 1e9;
+#else
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec / 1e9;
+#endif
+}
+
+static BOOL FileAppenderWriteVectors(int descriptor, struct iovec *vectors, int count)
+{
+	while (count > 0)
+	{
+		ssize_t written = writev(descriptor, vectors, count);
+		if (written < 0 && errno == EINTR) continue;
+		if (written < 0) return NO;
+		
+		// Skip what was written and retry the rest after a short write
+		while (count > 0 && (size_t)written >= vectors->iov_len)
+		{
+			written -= (ssize_t)vectors->iov_len;
+			vectors++;
+			count--;
+		}
+		
+		if (count > 0)
+		{
+			vectors->iov_base = (char *)vectors->iov_base + written;
+			vectors->iov_len -= (size_t)written;
+		}
+	}
+	
+	return YES;
+}
+
+static int FileAppenderSyncData(int descriptor)
+{
+#if defined(__APPLE__)
+	// fdatasync() isn't part of the public SDK; fsync() is the closest equivalent
+	return fsync(descriptor);
+#else
+	return fdatasync(descriptor);
+#endif
+}
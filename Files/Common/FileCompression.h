@@ -0,0 +1,29 @@
+//
+//  FileCompression.h
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+//  Description: Compressed file contents, deflated with zlib behind a 16-byte header (magic "FZLB", a version,
+//               the codec and the inflated length). Not part of the public interface.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ Whether the data starts with a compressed contents header.
+ */
+extern BOOL FileCompressionIsCompressed(NSData *data);
+
+/**
+ Writes the header and the deflated bytes to the descriptor, through a fixed-size output buffer.
+ Returns NO with errno set on failure.
+ */
+extern BOOL FileCompressionWriteDeflated(int descriptor, const void *bytes, size_t length);
+
+/**
+ Inflates compressed contents (header included) into a buffer allocated once at the inflated length.
+ Returns nil with errno set on failure (EINVAL when the contents are corrupt).
+ */
+extern NSData *FileCompressionInflate(NSData *data);
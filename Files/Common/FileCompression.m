@@ -0,0 +1,168 @@
+//
+//  FileCompression.m
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+
+#import <errno.h>
+#import <stdint.h>
+#import <stdlib.h>
+#import <string.h>
+#import <unistd.h>
+#import <zlib.h>
+#import "FileCompression.h"
+
+#define FileCompressionHeaderLength 16
+#define FileCompressionVersion 1
+#define FileCompressionCodecZlib 1
+
+// Large enough to keep system calls rare, small enough to keep compressed writes in bounded memory
+#define FileCompressionBufferSize (256 * 1024)
+
+// zlib counts bytes with 32-bit integers, so larger inputs are fed in slices
+#define FileCompressionMaximumSlice (1u << 30)
+
+// Deflate can't expand data more than about 1032 to 1, so a header claiming more is corrupt
+#define FileCompressionMaximumRatio 1032
+
+// Level 1 deflates several times faster than the default level for a slightly larger file
+#define FileCompressionLevel 1
+
+static const char FileCompressionMagic[4] = { 'F', 'Z', 'L', 'B' };
+
+static BOOL FileCompressionWriteAll(int descriptor, const unsigned char *bytes, size_t length)
+{
+	while (length > 0)
+	{
+		ssize_t written = write(descriptor, bytes, length);
+		if (written < 0 && errno == EINTR) continue;
+		if (written < 0) return NO;
+
+		bytes += written;
+		length -= (size_t)written;
+	}
+
+	return YES;
+}
+
+BOOL FileCompressionIsCompressed(NSData *data)
+{
+	return ([data length] >= FileCompressionHeaderLength && memcmp([data bytes], FileCompressionMagic, sizeof(FileCompressionMagic)) == 0);
+}
+
+BOOL FileCompressionWriteDeflated(int descriptor, const void *bytes, size_t length)
+{
+	unsigned char header[FileCompressionHeaderLength] = { 0 };
+	memcpy(header, FileCompressionMagic, sizeof(FileCompressionMagic));
+	header[4] = FileCompressionVersion;
+	header[5] = FileCompressionCodecZlib;
+	for (int i = 0; i < 8; i++) header[8 + i] = (unsigned char)((uint64_t)length >> (56 - 8 * i));
+
+	if (!FileCompressionWriteAll(descriptor, header, sizeof(header))) return NO;
+
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	if (deflateInit(&stream, FileCompressionLevel) != Z_OK) { errno = ENOMEM; return NO; }
+
+	unsigned char *buffer = malloc(FileCompressionBufferSize);
+	if (buffer == NULL) { deflateEnd(&stream); errno = ENOMEM; return NO; }
+
+	const unsigned char *input = bytes;
+	size_t remaining = length;
+	BOOL success = YES;
+	int result = Z_OK;
+
+	while (success && result != Z_STREAM_END)
+	{
+		if (stream.avail_in == 0 && remaining > 0)
+		{
+			uInt slice = (uInt)MIN(remaining, (size_t)FileCompressionMaximumSlice);
+			stream.next_in = (Bytef *)input;
+			stream.avail_in = slice;
+			input += slice;
+			remaining -= slice;
+		}
+
+		stream.next_out = buffer;
+		stream.avail_out = FileCompressionBufferSize;
+		result = deflate(&stream, (remaining == 0 ? Z_FINISH : Z_NO_FLUSH));
+
+		if (result == Z_STREAM_ERROR) { errno = EINVAL; success = NO; break; }
+		success = FileCompressionWriteAll(descriptor, buffer, FileCompressionBufferSize - stream.avail_out);
+	}
+
+	int code = errno;
+	free(buffer);
+	deflateEnd(&stream);
+	errno = code;
+
+	return success;
+}
+
+NSData *FileCompressionInflate(NSData *data)
+{
+	if (!FileCompressionIsCompressed(data)) { errno = EINVAL; return nil; }
+
+	const unsigned char *header = [data bytes];
+	if (header[4] != FileCompressionVersion || header[5] != FileCompressionCodecZlib) { errno = ENOTSUP; return nil; }
+
+	uint64_t length = 0;
+	for (int i = 0; i < 8; i++) length = (length << 8) | header[8 + i];
+	if (length > SIZE_MAX) { errno = EFBIG; return nil; }
+
+	// Checked before allocating, so that a corrupt length can't reserve more memory than the data could fill
+	uint64_t compressedLength = (uint64_t)([data length] - FileCompressionHeaderLength);
+	if (compressedLength < UINT64_MAX / FileCompressionMaximumRatio && length > compressedLength * FileCompressionMaximumRatio) { errno = EINVAL; return nil; }
+
+	// Allocated once at its final size rather than grown as data is inflated
+	unsigned char *output = malloc(length > 0 ? (size_t)length : 1);
+	if (output == NULL) { errno = ENOMEM; return nil; }
+
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	if (inflateInit(&stream) != Z_OK) { free(output); errno = ENOMEM; return nil; }
+
+	const unsigned char *input = header + FileCompressionHeaderLength;
+	size_t inputRemaining = [data length] - FileCompressionHeaderLength;
+	unsigned char *next = output;
+	size_t outputRemaining = (size_t)length;
+	int result = Z_OK;
+
+	while (result == Z_OK)
+	{
+		if (stream.avail_in == 0)
+		{
+			if (inputRemaining == 0) break;
+
+			uInt slice = (uInt)MIN(inputRemaining, (size_t)FileCompressionMaximumSlice);
+			stream.next_in = (Bytef *)input;
+			stream.avail_in = slice;
+			input += slice;
+			inputRemaining -= slice;
+		}
+
+		uInt outputSlice = (uInt)MIN(outputRemaining, (size_t)FileCompressionMaximumSlice);
+		stream.next_out = next;
+		stream.avail_out = outputSlice;
+		result = inflate(&stream, Z_NO_FLUSH);
+
+		next += outputSlice - stream.avail_out;
+		outputRemaining -= outputSlice - stream.avail_out;
+
+		// Input and output are never both empty, so no progress means the stream is longer than the header said
+		if (result == Z_BUF_ERROR) break;
+	}
+
+	inflateEnd(&stream);
+
+	if (result != Z_STREAM_END || outputRemaining != 0)
+	{
+		free(output);
+		errno = (result == Z_MEM_ERROR ? ENOMEM : EINVAL);
+		return nil;
+	}
+
+	return [NSData dataWithBytesNoCopy:output length:(NSUInteger)length freeWhenDone:YES];
+}
@@ -0,0 +1,23 @@
+//
+//  FileCopier+Internal.h
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+//  Description: The file copy primitive shared by File and CopyEngine. Not part of the public interface.
+//
+
+#import "FileCopier.h"
+
+/**
+ Copies the file at source to destination (both file system representations) as described in
+ +[FileCopier copyFileAtPath:toPath:overwrite:firstMethod:error:]. On failure, returns FileCopyMethodNone
+ with errno set and leaves no partial destination behind.
+ */
+extern FileCopyMethod FileCopierCopyItem(const char *source, const char *destination, BOOL overwrite, FileCopyMethod firstMethod, unsigned long long *byteCount);
+
+/**
+ Copies like FileCopierCopyItem(), with each name relative to an open directory (or AT_FDCWD).
+ */
+extern FileCopyMethod FileCopierCopyItemAt(int sourceDirectory, const char *source, int destinationDirectory, const char *destination, BOOL overwrite, FileCopyMethod firstMethod, unsigned long long *byteCount);
@@ -0,0 +1,51 @@
+//
+//  FileCopier.h
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+//  Description: Copies file data with the cheapest mechanism the file system supports,
+//               from copy-on-write clones down to a user-space read/write loop.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ The mechanisms used to copy file data, from the cheapest to the most expensive.
+ */
+typedef NS_ENUM(NSInteger, FileCopyMethod)
+{
+	FileCopyMethodNone = 0,
+
+	/**
+	 The copy shares the source's blocks until either file is modified (clonefile() on APFS, FICLONE on btrfs and XFS).
+	 */
+	FileCopyMethodClone,
+
+	/**
+	 The data is copied inside the kernel with copy_file_range() (Linux).
+	 */
+	FileCopyMethodCopyFileRange,
+
+	/**
+	 The data is copied inside the kernel with sendfile() (Linux).
+	 */
+	FileCopyMethodSendFile,
+
+	/**
+	 The data is read and written through a user-space buffer (copyfile() on Apple platforms).
+	 */
+	FileCopyMethodReadWrite
+};
+
+@interface FileCopier : NSObject
+
+/**
+ Copies the file at sourcePath to destinationPath, trying each method starting with firstMethod
+ (pass FileCopyMethodClone to try them all) until one is supported. The destination's permissions
+ and dates are set to the source's. Returns the method that was used, or FileCopyMethodNone on failure.
+ */
++ (FileCopyMethod)copyFileAtPath:(NSString *)sourcePath toPath:(NSString *)destinationPath overwrite:(BOOL)overwrite firstMethod:(FileCopyMethod)firstMethod error:(NSError **)error;
+
+@end
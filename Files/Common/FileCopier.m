@@ -0,0 +1,264 @@
+//
+//  FileCopier.m
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // copy_file_range()
+#endif
+
+#import <errno.h>
+#import <fcntl.h>
+#import <stdlib.h>
+#import <sys/stat.h>
+#import <unistd.h>
+#if defined(__APPLE__)
+#import <copyfile.h>
+#import <sys/clonefile.h>
+#elif defined(__linux__)
+#import <sys/ioctl.h>
+#import <sys/sendfile.h>
+#import <sys/syscall.h>
+#endif
+#import "FileCopier.h"
+#import "FileCopier+Internal.h"
+#import "Path+Internal.h"
+#import "NSError+FilesAdditions.h"
+
+#if defined(__linux__) && !defined(FICLONE)
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+
+#if defined(__APPLE__)
+#define FileCopierAccessTime(info) ((info).st_atimespec)
+#define FileCopierModificationTime(info) ((info).st_mtimespec)
+#else
+#define FileCopierAccessTime(info) ((info).st_atim)
+#define FileCopierModificationTime(info) ((info).st_mtim)
+#endif
+
+#define FileCopierMaximumBufferSize (1 << 20)
+#define FileCopierKernelChunkSize (1 << 30)
+
+static FileCopyMethod FileCopierCopyData(int input, int output, const struct stat *info, FileCopyMethod firstMethod, unsigned long long *byteCount);
+
+@implementation FileCopier
+
++ (FileCopyMethod)copyFileAtPath:(NSString *)sourcePath toPath:(NSString *)destinationPath overwrite:(BOOL)overwrite firstMethod:(FileCopyMethod)firstMethod error:(NSError **)error
+{
+	unsigned long long byteCount = 0;
+	FileCopyMethod method = FileCopierCopyItem([sourcePath fileSystemRepresentation], [destinationPath fileSystemRepresentation], overwrite, firstMethod, &byteCount);
+
+	if (method == FileCopyMethodNone)
+	{
+		int code = errno;
+		if (error) *error = [NSError errorWithPOSIXCode:code description:@"Could not copy file at path %@ to %@", sourcePath, destinationPath];
+	}
+
+	return method;
+}
+
+@end
+
+#pragma mark - Copy Primitive
+
+#if defined(__APPLE__)
+static BOOL FileCopierClone(int sourceDirectory, const char *source, int destinationDirectory, const char *destination, BOOL overwrite, const struct stat *info)
+{
+	// clonefileat() is weak-linked when deploying to systems older than macOS 10.12 / iOS 10
+	if (&clonefileat == NULL) { errno = ENOTSUP; return NO; }
+
+	BOOL cloned = (clonefileat(sourceDirectory, source, destinationDirectory, destination, CLONE_NOFOLLOW) == 0);
+	if (!cloned && errno == EEXIST && overwrite && PathRemoveItemAt(destinationDirectory, destination))
+		cloned = (clonefileat(sourceDirectory, source, destinationDirectory, destination, CLONE_NOFOLLOW) == 0);
+
+	if (cloned)
+	{
+		struct timespec times[2] = { FileCopierAccessTime(*info), FileCopierModificationTime(*info) };
+		utimensat(destinationDirectory, destination, times, AT_SYMLINK_NOFOLLOW);
+	}
+
+	return cloned;
+}
+#endif
+
+// Whether a failed method means "not supported here" (try the next one) rather than an actual I/O error
+static BOOL FileCopierShouldTryNextMethod(int code)
+{
+	return (code == ENOSYS || code == EXDEV || code == EINVAL || code == ENOTTY || code == ENOTSUP || code == EOPNOTSUPP);
+}
+
+static FileCopyMethod FileCopierCloseAndFail(int descriptor, int code)
+{
+	close(descriptor);
+	errno = code;
+	return FileCopyMethodNone;
+}
+
+static int FileCopierOpenDestination(int directory, const char *destination, BOOL overwrite)
+{
+	int flags = O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC;
+	int output = openat(directory, destination, flags, S_IRUSR | S_IWUSR);
+
+	if (output < 0 && errno == EEXIST && overwrite && PathRemoveItemAt(directory, destination))
+		output = openat(directory, destination, flags, S_IRUSR | S_IWUSR);
+
+	return output;
+}
+
+FileCopyMethod FileCopierCopyItem(const char *source, const char *destination, BOOL overwrite, FileCopyMethod firstMethod, unsigned long long *byteCount)
+{
+	return FileCopierCopyItemAt(AT_FDCWD, source, AT_FDCWD, destination, overwrite, firstMethod, byteCount);
+}
+
+FileCopyMethod FileCopierCopyItemAt(int sourceDirectory, const char *source, int destinationDirectory, const char *destination, BOOL overwrite, FileCopyMethod firstMethod, unsigned long long *byteCount)
+{
+	*byteCount = 0;
+
+	int input = openat(sourceDirectory, source, O_RDONLY | O_CLOEXEC);
+	if (input < 0) return FileCopyMethodNone;
+
+	struct stat info;
+	if (fstat(input, &info) != 0) return FileCopierCloseAndFail(input, errno);
+	if (S_ISDIR(info.st_mode)) return FileCopierCloseAndFail(input, EISDIR);
+
+#if defined(__APPLE__)
+	if (firstMethod <= FileCopyMethodClone)
+	{
+		if (FileCopierClone(sourceDirectory, source, destinationDirectory, destination, overwrite, &info))
+		{
+			close(input);
+			*byteCount = (unsigned long long)info.st_size;
+			return FileCopyMethodClone;
+		}
+
+		if (!FileCopierShouldTryNextMethod(errno)) return FileCopierCloseAndFail(input, errno);
+	}
+#endif
+
+	int output = FileCopierOpenDestination(destinationDirectory, destination, overwrite);
+	if (output < 0) return FileCopierCloseAndFail(input, errno);
+
+	FileCopyMethod method = FileCopierCopyData(input, output, &info, firstMethod, byteCount);
+
+	if (method != FileCopyMethodNone)
+	{
+		struct timespec times[2] = { FileCopierAccessTime(info), FileCopierModificationTime(info) };
+		if (fchmod(output, info.st_mode & 07777) != 0 || futimens(output, times) != 0) method = FileCopyMethodNone;
+	}
+
+	int code = errno;
+	close(input);
+	close(output);
+
+	if (method == FileCopyMethodNone)
+	{
+		unlinkat(destinationDirectory, destination, 0);
+		errno = code;
+	}
+
+	return method;
+}
+
+#pragma mark - Data Copy Methods
+
+#if defined(__linux__)
+static BOOL FileCopierCopyInKernel(int input, int output, const struct stat *info, FileCopyMethod method, unsigned long long *byteCount)
+{
+	while (YES)
+	{
+		ssize_t copied;
+
+		if (method == FileCopyMethodCopyFileRange)
+		{
+#if defined(SYS_copy_file_range)
+			copied = syscall(SYS_copy_file_range, input, NULL, output, NULL, (size_t)FileCopierKernelChunkSize, 0);
+#else
+			errno = ENOSYS;
+			return NO;
+#endif
+		}
+		else
+			copied = sendfile(output, input, NULL, (size_t)FileCopierKernelChunkSize);
+
+		if (copied < 0 && errno == EINTR) continue;
+		if (copied < 0) return NO;
+
+		// Some sysfs, FUSE and network files report a size but copy nothing this way; only read() returns their contents
+		if (copied == 0 && *byteCount == 0 && info->st_size > 0) { errno = ENOTSUP; return NO; }
+		if (copied == 0) return YES;
+
+		*byteCount += (unsigned long long)copied;
+	}
+}
+#endif
+
+static BOOL FileCopierCopyWithBuffer(int input, int output, const struct stat *info, unsigned long long *byteCount)
+{
+#if defined(__APPLE__)
+	if (fcopyfile(input, output, NULL, COPYFILE_ALL) != 0) return NO;
+	*byteCount = (unsigned long long)info->st_size;
+	return YES;
+#else
+	size_t bufferSize = (size_t)MAX(MIN(info->st_size, (off_t)FileCopierMaximumBufferSize), (off_t)4096);
+	char *buffer = malloc(bufferSize);
+	if (buffer == NULL) return NO;
+
+	BOOL success = YES;
+
+	while (success)
+	{
+		ssize_t readCount = read(input, buffer, bufferSize);
+		if (readCount < 0 && errno == EINTR) continue;
+		if (readCount <= 0) { success = (readCount == 0); break; }
+
+		for (ssize_t written = 0; written < readCount; )
+		{
+			ssize_t writeCount = write(output, buffer + written, (size_t)(readCount - written));
+			if (writeCount < 0 && errno == EINTR) continue;
+			if (writeCount < 0) { success = NO; break; }
+			written += writeCount;
+		}
+
+		if (success) *byteCount += (unsigned long long)readCount;
+	}
+
+	free(buffer);
+	return success;
+#endif
+}
+
+static FileCopyMethod FileCopierCopyData(int input, int output, const struct stat *info, FileCopyMethod firstMethod, unsigned long long *byteCount)
+{
+#if defined(__linux__)
+	// Pseudo-files (procfs, sysfs) report a size of zero but have contents that only read() returns
+	BOOL canCopyInKernel = (info->st_size > 0);
+
+	if (canCopyInKernel && firstMethod <= FileCopyMethodClone)
+	{
+		if (ioctl(output, FICLONE, input) == 0)
+		{
+			*byteCount = (unsigned long long)info->st_size;
+			return FileCopyMethodClone;
+		}
+
+		if (!FileCopierShouldTryNextMethod(errno)) return FileCopyMethodNone;
+	}
+
+	FileCopyMethod kernelMethods[] = { FileCopyMethodCopyFileRange, FileCopyMethodSendFile };
+
+	for (size_t i = 0; canCopyInKernel && i < sizeof(kernelMethods) / sizeof(kernelMethods[0]); i++)
+	{
+		if (firstMethod > kernelMethods[i]) continue;
+		if (FileCopierCopyInKernel(input, output, info, kernelMethods[i], byteCount)) return kernelMethods[i];
+
+		// Falling back is only possible while nothing was written (the file offsets have moved otherwise)
+		if (*byteCount > 0 || !FileCopierShouldTryNextMethod(errno)) return FileCopyMethodNone;
+	}
+#endif
+
+	return (FileCopierCopyWithBuffer(input, output, info, byteCount) ? FileCopyMethodReadWrite : FileCopyMethodNone);
+}
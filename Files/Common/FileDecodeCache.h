@@ -0,0 +1,88 @@
+//
+//  FileDecodeCache.h
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+//  Description: Keeps the objects decoded from files (unarchived objects, property lists) for as long as the
+//               files don't change. Entries are validated with a single stat against the file's device, inode,
+//               size and modification time, evicted least recently used first, and concurrent misses for the
+//               same file share a single decode.
+//
+
+#import <Foundation/Foundation.h>
+
+@class File;
+
+/**
+ Decodes the file, setting the cost of the returned object (preset to the file's size) to the number of bytes it
+ was decoded from, such as the inflated length of compressed contents.
+ */
+typedef id (^FileDecodeCacheDecoder)(unsigned long long *cost, NSError **error);
+
+/**
+ The cost a decoder sets for an object that must not be shared, such as a mutable one. The object is returned to
+ the caller that decoded it without being cached, and callers that were waiting for it decode their own.
+ */
+extern const unsigned long long FileDecodeCacheUnsharedCost;
+
+@interface FileDecodeCache : NSObject
+
+#pragma mark Lifetime
+
+/**
+ The cache used by -[File unarchive], -readArray and -readDictionary once enabled.
+ */
++ (FileDecodeCache *)sharedCache;
+
+/**
+ Creates a cache holding decoded objects up to the specified cost, in bytes of decoded data.
+ */
+- (id)initWithMemoryBudget:(unsigned long long)memoryBudget;
+
+#pragma mark Configuration
+
+/**
+ Whether File's decoding methods go through the shared cache (NO by default). Cached objects are shared by all
+ callers, so only immutable ones are cached.
+ */
+@property (nonatomic, getter=isEnabled) BOOL enabled;
+
+/**
+ The total cost of cached objects above which the least recently used ones are evicted (64 MB by default for the
+ shared cache). The cost of an object is the number of bytes its decoder reported decoding it from (the inflated
+ size of compressed archives), not the memory taken by the decoded objects, which is usually a few times larger.
+ */
+@property (nonatomic) unsigned long long memoryBudget;
+
+#pragma mark Decoding
+
+/**
+ Returns the object decoded from the file by a decoder of the specified kind (such as "archive" or "dictionary"),
+ calling the decoder only when no valid object is cached and no other thread is already decoding it. Failures
+ (nil objects) are returned to every waiting caller but not cached.
+ */
+- (id)objectForFile:(File *)file kind:(NSString *)kind decoder:(FileDecodeCacheDecoder)decoder error:(NSError **)error;
+
+- (void)removeAllObjects;
+
+#pragma mark Statistics
+
+/**
+ Lookups answered from the cache, including those that waited for another thread's decode.
+ */
+@property (readonly) unsigned long long hitCount;
+
+/**
+ Lookups that had to decode the file.
+ */
+@property (readonly) unsigned long long missCount;
+
+@property (readonly) unsigned long long evictionCount;
+
+@property (readonly) NSUInteger objectCount;
+
+@property (readonly) unsigned long long totalCost;
+
+@end
@@ -0,0 +1,349 @@
+//
+//  FileDecodeCache.m
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+
+#import <limits.h>
+#import <pthread.h>
+#import <sys/stat.h>
+#import "FileDecodeCache.h"
+#import "File.h"
+#import "NSException+FilesAdditions.h"
+
+#if defined(__APPLE__)
+#define FileDecodeCacheModificationTime(info) ((info).st_mtimespec)
+#else
+#define FileDecodeCacheModificationTime(info) ((info).st_mtim)
+#endif
+
+#define FileDecodeCacheDefaultMemoryBudget (64ULL * 1024 * 1024)
+
+const unsigned long long FileDecodeCacheUnsharedCost = ULLONG_MAX;
+
+// Counted for every entry on top of its decoded size, so that many empty files can't fill the cache for free
+#define FileDecodeCacheEntryOverhead 256
+
+static FileDecodeCache *FileDecodeCacheShared;
+static pthread_once_t FileDecodeCacheSharedOnce = PTHREAD_ONCE_INIT;
+
+static void FileDecodeCacheCreateShared(void)
+{
+	FileDecodeCacheShared = [[FileDecodeCache alloc] initWithMemoryBudget:FileDecodeCacheDefaultMemoryBudget];
+}
+
+#pragma mark - Entries
+
+@interface FileDecodeCacheEntry : NSObject
+{
+@public
+	NSString *_key;
+	dev_t _device;
+	ino_t _inode;
+	off_t _size;
+	int64_t _modificationTime;
+	unsigned long long _cost;
+
+	// While decoding, the entry is only in the dictionary; once decoded successfully, it is also in the recency list
+	BOOL _decoding;
+	BOOL _unshared;
+	id _object;
+	NSError *_error;
+
+	__unsafe_unretained FileDecodeCacheEntry *_previous;
+	__unsafe_unretained FileDecodeCacheEntry *_next;
+}
+@end
+
+@implementation FileDecodeCacheEntry
+@end
+
+#pragma mark - Cache
+
+@implementation FileDecodeCache
+{
+	pthread_mutex_t _lock;
+	pthread_cond_t _decoded;
+	NSMutableDictionary<NSString *, FileDecodeCacheEntry *> *_entries;
+
+	// Most recently used first
+	__unsafe_unretained FileDecodeCacheEntry *_head;
+	__unsafe_unretained FileDecodeCacheEntry *_tail;
+
+	unsigned long long _memoryBudget;
+	unsigned long long _totalCost;
+	unsigned long long _hitCount;
+	unsigned long long _missCount;
+	unsigned long long _evictionCount;
+}
+
+#pragma mark Lifetime
+
++ (FileDecodeCache *)sharedCache
+{
+	pthread_once(&FileDecodeCacheSharedOnce, FileDecodeCacheCreateShared);
+	return FileDecodeCacheShared;
+}
+
+- (id)init
+{
+	return [self initWithMemoryBudget:FileDecodeCacheDefaultMemoryBudget];
+}
+
+- (id)initWithMemoryBudget:(unsigned long long)memoryBudget
+{
+	self = [super init];
+	if (self)
+	{
+		pthread_mutex_init(&_lock, NULL);
+		pthread_cond_init(&_decoded, NULL);
+		_entries = [NSMutableDictionary dictionary];
+		_memoryBudget = memoryBudget;
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	pthread_cond_destroy(&_decoded);
+	pthread_mutex_destroy(&_lock);
+}
+
+#pragma mark Configuration
+
+- (unsigned long long)memoryBudget
+{
+	pthread_mutex_lock(&_lock);
+	unsigned long long memoryBudget = _memoryBudget;
+	pthread_mutex_unlock(&_lock);
+	return memoryBudget;
+}
+
+- (void)setMemoryBudget:(unsigned long long)memoryBudget
+{
+	pthread_mutex_lock(&_lock);
+	_memoryBudget = memoryBudget;
+	[self evictToBudget];
+	pthread_mutex_unlock(&_lock);
+}
+
+#pragma mark Decoding
+
+- (id)objectForFile:(File *)file kind:(NSString *)kind decoder:(FileDecodeCacheDecoder)decoder error:(NSError **)error
+{
+	if (file == nil || kind == nil || decoder == nil) @throw [NSException exceptionWithReason:@"A file, kind and decoder are required"];
+
+	// Files that can't be looked at aren't cached; the decoder reports why
+	NSString *path = [file absolutePath];
+	struct stat info;
+	if (stat([path fileSystemRepresentation], &info) != 0)
+	{
+		pthread_mutex_lock(&_lock);
+		_missCount++;
+		pthread_mutex_unlock(&_lock);
+
+		unsigned long long cost = 0;
+		return decoder(&cost, error);
+	}
+
+	// Keyed by path so that a replaced file's entry is dropped at once instead of lingering until evicted
+	NSString *key = [NSString stringWithFormat:@"%@:%@", kind, path];
+	int64_t modificationTime = (int64_t)FileDecodeCacheModificationTime(info).tv_sec * 1000000000 + FileDecodeCacheModificationTime(info).tv_nsec;
+
+	pthread_mutex_lock(&_lock);
+
+	FileDecodeCacheEntry *entry = _entries[key];
+
+	if (entry && entry->_device == info.st_dev && entry->_inode == info.st_ino && entry->_size == info.st_size && entry->_modificationTime == modificationTime)
+	{
+		while (entry->_decoding) pthread_cond_wait(&_decoded, &_lock);
+
+		if (entry->_unshared)
+		{
+			_missCount++;
+			pthread_mutex_unlock(&_lock);
+
+			unsigned long long cost = (unsigned long long)info.st_size;
+			return decoder(&cost, error);
+		}
+
+		id object = entry->_object;
+		NSError *sharedError = entry->_error;
+
+		// Decoded objects still in the dictionary are in the recency list; evicted ones are still valid for this caller
+		if (object && _entries[key] == entry) [self moveToFront:entry];
+
+		_hitCount++;
+		pthread_mutex_unlock(&_lock);
+
+		if (object == nil && error) *error = sharedError;
+		return object;
+	}
+
+	// The file changed (or was never decoded): a stale entry is dropped unless it is still being decoded,
+	// in which case its decoder finds out it was replaced when it finishes
+	if (entry && !entry->_decoding) [self removeEntry:entry];
+
+	entry = [[FileDecodeCacheEntry alloc] init];
+	entry->_key = key;
+	entry->_device = info.st_dev;
+	entry->_inode = info.st_ino;
+	entry->_size = info.st_size;
+	entry->_modificationTime = modificationTime;
+	entry->_decoding = YES;
+	_entries[key] = entry;
+	_missCount++;
+
+	pthread_mutex_unlock(&_lock);
+
+	id object = nil;
+	NSError *decodeError = nil;
+	unsigned long long cost = (unsigned long long)info.st_size;
+
+	@try
+	{
+		object = decoder(&cost, &decodeError);
+	}
+	@finally
+	{
+		// Waiting threads are woken up even if the decoder threw
+		pthread_mutex_lock(&_lock);
+
+		// Unshared objects are kept from the entry so that only their decoder gets them
+		entry->_unshared = (object && cost == FileDecodeCacheUnsharedCost);
+		entry->_cost = (entry->_unshared ? 0 : cost + FileDecodeCacheEntryOverhead);
+		entry->_decoding = NO;
+		entry->_object = (entry->_unshared ? nil : object);
+		entry->_error = decodeError;
+
+		if (_entries[key] == entry)
+		{
+			if (entry->_object && entry->_cost <= _memoryBudget)
+			{
+				[self insertAtFront:entry];
+				[self evictToBudget];
+			}
+			else
+			{
+				[_entries removeObjectForKey:key];
+			}
+		}
+
+		pthread_cond_broadcast(&_decoded);
+		pthread_mutex_unlock(&_lock);
+	}
+
+	if (object == nil && error) *error = decodeError;
+	return object;
+}
+
+- (void)removeAllObjects
+{
+	pthread_mutex_lock(&_lock);
+
+	// Entries being decoded stay so that their waiters are still woken up
+	while (_tail) [self removeEntry:_tail];
+
+	pthread_mutex_unlock(&_lock);
+}
+
+#pragma mark Statistics
+
+- (unsigned long long)hitCount
+{
+	pthread_mutex_lock(&_lock);
+	unsigned long long count = _hitCount;
+	pthread_mutex_unlock(&_lock);
+	return count;
+}
+
+- (unsigned long long)missCount
+{
+	pthread_mutex_lock(&_lock);
+	unsigned long long count = _missCount;
+	pthread_mutex_unlock(&_lock);
+	return count;
+}
+
+- (unsigned long long)evictionCount
+{
+	pthread_mutex_lock(&_lock);
+	unsigned long long count = _evictionCount;
+	pthread_mutex_unlock(&_lock);
+	return count;
+}
+
+- (NSUInteger)objectCount
+{
+	NSUInteger count = 0;
+
+	pthread_mutex_lock(&_lock);
+	for (FileDecodeCacheEntry *entry = _head; entry; entry = entry->_next) count++;
+	pthread_mutex_unlock(&_lock);
+
+	return count;
+}
+
+- (unsigned long long)totalCost
+{
+	pthread_mutex_lock(&_lock);
+	unsigned long long cost = _totalCost;
+	pthread_mutex_unlock(&_lock);
+	return cost;
+}
+
+#pragma mark Recency List (Locked)
+
+- (void)insertAtFront:(FileDecodeCacheEntry *)entry
+{
+	entry->_previous = nil;
+	entry->_next = _head;
+
+	if (_head) _head->_previous = entry;
+	_head = entry;
+	if (_tail == nil) _tail = entry;
+
+	_totalCost += entry->_cost;
+}
+
+- (void)unlink:(FileDecodeCacheEntry *)entry
+{
+	if (entry->_previous) entry->_previous->_next = entry->_next;
+	else _head = entry->_next;
+
+	if (entry->_next) entry->_next->_previous = entry->_previous;
+	else _tail = entry->_previous;
+
+	entry->_previous = nil;
+	entry->_next = nil;
+	_totalCost -= entry->_cost;
+}
+
+- (void)moveToFront:(FileDecodeCacheEntry *)entry
+{
+	if (_head == entry) return;
+
+	[self unlink:entry];
+	[self insertAtFront:entry];
+}
+
+- (void)removeEntry:(FileDecodeCacheEntry *)entry
+{
+	// The dictionary may hold the only strong reference, so the key is retained until the entry is gone
+	NSString *key = entry->_key;
+	[self unlink:entry];
+	[_entries removeObjectForKey:key];
+}
+
+- (void)evictToBudget
+{
+	while (_tail && _totalCost > _memoryBudget)
+	{
+		[self removeEntry:_tail];
+		_evictionCount++;
+	}
+}
+
+@end
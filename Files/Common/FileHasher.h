@@ -0,0 +1,79 @@
+//
+//  FileHasher.h
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+//  Description: Computes content hashes incrementally, so files are fingerprinted by streaming them
+//               through a fixed-size buffer instead of being read whole into memory. Many files can be
+//               hashed concurrently with a bounded number of reads in flight.
+//
+
+#import <Foundation/Foundation.h>
+
+@class File;
+
+typedef NS_ENUM(NSInteger, FileHashAlgorithm)
+{
+	/**
+	 The 64-bit xxHash (XXH64, seed 0): very fast, for change detection and cache keys. Not cryptographic.
+	 The digest is 8 bytes, most significant first (xxHash's canonical form).
+	 */
+	FileHashAlgorithmXXH64 = 0,
+
+	/**
+	 SHA-256: for content that must not collide even when crafted on purpose. The digest is 32 bytes.
+	 */
+	FileHashAlgorithmSHA256
+};
+
+@interface FileHasher : NSObject
+
+#pragma mark Lifetime
+
+- (id)initWithAlgorithm:(FileHashAlgorithm)algorithm;
+
+@property (readonly) FileHashAlgorithm algorithm;
+
+/**
+ The length of the digests produced by the algorithm, in bytes.
+ */
++ (NSUInteger)digestLengthForAlgorithm:(FileHashAlgorithm)algorithm;
+
+#pragma mark Hashing
+
+- (void)updateWithBytes:(const void *)bytes length:(NSUInteger)length;
+
+- (void)updateWithData:(NSData *)data;
+
+/**
+ Returns the digest of everything passed to the hasher so far. The hasher can't be updated afterwards.
+ */
+- (NSData *)finish;
+
+/**
+ Returns the digest of the data.
+ */
++ (NSData *)digestOfData:(NSData *)data algorithm:(FileHashAlgorithm)algorithm;
+
+#pragma mark Hashing Files
+
+/**
+ The size of the buffer each read fills, 1 MB by default.
+ */
++ (NSUInteger)bufferSize;
+
+/**
+ Returns the digest of the file's contents, read sequentially through a page-aligned buffer.
+ */
++ (NSData *)digestOfFile:(File *)file algorithm:(FileHashAlgorithm)algorithm error:(NSError **)error;
+
+/**
+ Hashes the files concurrently, keeping at most concurrentReads files open and being read at once (0 uses
+ one per processor), which also bounds memory use to that many buffers. Returns the digests keyed by the
+ files' absolute paths. Files that could not be read are left out and described in errors (if not NULL).
+ */
++ (NSDictionary<NSString *, NSData *> *)digestsOfFiles:(NSArray<File *> *)files algorithm:(FileHashAlgorithm)algorithm concurrentReads:(NSUInteger)concurrentReads errors:(NSArray<NSError *> **)errors;
+
+@end
@@ -0,0 +1,551 @@
+//
+//  FileHasher.m
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+
+#import <errno.h>
+#import <fcntl.h>
+#import <pthread.h>
+#import <stdint.h>
+#import <stdlib.h>
+#import <string.h>
+#import <unistd.h>
+#import "FileHasher.h"
+#import "File.h"
+#import "WorkerPool.h"
+#import "NSError+FilesAdditions.h"
+#import "NSException+FilesAdditions.h"
+
+#if defined(__APPLE__)
+#import <CommonCrypto/CommonDigest.h>
+#endif
+
+// Large enough that the per-read system call cost disappears, small enough to stay in the L2 cache
+#define FileHasherBufferSize (1024 * 1024)
+
+typedef struct
+{
+	uint64_t accumulators[4];
+	uint64_t totalLength;
+	uint8_t pending[32];
+	uint32_t pendingLength;
+} FileHasherXXH64State;
+
+#if !defined(__APPLE__)
+typedef struct
+{
+	uint32_t state[8];
+	uint64_t totalLength;
+	uint8_t pending[64];
+	uint32_t pendingLength;
+} FileHasherSHA256State;
+#endif
+
+static void FileHasherXXH64Init(FileHasherXXH64State *state);
+static void FileHasherXXH64Update(FileHasherXXH64State *state, const uint8_t *bytes, size_t length);
+static uint64_t FileHasherXXH64Final(const FileHasherXXH64State *state);
+
+#if !defined(__APPLE__)
+static void FileHasherSHA256Init(FileHasherSHA256State *state);
+static void FileHasherSHA256Update(FileHasherSHA256State *state, const uint8_t *bytes, size_t length);
+static void FileHasherSHA256Final(FileHasherSHA256State *state, uint8_t digest[32]);
+#endif
+
+static int FileHasherOpen(const char *path);
+static BOOL FileHasherUpdateWithDescriptor(FileHasher *hasher, int descriptor, void *buffer, size_t size);
+
+@implementation FileHasher
+{
+	union
+	{
+		FileHasherXXH64State xxh64;
+#if defined(__APPLE__)
+		CC_SHA256_CTX sha256;
+#else
+		FileHasherSHA256State sha256;
+#endif
+	} _state;
+
+	BOOL _finished;
+}
+
+#pragma mark Lifetime
+
+- (id)initWithAlgorithm:(FileHashAlgorithm)algorithm
+{
+	self = [super init];
+	if (self)
+	{
+		_algorithm = algorithm;
+
+		switch (algorithm)
+		{
+			case FileHashAlgorithmXXH64: FileHasherXXH64Init(&_state.xxh64); break;
+#if defined(__APPLE__)
+			case FileHashAlgorithmSHA256: CC_SHA256_Init(&_state.sha256); break;
+#else
+			case FileHashAlgorithmSHA256: FileHasherSHA256Init(&_state.sha256); break;
+#endif
+			default: @throw [NSException exceptionWithReason:@"Unknown hash algorithm %ld", (long)algorithm];
+		}
+	}
+	return self;
+}
+
++ (NSUInteger)digestLengthForAlgorithm:(FileHashAlgorithm)algorithm
+{
+	return (algorithm == FileHashAlgorithmXXH64 ? 8 : 32);
+}
+
+#pragma mark Hashing
+
+- (void)updateWithBytes:(const void *)bytes length:(NSUInteger)length
+{
+	if (_finished) @throw [NSException exceptionWithReason:@"Can't update a hasher after it has finished"];
+
+	switch (_algorithm)
+	{
+		case FileHashAlgorithmXXH64:
+			FileHasherXXH64Update(&_state.xxh64, bytes, length);
+			break;
+
+		case FileHashAlgorithmSHA256:
+#if defined(__APPLE__)
+			// CommonCrypto takes 32-bit lengths and uses the processor's SHA instructions where present
+			for (NSUInteger done = 0; done < length; )
+			{
+				CC_LONG count = (CC_LONG)MIN(length - done, (NSUInteger)UINT32_MAX);
+				CC_SHA256_Update(&_state.sha256, (const char *)bytes + done, count);
+				done += count;
+			}
+#else
+			FileHasherSHA256Update(&_state.sha256, bytes, length);
+#endif
+			break;
+	}
+}
+
+- (void)updateWithData:(NSData *)data
+{
+	[self updateWithBytes:[data bytes] length:[data length]];
+}
+
+- (NSData *)finish
+{
+	if (_finished) @throw [NSException exceptionWithReason:@"The hasher has already finished"];
+	_finished = YES;
+
+	uint8_t digest[32];
+
+	if (_algorithm == FileHashAlgorithmXXH64)
+	{
+		uint64_t hash = FileHasherXXH64Final(&_state.xxh64);
+		for (int i = 0; i < 8; i++) digest[i] = (uint8_t)(hash >> (56 - 8 * i));
+		return [NSData dataWithBytes:digest length:8];
+	}
+
+#if defined(__APPLE__)
+	CC_SHA256_Final(digest, &_state.sha256);
+#else
+	FileHasherSHA256Final(&_state.sha256, digest);
+#endif
+	return [NSData dataWithBytes:digest length:32];
+}
+
++ (NSData *)digestOfData:(NSData *)data algorithm:(FileHashAlgorithm)algorithm
+{
+	FileHasher *hasher = [[FileHasher alloc] initWithAlgorithm:algorithm];
+	[hasher updateWithData:data];
+	return [hasher finish];
+}
+
+#pragma mark Hashing Files
+
++ (NSUInteger)bufferSize
+{
+	return FileHasherBufferSize;
+}
+
++ (NSData *)digestOfFile:(File *)file algorithm:(FileHashAlgorithm)algorithm error:(NSError **)error
+{
+	if (file == nil) @throw [NSException exceptionWithReason:@"File is nil"];
+
+	FileHasher *hasher = [[FileHasher alloc] initWithAlgorithm:algorithm];
+	void *buffer = NULL;
+	int code = posix_memalign(&buffer, (size_t)getpagesize(), FileHasherBufferSize);
+
+	if (code == 0)
+	{
+		int descriptor = FileHasherOpen([[file absolutePath] fileSystemRepresentation]);
+		BOOL success = (descriptor >= 0 && FileHasherUpdateWithDescriptor(hasher, descriptor, buffer, FileHasherBufferSize));
+
+		code = (success ? 0 : errno);
+		if (descriptor >= 0) close(descriptor);
+		free(buffer);
+	}
+
+	if (code != 0)
+	{
+		NSError *innerError = [NSError errorWithPOSIXCode:code description:@"Could not hash the contents of %@", [file absolutePath]];
+		NSLog(@"%@", [innerError description]);
+		if (error) *error = innerError;
+		return nil;
+	}
+
+	return [hasher finish];
+}
+
++ (NSDictionary<NSString *, NSData *> *)digestsOfFiles:(NSArray<File *> *)files algorithm:(FileHashAlgorithm)algorithm concurrentReads:(NSUInteger)concurrentReads errors:(NSArray<NSError *> **)errors
+{
+	if (files == nil) @throw [NSException exceptionWithReason:@"Files is nil"];
+
+	WorkerPool *pool = [[WorkerPool alloc] initWithWorkerCount:concurrentReads];
+	NSUInteger bufferCount = [pool workerCount];
+
+	// At most one task runs per worker, so one buffer per worker is always enough and memory stays bounded
+	void **buffers = calloc(bufferCount, sizeof(void *));
+	__block NSUInteger availableCount = 0;
+
+	for (NSUInteger i = 0; buffers && i < bufferCount; i++)
+		if (posix_memalign(&buffers[availableCount], (size_t)getpagesize(), FileHasherBufferSize) == 0) availableCount++;
+
+	if (availableCount == 0)
+	{
+		free(buffers);
+		if (errors) *errors = @[[NSError errorWithPOSIXCode:ENOMEM description:@"Could not allocate buffers to hash %lu files", (unsigned long)[files count]]];
+		return @{};
+	}
+
+	NSMutableDictionary *digests = [NSMutableDictionary dictionaryWithCapacity:[files count]];
+	NSMutableArray *mutableErrors = [NSMutableArray array];
+	pthread_mutex_t lockStorage;
+	pthread_mutex_t *lock = &lockStorage;
+	pthread_cond_t conditionStorage;
+	pthread_cond_t *bufferReturned = &conditionStorage;
+	pthread_mutex_init(lock, NULL);
+	pthread_cond_init(bufferReturned, NULL);
+
+	for (File *file in files)
+	{
+		[pool addTask:^{
+			pthread_mutex_lock(lock);
+			while (availableCount == 0) pthread_cond_wait(bufferReturned, lock);
+			void *buffer = buffers[--availableCount];
+			pthread_mutex_unlock(lock);
+
+			NSString *path = [file absolutePath];
+			FileHasher *hasher = [[FileHasher alloc] initWithAlgorithm:algorithm];
+			int descriptor = FileHasherOpen([path fileSystemRepresentation]);
+			BOOL success = (descriptor >= 0 && FileHasherUpdateWithDescriptor(hasher, descriptor, buffer, FileHasherBufferSize));
+			int code = errno;
+			if (descriptor >= 0) close(descriptor);
+
+			NSData *digest = (success ? [hasher finish] : nil);
+			NSError *error = (success ? nil : [NSError errorWithPOSIXCode:code description:@"Could not hash the contents of %@", path]);
+
+			pthread_mutex_lock(lock);
+			buffers[availableCount++] = buffer;
+			if (digest) digests[path] = digest; else [mutableErrors addObject:error];
+			pthread_cond_signal(bufferReturned);
+			pthread_mutex_unlock(lock);
+		}];
+	}
+
+	[pool waitUntilAllTasksAreFinished];
+
+	for (NSUInteger i = 0; i < availableCount; i++) free(buffers[i]);
+	free(buffers);
+	pthread_cond_destroy(bufferReturned);
+	pthread_mutex_destroy(lock);
+
+	if (errors) *errors = [mutableErrors copy];
+	return [digests copy];
+}
+
+@end
+
+#pragma mark - Reading
+
+static int FileHasherOpen(const char *path)
+{
+	int descriptor = open(path, O_RDONLY | O_CLOEXEC);
+	if (descriptor < 0) return -1;
+
+	// Hashing reads every byte once, front to back: ask for aggressive read-ahead
+#if defined(__APPLE__)
+	fcntl(descriptor, F_RDAHEAD, 1);
+#elif defined(POSIX_FADV_SEQUENTIAL)
+	posix_fadvise(descriptor, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+	return descriptor;
+}
+
+static BOOL FileHasherUpdateWithDescriptor(FileHasher *hasher, int descriptor, void *buffer, size_t size)
+{
+	while (1)
+	{
+		ssize_t count = read(descriptor, buffer, size);
+		if (count < 0 && errno == EINTR) continue;
+		if (count < 0) return NO;
+		if (count == 0) return YES;
+
+		[hasher updateWithBytes:buffer length:(NSUInteger)count];
+	}
+}
+
+#pragma mark - XXH64
+
+#define FileHasherXXH64Prime1 0x9E3779B185EBCA87ULL
+#define FileHasherXXH64Prime2 0xC2B2AE3D27D4EB4FULL
+#define FileHasherXXH64Prime3 0x165667B19E3779F9ULL
+#define FileHasherXXH64Prime4 0x85EBCA77C2B2AE63ULL
+#define FileHasherXXH64Prime5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t FileHasherRotateLeft64(uint64_t value, int count)
+{
+	return (value << count) | (value >> (64 - count));
+}
+
+static inline uint64_t FileHasherReadLittleEndian64(const uint8_t *bytes)
+{
+	uint64_t value;
+	memcpy(&value, bytes, sizeof(value));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	value = __builtin_bswap64(value);
+#endif
+	return value;
+}
+
+static inline uint32_t FileHasherReadLittleEndian32(const uint8_t *bytes)
+{
+	uint32_t value;
+	memcpy(&value, bytes, sizeof(value));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	value = __builtin_bswap32(value);
+#endif
+	return value;
+}
+
+static inline uint64_t FileHasherXXH64Round(uint64_t accumulator, uint64_t input)
+{
+	accumulator += input * FileHasherXXH64Prime2;
+	accumulator = FileHasherRotateLeft64(accumulator, 31);
+	return accumulator * FileHasherXXH64Prime1;
+}
+
+static inline uint64_t FileHasherXXH64MergeRound(uint64_t accumulator, uint64_t value)
+{
+	accumulator ^= FileHasherXXH64Round(0, value);
+	return accumulator * FileHasherXXH64Prime1 + FileHasherXXH64Prime4;
+}
+
+static void FileHasherXXH64Init(FileHasherXXH64State *state)
+{
+	memset(state, 0, sizeof(*state));
+	state->accumulators[0] = FileHasherXXH64Prime1 + FileHasherXXH64Prime2;
+	state->accumulators[1] = FileHasherXXH64Prime2;
+	state->accumulators[2] = 0;
+	state->accumulators[3] = 0 - FileHasherXXH64Prime1;
+}
+
+static void FileHasherXXH64Update(FileHasherXXH64State *state, const uint8_t *bytes, size_t length)
+{
+	state->totalLength += length;
+
+	if (state->pendingLength + length < 32)
+	{
+		memcpy(state->pending + state->pendingLength, bytes, length);
+		state->pendingLength += (uint32_t)length;
+		return;
+	}
+
+	uint64_t *accumulators = state->accumulators;
+
+	if (state->pendingLength > 0)
+	{
+		size_t fill = 32 - state->pendingLength;
+		memcpy(state->pending + state->pendingLength, bytes, fill);
+		bytes += fill;
+		length -= fill;
+
+		for (int i = 0; i < 4; i++)
+			accumulators[i] = FileHasherXXH64Round(accumulators[i], FileHasherReadLittleEndian64(state->pending + 8 * i));
+
+		state->pendingLength = 0;
+	}
+
+	// The four independent lanes let the processor overlap their multiplications
+	uint64_t v1 = accumulators[0], v2 = accumulators[1], v3 = accumulators[2], v4 = accumulators[3];
+
+	for (; length >= 32; bytes += 32, length -= 32)
+	{
+		v1 = FileHasherXXH64Round(v1, FileHasherReadLittleEndian64(bytes));
+		v2 = FileHasherXXH64Round(v2, FileHasherReadLittleEndian64(bytes + 8));
+		v3 = FileHasherXXH64Round(v3, FileHasherReadLittleEndian64(bytes + 16));
+		v4 = FileHasherXXH64Round(v4, FileHasherReadLittleEndian64(bytes + 24));
+	}
+
+	accumulators[0] = v1, accumulators[1] = v2, accumulators[2] = v3, accumulators[3] = v4;
+
+	memcpy(state->pending, bytes, length);
+	state->pendingLength = (uint32_t)length;
+}
+
+static uint64_t FileHasherXXH64Final(const FileHasherXXH64State *state)
+{
+	const uint64_t *accumulators = state->accumulators;
+	uint64_t hash;
+
+	if (state->totalLength >= 32)
+	{
+		hash = FileHasherRotateLeft64(accumulators[0], 1) + FileHasherRotateLeft64(accumulators[1], 7) + FileHasherRotateLeft64(accumulators[2], 12) + FileHasherRotateLeft64(accumulators[3], 18);
+		for (int i = 0; i < 4; i++) hash = FileHasherXXH64MergeRound(hash, accumulators[i]);
+	}
+	else
+	{
+		hash = FileHasherXXH64Prime5;
+	}
+
+	hash += state->totalLength;
+
+	const uint8_t *bytes = state->pending;
+	uint32_t length = state->pendingLength;
+
+	for (; length >= 8; bytes += 8, length -= 8)
+	{
+		hash ^= FileHasherXXH64Round(0, FileHasherReadLittleEndian64(bytes));
+		hash = FileHasherRotateLeft64(hash, 27) * FileHasherXXH64Prime1 + FileHasherXXH64Prime4;
+	}
+
+	if (length >= 4)
+	{
+		hash ^= (uint64_t)FileHasherReadLittleEndian32(bytes) * FileHasherXXH64Prime1;
+		hash = FileHasherRotateLeft64(hash, 23) * FileHasherXXH64Prime2 + FileHasherXXH64Prime3;
+		bytes += 4, length -= 4;
+	}
+
+	for (; length > 0; bytes++, length--)
+	{
+		hash ^= (*bytes) * FileHasherXXH64Prime5;
+		hash = FileHasherRotateLeft64(hash, 11) * FileHasherXXH64Prime1;
+	}
+
+	hash ^= hash >> 33;
+	hash *= FileHasherXXH64Prime2;
+	hash ^= hash >> 29;
+	hash *= FileHasherXXH64Prime3;
+	hash ^= hash >> 32;
+
+	return hash;
+}
+
+#pragma mark - SHA-256
+
+#if !defined(__APPLE__)
+
+static const uint32_t FileHasherSHA256RoundConstants[64] =
+{
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t FileHasherRotateRight32(uint32_t value, int count)
+{
+	return (value >> count) | (value << (32 - count));
+}
+
+static void FileHasherSHA256Init(FileHasherSHA256State *state)
+{
+	static const uint32_t initialState[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+
+	memset(state, 0, sizeof(*state));
+	memcpy(state->state, initialState, sizeof(initialState));
+}
+
+static void FileHasherSHA256Compress(uint32_t state[8], const uint8_t *block)
+{
+	uint32_t w[64];
+
+	for (int i = 0; i < 16; i++)
+		w[i] = ((uint32_t)block[4 * i] << 24) | ((uint32_t)block[4 * i + 1] << 16) | ((uint32_t)block[4 * i + 2] << 8) | block[4 * i + 3];
+
+	for (int i = 16; i < 64; i++)
+	{
+		uint32_t s0 = FileHasherRotateRight32(w[i - 15], 7) ^ FileHasherRotateRight32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		uint32_t s1 = FileHasherRotateRight32(w[i - 2], 17) ^ FileHasherRotateRight32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+
+	uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4], f = state[5], g = state[6], h = state[7];
+
+	for (int i = 0; i < 64; i++)
+	{
+		uint32_t s1 = FileHasherRotateRight32(e, 6) ^ FileHasherRotateRight32(e, 11) ^ FileHasherRotateRight32(e, 25);
+		uint32_t choice = (e & f) ^ (~e & g);
+		uint32_t temp1 = h + s1 + choice + FileHasherSHA256RoundConstants[i] + w[i];
+		uint32_t s0 = FileHasherRotateRight32(a, 2) ^ FileHasherRotateRight32(a, 13) ^ FileHasherRotateRight32(a, 22);
+		uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+		uint32_t temp2 = s0 + majority;
+
+		h = g, g = f, f = e, e = d + temp1;
+		d = c, c = b, b = a, a = temp1 + temp2;
+	}
+
+	state[0] += a, state[1] += b, state[2] += c, state[3] += d;
+	state[4] += e, state[5] += f, state[6] += g, state[7] += h;
+}
+
+static void FileHasherSHA256Update(FileHasherSHA256State *state, const uint8_t *bytes, size_t length)
+{
+	state->totalLength += length;
+
+	if (state->pendingLength > 0)
+	{
+		size_t fill = MIN(64 - state->pendingLength, length);
+		memcpy(state->pending + state->pendingLength, bytes, fill);
+		state->pendingLength += (uint32_t)fill;
+		bytes += fill;
+		length -= fill;
+
+		if (state->pendingLength < 64) return;
+
+		FileHasherSHA256Compress(state->state, state->pending);
+		state->pendingLength = 0;
+	}
+
+	for (; length >= 64; bytes += 64, length -= 64)
+		FileHasherSHA256Compress(state->state, bytes);
+
+	memcpy(state->pending, bytes, length);
+	state->pendingLength = (uint32_t)length;
+}
+
+static void FileHasherSHA256Final(FileHasherSHA256State *state, uint8_t digest[32])
+{
+	uint64_t bitLength = state->totalLength * 8;
+	uint8_t padding[72] = { 0x80 };
+	size_t paddingLength = (state->pendingLength < 56 ? 56 - state->pendingLength : 120 - state->pendingLength);
+
+	for (int i = 0; i < 8; i++) padding[paddingLength + i] = (uint8_t)(bitLength >> (56 - 8 * i));
+	FileHasherSHA256Update(state, padding, paddingLength + 8);
+
+	for (int i = 0; i < 8; i++)
+	{
+		digest[4 * i] = (uint8_t)(state->state[i] >> 24);
+		digest[4 * i + 1] = (uint8_t)(state->state[i] >> 16);
+		digest[4 * i + 2] = (uint8_t)(state->state[i] >> 8);
+		digest[4 * i + 3] = (uint8_t)state->state[i];
+	}
+}
+
+#endif
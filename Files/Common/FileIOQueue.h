@@ -0,0 +1,60 @@
+//
+//  FileIOQueue.h
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+//  Description: Performs file operations asynchronously on a small, fixed set of threads and reports
+//               results through completion handlers. On Linux, reads are batched through io_uring so
+//               that thousands of them can be in flight from a single thread.
+//
+
+#import <Foundation/Foundation.h>
+
+@class Path;
+@class File;
+@class FileInfo;
+
+@interface FileIOQueue : NSObject
+
+#pragma mark Lifetime
+
+/**
+ A queue shared by the whole process, used by the asynchronous methods of File and Path.
+ */
++ (FileIOQueue *)sharedQueue;
+
+/**
+ Creates a queue whose blocking operations run on the specified number of threads (0 uses one per processor).
+ */
+- (id)initWithWorkerCount:(NSUInteger)workerCount;
+
+#pragma mark Configuration
+
+/**
+ Whether reads are submitted through io_uring. When NO (other systems, old kernels, io_uring being
+ disabled or failing), reads run on the worker threads like the other operations.
+ */
+@property (readonly) BOOL usesIOUring;
+
+#pragma mark Operations
+
+// Completion handlers are called exactly once, on one of the queue's internal threads: they should return
+// quickly and hand any long work to another queue. Errors are reported like the synchronous methods do.
+
+- (void)readDataOfFile:(File *)file completion:(void (^)(NSData *data, NSError *error))completion;
+
+- (void)writeData:(NSData *)data toFile:(File *)file overwrite:(BOOL)overwrite completion:(void (^)(BOOL success, NSError *error))completion;
+
+- (void)copyFile:(File *)file to:(Path *)destination overwrite:(BOOL)overwrite completion:(void (^)(File *copy, NSError *error))completion;
+
+- (void)infoForItem:(Path *)item completion:(void (^)(FileInfo *info, NSError *error))completion;
+
+/**
+ Blocks until every operation added so far (and its completion handler) has finished.
+ Must not be called from a completion handler.
+ */
+- (void)waitUntilAllOperationsAreFinished;
+
+@end
@@ -0,0 +1,732 @@
+//
+//  FileIOQueue.m
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // struct statx
+#endif
+
+#import <errno.h>
+#import <fcntl.h>
+#import <pthread.h>
+#import <stdint.h>
+#import <stdlib.h>
+#import <string.h>
+#import <sys/stat.h>
+#import <unistd.h>
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#import <sys/mman.h>
+#import <sys/syscall.h>
+#import <linux/io_uring.h>
+#endif
+#import "FileIOQueue.h"
+#import "File.h"
+#import "FileInfo.h"
+#import "WorkerPool.h"
+#import "Path+Internal.h"
+#import "NSError+FilesAdditions.h"
+#import "NSException+FilesAdditions.h"
+
+// IORING_FEAT_FAST_POLL comes with the same kernel headers (5.7) as the open, statx, read and close operations
+#if defined(IORING_FEAT_FAST_POLL) && defined(STATX_TYPE) && defined(SYS_io_uring_setup)
+#define FileIOQueueUsesRing 1
+#else
+#define FileIOQueueUsesRing 0
+#endif
+
+#define FileIOQueueRingEntryCount 256
+#define FileIOQueueUnknownSizeReadLength (16 * 1024)
+#define FileIOQueueMaximumReadLength (1U << 30)
+
+#if FileIOQueueUsesRing
+
+#pragma mark - Ring
+
+typedef struct FileIORing
+{
+	int descriptor;
+	unsigned entryCount;
+	
+	unsigned *submissionHead;
+	unsigned *submissionTail;
+	unsigned *submissionMask;
+	unsigned *submissionArray;
+	struct io_uring_sqe *submissionEntries;
+	unsigned pendingSubmissionCount;
+	
+	unsigned *completionHead;
+	unsigned *completionTail;
+	unsigned *completionMask;
+	struct io_uring_cqe *completionEntries;
+	
+	void *submissionRing;
+	size_t submissionRingSize;
+	void *completionRing;
+	size_t completionRingSize;
+	size_t submissionEntriesSize;
+} FileIORing;
+
+static BOOL FileIORingSupportsOperations(int descriptor, const int *operations, size_t count)
+{
+	size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+	struct io_uring_probe *probe = calloc(1, size);
+	if (probe == NULL) return NO;
+	
+	BOOL supported = (syscall(SYS_io_uring_register, descriptor, IORING_REGISTER_PROBE, probe, 256) == 0);
+	
+	for (size_t i = 0; supported && i < count; i++)
+		supported = (operations[i] <= probe->last_op && (probe->ops[operations[i]].flags & IO_URING_OP_SUPPORTED));
+	
+	free(probe);
+	return supported;
+}
+
+static void FileIORingDestroy(FileIORing *ring)
+{
+	if (ring->submissionEntries) munmap(ring->submissionEntries, ring->submissionEntriesSize);
+	if (ring->completionRing && ring->completionRing != ring->submissionRing) munmap(ring->completionRing, ring->completionRingSize);
+	if (ring->submissionRing) munmap(ring->submissionRing, ring->submissionRingSize);
+	if (ring->descriptor >= 0) close(ring->descriptor);
+	
+	memset(ring, 0, sizeof(*ring));
+	ring->descriptor = -1;
+}
+
+// Fails where io_uring is missing, disabled (containers often block it) or lacks the operations used here
+static BOOL FileIORingCreate(FileIORing *ring, unsigned entryCount, const int *operations, size_t operationCount)
+{
+	memset(ring, 0, sizeof(*ring));
+	
+	struct io_uring_params parameters;
+	memset(&parameters, 0, sizeof(parameters));
+	
+	ring->descriptor = (int)syscall(SYS_io_uring_setup, entryCount, &parameters);
+	if (ring->descriptor < 0) return NO;
+	
+	ring->entryCount = parameters.sq_entries;
+	ring->submissionRingSize = parameters.sq_off.array + parameters.sq_entries * sizeof(unsigned);
+	ring->completionRingSize = parameters.cq_off.cqes + parameters.cq_entries * sizeof(struct io_uring_cqe);
+	ring->submissionEntriesSize = parameters.sq_entries * sizeof(struct io_uring_sqe);
+	
+	if (parameters.features & IORING_FEAT_SINGLE_MMAP)
+		ring->submissionRingSize = ring->completionRingSize = MAX(ring->submissionRingSize, ring->completionRingSize);
+	
+	ring->submissionRing = mmap(NULL, ring->submissionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->descriptor, IORING_OFF_SQ_RING);
+	if (ring->submissionRing == MAP_FAILED) { ring->submissionRing = NULL; FileIORingDestroy(ring); return NO; }
+	
+	if (parameters.features & IORING_FEAT_SINGLE_MMAP)
+		ring->completionRing = ring->submissionRing;
+	else
+		ring->completionRing = mmap(NULL, ring->completionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->descriptor, IORING_OFF_CQ_RING);
+	
+	if (ring->completionRing == MAP_FAILED) { ring->completionRing = NULL; FileIORingDestroy(ring); return NO; }
+	
+	ring->submissionEntries = mmap(NULL, ring->submissionEntriesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->descriptor, IORING_OFF_SQES);
+	if (ring->submissionEntries == MAP_FAILED) { ring->submissionEntries = NULL; FileIORingDestroy(ring); return NO; }
+	
+	char *submission = ring->submissionRing;
+	ring->submissionHead = (unsigned *)(submission + parameters.sq_off.head);
+	ring->submissionTail = (unsigned *)(submission + parameters.sq_off.tail);
+	ring->submissionMask = (unsigned *)(submission + parameters.sq_off.ring_mask);
+	ring->submissionArray = (unsigned *)(submission + parameters.sq_off.array);
+	
+	char *completion = ring->completionRing;
+	ring->completionHead = (unsigned *)(completion + parameters.cq_off.head);
+	ring->completionTail = (unsigned *)(completion + parameters.cq_off.tail);
+	ring->completionMask = (unsigned *)(completion + parameters.cq_off.ring_mask);
+	ring->completionEntries = (struct io_uring_cqe *)(completion + parameters.cq_off.cqes);
+	
+	if (!FileIORingSupportsOperations(ring->descriptor, operations, operationCount))
+	{
+		FileIORingDestroy(ring);
+		errno = ENOTSUP;
+		return NO;
+	}
+	
+	return YES;
+}
+
+// Returns a cleared entry to fill in, or NULL when the submission queue is full
+static struct io_uring_sqe *FileIORingNextEntry(FileIORing *ring)
+{
+	unsigned head = __atomic_load_n(ring->submissionHead, __ATOMIC_ACQUIRE);
+	unsigned tail = *ring->submissionTail + ring->pendingSubmissionCount;
+	if (tail - head >= ring->entryCount) return NULL;
+	
+	unsigned index = tail & *ring->submissionMask;
+	struct io_uring_sqe *entry = &ring->submissionEntries[index];
+	memset(entry, 0, sizeof(*entry));
+	
+	ring->submissionArray[index] = index;
+	ring->pendingSubmissionCount++;
+	
+	return entry;
+}
+
+// Submits every prepared entry in a single system call and waits for at least waitCount completions
+static BOOL FileIORingSubmitAndWait(FileIORing *ring, unsigned waitCount)
+{
+	unsigned submitCount = ring->pendingSubmissionCount;
+	__atomic_store_n(ring->submissionTail, *ring->submissionTail + submitCount, __ATOMIC_RELEASE);
+	ring->pendingSubmissionCount = 0;
+	
+	while (YES)
+	{
+		long result = syscall(SYS_io_uring_enter, ring->descriptor, submitCount, waitCount, (waitCount > 0 ? IORING_ENTER_GETEVENTS : 0), NULL, 0);
+		if (result < 0 && errno == EINTR) continue;
+		if (result < 0) return NO;
+		
+		// Passing the same entries again would spin if the kernel can't take any of them
+		if (result == 0 && submitCount > 0) { errno = EAGAIN; return NO; }
+		
+		// Entries the kernel didn't consume yet are still in the queue and must be passed again
+		submitCount -= MIN((unsigned)result, submitCount);
+		if (submitCount == 0) return YES;
+	}
+}
+
+static BOOL FileIORingNextCompletion(FileIORing *ring, struct io_uring_cqe *completion)
+{
+	unsigned head = *ring->completionHead;
+	if (head == __atomic_load_n(ring->completionTail, __ATOMIC_ACQUIRE)) return NO;
+	
+	*completion = ring->completionEntries[head & *ring->completionMask];
+	__atomic_store_n(ring->completionHead, head + 1, __ATOMIC_RELEASE);
+	
+	return YES;
+}
+
+#pragma mark - Ring Reads
+
+// Each read goes through three stages, with every stage of every in-flight read sharing submissions:
+// open and statx (in parallel, both by path), reads until the file's size or its end is reached, then close.
+typedef NS_ENUM(uintptr_t, FileIORingOperation)
+{
+	FileIORingOperationOpen = 0,
+	FileIORingOperationStat,
+	FileIORingOperationRead,
+	FileIORingOperationClose
+};
+
+#define FileIORingOperationMask ((uintptr_t)3)
+
+@interface FileIORingRead : NSObject
+{
+	@public
+	File *_file;
+	NSData *_path;
+	void (^_completion)(NSData *, NSError *);
+	
+	int _descriptor;
+	int _errorCode;
+	unsigned _outstandingOperationCount;
+	struct statx _info;
+	NSMutableData *_data;
+	NSUInteger _length;
+	BOOL _sizeIsKnown;
+}
+
+@end
+
+@implementation FileIORingRead
+@end
+
+#endif
+
+#pragma mark - Shared State
+
+// The ring thread retains this object rather than the queue itself so that releasing the queue stops it.
+@interface FileIOQueueState : NSObject
+{
+	@public
+	pthread_mutex_t _lock;
+	pthread_cond_t _workAvailable;
+	pthread_cond_t _allOperationsFinished;
+	NSUInteger _unfinishedOperationCount;
+	BOOL _stopped;
+	
+#if FileIOQueueUsesRing
+	FileIORing _ring;
+	NSMutableArray<FileIORingRead *> *_pendingReads;
+	WorkerPool *_pool;
+	
+	// Once the ring fails, reads run on the pool instead (set under the lock)
+	BOOL _ringFailed;
+	
+	// Only used by the ring thread
+	int _ringErrorCode;
+#endif
+}
+
+@end
+
+@implementation FileIOQueueState
+
+- (id)init
+{
+	self = [super init];
+	if (self)
+	{
+		pthread_mutex_init(&_lock, NULL);
+		pthread_cond_init(&_workAvailable, NULL);
+		pthread_cond_init(&_allOperationsFinished, NULL);
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	pthread_cond_destroy(&_allOperationsFinished);
+	pthread_cond_destroy(&_workAvailable);
+	pthread_mutex_destroy(&_lock);
+}
+
+- (void)startOperation
+{
+	pthread_mutex_lock(&_lock);
+	_unfinishedOperationCount++;
+	pthread_mutex_unlock(&_lock);
+}
+
+- (void)finishOperation
+{
+	pthread_mutex_lock(&_lock);
+	if (--_unfinishedOperationCount == 0) pthread_cond_broadcast(&_allOperationsFinished);
+	pthread_mutex_unlock(&_lock);
+}
+
+- (void)waitUntilAllOperationsAreFinished
+{
+	pthread_mutex_lock(&_lock);
+	while (_unfinishedOperationCount > 0) pthread_cond_wait(&_allOperationsFinished, &_lock);
+	pthread_mutex_unlock(&_lock);
+}
+
+- (void)stop
+{
+	pthread_mutex_lock(&_lock);
+	_stopped = YES;
+	pthread_cond_broadcast(&_workAvailable);
+	pthread_mutex_unlock(&_lock);
+}
+
+#if FileIOQueueUsesRing
+
+#pragma mark Ring Thread
+
+- (BOOL)startRingWithFallbackPool:(WorkerPool *)pool
+{
+	static const int operations[] = { IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_CLOSE };
+	if (!FileIORingCreate(&_ring, FileIOQueueRingEntryCount, operations, sizeof(operations) / sizeof(operations[0]))) return NO;
+	
+	_pendingReads = [NSMutableArray array];
+	_pool = pool;
+	[NSThread detachNewThreadSelector:@selector(runRing) toTarget:self withObject:nil];
+	
+	return YES;
+}
+
+- (BOOL)addRead:(FileIORingRead *)read
+{
+	pthread_mutex_lock(&_lock);
+	
+	BOOL added = !_ringFailed;
+	
+	if (added)
+	{
+		[_pendingReads addObject:read];
+		pthread_cond_signal(&_workAvailable);
+	}
+	
+	pthread_mutex_unlock(&_lock);
+	return added;
+}
+
+- (BOOL)ringFailed
+{
+	pthread_mutex_lock(&_lock);
+	BOOL failed = _ringFailed;
+	pthread_mutex_unlock(&_lock);
+	return failed;
+}
+
+- (void)runRing
+{
+	// Reads in flight are referenced by the kernel through their addresses, so they are kept alive here.
+	// Each one has at most two operations outstanding, which keeps both kernel queues from overflowing.
+	NSMutableSet<FileIORingRead *> *inFlightReads = [NSMutableSet set];
+	NSUInteger maximumInFlightCount = _ring.entryCount / 2;
+	
+	while (YES)
+	{
+		@autoreleasepool
+		{
+			pthread_mutex_lock(&_lock);
+			while ([_pendingReads count] == 0 && [inFlightReads count] == 0 && !_stopped) pthread_cond_wait(&_workAvailable, &_lock);
+			
+			if ([_pendingReads count] == 0 && [inFlightReads count] == 0)
+			{
+				pthread_mutex_unlock(&_lock);
+				break;
+			}
+			
+			NSRange range = NSMakeRange(0, MIN([_pendingReads count], maximumInFlightCount - [inFlightReads count]));
+			NSArray<FileIORingRead *> *newReads = [_pendingReads subarrayWithRange:range];
+			[_pendingReads removeObjectsInRange:range];
+			pthread_mutex_unlock(&_lock);
+			
+			for (FileIORingRead *read in newReads)
+			{
+				[inFlightReads addObject:read];
+				[self submitOpenAndStatForRead:read];
+			}
+			
+			// New reads wait for this call to return, so they are batched with the next stages of the others
+			if (_ringErrorCode == 0 && !FileIORingSubmitAndWait(&_ring, 1)) _ringErrorCode = errno;
+			
+			struct io_uring_cqe completion;
+			while (_ringErrorCode == 0 && FileIORingNextCompletion(&_ring, &completion))
+				[self handleCompletion:&completion inFlightReads:inFlightReads];
+			
+			if (_ringErrorCode != 0)
+			{
+				[self abandonRingWithInFlightReads:inFlightReads];
+				return;
+			}
+		}
+	}
+	
+	FileIORingDestroy(&_ring);
+}
+
+- (void)abandonRingWithInFlightReads:(NSMutableSet<FileIORingRead *> *)inFlightReads
+{
+	NSLog(@"Could not submit reads to io_uring, reading with worker threads instead: %s", strerror(_ringErrorCode));
+	
+	pthread_mutex_lock(&_lock);
+	_ringFailed = YES;
+	NSArray<FileIORingRead *> *pendingReads = [_pendingReads copy];
+	[_pendingReads removeAllObjects];
+	pthread_mutex_unlock(&_lock);
+	
+	// Reads that didn't finish are run again from the start, ignoring whatever the ring did for them
+	for (FileIORingRead *read in inFlightReads) [self addReadToPool:read];
+	for (FileIORingRead *read in pendingReads) [self addReadToPool:read];
+	
+	// Operations already submitted can still write to the in-flight reads' buffers, so neither the reads
+	// nor the ring are ever released
+	(void)(__bridge_retained void *)inFlightReads;
+}
+
+- (void)addReadToPool:(FileIORingRead *)read
+{
+	File *file = read->_file;
+	void (^completion)(NSData *, NSError *) = read->_completion;
+	
+	[_pool addTask:^
+	{
+		NSError *error = nil;
+		NSData *data = [file readData:&error];
+		completion(data, error);
+		[self finishOperation];
+	}];
+}
+
+- (void)submitOperation:(FileIORingOperation)operation forRead:(FileIORingRead *)read
+{
+	if (_ringErrorCode != 0) return;
+	
+	struct io_uring_sqe *entry = FileIORingNextEntry(&_ring);
+	
+	// The queue is full of prepared entries, which are submitted to make room
+	if (entry == NULL)
+	{
+		if (!FileIORingSubmitAndWait(&_ring, 0)) { _ringErrorCode = errno; return; }
+		
+		entry = FileIORingNextEntry(&_ring);
+		if (entry == NULL) { _ringErrorCode = EBUSY; return; }
+	}
+	
+	entry->user_data = (uint64_t)((uintptr_t)(__bridge void *)read | operation);
+	
+	switch (operation)
+	{
+		case FileIORingOperationOpen:
+			entry->opcode = IORING_OP_OPENAT;
+			entry->fd = AT_FDCWD;
+			entry->addr = (uint64_t)(uintptr_t)[read->_path bytes];
+			entry->open_flags = O_RDONLY | O_CLOEXEC;
+			break;
+			
+		case FileIORingOperationStat:
+			entry->opcode = IORING_OP_STATX;
+			entry->fd = AT_FDCWD;
+			entry->addr = (uint64_t)(uintptr_t)[read->_path bytes];
+			entry->len = STATX_TYPE | STATX_SIZE;
+			entry->off = (uint64_t)(uintptr_t)&read->_info;
+			break;
+			
+		case FileIORingOperationRead:
+			entry->opcode = IORING_OP_READ;
+			entry->fd = read->_descriptor;
+			entry->addr = (uint64_t)(uintptr_t)((char *)[read->_data mutableBytes] + read->_length);
+			entry->len = (unsigned)MIN([read->_data length] - read->_length, (NSUInteger)FileIOQueueMaximumReadLength);
+			entry->off = read->_length;
+			break;
+			
+		case FileIORingOperationClose:
+			entry->opcode = IORING_OP_CLOSE;
+			entry->fd = read->_descriptor;
+			break;
+	}
+	
+	read->_outstandingOperationCount++;
+}
+
+- (void)submitOpenAndStatForRead:(FileIORingRead *)read
+{
+	read->_descriptor = -1;
+	[self submitOperation:FileIORingOperationOpen forRead:read];
+	[self submitOperation:FileIORingOperationStat forRead:read];
+}
+
+- (void)handleCompletion:(const struct io_uring_cqe *)completion inFlightReads:(NSMutableSet<FileIORingRead *> *)inFlightReads
+{
+	FileIORingRead *read = (__bridge FileIORingRead *)(void *)(uintptr_t)(completion->user_data & ~(uint64_t)FileIORingOperationMask);
+	FileIORingOperation operation = (FileIORingOperation)(completion->user_data & FileIORingOperationMask);
+	int result = completion->res;
+	
+	read->_outstandingOperationCount--;
+	if (result < 0 && read->_errorCode == 0 && operation != FileIORingOperationClose) read->_errorCode = -result;
+	
+	switch (operation)
+	{
+		case FileIORingOperationOpen:
+			if (result >= 0) read->_descriptor = result;
+			if (read->_outstandingOperationCount == 0) [self startReadingRead:read inFlightReads:inFlightReads];
+			break;
+			
+		case FileIORingOperationStat:
+			if (read->_outstandingOperationCount == 0) [self startReadingRead:read inFlightReads:inFlightReads];
+			break;
+			
+		case FileIORingOperationRead:
+			if (result > 0) read->_length += (NSUInteger)result;
+			
+			if (result <= 0 || (read->_sizeIsKnown && read->_length == [read->_data length]))
+			{
+				[self submitOperation:FileIORingOperationClose forRead:read];
+			}
+			else
+			{
+				// Files that report no size (procfs) are read until their end, growing the buffer as needed
+				if (read->_length == [read->_data length]) [read->_data setLength:[read->_data length] * 2];
+				[self submitOperation:FileIORingOperationRead forRead:read];
+			}
+			break;
+			
+		case FileIORingOperationClose:
+			[self finishRead:read inFlightReads:inFlightReads];
+			break;
+	}
+}
+
+- (void)startReadingRead:(FileIORingRead *)read inFlightReads:(NSMutableSet<FileIORingRead *> *)inFlightReads
+{
+	if (read->_descriptor < 0)
+	{
+		[self finishRead:read inFlightReads:inFlightReads];
+		return;
+	}
+	
+	if (read->_errorCode == 0 && S_ISDIR(read->_info.stx_mode)) read->_errorCode = EISDIR;
+	if (read->_errorCode == 0 && read->_info.stx_size > NSUIntegerMax) read->_errorCode = EFBIG;
+	
+	if (read->_errorCode != 0)
+	{
+		[self submitOperation:FileIORingOperationClose forRead:read];
+		return;
+	}
+	
+	read->_sizeIsKnown = (read->_info.stx_size > 0);
+	read->_data = [NSMutableData dataWithLength:(read->_sizeIsKnown ? (NSUInteger)read->_info.stx_size : FileIOQueueUnknownSizeReadLength)];
+	[self submitOperation:FileIORingOperationRead forRead:read];
+}
+
+- (void)finishRead:(FileIORingRead *)read inFlightReads:(NSMutableSet<FileIORingRead *> *)inFlightReads
+{
+	NSData *data = nil;
+	NSError *error = nil;
+	
+	if (read->_errorCode == 0)
+	{
+		[read->_data setLength:read->_length];
+		data = (read->_data ? read->_data : [NSData data]);
+	}
+	else
+	{
+		error = [NSError errorWithPOSIXCode:read->_errorCode description:@"Could not read data from %@", [read->_file absolutePath]];
+		NSLog(@"%@", [error description]);
+	}
+	
+	read->_completion(data, error);
+	[inFlightReads removeObject:read];
+	[self finishOperation];
+}
+
+#endif
+
+@end
+
+#pragma mark - File I/O Queue
+
+static FileIOQueue *FileIOQueueShared;
+static pthread_once_t FileIOQueueSharedOnce = PTHREAD_ONCE_INIT;
+
+static void FileIOQueueCreateShared(void)
+{
+	FileIOQueueShared = [[FileIOQueue alloc] initWithWorkerCount:0];
+}
+
+@implementation FileIOQueue
+{
+	FileIOQueueState *_state;
+	WorkerPool *_pool;
+	BOOL _usesIOUring;
+}
+
+#pragma mark Lifetime
+
++ (FileIOQueue *)sharedQueue
+{
+	pthread_once(&FileIOQueueSharedOnce, FileIOQueueCreateShared);
+	return FileIOQueueShared;
+}
+
+- (id)init
+{
+	return [self initWithWorkerCount:0];
+}
+
+- (id)initWithWorkerCount:(NSUInteger)workerCount
+{
+	self = [super init];
+	if (self)
+	{
+		_state = [[FileIOQueueState alloc] init];
+		_pool = [[WorkerPool alloc] initWithWorkerCount:workerCount];
+		
+#if FileIOQueueUsesRing
+		_usesIOUring = [_state startRingWithFallbackPool:_pool];
+#endif
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	[_state stop];
+}
+
+#pragma mark Information
+
+- (BOOL)usesIOUring
+{
+#if FileIOQueueUsesRing
+	return (_usesIOUring && ![_state ringFailed]);
+#else
+	return NO;
+#endif
+}
+
+#pragma mark Operations
+
+- (void)readDataOfFile:(File *)file completion:(void (^)(NSData *data, NSError *error))completion
+{
+	if (file == nil || completion == nil) @throw [NSException exceptionWithReason:@"File and completion handler are required"];
+	
+	[_state startOperation];
+	
+#if FileIOQueueUsesRing
+	if (_usesIOUring)
+	{
+		FileIORingRead *read = [[FileIORingRead alloc] init];
+		read->_file = file;
+		read->_path = PathRepresentationWithString([file absolutePath]);
+		read->_completion = [completion copy];
+		if ([_state addRead:read]) return;
+	}
+#endif
+	
+	[self addTask:^
+	{
+		NSError *error = nil;
+		NSData *data = [file readData:&error];
+		completion(data, error);
+	}];
+}
+
+- (void)writeData:(NSData *)data toFile:(File *)file overwrite:(BOOL)overwrite completion:(void (^)(BOOL success, NSError *error))completion
+{
+	if (file == nil || completion == nil) @throw [NSException exceptionWithReason:@"File and completion handler are required"];
+	if (data == nil) @throw [NSException exceptionWithReason:@"No data to write!"];
+	
+	[_state startOperation];
+	[self addTask:^
+	{
+		NSError *error = nil;
+		BOOL success = [file writeData:data overwrite:overwrite error:&error];
+		completion(success, error);
+	}];
+}
+
+- (void)copyFile:(File *)file to:(Path *)destination overwrite:(BOOL)overwrite completion:(void (^)(File *copy, NSError *error))completion
+{
+	if (file == nil || completion == nil) @throw [NSException exceptionWithReason:@"File and completion handler are required"];
+	if (destination == nil) @throw [NSException exceptionWithReason:@"Destination is nil"];
+	
+	[_state startOperation];
+	[self addTask:^
+	{
+		NSError *error = nil;
+		File *copy = [file copyTo:destination overwrite:overwrite error:&error];
+		completion(copy, error);
+	}];
+}
+
+- (void)infoForItem:(Path *)item completion:(void (^)(FileInfo *info, NSError *error))completion
+{
+	if (item == nil || completion == nil) @throw [NSException exceptionWithReason:@"Item and completion handler are required"];
+	
+	[_state startOperation];
+	[self addTask:^
+	{
+		NSError *error = nil;
+		FileInfo *info = [item info:&error];
+		completion(info, error);
+	}];
+}
+
+- (void)waitUntilAllOperationsAreFinished
+{
+	[_state waitUntilAllOperationsAreFinished];
+}
+
+#pragma mark Private
+
+- (void)addTask:(void (^)(void))task
+{
+	FileIOQueueState *state = _state;
+	
+	[_pool addTask:^
+	{
+		task();
+		[state finishOperation];
+	}];
+}
+
+@end
@@ -0,0 +1,89 @@
+//
+//  FileInfo.h
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+//  Description: An immutable snapshot of an item's attributes, obtained with a single stat call.
+//
+
+#import <Foundation/Foundation.h>
+
+typedef NS_ENUM(NSInteger, FileInfoType)
+{
+	FileInfoTypeRegular,
+	FileInfoTypeDirectory,
+	FileInfoTypeSymbolicLink,
+	FileInfoTypeOther
+};
+
+@interface FileInfo : NSObject
+
+#pragma mark Creation
+
+/**
+ Obtains information about the item at the specified absolute path. Symbolic links are not followed.
+ */
++ (instancetype)infoForItemAtPath:(NSString *)path error:(NSError **)error;
+
+/**
+ Obtains information about the item with the specified name, relative to an open directory descriptor.
+ Symbolic links are not followed.
+ */
++ (instancetype)infoForItemNamed:(const char *)name inDirectoryDescriptor:(int)descriptor error:(NSError **)error;
+
+#pragma mark Information
+
+@property (readonly) FileInfoType type;
+
+/**
+ The size of the item's contents in bytes (the logical size, which may be larger than the space used on disk).
+ */
+@property (readonly) unsigned long long size;
+
+/**
+ The space allocated to the item on disk, in bytes.
+ */
+@property (readonly) unsigned long long allocatedSize;
+
+@property (readonly) unsigned long long inode;
+@property (readonly) unsigned long long device;
+
+/**
+ The full mode of the item, including the file type bits (see stat(2)).
+ */
+@property (readonly) unsigned int mode;
+
+/**
+ The item's permission bits (the lower 12 bits of the mode).
+ */
+@property (readonly) unsigned int permissions;
+
+@property (readonly) unsigned long long linkCount;
+
+/**
+ Timestamps in nanoseconds since 1970-01-01 00:00:00 UTC.
+ The creation time is 0 when the file system or platform does not record it.
+ */
+@property (readonly) long long modificationTimeNanoseconds;
+@property (readonly) long long changeTimeNanoseconds;
+@property (readonly) long long creationTimeNanoseconds;
+
+- (NSDate *)modificationDate;
+
+/**
+ The last time the item's attributes (inode) changed.
+ */
+- (NSDate *)changeDate;
+
+/**
+ The item's creation date, or nil when unavailable.
+ */
+- (NSDate *)creationDate;
+
+- (BOOL)isFile;
+- (BOOL)isDirectory;
+- (BOOL)isSymbolicLink;
+
+@end
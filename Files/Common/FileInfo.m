@@ -0,0 +1,172 @@
+//
+//  FileInfo.m
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // statx()
+#endif
+
+#import <errno.h>
+#import <fcntl.h>
+#import <sys/stat.h>
+#import <unistd.h>
+#if defined(__linux__)
+#import <sys/sysmacros.h>
+#endif
+#import "FileInfo.h"
+#import "NSError+FilesAdditions.h"
+
+#define FileInfoNanosecondsPerSecond 1000000000LL
+
+static long long FileInfoNanoseconds(long long seconds, long long nanoseconds)
+{
+	return seconds * FileInfoNanosecondsPerSecond + nanoseconds;
+}
+
+@implementation FileInfo
+
+#pragma mark Creation
+
++ (instancetype)infoForItemAtPath:(NSString *)path error:(NSError **)error
+{
+	return [self infoForItemNamed:[path fileSystemRepresentation] inDirectoryDescriptor:AT_FDCWD error:error];
+}
+
++ (instancetype)infoForItemNamed:(const char *)name inDirectoryDescriptor:(int)descriptor error:(NSError **)error
+{
+	FileInfo *info = [[self alloc] init];
+	
+	if (![info loadItemNamed:name inDirectoryDescriptor:descriptor])
+	{
+		int code = errno;
+		if (error) *error = [NSError errorWithPOSIXCode:code description:@"Could not obtain information for item %s", name];
+		return nil;
+	}
+	
+	return info;
+}
+
+#pragma mark Private
+
+- (BOOL)loadItemNamed:(const char *)name inDirectoryDescriptor:(int)descriptor
+{
+#if defined(__linux__) && defined(STATX_BTIME)
+	// statx is the only way to obtain the birth time on Linux
+	struct statx extendedInfo;
+	if (statx(descriptor, name, AT_SYMLINK_NOFOLLOW, STATX_BASIC_STATS | STATX_BTIME, &extendedInfo) == 0)
+	{
+		[self loadStatx:&extendedInfo];
+		return YES;
+	}
+	
+	// Older kernels don't have statx, and container seccomp filters often reject it with EPERM
+	if (errno != ENOSYS && errno != EPERM) return NO;
+#endif
+	
+	struct stat info;
+	if (fstatat(descriptor, name, &info, AT_SYMLINK_NOFOLLOW) != 0) return NO;
+	
+	[self loadStat:&info];
+	return YES;
+}
+
+- (void)loadStat:(const struct stat *)info
+{
+	_type = [FileInfo typeForMode:info->st_mode];
+	_size = (unsigned long long)info->st_size;
+	_allocatedSize = (unsigned long long)info->st_blocks * 512;
+	_inode = (unsigned long long)info->st_ino;
+	_device = (unsigned long long)info->st_dev;
+	_mode = (unsigned int)info->st_mode;
+	_linkCount = (unsigned long long)info->st_nlink;
+	
+#if defined(__APPLE__)
+	_modificationTimeNanoseconds = FileInfoNanoseconds(info->st_mtimespec.tv_sec, info->st_mtimespec.tv_nsec);
+	_changeTimeNanoseconds = FileInfoNanoseconds(info->st_ctimespec.tv_sec, info->st_ctimespec.tv_nsec);
+	_creationTimeNanoseconds = FileInfoNanoseconds(info->st_birthtimespec.tv_sec, info->st_birthtimespec.tv_nsec);
+#else
+	_modificationTimeNanoseconds = FileInfoNanoseconds(info->st_mtim.tv_sec, info->st_mtim.tv_nsec);
+	_changeTimeNanoseconds = FileInfoNanoseconds(info->st_ctim.tv_sec, info->st_ctim.tv_nsec);
+	_creationTimeNanoseconds = 0;
+#endif
+}
+
+#if defined(__linux__) && defined(STATX_BTIME)
+- (void)loadStatx:(const struct statx *)info
+{
+	_type = [FileInfo typeForMode:info->stx_mode];
+	_size = info->stx_size;
+	_allocatedSize = info->stx_blocks * 512;
+	_inode = info->stx_ino;
+	_device = makedev(info->stx_dev_major, info->stx_dev_minor);
+	_mode = info->stx_mode;
+	_linkCount = info->stx_nlink;
+	_modificationTimeNanoseconds = FileInfoNanoseconds(info->stx_mtime.tv_sec, info->stx_mtime.tv_nsec);
+	_changeTimeNanoseconds = FileInfoNanoseconds(info->stx_ctime.tv_sec, info->stx_ctime.tv_nsec);
+	_creationTimeNanoseconds = (info->stx_mask & STATX_BTIME) ? FileInfoNanoseconds(info->stx_btime.tv_sec, info->stx_btime.tv_nsec) : 0;
+}
+#endif
+
++ (FileInfoType)typeForMode:(mode_t)mode
+{
+	if (S_ISREG(mode)) return FileInfoTypeRegular;
+	if (S_ISDIR(mode)) return FileInfoTypeDirectory;
+	if (S_ISLNK(mode)) return FileInfoTypeSymbolicLink;
+	return FileInfoTypeOther;
+}
+
+#pragma mark Information
+
+- (unsigned int)permissions
+{
+	return _mode & 07777;
+}
+
+- (NSDate *)modificationDate
+{
+	return [FileInfo dateWithNanoseconds:_modificationTimeNanoseconds];
+}
+
+- (NSDate *)changeDate
+{
+	return [FileInfo dateWithNanoseconds:_changeTimeNanoseconds];
+}
+
+- (NSDate *)creationDate
+{
+	if (_creationTimeNanoseconds == 0) return nil;
+	return [FileInfo dateWithNanoseconds:_creationTimeNanoseconds];
+}
+
+- (BOOL)isFile
+{
+	return _type == FileInfoTypeRegular;
+}
+
+- (BOOL)isDirectory
+{
+	return _type == FileInfoTypeDirectory;
+}
+
+- (BOOL)isSymbolicLink
+{
+	return _type == FileInfoTypeSymbolicLink;
+}
+
++ (NSDate *)dateWithNanoseconds:(long long)nanoseconds
+{
+	return [NSDate dateWithTimeIntervalSince1970:(NSTimeInterval)nanoseconds / FileInfoNanosecondsPerSecond];
+}
+
+#pragma mark Description
+
+- (NSString *)description
+{
+	return [NSString stringWithFormat:@"<%@ type: %ld, size: %llu, inode: %llu, modified: %@>", [self class], (long)_type, _size, _inode, [self modificationDate]];
+}
+
+@end
@@ -0,0 +1,72 @@
+//
+//  FileReader.h
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+//  Description: Streams a file (or a byte range of it) in fixed-size chunks or line by line through
+//               a reused buffer, so memory use does not depend on the size of the file.
+//
+
+#import <Foundation/Foundation.h>
+
+@class File;
+
+@interface FileReader : NSObject
+
+#pragma mark Lifetime
+
++ (instancetype)readerWithFile:(File *)file;
+
+- (id)initWithFile:(File *)file;
+
+#pragma mark Configuration
+
+/**
+ The file being read.
+ */
+@property (readonly) File *file;
+
+/**
+ The position in the file at which reading starts. Defaults to 0.
+ */
+@property (nonatomic) unsigned long long offset;
+
+/**
+ The maximum number of bytes read, starting at offset. Defaults to ULLONG_MAX (up to the end of the file).
+ */
+@property (nonatomic) unsigned long long length;
+
+/**
+ The size of the buffer used to read lines. Lines longer than this are still read whole, by growing the buffer.
+ Defaults to 256 KB.
+ */
+@property (nonatomic) NSUInteger bufferSize;
+
+/**
+ The encoding used to decode lines in -enumerateLinesUsingBlock:error:. Defaults to UTF-8.
+ */
+@property (nonatomic) NSStringEncoding encoding;
+
+#pragma mark Reading
+
+/**
+ Reads the file in chunks of the specified size (the last one can be shorter). The chunk points into the
+ reader's buffer and is only valid during the block: copy it to keep it.
+ */
+- (BOOL)enumerateChunksOfSize:(NSUInteger)chunkSize usingBlock:(void (^)(NSData *chunk, unsigned long long offset, BOOL *stop))block error:(NSError **)error;
+
+/**
+ Reads the file line by line. Lines end with "\n" or "\r\n", which are not included in the line.
+ The line points into the reader's buffer and is only valid during the block: copy it to keep it.
+ */
+- (BOOL)enumerateLineDataUsingBlock:(void (^)(NSData *line, BOOL *stop))block error:(NSError **)error;
+
+/**
+ Reads the file line by line, decoding each line with the reader's encoding. Stops with an error
+ if a line cannot be decoded.
+ */
+- (BOOL)enumerateLinesUsingBlock:(void (^)(NSString *line, BOOL *stop))block error:(NSError **)error;
+
+@end
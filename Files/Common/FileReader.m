@@ -0,0 +1,252 @@
+//
+//  FileReader.m
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+
+#import <errno.h>
+#import <fcntl.h>
+#import <limits.h>
+#import <string.h>
+#import <unistd.h>
+#import "FileReader.h"
+#import "File.h"
+#import "NSError+FilesAdditions.h"
+#import "NSException+FilesAdditions.h"
+
+#define FileReaderDefaultBufferSize (256 * 1024)
+
+static ssize_t FileReaderRead(int descriptor, void *bytes, size_t count, unsigned long long *position, unsigned long long end);
+
+@implementation FileReader
+{
+	NSMutableData *_buffer;
+}
+
+#pragma mark Lifetime
+
++ (instancetype)readerWithFile:(File *)file
+{
+	return [[self alloc] initWithFile:file];
+}
+
+- (id)initWithFile:(File *)file
+{
+	if (file == nil) @throw [NSException exceptionWithReason:@"File is nil"];
+	
+	self = [super init];
+	if (self)
+	{
+		_file = file;
+		_length = ULLONG_MAX;
+		_bufferSize = FileReaderDefaultBufferSize;
+		_encoding = NSUTF8StringEncoding;
+		_buffer = [NSMutableData data];
+	}
+	return self;
+}
+
+#pragma mark Reading
+
+- (BOOL)enumerateChunksOfSize:(NSUInteger)chunkSize usingBlock:(void (^)(NSData *chunk, unsigned long long offset, BOOL *stop))block error:(NSError **)error
+{
+	if (chunkSize == 0) @throw [NSException exceptionWithReason:@"Chunk size must be greater than zero"];
+	
+	int descriptor = [self openWithError:error];
+	if (descriptor < 0) return NO;
+	
+	if ([_buffer length] < chunkSize) [_buffer setLength:chunkSize];
+	char *bytes = [_buffer mutableBytes];
+	
+	unsigned long long position = _offset;
+	unsigned long long end = [self rangeEnd];
+	BOOL endReached = NO;
+	BOOL stop = NO;
+	
+	while (!endReached && !stop)
+	{
+		unsigned long long chunkOffset = position;
+		size_t filled = 0;
+		
+		while (filled < chunkSize)
+		{
+			ssize_t count = FileReaderRead(descriptor, bytes + filled, chunkSize - filled, &position, end);
+			if (count < 0) return [self failWithCode:errno descriptor:descriptor error:error];
+			if (count == 0) { endReached = YES; break; }
+			filled += (size_t)count;
+		}
+		
+		if (filled == 0) break;
+		
+		@autoreleasepool
+		{
+			NSData *chunk = [[NSData alloc] initWithBytesNoCopy:bytes length:filled freeWhenDone:NO];
+			block(chunk, chunkOffset, &stop);
+		}
+	}
+	
+	close(descriptor);
+	return YES;
+}
+
+- (BOOL)enumerateLineDataUsingBlock:(void (^)(NSData *line, BOOL *stop))block error:(NSError **)error
+{
+	int descriptor = [self openWithError:error];
+	if (descriptor < 0) return NO;
+	
+	if ([_buffer length] < MAX(_bufferSize, (NSUInteger)1)) [_buffer setLength:MAX(_bufferSize, (NSUInteger)1)];
+	char *bytes = [_buffer mutableBytes];
+	
+	// Bytes [start, end) of the buffer are unconsumed; [start, scan) is known to contain no newline
+	size_t start = 0, scan = 0, end = 0;
+	unsigned long long position = _offset;
+	unsigned long long rangeEnd = [self rangeEnd];
+	BOOL endReached = NO;
+	BOOL stop = NO;
+	
+	while (!stop)
+	{
+		// memchr() is vectorized by the C library, which makes it much faster than a byte loop
+		char *newline = (scan < end ? memchr(bytes + scan, '\n', end - scan) : NULL);
+		
+		if (newline)
+		{
+			size_t lineEnd = (size_t)(newline - bytes);
+			size_t lineLength = lineEnd - start;
+			if (lineLength > 0 && bytes[lineEnd - 1] == '\r') lineLength--;
+			
+			@autoreleasepool
+			{
+				block([[NSData alloc] initWithBytesNoCopy:bytes + start length:lineLength freeWhenDone:NO], &stop);
+			}
+			
+			start = scan = lineEnd + 1;
+			continue;
+		}
+		
+		if (endReached)
+		{
+			if (start < end)
+			{
+				@autoreleasepool
+				{
+					block([[NSData alloc] initWithBytesNoCopy:bytes + start length:end - start freeWhenDone:NO], &stop);
+				}
+			}
+			break;
+		}
+		
+		// Move the partial line to the front of the buffer, growing it only if the line fills it entirely
+		if (start > 0)
+		{
+			memmove(bytes, bytes + start, end - start);
+			end -= start;
+			start = 0;
+		}
+		
+		if (end == [_buffer length])
+		{
+			[_buffer setLength:end * 2];
+			bytes = [_buffer mutableBytes];
+		}
+		
+		scan = end;
+		
+		ssize_t count = FileReaderRead(descriptor, bytes + end, [_buffer length] - end, &position, rangeEnd);
+		if (count < 0) return [self failWithCode:errno descriptor:descriptor error:error];
+		if (count == 0) endReached = YES;
+		
+		end += (size_t)MAX(count, (ssize_t)0);
+	}
+	
+	close(descriptor);
+	return YES;
+}
+
+- (BOOL)enumerateLinesUsingBlock:(void (^)(NSString *line, BOOL *stop))block error:(NSError **)error
+{
+	__block unsigned long long lineNumber = 0;
+	__block BOOL decoded = YES;
+	NSStringEncoding encoding = _encoding;
+	
+	BOOL success = [self enumerateLineDataUsingBlock:^(NSData *lineData, BOOL *stop)
+	{
+		lineNumber++;
+		NSString *line = [[NSString alloc] initWithBytes:[lineData bytes] length:[lineData length] encoding:encoding];
+		
+		if (line == nil)
+		{
+			decoded = NO;
+			*stop = YES;
+			return;
+		}
+		
+		block(line, stop);
+	}
+	error:error];
+	
+	if (success && !decoded)
+	{
+		NSString *description = [NSString stringWithFormat:@"Could not decode line %llu of file %@ with encoding %lu", lineNumber, [_file absolutePath], (unsigned long)encoding];
+		NSLog(@"%@", description);
+		if (error) *error = [NSError errorWithDescription:@"%@", description];
+		return NO;
+	}
+	
+	return success;
+}
+
+#pragma mark Private
+
+- (int)openWithError:(NSError **)error
+{
+	int descriptor = open([[_file absolutePath] fileSystemRepresentation], O_RDONLY | O_CLOEXEC);
+	
+	if (descriptor < 0)
+	{
+		[self failWithCode:errno descriptor:-1 error:error];
+		return -1;
+	}
+	
+#if defined(POSIX_FADV_SEQUENTIAL)
+	posix_fadvise(descriptor, (off_t)_offset, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+	
+	return descriptor;
+}
+
+- (unsigned long long)rangeEnd
+{
+	return (_length > ULLONG_MAX - _offset ? ULLONG_MAX : _offset + _length);
+}
+
+- (BOOL)failWithCode:(int)code descriptor:(int)descriptor error:(NSError **)error
+{
+	if (descriptor >= 0) close(descriptor);
+	
+	NSError *innerError = [NSError errorWithPOSIXCode:code description:@"Could not read file %@", [_file absolutePath]];
+	NSLog(@"%@", [innerError description]);
+	if (error) *error = innerError;
+	return NO;
+}
+
+@end
+
+#pragma mark - Reading Primitive
+
+// Reads at most count bytes at position without going past end. Returns 0 at the end of the file or range.
+static ssize_t FileReaderRead(int descriptor, void *bytes, size_t count, unsigned long long *position, unsigned long long end)
+{
+	if (*position >= end) return 0;
+	count = (size_t)MIN((unsigned long long)count, end - *position);
+	
+	while (YES)
+	{
+		ssize_t readCount = pread(descriptor, bytes, count, (off_t)*position);
+		if (readCount < 0 && errno == EINTR) continue;
+		if (readCount > 0) *position += (unsigned long long)readCount;
+		return readCount;
+	}
+}
@@ -0,0 +1,20 @@
+//
+//  LazyPropertyList.h
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+//  Description: Reads binary (bplist00) property lists in place. Arrays and dictionaries are returned as
+//               NSArray and NSDictionary subclasses over the file's bytes, and their values are only decoded
+//               when accessed. Not part of the public interface.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ Returns the top object of the binary property list, or nil if the data isn't a valid binary property list.
+ The data is retained by the returned containers and must not change while they are in use. Corruption found
+ while decoding values on access (past the checks done up front) raises an exception.
+ */
+extern id LazyPropertyListWithData(NSData *data);
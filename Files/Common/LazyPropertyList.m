@@ -0,0 +1,595 @@
+//
+//  LazyPropertyList.m
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+
+#import <pthread.h>
+#import <stdint.h>
+#import <stdlib.h>
+#import <string.h>
+#import "LazyPropertyList.h"
+#import "NSException+FilesAdditions.h"
+
+#define LazyPropertyListHeaderLength 8
+#define LazyPropertyListTrailerLength 32
+
+// Dictionaries up to this many keys are searched by comparing keys directly rather than through an index
+#define LazyPropertyListLinearSearchLimit 8
+
+// Sets are decoded eagerly, so nesting them deeper than this (or in a cycle) is treated as corruption
+#define LazyPropertyListMaximumSetDepth 64
+
+// Object types, from the high nibble of each object's marker byte
+#define LazyPropertyListTypeSimple 0x0
+#define LazyPropertyListTypeInteger 0x1
+#define LazyPropertyListTypeReal 0x2
+#define LazyPropertyListTypeDate 0x3
+#define LazyPropertyListTypeData 0x4
+#define LazyPropertyListTypeASCIIString 0x5
+#define LazyPropertyListTypeUnicodeString 0x6
+#define LazyPropertyListTypeUID 0x8
+#define LazyPropertyListTypeArray 0xA
+#define LazyPropertyListTypeSet 0xC
+#define LazyPropertyListTypeDictionary 0xD
+
+static const char LazyPropertyListMagic[LazyPropertyListHeaderLength] = { 'b', 'p', 'l', 'i', 's', 't', '0', '0' };
+
+static uint64_t LazyPropertyListReadInteger(const uint8_t *bytes, size_t size)
+{
+	uint64_t value = 0;
+	for (size_t i = 0; i < size; i++) value = (value << 8) | bytes[i];
+	return value;
+}
+
+static uint64_t LazyPropertyListHashKey(uint8_t type, const uint8_t *bytes, size_t length)
+{
+	// FNV-1a
+	uint64_t hash = 14695981039346656037ULL ^ type;
+	for (size_t i = 0; i < length; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+#pragma mark - Document
+
+@interface LazyPropertyListDocument : NSObject
+{
+@public
+	NSData *_data;
+	const uint8_t *_bytes;
+
+	// Objects lie between the header and the offset table
+	size_t _offsetTable;
+	size_t _offsetSize;
+	size_t _referenceSize;
+	uint64_t _objectCount;
+}
+
+- (id)objectWithReference:(uint64_t)reference;
+
+- (id)requiredObjectWithReference:(uint64_t)reference;
+
+@end
+
+/**
+ The containers decoded from the elements of an array or dictionary, kept so that their own decoded containers
+ and key indexes are reused by later accesses. Other values are cheap to decode again and are not kept.
+ */
+@interface LazyPropertyListContainers : NSObject
+
+- (id)initWithCount:(NSUInteger)count document:(LazyPropertyListDocument *)document;
+
+- (id)objectAtIndex:(NSUInteger)index reference:(uint64_t)reference;
+
+@end
+
+@interface LazyPropertyListArray : NSArray
+
+- (id)initWithDocument:(LazyPropertyListDocument *)document references:(size_t)references count:(NSUInteger)count;
+
+@end
+
+@interface LazyPropertyListDictionary : NSDictionary
+
+- (id)initWithDocument:(LazyPropertyListDocument *)document references:(size_t)references count:(NSUInteger)count;
+
+@end
+
+@implementation LazyPropertyListDocument
+
+#pragma mark Layout
+
+- (uint64_t)referenceAtPosition:(size_t)position
+{
+	return LazyPropertyListReadInteger(_bytes + position, _referenceSize);
+}
+
+/**
+ Returns the position of the object's marker byte, or 0 if the reference or its offset are out of bounds.
+ */
+- (size_t)positionOfObject:(uint64_t)reference
+{
+	if (reference >= _objectCount) return 0;
+
+	uint64_t offset = LazyPropertyListReadInteger(_bytes + _offsetTable + (size_t)reference * _offsetSize, _offsetSize);
+	if (offset < LazyPropertyListHeaderLength || offset >= _offsetTable) return 0;
+
+	return (size_t)offset;
+}
+
+/**
+ Whether the specified number of elements of the specified size fit between the position and the offset table.
+ */
+- (BOOL)hasRoomForCount:(uint64_t)count size:(size_t)size atPosition:(size_t)position
+{
+	return (position <= _offsetTable && count <= (_offsetTable - position) / size);
+}
+
+/**
+ Reads the element count of the object at the position (from its marker, or from the integer that follows it
+ for 15 elements and more) and where its contents start.
+ */
+- (BOOL)getCount:(uint64_t *)count contents:(size_t *)contents ofObjectAtPosition:(size_t)position
+{
+	uint8_t info = _bytes[position] & 0x0F;
+	size_t next = position + 1;
+
+	if (info != 0x0F)
+	{
+		*count = info;
+		*contents = next;
+		return YES;
+	}
+
+	if (next >= _offsetTable || (_bytes[next] >> 4) != LazyPropertyListTypeInteger) return NO;
+
+	size_t size = (size_t)1 << (_bytes[next] & 0x0F);
+	if (size > 8 || ![self hasRoomForCount:size size:1 atPosition:next + 1]) return NO;
+
+	*count = LazyPropertyListReadInteger(_bytes + next + 1, size);
+	*contents = next + 1 + size;
+	return YES;
+}
+
+/**
+ Finds the bytes of a string object as stored (ASCII or UTF-16BE), so that keys can be compared without decoding.
+ */
+- (BOOL)getStringType:(uint8_t *)type bytes:(const uint8_t **)bytes length:(size_t *)length ofObject:(uint64_t)reference
+{
+	size_t position = [self positionOfObject:reference];
+	if (position == 0) return NO;
+
+	uint8_t objectType = _bytes[position] >> 4;
+	if (objectType != LazyPropertyListTypeASCIIString && objectType != LazyPropertyListTypeUnicodeString) return NO;
+
+	uint64_t count;
+	size_t contents;
+	size_t characterSize = (objectType == LazyPropertyListTypeASCIIString ? 1 : 2);
+	if (![self getCount:&count contents:&contents ofObjectAtPosition:position] || ![self hasRoomForCount:count size:characterSize atPosition:contents]) return NO;
+
+	*type = objectType;
+	*bytes = _bytes + contents;
+	*length = (size_t)count * characterSize;
+	return YES;
+}
+
+#pragma mark Decoding
+
+- (id)objectWithReference:(uint64_t)reference
+{
+	return [self objectWithReference:reference setDepth:0];
+}
+
+/**
+ Decodes the object, returning containers without decoding their elements. Returns nil if the object is corrupt.
+ */
+- (id)objectWithReference:(uint64_t)reference setDepth:(NSUInteger)setDepth
+{
+	size_t position = [self positionOfObject:reference];
+	if (position == 0) return nil;
+
+	uint8_t type = _bytes[position] >> 4;
+	uint8_t info = _bytes[position] & 0x0F;
+	const uint8_t *contents = _bytes + position + 1;
+
+	switch (type)
+	{
+		case LazyPropertyListTypeSimple:
+		{
+			if (info == 0x0) return [NSNull null];
+			if (info == 0x8) return @NO;
+			if (info == 0x9) return @YES;
+			return nil;
+		}
+		case LazyPropertyListTypeInteger:
+		{
+			if (info > 4) return nil;
+
+			size_t size = (size_t)1 << info;
+			if (![self hasRoomForCount:size size:1 atPosition:position + 1]) return nil;
+
+			// Integers up to 4 bytes are unsigned and 8-byte ones signed; 16-byte ones hold unsigned values
+			// too large for 8 signed bytes in their low half
+			if (size == 16) return @(LazyPropertyListReadInteger(contents + 8, 8));
+			if (size == 8) return @((long long)LazyPropertyListReadInteger(contents, 8));
+			return @(LazyPropertyListReadInteger(contents, size));
+		}
+		case LazyPropertyListTypeReal:
+		case LazyPropertyListTypeDate:
+		{
+			// Reals are 4 or 8 bytes, dates always 8
+			if (info != 3 && (info != 2 || type == LazyPropertyListTypeDate)) return nil;
+
+			size_t size = (size_t)1 << info;
+			if (![self hasRoomForCount:size size:1 atPosition:position + 1]) return nil;
+
+			uint64_t bits = LazyPropertyListReadInteger(contents, size);
+			double value;
+
+			if (size == 4)
+			{
+				uint32_t bits32 = (uint32_t)bits;
+				float value32;
+				memcpy(&value32, &bits32, sizeof(value32));
+				value = value32;
+			}
+			else
+			{
+				memcpy(&value, &bits, sizeof(value));
+			}
+
+			if (type == LazyPropertyListTypeDate) return [NSDate dateWithTimeIntervalSinceReferenceDate:value];
+			return (size == 4 ? @((float)value) : @(value));
+		}
+		case LazyPropertyListTypeData:
+		{
+			uint64_t count;
+			size_t start;
+			if (![self getCount:&count contents:&start ofObjectAtPosition:position] || ![self hasRoomForCount:count size:1 atPosition:start]) return nil;
+
+			// Copied so that the data outlives the mapping
+			return [NSData dataWithBytes:_bytes + start length:(NSUInteger)count];
+		}
+		case LazyPropertyListTypeASCIIString:
+		case LazyPropertyListTypeUnicodeString:
+		{
+			uint8_t stringType;
+			const uint8_t *bytes;
+			size_t length;
+			if (![self getStringType:&stringType bytes:&bytes length:&length ofObject:reference]) return nil;
+
+			NSStringEncoding encoding = (stringType == LazyPropertyListTypeASCIIString ? NSASCIIStringEncoding : NSUTF16BigEndianStringEncoding);
+			return [[NSString alloc] initWithBytes:bytes length:length encoding:encoding];
+		}
+		case LazyPropertyListTypeUID:
+		{
+			size_t size = (size_t)info + 1;
+			if (size > 8 || ![self hasRoomForCount:size size:1 atPosition:position + 1]) return nil;
+
+			return @(LazyPropertyListReadInteger(contents, size));
+		}
+		case LazyPropertyListTypeArray:
+		case LazyPropertyListTypeSet:
+		case LazyPropertyListTypeDictionary:
+		{
+			uint64_t count;
+			size_t start;
+			size_t referenceCount = (type == LazyPropertyListTypeDictionary ? 2 : 1);
+			if (![self getCount:&count contents:&start ofObjectAtPosition:position]) return nil;
+			if (count > UINT32_MAX || ![self hasRoomForCount:count * referenceCount size:_referenceSize atPosition:start]) return nil;
+
+			if (type == LazyPropertyListTypeArray)
+				return [[LazyPropertyListArray alloc] initWithDocument:self references:start count:(NSUInteger)count];
+
+			if (type == LazyPropertyListTypeDictionary)
+				return [[LazyPropertyListDictionary alloc] initWithDocument:self references:start count:(NSUInteger)count];
+
+			// Sets don't support lookups that could skip decoding, so their elements are decoded right away
+			if (setDepth >= LazyPropertyListMaximumSetDepth) return nil;
+
+			NSMutableSet *set = [NSMutableSet setWithCapacity:(NSUInteger)count];
+			for (uint64_t i = 0; i < count; i++)
+			{
+				id element = [self objectWithReference:[self referenceAtPosition:start + (size_t)i * _referenceSize] setDepth:setDepth + 1];
+				if (element == nil) return nil;
+				[set addObject:element];
+			}
+			return set;
+		}
+		default:
+			return nil;
+	}
+}
+
+/**
+ Decodes an element of a container, which was valid when the container was created.
+ */
+- (id)requiredObjectWithReference:(uint64_t)reference
+{
+	id object = [self objectWithReference:reference];
+	if (object == nil) @throw [NSException exceptionWithReason:@"Corrupt binary property list object %llu", (unsigned long long)reference];
+	return object;
+}
+
+@end
+
+#pragma mark - Decoded Containers
+
+@implementation LazyPropertyListContainers
+{
+	LazyPropertyListDocument *_document;
+	NSUInteger _count;
+	pthread_mutex_t _lock;
+
+	// Allocated when the first container is decoded
+	__strong id *_containers;
+}
+
+- (id)initWithCount:(NSUInteger)count document:(LazyPropertyListDocument *)document
+{
+	self = [super init];
+	if (self)
+	{
+		_document = document;
+		_count = count;
+		pthread_mutex_init(&_lock, NULL);
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	if (_containers)
+	{
+		for (NSUInteger i = 0; i < _count; i++) _containers[i] = nil;
+		free(_containers);
+	}
+
+	pthread_mutex_destroy(&_lock);
+}
+
+- (id)objectAtIndex:(NSUInteger)index reference:(uint64_t)reference
+{
+	pthread_mutex_lock(&_lock);
+	id object = (_containers ? _containers[index] : nil);
+	pthread_mutex_unlock(&_lock);
+
+	if (object) return object;
+
+	object = [_document requiredObjectWithReference:reference];
+	if (![object isKindOfClass:[LazyPropertyListArray class]] && ![object isKindOfClass:[LazyPropertyListDictionary class]]) return object;
+
+	pthread_mutex_lock(&_lock);
+
+	if (_containers == NULL) _containers = (__strong id *)calloc(_count, sizeof(id));
+
+	// Threads that decoded the same container concurrently all return the one that was kept
+	if (_containers)
+	{
+		if (_containers[index] == nil) _containers[index] = object;
+		object = _containers[index];
+	}
+
+	pthread_mutex_unlock(&_lock);
+	return object;
+}
+
+@end
+
+#pragma mark - Arrays
+
+@implementation LazyPropertyListArray
+{
+	LazyPropertyListDocument *_document;
+	size_t _references;
+	NSUInteger _count;
+	LazyPropertyListContainers *_containers;
+}
+
+- (id)initWithDocument:(LazyPropertyListDocument *)document references:(size_t)references count:(NSUInteger)count
+{
+	self = [super init];
+	if (self)
+	{
+		_document = document;
+		_references = references;
+		_count = count;
+		_containers = [[LazyPropertyListContainers alloc] initWithCount:count document:document];
+	}
+	return self;
+}
+
+#pragma mark NSArray Primitives
+
+- (NSUInteger)count
+{
+	return _count;
+}
+
+- (id)objectAtIndex:(NSUInteger)index
+{
+	if (index >= _count)
+		@throw [NSException exceptionWithName:NSRangeException reason:[NSString stringWithFormat:@"Index %lu beyond bounds of array with %lu objects", (unsigned long)index, (unsigned long)_count] userInfo:nil];
+
+	return [_containers objectAtIndex:index reference:[_document referenceAtPosition:_references + index * _document->_referenceSize]];
+}
+
+@end
+
+#pragma mark - Dictionaries
+
+@implementation LazyPropertyListDictionary
+{
+	LazyPropertyListDocument *_document;
+
+	// Key references, followed by as many value references
+	size_t _references;
+	NSUInteger _count;
+	LazyPropertyListContainers *_containers;
+
+	// Open addressing table of key indexes plus one (zero for empty slots), built on the first lookup
+	pthread_mutex_t _lock;
+	uint32_t *_slots;
+	size_t _slotMask;
+}
+
+- (id)initWithDocument:(LazyPropertyListDocument *)document references:(size_t)references count:(NSUInteger)count
+{
+	self = [super init];
+	if (self)
+	{
+		_document = document;
+		_references = references;
+		_count = count;
+		_containers = [[LazyPropertyListContainers alloc] initWithCount:count document:document];
+		pthread_mutex_init(&_lock, NULL);
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	free(_slots);
+	pthread_mutex_destroy(&_lock);
+}
+
+#pragma mark NSDictionary Primitives
+
+- (NSUInteger)count
+{
+	return _count;
+}
+
+- (id)objectForKey:(id)key
+{
+	NSUInteger index = [self indexOfKey:key];
+	if (index == NSNotFound) return nil;
+
+	return [_containers objectAtIndex:index reference:[self referenceAtIndex:_count + index]];
+}
+
+- (NSEnumerator *)keyEnumerator
+{
+	NSMutableArray *keys = [NSMutableArray arrayWithCapacity:_count];
+	for (NSUInteger i = 0; i < _count; i++) [keys addObject:[_document requiredObjectWithReference:[self referenceAtIndex:i]]];
+	return [keys objectEnumerator];
+}
+
+#pragma mark Lookups
+
+- (uint64_t)referenceAtIndex:(NSUInteger)index
+{
+	return [_document referenceAtPosition:_references + index * _document->_referenceSize];
+}
+
+- (BOOL)keyAtIndex:(NSUInteger)index hasType:(uint8_t)type bytes:(const uint8_t *)bytes length:(size_t)length
+{
+	uint8_t keyType;
+	const uint8_t *keyBytes;
+	size_t keyLength;
+
+	if (![_document getStringType:&keyType bytes:&keyBytes length:&keyLength ofObject:[self referenceAtIndex:index]]) return NO;
+	return (keyType == type && keyLength == length && memcmp(keyBytes, bytes, length) == 0);
+}
+
+- (NSUInteger)indexOfKey:(id)key
+{
+	if (![key isKindOfClass:[NSString class]] || _count == 0) return NSNotFound;
+
+	// Encoded the way binary property lists store strings, so that keys are compared without being decoded
+	uint8_t type = LazyPropertyListTypeASCIIString;
+	NSData *encoded = [key dataUsingEncoding:NSASCIIStringEncoding];
+
+	if (encoded == nil)
+	{
+		type = LazyPropertyListTypeUnicodeString;
+		encoded = [key dataUsingEncoding:NSUTF16BigEndianStringEncoding];
+	}
+
+	const uint8_t *bytes = [encoded bytes];
+	size_t length = [encoded length];
+
+	if (_count <= LazyPropertyListLinearSearchLimit)
+	{
+		for (NSUInteger i = 0; i < _count; i++)
+			if ([self keyAtIndex:i hasType:type bytes:bytes length:length]) return i;
+
+		return NSNotFound;
+	}
+
+	pthread_mutex_lock(&_lock);
+	if (_slots == NULL) [self buildIndex];
+	pthread_mutex_unlock(&_lock);
+
+	if (_slots == NULL) return NSNotFound;
+
+	for (size_t slot = LazyPropertyListHashKey(type, bytes, length) & _slotMask; _slots[slot] != 0; slot = (slot + 1) & _slotMask)
+		if ([self keyAtIndex:_slots[slot] - 1 hasType:type bytes:bytes length:length]) return _slots[slot] - 1;
+
+	return NSNotFound;
+}
+
+- (void)buildIndex
+{
+	// At most half full, so that probe sequences stay short
+	size_t slotCount = 1;
+	while (slotCount < (size_t)_count * 2) slotCount <<= 1;
+
+	_slots = calloc(slotCount, sizeof(uint32_t));
+	if (_slots == NULL) return;
+	_slotMask = slotCount - 1;
+
+	// Only the keys' bytes are hashed; no key or value is decoded
+	for (NSUInteger i = 0; i < _count; i++)
+	{
+		uint8_t type;
+		const uint8_t *bytes;
+		size_t length;
+		if (![_document getStringType:&type bytes:&bytes length:&length ofObject:[self referenceAtIndex:i]]) continue;
+
+		size_t slot = LazyPropertyListHashKey(type, bytes, length) & _slotMask;
+		while (_slots[slot] != 0) slot = (slot + 1) & _slotMask;
+		_slots[slot] = (uint32_t)i + 1;
+	}
+}
+
+@end
+
+#pragma mark - Reading
+
+id LazyPropertyListWithData(NSData *data)
+{
+	const uint8_t *bytes = [data bytes];
+	size_t length = [data length];
+
+	if (length < LazyPropertyListHeaderLength + LazyPropertyListTrailerLength || memcmp(bytes, LazyPropertyListMagic, LazyPropertyListHeaderLength) != 0) return nil;
+
+	// Trailer: 6 unused bytes, offset size, reference size, object count, top object, offset table offset
+	const uint8_t *trailer = bytes + length - LazyPropertyListTrailerLength;
+	size_t offsetSize = trailer[6];
+	size_t referenceSize = trailer[7];
+	uint64_t objectCount = LazyPropertyListReadInteger(trailer + 8, 8);
+	uint64_t topObject = LazyPropertyListReadInteger(trailer + 16, 8);
+	uint64_t offsetTable = LazyPropertyListReadInteger(trailer + 24, 8);
+	size_t trailerStart = length - LazyPropertyListTrailerLength;
+
+	if (offsetSize < 1 || offsetSize > 8 || referenceSize < 1 || referenceSize > 8) return nil;
+	if (offsetTable < LazyPropertyListHeaderLength || offsetTable > trailerStart) return nil;
+	if (topObject >= objectCount || objectCount > (trailerStart - offsetTable) / offsetSize) return nil;
+
+	LazyPropertyListDocument *document = [[LazyPropertyListDocument alloc] init];
+	document->_data = data;
+	document->_bytes = bytes;
+	document->_offsetTable = (size_t)offsetTable;
+	document->_offsetSize = offsetSize;
+	document->_referenceSize = referenceSize;
+	document->_objectCount = objectCount;
+
+	return [document objectWithReference:topObject];
+}
@@ -0,0 +1,27 @@
+//
+//  MappedData.h
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+//  Description: Immutable NSData backed by a read-only memory mapping of a file.
+//               The mapping is removed when the object is deallocated.
+//
+
+#import <Foundation/Foundation.h>
+
+@interface MappedData : NSData
+
+/**
+ Maps the first length bytes of the open file in memory. The descriptor can be closed afterwards.
+ Returns nil with errno set on failure.
+ */
+- (id)initWithFileDescriptor:(int)descriptor length:(size_t)length;
+
+/**
+ Tells the system how the bytes will be accessed (MADV_SEQUENTIAL, MADV_WILLNEED, ... see madvise()).
+ */
+- (void)advise:(int)advice;
+
+@end
@@ -0,0 +1,62 @@
+//
+//  MappedData.m
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+
+#import <sys/mman.h>
+#import "MappedData.h"
+
+@implementation MappedData
+{
+	void *_bytes;
+	size_t _length;
+}
+
+#pragma mark Lifetime
+
+- (id)initWithFileDescriptor:(int)descriptor length:(size_t)length
+{
+	void *bytes = mmap(NULL, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+	if (bytes == MAP_FAILED) return nil;
+	
+	self = [super init];
+	if (self)
+	{
+		_bytes = bytes;
+		_length = length;
+	}
+	else
+	{
+		munmap(bytes, length);
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	if (_bytes) munmap(_bytes, _length);
+}
+
+#pragma mark Access Hints
+
+- (void)advise:(int)advice
+{
+	madvise(_bytes, _length, advice);
+}
+
+#pragma mark NSData Primitives
+
+- (const void *)bytes
+{
+	return _bytes;
+}
+
+- (NSUInteger)length
+{
+	return _length;
+}
+
+@end
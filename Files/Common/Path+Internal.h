@@ -0,0 +1,80 @@
+//
+//  Path+Internal.h
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+//  Description: Construction shortcuts shared by the library's own classes. Not part of the public interface.
+//
+
+#import "Path.h"
+
+@interface Path (Internal)
+
+/**
+ Returns an instance of the receiving class for an item named "name" in the directory at parentPath,
+ which must be an absolute path as returned from -absolutePath. When the name is a single plain path
+ component, the resulting path is built without being validated or standardized again.
+ */
++ (instancetype)itemWithAbsoluteParentPath:(NSString *)parentPath name:(NSString *)name;
+
+/**
+ Creates the item's parent directory (and its own parents) if needed, logging and reporting failures like the public operations do.
+ */
+- (BOOL)createParentDirectory:(NSError **)error;
+
+@end
+
+#pragma mark File System Representations
+
+// The multi-threaded engines pass paths around as null-terminated file system representations
+// held in NSData so that no string conversion is needed for every item they visit.
+
+/**
+ Returns the null-terminated file system representation of the specified path.
+ */
+extern NSData *PathRepresentationWithString(NSString *path);
+
+/**
+ Returns the representation of the item named "name" inside the directory with the specified representation.
+ */
+extern NSData *PathRepresentationByAppendingName(NSData *representation, const char *name);
+
+/**
+ Returns the path string for a null-terminated file system representation.
+ */
+extern NSString *PathStringWithRepresentation(const char *representation);
+
+/**
+ Removes the file, link or directory (with its contents) at the specified representation.
+ */
+extern BOOL PathRemoveItemAtRepresentation(const char *representation);
+
+/**
+ Removes the file, link or directory (with its contents) named "name" in the open directory (or AT_FDCWD).
+ Directories are emptied through descriptors relative to each other, so paths are never resolved twice.
+ */
+extern BOOL PathRemoveItemAt(int directory, const char *name);
+
+/**
+ Removes everything inside the open directory, continuing past failures. Returns NO with errno set to the first failure.
+ */
+extern BOOL PathRemoveDirectoryContents(int descriptor);
+
+/**
+ Renames the item at source to destination without copying anything. Without overwrite, fails with EEXIST
+ if the destination exists (atomically where the system supports it). With overwrite, any existing item is
+ replaced, including non-empty directories and items of another kind. Fails with EXDEV across file systems.
+ */
+extern BOOL PathRenameItem(const char *source, const char *destination, BOOL overwrite);
+
+/**
+ Renames like PathRenameItem(), with each name relative to an open directory (or AT_FDCWD).
+ */
+extern BOOL PathRenameItemAt(int sourceDirectory, const char *source, int destinationDirectory, const char *destination, BOOL overwrite);
+
+/**
+ Atomically swaps the items at the two representations. Fails with ENOTSUP where the system can't do it atomically.
+ */
+extern BOOL PathExchangeItems(const char *first, const char *second);
@@ -10,9 +10,11 @@
 //
 
 #import <Foundation/Foundation.h>
+#import "PathWatcher.h"
 
 @class Directory;
 @class File;
+@class FileInfo;
 
 @interface Path : NSObject<NSCopying, NSCoding>
 
@@ -28,7 +30,7 @@
 - (NSString *)path;
 
 /**
- Returns the absolute path (fully expanded).
+ Returns the absolute path (fully expanded). It is computed once, when the instance is created.
  */
 - (NSString *)absolutePath;
 
@@ -92,7 +94,24 @@
 - (NSDictionary *)attributes;
 
 /**
- Returns the size of the item on disk (file or directory contents).
+ Returns a snapshot of the item's attributes (size, dates, inode, mode, etc.) obtained with a single stat call.
+ Prefer this over calling several of the individual attribute methods below.
+ */
+- (FileInfo *)info;
+
+/**
+ Returns a snapshot of the item's attributes obtained with a single stat call.
+ */
+- (FileInfo *)info:(NSError **)error;
+
+/**
+ Obtains the item's attributes on +[FileIOQueue sharedQueue] and passes them to the completion handler.
+ */
+- (void)infoWithCompletion:(void (^)(FileInfo *info, NSError *error))completion;
+
+/**
+ Returns the size of the item as reported by the file system. For a directory, this is the size of the
+ directory entry itself and not of its contents: use -[Directory diskUsage] to measure a directory's contents.
  */
 - (unsigned long long)size;
 
@@ -143,17 +162,39 @@
 
 /**
  Returns a subitem of the current path with the same concrete type as the object on which the method is called.
- Adds a numeric suffix if there is already something on disk with that name.
+ Adds a numeric suffix above the highest one in use if there is already something on disk with that name.
+ The highest suffix is cached per directory, which is only scanned again once its modification time changes.
  */
 - (Path *)subitemWithNumericSuffixIfExists:(NSString *)name;
 
 #pragma mark Operations
 
 - (BOOL)delete;
+
+/**
+ Removes the item (with its contents for directories). An item that doesn't exist counts as deleted.
+ */
+- (BOOL)delete:(NSError **)error;
+
+/**
+ Atomically swaps this item with another one on the same volume: each path then refers to what the other one referred to.
+ Useful to publish a fully prepared replacement with no window where neither version exists. Fails where the file system
+ doesn't support atomic exchanges (macOS before 10.12, Linux before 3.15 and some file systems).
+ */
+- (BOOL)exchangeWith:(Path *)other error:(NSError **)error;
+
 - (Path *)copyTo:(Path *)destination overwrite:(BOOL)overwrite error:(NSError **)error;
 - (Path *)createSymlinkAtPath:(Path *)path;
 - (Path *)createSymlinkAtPath:(Path *)path error:(NSError **)error;
 - (Path *)createHardLinkAtPath:(Path *)path;
 - (Path *)createHardLinkAtPath:(Path *)path error:(NSError **)error;
 
+#pragma mark Watching
+
+/**
+ Starts watching the item for changes (directories recursively) and calls the handler on the queue with
+ each batch of changes. Keep the returned watcher: watching stops when it is released.
+ */
+- (PathWatcher *)watchWithQueue:(NSOperationQueue *)queue handler:(void (^)(NSArray<PathChange *> *changes))handler error:(NSError **)error;
+
 @end
@@ -6,14 +6,42 @@
 //  Copyright (c) 2013 irradiated.net. All rights reserved.
 //
 
+#import <dirent.h>
+#import <errno.h>
+#import <fcntl.h>
+#import <stdio.h>
+#import <string.h>
+#import <sys/stat.h>
+#import <unistd.h>
+#if defined(__linux__)
+#import <sys/syscall.h>
+#endif
 #import "Path.h"
+#import "Path+Internal.h"
 #import "Directory.h"
+#import "FileInfo.h"
+#import "FileIOQueue.h"
+#import "UniqueNameAllocator.h"
 #import "NSError+FilesAdditions.h"
 #import "NSException+FilesAdditions.h"
 
+#if defined(__linux__)
+#if !defined(RENAME_NOREPLACE)
+#define RENAME_NOREPLACE (1 << 0)
+#endif
+#if !defined(RENAME_EXCHANGE)
+#define RENAME_EXCHANGE (1 << 1)
+#endif
+#endif
+
+static BOOL PathIsValid(NSString *candidatePath);
+static BOOL PathIsPlainComponent(NSString *name);
+
 @implementation Path
 {
 	NSString *_path;
+	NSString *_absolutePath;
+	NSUInteger _absolutePathHash;
 }
 
 #pragma mark Lifetime
@@ -23,29 +51,100 @@
 	self = [super init];
 	if (self)
 	{
-		if (path == nil || [self candidateHasInvalidPrefix:path] || [self candidateContainsSuccessiveSlashes:path])
+		if (!PathIsValid(path))
 		{
 			NSString *reason = [NSString stringWithFormat:@"The provided path is invalid: %@", path];
 			@throw [NSException exceptionWithReason:@"%@", reason];
 		}
 		
 		_path = [path copy];
+		
+		// Paths are immutable, so standardizing once here saves doing it on every comparison, hash and file operation
+		_absolutePath = [_path stringByStandardizingPath];
+		_absolutePathHash = [_absolutePath hash];
+	}
+	return self;
+}
+
+- (id)initWithAbsolutePath:(NSString *)absolutePath
+{
+	self = [super init];
+	if (self)
+	{
+		_path = [absolutePath copy];
+		_absolutePath = _path;
+		_absolutePathHash = [_absolutePath hash];
 	}
 	return self;
 }
 
 #pragma mark Private Validation
 
-- (BOOL)candidateHasInvalidPrefix:(NSString *)candidatePath
+#define PathValidationBufferLength 128
+
+// A valid path starts with "/" or "~/" (or is exactly "~") and never contains successive slashes.
+// Characters are scanned in fixed-size chunks copied on the stack, stopping at the first problem.
+static BOOL PathIsValid(NSString *candidatePath)
 {
-    return !([candidatePath hasPrefix:@"/"] || [candidatePath hasPrefix:@"~/"]) && ![candidatePath isEqualToString:@"~"];
+	NSUInteger length = [candidatePath length];
+	if (length == 0) return NO;
+	
+	unichar buffer[PathValidationBufferLength];
+	unichar previous = 0;
+	
+	for (NSUInteger location = 0; location < length; location += PathValidationBufferLength)
+	{
+		NSUInteger count = MIN((NSUInteger)PathValidationBufferLength, length - location);
+		[candidatePath getCharacters:buffer range:NSMakeRange(location, count)];
+		
+		NSUInteger index = 0;
+		if (location == 0)
+		{
+			if (buffer[0] == '~')
+			{
+				if (length == 1) return YES;
+				if (buffer[1] != '/') return NO;
+			}
+			else if (buffer[0] != '/')
+			{
+				return NO;
+			}
+		}
+		
+		for (; index < count; index++)
+		{
+			unichar character = buffer[index];
+			if (character == '/' && previous == '/') return NO;
+			previous = character;
+		}
+	}
+	
+	return YES;
 }
 
-- (BOOL)candidateContainsSuccessiveSlashes:(NSString *)candidatePath
+// Whether the name can be appended to an absolute path as-is, with the result still being standardized
+static BOOL PathIsPlainComponent(NSString *name)
 {
-    NSRegularExpression *regex = [NSRegularExpression regularExpressionWithPattern:@"/{2,}" options:NSRegularExpressionCaseInsensitive error:nil];
-    NSArray *matches = [regex matchesInString:candidatePath options:0 range:NSMakeRange(0, [candidatePath length])];
-    return matches.count > 0;
+	NSUInteger length = [name length];
+	if (length == 0) return NO;
+	
+	unichar buffer[PathValidationBufferLength];
+	BOOL onlyDots = YES;
+	
+	for (NSUInteger location = 0; location < length; location += PathValidationBufferLength)
+	{
+		NSUInteger count = MIN((NSUInteger)PathValidationBufferLength, length - location);
+		[name getCharacters:buffer range:NSMakeRange(location, count)];
+		
+		for (NSUInteger index = 0; index < count; index++)
+		{
+			if (buffer[index] == '/' || buffer[index] == 0) return NO;
+			if (buffer[index] != '.') onlyDots = NO;
+		}
+	}
+	
+	// "." and ".." need to be resolved by standardization
+	return !(onlyDots && length <= 2);
 }
 
 #pragma mark Equality
@@ -56,20 +155,25 @@
 #define NSUINTROTATE(val, howmuch) ((((NSUInteger)val) << howmuch) | (((NSUInteger)val) >> (NSUINT_BIT - howmuch)))
 - (BOOL)isEqual:(id)otherObject
 {
+	if (otherObject == self) return YES;
 	if (![otherObject isKindOfClass:[self class]]) return NO;
-	return [[self absolutePath] isEqual:[otherObject absolutePath]];
+	
+	Path *otherPath = otherObject;
+	if (otherPath->_absolutePathHash != _absolutePathHash) return NO;
+	
+	return [_absolutePath isEqualToString:otherPath->_absolutePath];
 }
 
 - (NSUInteger)hash
 {
-	return NSUINTROTATE([[self absolutePath] hash], NSUINT_BIT / 2) ^ [[self class] hash];
+	return NSUINTROTATE(_absolutePathHash, NSUINT_BIT / 2) ^ [[self class] hash];
 }
 
 #pragma mark Description
 
 - (NSString *)description
 {
-	return [self absolutePath];
+	return _absolutePath;
 }
 
 #pragma mark Information
@@ -81,7 +185,7 @@
 
 - (NSString *)absolutePath
 {
-	return [_path stringByStandardizingPath];
+	return _absolutePath;
 }
 
 - (NSArray<NSString *> *)pathComponents
@@ -176,32 +280,39 @@
 	return attributes;
 }
 
-- (unsigned long long)size
+- (FileInfo *)info
 {
-	return [[self tryObtainAttribute:NSFileSize] unsignedLongLongValue];
+	NSError *error;
+	FileInfo *info = [self info:&error];
+	
+	if (!info) NSLog(@"Could not obtain item information for path %@. Error: %@", [self path], error);
+	
+	return info;
 }
 
-- (NSDate *)creationDate
+- (FileInfo *)info:(NSError **)error
 {
-	return [self tryObtainAttribute:NSFileCreationDate];
+	return [FileInfo infoForItemAtPath:[self absolutePath] error:error];
 }
 
-- (NSDate *)modificationDate
+- (void)infoWithCompletion:(void (^)(FileInfo *info, NSError *error))completion
 {
-	return [self tryObtainAttribute:NSFileModificationDate];
+	[[FileIOQueue sharedQueue] infoForItem:self completion:completion];
 }
 
-- (id)tryObtainAttribute:(NSString *)fileAttributeKey
+- (unsigned long long)size
 {
-	NSNumber *attribute = [self attributes][fileAttributeKey];
-	
-	if (!attribute)
-	{
-		NSLog(@"Could not obtain file attribute %@ for item at path %@", fileAttributeKey, [self path]);
-		return nil;
-	}
-	
-	return attribute;
+	return [[self info] size];
+}
+
+- (NSDate *)creationDate
+{
+	return [[self info] creationDate];
+}
+
+- (NSDate *)modificationDate
+{
+	return [[self info] modificationDate];
 }
 
 - (void)setExcludeFromBackup:(BOOL)exclude
@@ -260,55 +371,89 @@
 
 - (Directory *)parent
 {
-	if ([[self absolutePath] isEqualToString:@"/"]) return nil;
+	if ([_absolutePath isEqualToString:@"/"]) return nil;
 	
-	return [Directory directoryWithPath:[[self absolutePath] stringByDeletingLastPathComponent]];
+	return [Directory directoryWithPath:[_absolutePath stringByDeletingLastPathComponent]];
 }
 
 - (Path *)subitem:(NSString *)name
 {
-	NSString *path = [[self absolutePath] stringByAppendingPathComponent:name];
-	return [[Path alloc] initWithPath:path]; // Can return instances of subclasses!
+	return [Path itemWithAbsoluteParentPath:_absolutePath name:name]; // Can return instances of subclasses!
 }
 
 - (Path *)subitemWithNumericSuffixIfExists:(NSString *)name
 {
-	Path *candidatePath = [self subitem:name];
-	
-	if (![candidatePath itemExists])
-		return candidatePath;
-	
-	NSString *basename = [candidatePath nameWithoutExtension];
-	NSString *extension = [candidatePath extension];
+	return [self subitem:[[UniqueNameAllocator sharedAllocator] availableName:name inDirectoryAtPath:[self absolutePath]]];
+}
+
+#pragma mark Internal
+
++ (instancetype)itemWithAbsoluteParentPath:(NSString *)parentPath name:(NSString *)name
+{
+	// Standardization can alter paths starting with "/private" (a child of the root) so only deeper paths are built directly
+	if (PathIsPlainComponent(name) && [parentPath length] > 1)
+	{
+		NSMutableString *path = [[NSMutableString alloc] initWithCapacity:[parentPath length] + 1 + [name length]];
+		[path appendString:parentPath];
+		[path appendString:@"/"];
+		[path appendString:name];
+		
+		return [[self alloc] initWithAbsolutePath:path];
+	}
 	
-	Path *suffixedPath;
-	NSUInteger suffixIndex = 1;
-	do
+	return [[self alloc] initWithPath:[parentPath stringByAppendingPathComponent:name]];
+}
+
+- (BOOL)createParentDirectory:(NSError **)error
+{
+	Directory *parent = [self parent];
+	if ([parent create] == nil)
 	{
-		NSString *extensionWithDot = extension ? [@"." stringByAppendingString:extension] : @"";
-		NSString *suffixedFileNameString = [NSString stringWithFormat:@"%@%@%@", basename, @(suffixIndex), extensionWithDot];
-		suffixedPath = [[Path alloc] initWithPath:[[self subitem:suffixedFileNameString] absolutePath]];
-		suffixIndex++;
+		NSString *description = [NSString stringWithFormat:@"Could not create parent directory %@", [parent absolutePath]];
+		NSLog(@"%@", description);
+		if (error) *error = [NSError errorWithDescription:@"%@", description];
+		return NO;
 	}
-	while ([suffixedPath itemExists]);
 	
-	return suffixedPath;
+	return YES;
 }
 
 #pragma mark Operations
 
+- (BOOL)exchangeWith:(Path *)other error:(NSError **)error
+{
+	if (other == nil)
+		@throw [NSException exceptionWithReason:@"Item to exchange with is nil"];
+	
+	if (!PathExchangeItems([[self absolutePath] fileSystemRepresentation], [[other absolutePath] fileSystemRepresentation]))
+	{
+		int code = errno;
+		NSError *innerError = [NSError errorWithPOSIXCode:code description:@"Could not exchange item at path %@ with item at path %@", [self absolutePath], [other absolutePath]];
+		NSLog(@"%@", [innerError description]);
+		if (error) *error = innerError;
+		return NO;
+	}
+	
+	return YES;
+}
+
 - (BOOL)delete
 {
-    BOOL itemExists = [[NSFileManager defaultManager] fileExistsAtPath:[self absolutePath]];
-    if (!itemExists) return YES;
-    
-    NSError *error = nil;
-    NSFileManager *manager = [NSFileManager defaultManager];
-    BOOL success = [manager removeItemAtPath:[self absolutePath] error:&error];
-    
-    if (error) NSLog(@"%@", error);
-    
-    return success && !error;
+	// Without an error to return, the failure is logged like it always was
+	NSError *error = nil;
+	BOOL deleted = [self delete:&error];
+	if (!deleted) NSLog(@"%@", [error description]);
+	return deleted;
+}
+
+- (BOOL)delete:(NSError **)error
+{
+	// No existence check: removing a missing item fails with ENOENT, which is the same answer for one system call less
+	if (PathRemoveItemAtRepresentation([[self absolutePath] fileSystemRepresentation]) || errno == ENOENT) return YES;
+	
+	int code = errno;
+	if (error) *error = [NSError errorWithPOSIXCode:code description:@"Could not delete item at path %@", [self absolutePath]];
+	return NO;
 }
 
 // Overriden with more concrete parameter and return types
@@ -328,14 +473,7 @@
 		}
 	}
 	
-	Directory *parent = [destination parent];
-	if ([parent create] == nil)
-	{
-		NSString *description = [NSString stringWithFormat:@"Could not create parent directory %@", [parent absolutePath]];
-		NSLog(@"%@", description);
-		if (error) *error = [NSError errorWithDescription:@"%@", description];
-		return nil;
-	}
+	if (![destination createParentDirectory:error]) return nil;
 	
 	NSError *innerError = nil;
 	[manager copyItemAtPath:[self absolutePath] toPath:[destination absolutePath] error:&innerError];
@@ -385,6 +523,16 @@
 	return [[[self class] alloc] initWithPath:_path];
 }
 
+#pragma mark Watching
+
+- (PathWatcher *)watchWithQueue:(NSOperationQueue *)queue handler:(void (^)(NSArray<PathChange *> *changes))handler error:(NSError **)error
+{
+	PathWatcher *watcher = [[PathWatcher alloc] initWithItem:self options:PathWatcherRecursive];
+	[watcher setQueue:queue];
+	
+	return ([watcher startWithHandler:handler error:error] ? watcher : nil);
+}
+
 #pragma mark NSCoding
 
 - (void)encodeWithCoder:(NSCoder *)aCoder
@@ -398,3 +546,183 @@
 }
 
 @end
+
+#pragma mark - File System Representations
+
+NSData *PathRepresentationWithString(NSString *path)
+{
+	const char *representation = [path fileSystemRepresentation];
+	return [NSData dataWithBytes:representation length:strlen(representation) + 1];
+}
+
+NSData *PathRepresentationByAppendingName(NSData *representation, const char *name)
+{
+	size_t pathLength = [representation length] - 1;
+	size_t nameLength = strlen(name);
+	BOOL needsSeparator = (pathLength == 0 || ((const char *)[representation bytes])[pathLength - 1] != '/');
+	
+	NSMutableData *result = [NSMutableData dataWithLength:pathLength + needsSeparator + nameLength + 1];
+	char *bytes = [result mutableBytes];
+	
+	memcpy(bytes, [representation bytes], pathLength);
+	if (needsSeparator) bytes[pathLength] = '/';
+	memcpy(bytes + pathLength + needsSeparator, name, nameLength + 1);
+	
+	return result;
+}
+
+NSString *PathStringWithRepresentation(const char *representation)
+{
+	return [[NSFileManager defaultManager] stringWithFileSystemRepresentation:representation length:strlen(representation)];
+}
+
+BOOL PathRemoveItemAtRepresentation(const char *representation)
+{
+	return PathRemoveItemAt(AT_FDCWD, representation);
+}
+
+BOOL PathRemoveItemAt(int directory, const char *name)
+{
+	if (unlinkat(directory, name, 0) == 0) return YES;
+	
+	// unlink() fails with EISDIR on Linux and EPERM on Apple platforms for directories
+	if (errno != EISDIR && errno != EPERM) return NO;
+	
+	int code = errno;
+	int descriptor = openat(directory, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	
+	if (descriptor < 0)
+	{
+		// Not a directory after all: the original error was a genuine permission error
+		if (errno == ENOTDIR || errno == ELOOP) errno = code;
+		return NO;
+	}
+	
+	BOOL emptied = PathRemoveDirectoryContents(descriptor);
+	code = errno;
+	close(descriptor);
+	
+	if (!emptied)
+	{
+		errno = code;
+		return NO;
+	}
+	
+	return (unlinkat(directory, name, AT_REMOVEDIR) == 0);
+}
+
+BOOL PathRemoveDirectoryContents(int descriptor)
+{
+	// The stream gets its own descriptor so that reading it doesn't move the caller's descriptor
+	int streamDescriptor = openat(descriptor, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	DIR *stream = (streamDescriptor >= 0 ? fdopendir(streamDescriptor) : NULL);
+	
+	if (stream == NULL)
+	{
+		int code = errno;
+		if (streamDescriptor >= 0) close(streamDescriptor);
+		errno = code;
+		return NO;
+	}
+	
+	int firstErrorCode = 0;
+	BOOL removedItems = YES;
+	
+	// Directories can skip entries when they change while being read, so reading is repeated until
+	// a pass removes nothing (the last pass normally only finds "." and "..")
+	while (removedItems)
+	{
+		removedItems = NO;
+		firstErrorCode = 0;
+		rewinddir(stream);
+		
+		struct dirent *entry;
+		while (YES)
+		{
+			errno = 0;
+			if ((entry = readdir(stream)) == NULL)
+			{
+				// A directory that can't be read won't get any better on the next pass
+				if (errno != 0)
+				{
+					if (firstErrorCode == 0) firstErrorCode = errno;
+					removedItems = NO;
+				}
+				break;
+			}
+			
+			const char *name = entry->d_name;
+			if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+			
+			if (PathRemoveItemAt(descriptor, name))
+				removedItems = YES;
+			else if (firstErrorCode == 0)
+				firstErrorCode = errno;
+		}
+	}
+	
+	closedir(stream);
+	
+	errno = firstErrorCode;
+	return (firstErrorCode == 0);
+}
+
+// Returns -1 with errno set to ENOTSUP when the system has no flagged rename
+static int PathRenameWithFlags(int sourceDirectory, const char *source, int destinationDirectory, const char *destination, unsigned int flags)
+{
+#if defined(__linux__) && defined(SYS_renameat2)
+	return (int)syscall(SYS_renameat2, sourceDirectory, source, destinationDirectory, destination, flags);
+#elif defined(__APPLE__)
+	// renameatx_np() is weak-linked when deploying to systems older than macOS 10.12 / iOS 10
+	if (&renameatx_np != NULL) return renameatx_np(sourceDirectory, source, destinationDirectory, destination, flags);
+	errno = ENOTSUP;
+	return -1;
+#else
+	errno = ENOTSUP;
+	return -1;
+#endif
+}
+
+BOOL PathRenameItem(const char *source, const char *destination, BOOL overwrite)
+{
+	return PathRenameItemAt(AT_FDCWD, source, AT_FDCWD, destination, overwrite);
+}
+
+BOOL PathRenameItemAt(int sourceDirectory, const char *source, int destinationDirectory, const char *destination, BOOL overwrite)
+{
+	if (!overwrite)
+	{
+#if defined(__APPLE__)
+		if (PathRenameWithFlags(sourceDirectory, source, destinationDirectory, destination, RENAME_EXCL) == 0) return YES;
+#else
+		if (PathRenameWithFlags(sourceDirectory, source, destinationDirectory, destination, RENAME_NOREPLACE) == 0) return YES;
+#endif
+		if (errno != ENOTSUP && errno != ENOSYS && errno != EINVAL) return NO;
+		
+		// No atomic way to refuse replacing the destination on this system or file system
+		struct stat info;
+		if (fstatat(destinationDirectory, destination, &info, AT_SYMLINK_NOFOLLOW) == 0) { errno = EEXIST; return NO; }
+		
+		return (renameat(sourceDirectory, source, destinationDirectory, destination) == 0);
+	}
+	
+	if (renameat(sourceDirectory, source, destinationDirectory, destination) == 0) return YES;
+	
+	// rename() only replaces empty directories with directories and files with files
+	if (errno != EEXIST && errno != ENOTEMPTY && errno != EISDIR && errno != ENOTDIR) return NO;
+	if (!PathRemoveItemAt(destinationDirectory, destination)) return NO;
+	
+	return (renameat(sourceDirectory, source, destinationDirectory, destination) == 0);
+}
+
+BOOL PathExchangeItems(const char *first, const char *second)
+{
+#if defined(__APPLE__)
+	int result = PathRenameWithFlags(AT_FDCWD, first, AT_FDCWD, second, RENAME_SWAP);
+#else
+	int result = PathRenameWithFlags(AT_FDCWD, first, AT_FDCWD, second, RENAME_EXCHANGE);
+#endif
+	
+	if (result != 0 && (errno == ENOSYS || errno == EINVAL)) errno = ENOTSUP;
+	return (result == 0);
+}
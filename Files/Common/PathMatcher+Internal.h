@@ -0,0 +1,35 @@
+//
+//  PathMatcher+Internal.h
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+//  Description: Matching on raw file system names for directory enumerators. Not part of the public interface.
+//
+
+#import <sys/stat.h>
+#import "PathMatcher.h"
+
+@interface PathMatcher (Internal)
+
+/**
+ Returns whether the item matches the pattern and name test. The path is relative to the enumerated
+ directory and is only used by path patterns. Neither string is null-terminated.
+ */
+- (BOOL)matchesName:(const char *)name length:(size_t)nameLength relativePath:(const char *)path length:(size_t)pathLength;
+
+/**
+ Returns whether items inside the directory at the relative path could match, so that enumerators don't
+ descend into directories a path pattern excludes. Always YES for name patterns.
+ */
+- (BOOL)mayMatchInsideDirectoryAtRelativePath:(const char *)path length:(size_t)length;
+
+/**
+ Whether matching requires the item's information (size or modification date predicates are set).
+ */
+@property (readonly) BOOL needsItemInfo;
+
+- (BOOL)matchesInfo:(const struct stat *)info;
+
+@end
@@ -0,0 +1,96 @@
+//
+//  PathMatcher.h
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+//  Description: A glob pattern compiled once and matched against the raw names read from directories,
+//               plus optional size and modification date predicates. Directory enumerators test names
+//               before creating any object and only stat the items whose name matched.
+//
+
+#import <Foundation/Foundation.h>
+
+typedef NS_OPTIONS(NSUInteger, PathMatcherOptions)
+{
+	PathMatcherOptionsNone = 0,
+
+	/**
+	 ASCII letters match regardless of case.
+	 */
+	PathMatcherCaseInsensitive = 1 << 0,
+
+	/**
+	 Wildcards can match a period at the start of a name, so that "*" also matches hidden items.
+	 */
+	PathMatcherMatchHidden = 1 << 1
+};
+
+@interface PathMatcher : NSObject
+
+#pragma mark Lifetime
+
++ (instancetype)matcherWithPattern:(NSString *)pattern;
+
+/**
+ Compiles the pattern, which supports "*" (any characters but "/"), "?" (one character), "[abc]", "[a-z]" and
+ "[!abc]" (one character in or out of a set), "**" as a whole path component (any number of directories) and "\"
+ to escape the next character. A pattern without "/" matches the name of items at any level; a pattern with "/"
+ matches paths relative to the enumerated directory. A nil pattern matches everything (for predicates only).
+ Throws if the pattern is malformed.
+ */
+- (id)initWithPattern:(NSString *)pattern options:(PathMatcherOptions)options;
+
+@property (readonly) NSString *pattern;
+
+@property (readonly) PathMatcherOptions options;
+
+/**
+ Whether the pattern contains "/" and is matched against relative paths rather than names.
+ */
+@property (readonly) BOOL matchesRelativePaths;
+
+#pragma mark Predicates
+
+// Checked only for items whose name matched, with a single stat. Symbolic links are checked for what they point to.
+
+/**
+ The minimum size of matching items, in bytes (0 by default).
+ */
+@property (nonatomic) unsigned long long minimumSize;
+
+/**
+ The maximum size of matching items, in bytes (ULLONG_MAX by default).
+ */
+@property (nonatomic) unsigned long long maximumSize;
+
+/**
+ When set, matching items were last modified after this date.
+ */
+@property (nonatomic) NSDate *modifiedAfter;
+
+/**
+ When set, matching items were last modified before this date.
+ */
+@property (nonatomic) NSDate *modifiedBefore;
+
+/**
+ When set, an additional test on the raw file system name of items (not null-terminated), called after the pattern matched.
+ */
+@property (nonatomic, copy) BOOL (^nameTest)(const char *name, size_t length);
+
+#pragma mark Matching
+
+/**
+ Returns whether the pattern (and name test) match the relative path, or its last component for name patterns.
+ Predicates are not checked.
+ */
+- (BOOL)matchesPath:(NSString *)path;
+
+/**
+ Escapes the characters that have a meaning in patterns, so that the string is matched literally.
+ */
++ (NSString *)escapedPattern:(NSString *)string;
+
+@end
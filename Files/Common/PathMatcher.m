@@ -0,0 +1,434 @@
+//
+//  PathMatcher.m
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+
+#import <limits.h>
+#import <stdint.h>
+#import <string.h>
+#import <sys/stat.h>
+#import "PathMatcher.h"
+#import "PathMatcher+Internal.h"
+#import "NSException+FilesAdditions.h"
+
+#if defined(__APPLE__)
+#define PathMatcherModificationTime(info) ((info)->st_mtimespec)
+#else
+#define PathMatcherModificationTime(info) ((info)->st_mtim)
+#endif
+
+typedef NS_ENUM(uint8_t, PathMatcherTokenKind)
+{
+	PathMatcherTokenLiteral, // One byte
+	PathMatcherTokenAny, // One character
+	PathMatcherTokenClass, // One character in (or out of) a set of ranges
+	PathMatcherTokenStar // Any number of characters
+};
+
+typedef struct
+{
+	PathMatcherTokenKind kind;
+	uint8_t byte;
+	uint8_t negated;
+	uint32_t rangeStart;
+	uint32_t rangeCount;
+} PathMatcherToken;
+
+typedef struct
+{
+	uint32_t tokenStart;
+	uint32_t tokenCount;
+	uint8_t isGlobstar;
+} PathMatcherSegment;
+
+typedef struct
+{
+	uint32_t first;
+	uint32_t last;
+} PathMatcherRange;
+
+// A compiled pattern: one segment per path component, each a sequence of tokens. Characters are matched
+// as UTF-8 so that "?" and classes consume whole characters, while literals compare bytes.
+typedef struct
+{
+	const PathMatcherToken *tokens;
+	const PathMatcherSegment *segments;
+	const PathMatcherRange *ranges;
+	size_t segmentCount;
+	BOOL caseInsensitive;
+	BOOL matchHidden;
+} PathMatcherProgram;
+
+static BOOL PathMatcherCompile(const uint8_t *pattern, size_t length, BOOL caseInsensitive, PathMatcherToken *tokens, PathMatcherSegment *segments, PathMatcherRange *ranges, size_t *segmentCount);
+static BOOL PathMatcherMatchSegment(const PathMatcherProgram *program, const PathMatcherSegment *segment, const uint8_t *name, size_t length);
+static BOOL PathMatcherMatchPath(const PathMatcherProgram *program, size_t segmentIndex, const uint8_t *path, size_t length, BOOL partial);
+
+@implementation PathMatcher
+{
+	NSMutableData *_tokens;
+	NSMutableData *_segments;
+	NSMutableData *_ranges;
+	PathMatcherProgram _program;
+	double _modifiedAfterTime;
+	double _modifiedBeforeTime;
+}
+
+#pragma mark Lifetime
+
++ (instancetype)matcherWithPattern:(NSString *)pattern
+{
+	return [[self alloc] initWithPattern:pattern options:PathMatcherOptionsNone];
+}
+
+- (id)init
+{
+	return [self initWithPattern:nil options:PathMatcherOptionsNone];
+}
+
+- (id)initWithPattern:(NSString *)pattern options:(PathMatcherOptions)options
+{
+	self = [super init];
+	if (self)
+	{
+		_pattern = [pattern copy];
+		_options = options;
+		_maximumSize = ULLONG_MAX;
+
+		if (pattern)
+		{
+			const char *representation = [pattern fileSystemRepresentation];
+			size_t length = strlen(representation);
+			size_t segmentCount = 0;
+
+			// Every pattern byte produces at most one token, one segment and one range
+			_tokens = [NSMutableData dataWithLength:(length + 1) * sizeof(PathMatcherToken)];
+			_segments = [NSMutableData dataWithLength:(length + 1) * sizeof(PathMatcherSegment)];
+			_ranges = [NSMutableData dataWithLength:(length + 1) * sizeof(PathMatcherRange)];
+
+			BOOL compiled = PathMatcherCompile((const uint8_t *)representation, length, (options & PathMatcherCaseInsensitive) != 0,
+			                                   [_tokens mutableBytes], [_segments mutableBytes], [_ranges mutableBytes], &segmentCount);
+
+			if (!compiled) @throw [NSException exceptionWithReason:@"Malformed pattern \"%@\": unterminated character class", pattern];
+
+			_matchesRelativePaths = (strchr(representation, '/') != NULL);
+			_program = (PathMatcherProgram){ [_tokens bytes], [_segments bytes], [_ranges bytes], segmentCount, (options & PathMatcherCaseInsensitive) != 0, (options & PathMatcherMatchHidden) != 0 };
+		}
+	}
+	return self;
+}
+
+#pragma mark Predicates
+
+- (void)setModifiedAfter:(NSDate *)modifiedAfter
+{
+	_modifiedAfter = modifiedAfter;
+	_modifiedAfterTime = [modifiedAfter timeIntervalSince1970];
+}
+
+- (void)setModifiedBefore:(NSDate *)modifiedBefore
+{
+	_modifiedBefore = modifiedBefore;
+	_modifiedBeforeTime = [modifiedBefore timeIntervalSince1970];
+}
+
+#pragma mark Matching
+
+- (BOOL)matchesPath:(NSString *)path
+{
+	const char *representation = [path fileSystemRepresentation];
+	const char *name = strrchr(representation, '/');
+	name = (name ? name + 1 : representation);
+
+	return [self matchesName:name length:strlen(name) relativePath:representation length:strlen(representation)];
+}
+
++ (NSString *)escapedPattern:(NSString *)string
+{
+	NSMutableString *escaped = [NSMutableString stringWithCapacity:[string length]];
+	NSCharacterSet *special = [NSCharacterSet characterSetWithCharactersInString:@"*?[]\\"];
+
+	for (NSUInteger i = 0; i < [string length]; i++)
+	{
+		unichar character = [string characterAtIndex:i];
+		if ([special characterIsMember:character]) [escaped appendString:@"\\"];
+		[escaped appendFormat:@"%C", character];
+	}
+
+	return escaped;
+}
+
+#pragma mark Internal
+
+- (BOOL)matchesName:(const char *)name length:(size_t)nameLength relativePath:(const char *)path length:(size_t)pathLength
+{
+	if (_pattern)
+	{
+		BOOL matched;
+
+		if (_matchesRelativePaths) matched = PathMatcherMatchPath(&_program, 0, (const uint8_t *)path, pathLength, NO);
+		else if (_program.segmentCount == 0) matched = YES;
+		else matched = PathMatcherMatchSegment(&_program, &_program.segments[0], (const uint8_t *)name, nameLength);
+
+		if (!matched) return NO;
+	}
+
+	return (_nameTest == nil || _nameTest(name, nameLength));
+}
+
+- (BOOL)mayMatchInsideDirectoryAtRelativePath:(const char *)path length:(size_t)length
+{
+	if (_pattern == nil || !_matchesRelativePaths) return YES;
+
+	return PathMatcherMatchPath(&_program, 0, (const uint8_t *)path, length, YES);
+}
+
+- (BOOL)needsItemInfo
+{
+	return (_minimumSize > 0 || _maximumSize < ULLONG_MAX || _modifiedAfter != nil || _modifiedBefore != nil);
+}
+
+- (BOOL)matchesInfo:(const struct stat *)info
+{
+	unsigned long long size = (unsigned long long)info->st_size;
+	if (size < _minimumSize || size > _maximumSize) return NO;
+
+	double modificationTime = (double)PathMatcherModificationTime(info).tv_sec + PathMatcherModificationTime(info).tv_nsec / 1e9;
+	if (_modifiedAfter && !(modificationTime > _modifiedAfterTime)) return NO;
+	if (_modifiedBefore && !(modificationTime < _modifiedBeforeTime)) return NO;
+
+	return YES;
+}
+
+@end
+
+#pragma mark - Compilation
+
+static inline uint8_t PathMatcherFold(uint8_t byte, BOOL caseInsensitive)
+{
+	return (caseInsensitive && byte >= 'A' && byte <= 'Z' ? (uint8_t)(byte + ('a' - 'A')) : byte);
+}
+
+// Decodes one UTF-8 character, treating invalid sequences as single bytes
+static size_t PathMatcherDecode(const uint8_t *bytes, size_t length, uint32_t *character)
+{
+	uint8_t lead = bytes[0];
+	size_t count = (lead >= 0xF0 && lead < 0xF8 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 1);
+
+	if (count == 1 || count > length)
+	{
+		*character = lead;
+		return 1;
+	}
+
+	uint32_t value = lead & (0x7F >> count);
+
+	for (size_t i = 1; i < count; i++)
+	{
+		if ((bytes[i] & 0xC0) != 0x80)
+		{
+			*character = lead;
+			return 1;
+		}
+
+		value = (value << 6) | (bytes[i] & 0x3F);
+	}
+
+	*character = value;
+	return count;
+}
+
+static BOOL PathMatcherCompile(const uint8_t *pattern, size_t length, BOOL caseInsensitive, PathMatcherToken *tokens, PathMatcherSegment *segments, PathMatcherRange *ranges, size_t *segmentCount)
+{
+	size_t tokenCount = 0, rangeCount = 0, i = 0;
+	*segmentCount = 0;
+
+	while (i < length)
+	{
+		PathMatcherSegment segment = { (uint32_t)tokenCount, 0, 0 };
+
+		if (pattern[i] == '*' && i + 1 < length && pattern[i + 1] == '*' && (i + 2 == length || pattern[i + 2] == '/'))
+		{
+			segment.isGlobstar = 1;
+			i += 2;
+		}
+
+		while (!segment.isGlobstar && i < length && pattern[i] != '/')
+		{
+			uint8_t byte = pattern[i];
+			PathMatcherToken token = { PathMatcherTokenLiteral, 0, 0, 0, 0 };
+
+			if (byte == '*')
+			{
+				i++;
+				if (tokenCount > segment.tokenStart && tokens[tokenCount - 1].kind == PathMatcherTokenStar) continue;
+				token.kind = PathMatcherTokenStar;
+			}
+			else if (byte == '?')
+			{
+				i++;
+				token.kind = PathMatcherTokenAny;
+			}
+			else if (byte == '[')
+			{
+				size_t j = i + 1;
+				token.kind = PathMatcherTokenClass;
+				token.rangeStart = (uint32_t)rangeCount;
+
+				if (j < length && (pattern[j] == '!' || pattern[j] == '^'))
+				{
+					token.negated = 1;
+					j++;
+				}
+
+				// A "]" right after the opening bracket is part of the set
+				for (BOOL first = YES; j < length && (pattern[j] != ']' || first); first = NO)
+				{
+					if (pattern[j] == '/') return NO;
+					if (pattern[j] == '\\' && j + 1 < length) j++;
+
+					uint32_t low, high;
+					j += PathMatcherDecode(pattern + j, length - j, &low);
+					high = low;
+
+					if (j + 1 < length && pattern[j] == '-' && pattern[j + 1] != ']')
+					{
+						j++;
+						if (pattern[j] == '\\' && j + 1 < length) j++;
+						j += PathMatcherDecode(pattern + j, length - j, &high);
+					}
+
+					ranges[rangeCount++] = (PathMatcherRange){ MIN(low, high), MAX(low, high) };
+				}
+
+				if (j >= length) return NO;
+
+				token.rangeCount = (uint32_t)(rangeCount - token.rangeStart);
+				i = j + 1;
+			}
+			else
+			{
+				if (byte == '\\' && i + 1 < length) byte = pattern[++i];
+				token.byte = PathMatcherFold(byte, caseInsensitive);
+				i++;
+			}
+
+			tokens[tokenCount++] = token;
+		}
+
+		segment.tokenCount = (uint32_t)(tokenCount - segment.tokenStart);
+
+		// Empty components ("a//b", a leading or trailing "/") are ignored
+		if (segment.isGlobstar || segment.tokenCount > 0) segments[(*segmentCount)++] = segment;
+
+		if (i < length) i++; // Skips the "/"
+	}
+
+	return YES;
+}
+
+#pragma mark - Matching
+
+static BOOL PathMatcherClassContains(const PathMatcherProgram *program, const PathMatcherToken *token, uint32_t character)
+{
+	uint32_t alternate = character;
+
+	if (program->caseInsensitive && character < 128 && ((character | 0x20) >= 'a' && (character | 0x20) <= 'z'))
+		alternate = character ^ 0x20;
+
+	for (uint32_t i = 0; i < token->rangeCount; i++)
+	{
+		const PathMatcherRange *range = &program->ranges[token->rangeStart + i];
+		if ((character >= range->first && character <= range->last) || (alternate >= range->first && alternate <= range->last)) return YES;
+	}
+
+	return NO;
+}
+
+static BOOL PathMatcherMatchSegment(const PathMatcherProgram *program, const PathMatcherSegment *segment, const uint8_t *name, size_t length)
+{
+	const PathMatcherToken *tokens = program->tokens + segment->tokenStart;
+	size_t tokenCount = segment->tokenCount;
+
+	if (segment->isGlobstar) return (program->matchHidden || length == 0 || name[0] != '.');
+
+	// Like in shells, a leading period is only matched by a literal period
+	if (!program->matchHidden && length > 0 && name[0] == '.' && (tokenCount == 0 || tokens[0].kind != PathMatcherTokenLiteral)) return NO;
+
+	size_t t = 0, n = 0;
+	size_t starToken = SIZE_MAX, starPosition = 0;
+
+	// Classic wildcard matching: on a mismatch, the last star absorbs one more character and matching resumes after it
+	while (n < length)
+	{
+		if (t < tokenCount)
+		{
+			const PathMatcherToken *token = &tokens[t];
+			uint32_t character;
+			size_t count;
+
+			switch (token->kind)
+			{
+				case PathMatcherTokenLiteral:
+					if (PathMatcherFold(name[n], program->caseInsensitive) == token->byte) { t++; n++; continue; }
+					break;
+
+				case PathMatcherTokenAny:
+					n += PathMatcherDecode(name + n, length - n, &character);
+					t++;
+					continue;
+
+				case PathMatcherTokenClass:
+					count = PathMatcherDecode(name + n, length - n, &character);
+					if (PathMatcherClassContains(program, token, character) != (token->negated != 0)) { t++; n += count; continue; }
+					break;
+
+				case PathMatcherTokenStar:
+					starToken = t++;
+					starPosition = n;
+					continue;
+			}
+		}
+
+		if (starToken == SIZE_MAX) return NO;
+
+		uint32_t character;
+		starPosition += PathMatcherDecode(name + starPosition, length - starPosition, &character);
+		n = starPosition;
+		t = starToken + 1;
+	}
+
+	while (t < tokenCount && tokens[t].kind == PathMatcherTokenStar) t++;
+	return (t == tokenCount);
+}
+
+// Matches the path's components against the segments from segmentIndex on. With partial, returns whether
+// the path could be the directory of a match instead (the segments outlast the path).
+static BOOL PathMatcherMatchPath(const PathMatcherProgram *program, size_t segmentIndex, const uint8_t *path, size_t length, BOOL partial)
+{
+	if (segmentIndex == program->segmentCount) return (length == 0 && !partial);
+
+	if (length == 0)
+	{
+		if (partial) return YES;
+		for (size_t i = segmentIndex; i < program->segmentCount; i++) if (!program->segments[i].isGlobstar) return NO;
+		return YES;
+	}
+
+	const PathMatcherSegment *segment = &program->segments[segmentIndex];
+	const uint8_t *separator = memchr(path, '/', length);
+	size_t componentLength = (separator ? (size_t)(separator - path) : length);
+	const uint8_t *rest = (separator ? separator + 1 : path + length);
+	size_t restLength = (separator ? length - componentLength - 1 : 0);
+
+	if (segment->isGlobstar)
+	{
+		// "**" matches no directories, or swallows one more and stays in place
+		if (PathMatcherMatchPath(program, segmentIndex + 1, path, length, partial)) return YES;
+		return (PathMatcherMatchSegment(program, segment, path, componentLength) && PathMatcherMatchPath(program, segmentIndex, rest, restLength, partial));
+	}
+
+	return (PathMatcherMatchSegment(program, segment, path, componentLength) && PathMatcherMatchPath(program, segmentIndex + 1, rest, restLength, partial));
+}
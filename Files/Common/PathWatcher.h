@@ -0,0 +1,110 @@
+//
+//  PathWatcher.h
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+//  Description: Reports changes to a file or a directory tree as they happen, using inotify on Linux
+//               and kqueue on Apple platforms. Changes are coalesced over a short window and delivered
+//               in batches, so a burst of writes results in a single notification per item.
+//
+
+#import <Foundation/Foundation.h>
+
+@class Path;
+
+typedef NS_OPTIONS(NSUInteger, PathChangeKind)
+{
+	PathChangeCreated = 1 << 0,
+	PathChangeRemoved = 1 << 1,
+
+	/**
+	 The item's contents were written to.
+	 */
+	PathChangeModified = 1 << 2,
+
+	PathChangeAttributesChanged = 1 << 3,
+
+	/**
+	 The item was renamed or moved (combined with Created for its new path and Removed for its old path).
+	 */
+	PathChangeRenamed = 1 << 4,
+
+	/**
+	 Changes were lost because too many happened at once or a directory couldn't be read. The change is reported for
+	 the watched item: anything derived from its contents should be read again.
+	 */
+	PathChangeRescanRequired = 1 << 5
+};
+
+typedef NS_OPTIONS(NSUInteger, PathWatcherOptions)
+{
+	PathWatcherOptionsNone = 0,
+
+	/**
+	 Also reports changes inside the subdirectories of a watched directory, including subdirectories created later.
+	 */
+	PathWatcherRecursive = 1 << 0
+};
+
+/**
+ A change to one item. Several changes to the same item within the coalescing window are combined.
+ */
+@interface PathChange : NSObject
+
+@property (readonly) NSString *path;
+@property (readonly) BOOL isDirectory;
+@property (readonly) PathChangeKind kinds;
+
+/**
+ A File or a Directory for the changed path.
+ */
+- (Path *)item;
+
+@end
+
+@interface PathWatcher : NSObject
+
+#pragma mark Lifetime
+
+- (id)initWithItem:(Path *)item options:(PathWatcherOptions)options;
+
+#pragma mark Configuration
+
+// These must be set before starting.
+
+@property (readonly) Path *item;
+
+@property (readonly) PathWatcherOptions options;
+
+/**
+ How long changes are accumulated after the first one before they are delivered, in seconds (0.05 by default).
+ */
+@property (nonatomic) NSTimeInterval coalescingInterval;
+
+/**
+ The queue on which the handler is called. When nil, the handler is called on the watcher's own thread.
+ */
+@property (nonatomic) NSOperationQueue *queue;
+
+#pragma mark Watching
+
+/**
+ Starts watching. The handler is called with the changes accumulated during each coalescing window,
+ in the order the items first changed. Fails if the item does not exist or can't be watched (for
+ example when the system's limit on inotify watches is reached).
+
+ On Apple platforms, directories only report changes to their entries: writes to an existing file
+ inside a watched directory are reported when the file is replaced or resized through a new entry,
+ but in-place modifications are only reported when watching the file itself.
+ */
+- (BOOL)startWithHandler:(void (^)(NSArray<PathChange *> *changes))handler error:(NSError **)error;
+
+/**
+ Stops watching. Batches already handed to the queue are dropped; a handler that is running finishes normally.
+ Watchers also stop when deallocated.
+ */
+- (void)stop;
+
+@end
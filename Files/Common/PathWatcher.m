@@ -0,0 +1,757 @@
+//
+//  PathWatcher.m
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+
+#import <dirent.h>
+#import <errno.h>
+#import <fcntl.h>
+#import <math.h>
+#import <pthread.h>
+#import <string.h>
+#import <sys/stat.h>
+#import <unistd.h>
+#if defined(__linux__)
+#import <poll.h>
+#import <sys/inotify.h>
+#elif defined(__APPLE__)
+#import <sys/event.h>
+#endif
+#import "PathWatcher.h"
+#import "Directory.h"
+#import "File.h"
+#import "NSError+FilesAdditions.h"
+#import "NSException+FilesAdditions.h"
+
+#define PathWatcherDefaultCoalescingInterval 0.05
+
+#if defined(__linux__)
+#define PathWatcherEventBufferSize (64 * 1024)
+#define PathWatcherInotifyMask (IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_EXCL_UNLINK)
+#elif defined(__APPLE__)
+#define PathWatcherEventBatchSize 64
+#define PathWatcherVnodeEvents (NOTE_WRITE | NOTE_EXTEND | NOTE_ATTRIB | NOTE_DELETE | NOTE_RENAME | NOTE_REVOKE)
+#endif
+
+#if defined(__linux__)
+static PathChangeKind PathWatcherKindsForMask(uint32_t mask);
+#endif
+
+#pragma mark - Changes
+
+@implementation PathChange
+
+- (id)initWithPath:(NSString *)path isDirectory:(BOOL)isDirectory kinds:(PathChangeKind)kinds
+{
+	self = [super init];
+	if (self)
+	{
+		_path = path;
+		_isDirectory = isDirectory;
+		_kinds = kinds;
+	}
+	return self;
+}
+
+- (Path *)item
+{
+	Class kind = (_isDirectory ? [Directory class] : [File class]);
+	return [[kind alloc] initWithPath:_path];
+}
+
+- (NSString *)description
+{
+	return [NSString stringWithFormat:@"<%@ %@ kinds: 0x%lx>", NSStringFromClass([self class]), _path, (unsigned long)_kinds];
+}
+
+@end
+
+#pragma mark - Watched Items (kqueue)
+
+#if defined(__APPLE__)
+// kqueue watches open descriptors and only says that a directory changed, not what changed in it:
+// each watched directory keeps the signature of its entries so that the changes can be worked out.
+@interface PathWatcherNode : NSObject
+{
+	@public
+	int _descriptor;
+	NSString *_path;
+	BOOL _isDirectory;
+	NSDictionary<NSString *, NSArray<NSNumber *> *> *_entries;
+}
+
+@end
+
+@implementation PathWatcherNode
+
+- (id)initWithDescriptor:(int)descriptor path:(NSString *)path isDirectory:(BOOL)isDirectory
+{
+	self = [super init];
+	if (self)
+	{
+		_descriptor = descriptor;
+		_path = path;
+		_isDirectory = isDirectory;
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	if (_descriptor >= 0) close(_descriptor);
+}
+
+@end
+#endif
+
+#pragma mark - Shared State
+
+// The watcher's thread retains this object rather than the watcher itself so that releasing the watcher stops it.
+@interface PathWatcherState : NSObject
+{
+	@public
+	NSString *_rootPath;
+	NSString *_fileName; // Set when watching a file, which is watched through its parent directory
+	BOOL _recursive;
+	NSTimeInterval _coalescingInterval;
+	NSOperationQueue *_queue;
+	void (^_handler)(NSArray<PathChange *> *changes);
+
+	int _descriptor;
+	int _wakePipe[2];
+	pthread_mutex_t _lock;
+	BOOL _stopped;
+
+	NSMutableArray<NSString *> *_changedPaths;
+	NSMutableDictionary<NSString *, NSNumber *> *_changedKinds;
+	NSMutableSet<NSString *> *_changedDirectories;
+	NSTimeInterval _deadline;
+
+#if defined(__linux__)
+	NSMutableDictionary<NSNumber *, NSString *> *_watchedPaths;
+#elif defined(__APPLE__)
+	NSMutableDictionary<NSString *, PathWatcherNode *> *_nodes;
+	NSMutableArray<PathWatcherNode *> *_retiredNodes;
+#endif
+}
+
+@end
+
+@implementation PathWatcherState
+
+#pragma mark Lifetime
+
+- (id)initWithPath:(NSString *)path isDirectory:(BOOL)isDirectory options:(PathWatcherOptions)options
+{
+	self = [super init];
+	if (self)
+	{
+		_rootPath = path;
+		_fileName = (isDirectory ? nil : [path lastPathComponent]);
+		_recursive = (isDirectory && (options & PathWatcherRecursive));
+		_descriptor = -1;
+		_wakePipe[0] = _wakePipe[1] = -1;
+		_changedPaths = [NSMutableArray array];
+		_changedKinds = [NSMutableDictionary dictionary];
+		_changedDirectories = [NSMutableSet set];
+		pthread_mutex_init(&_lock, NULL);
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	if (_descriptor >= 0) close(_descriptor);
+	if (_wakePipe[0] >= 0) close(_wakePipe[0]);
+	if (_wakePipe[1] >= 0) close(_wakePipe[1]);
+	pthread_mutex_destroy(&_lock);
+}
+
+- (BOOL)start
+{
+	if (pipe(_wakePipe) != 0) return NO;
+	fcntl(_wakePipe[0], F_SETFD, FD_CLOEXEC);
+	fcntl(_wakePipe[1], F_SETFD, FD_CLOEXEC);
+
+	if (![self openBackend]) return NO;
+
+	[NSThread detachNewThreadSelector:@selector(run) toTarget:self withObject:nil];
+	return YES;
+}
+
+- (void)stop
+{
+	pthread_mutex_lock(&_lock);
+	BOOL wasStopped = _stopped;
+	_stopped = YES;
+	pthread_mutex_unlock(&_lock);
+
+	if (!wasStopped) write(_wakePipe[1], "", 1);
+}
+
+- (BOOL)isStopped
+{
+	pthread_mutex_lock(&_lock);
+	BOOL stopped = _stopped;
+	pthread_mutex_unlock(&_lock);
+
+	return stopped;
+}
+
+#pragma mark Thread
+
+- (void)run
+{
+	while (![self isStopped])
+	{
+		@autoreleasepool
+		{
+			[self waitForEventsWithTimeout:[self timeout]];
+
+			if ([_changedPaths count] > 0 && [[NSProcessInfo processInfo] systemUptime] >= _deadline)
+				[self deliverChanges];
+		}
+	}
+}
+
+// In milliseconds: until the end of the coalescing window, or forever when there is nothing to deliver
+- (int)timeout
+{
+	if ([_changedPaths count] == 0) return -1;
+
+	NSTimeInterval remaining = _deadline - [[NSProcessInfo processInfo] systemUptime];
+	return (remaining > 0 ? (int)ceil(remaining * 1000) : 0);
+}
+
+#pragma mark Coalescing
+
+- (void)recordChangeAtPath:(NSString *)path isDirectory:(BOOL)isDirectory kinds:(PathChangeKind)kinds
+{
+	if (kinds == 0) return;
+
+	NSNumber *previousKinds = _changedKinds[path];
+
+	if (previousKinds == nil)
+	{
+		if ([_changedPaths count] == 0) _deadline = [[NSProcessInfo processInfo] systemUptime] + _coalescingInterval;
+		[_changedPaths addObject:path];
+	}
+
+	_changedKinds[path] = @([previousKinds unsignedIntegerValue] | kinds);
+	if (isDirectory) [_changedDirectories addObject:path];
+}
+
+// Changes inside a directory that couldn't be read completely may have been missed
+- (void)reportUnreadableDirectoryAtPath:(NSString *)path code:(int)code
+{
+	NSLog(@"%@", [NSError errorWithPOSIXCode:code description:@"Could not read contents of directory at path %@", path]);
+	[self recordChangeAtPath:_rootPath isDirectory:(_fileName == nil) kinds:PathChangeRescanRequired];
+}
+
+- (void)deliverChanges
+{
+	NSMutableArray<PathChange *> *changes = [NSMutableArray arrayWithCapacity:[_changedPaths count]];
+
+	for (NSString *path in _changedPaths)
+		[changes addObject:[[PathChange alloc] initWithPath:path isDirectory:[_changedDirectories containsObject:path] kinds:[_changedKinds[path] unsignedIntegerValue]]];
+
+	[_changedPaths removeAllObjects];
+	[_changedKinds removeAllObjects];
+	[_changedDirectories removeAllObjects];
+
+	void (^handler)(NSArray<PathChange *> *) = _handler;
+	void (^delivery)(void) = ^{ if (![self isStopped]) handler(changes); };
+
+	if (_queue)
+		[_queue addOperationWithBlock:delivery];
+	else
+		delivery();
+}
+
+#pragma mark Backend
+
+- (NSString *)watchedDirectoryPath
+{
+	return (_fileName ? [_rootPath stringByDeletingLastPathComponent] : _rootPath);
+}
+
+#if defined(__linux__)
+
+- (BOOL)openBackend
+{
+	_descriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (_descriptor < 0) return NO;
+
+	_watchedPaths = [NSMutableDictionary dictionary];
+	return [self watchTreeAtPath:[self watchedDirectoryPath] reportingContents:NO];
+}
+
+// Each directory is watched before being read, so a subdirectory created during the walk is either
+// found by the walk or reported by the new watch. Returns NO with errno set if a watch can't be added.
+- (BOOL)watchTreeAtPath:(NSString *)path reportingContents:(BOOL)reportContents
+{
+	NSMutableArray<NSString *> *pendingPaths = [NSMutableArray arrayWithObject:path];
+	BOOL isTop = YES;
+
+	while ([pendingPaths count] > 0)
+	{
+		NSString *directory = [pendingPaths lastObject];
+		[pendingPaths removeLastObject];
+
+		int watch = inotify_add_watch(_descriptor, [directory fileSystemRepresentation], PathWatcherInotifyMask);
+
+		if (watch < 0)
+		{
+			// Subdirectories removed since they were found are not an error
+			if (isTop || (errno != ENOENT && errno != ENOTDIR)) return NO;
+			continue;
+		}
+
+		isTop = NO;
+		_watchedPaths[@(watch)] = directory;
+		if (!_recursive) continue;
+
+		DIR *stream = opendir([directory fileSystemRepresentation]);
+		if (stream == NULL) continue;
+
+		struct dirent *entry;
+		while (YES)
+		{
+			errno = 0;
+			if ((entry = readdir(stream)) == NULL)
+			{
+				if (errno != 0) [self reportUnreadableDirectoryAtPath:directory code:errno];
+				break;
+			}
+
+			const char *name = entry->d_name;
+			if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+
+			struct stat info;
+			BOOL isDirectory = (entry->d_type == DT_DIR || (entry->d_type == DT_UNKNOWN && fstatat(dirfd(stream), name, &info, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(info.st_mode)));
+			NSString *itemPath = [directory stringByAppendingPathComponent:[[NSFileManager defaultManager] stringWithFileSystemRepresentation:name length:strlen(name)]];
+
+			if (reportContents) [self recordChangeAtPath:itemPath isDirectory:isDirectory kinds:PathChangeCreated];
+			if (isDirectory) [pendingPaths addObject:itemPath];
+		}
+
+		closedir(stream);
+	}
+
+	return YES;
+}
+
+- (void)unwatchTreeAtPath:(NSString *)path
+{
+	NSString *prefix = [path stringByAppendingString:@"/"];
+
+	for (NSNumber *watch in [_watchedPaths allKeys])
+	{
+		NSString *watchedPath = _watchedPaths[watch];
+		if (![watchedPath isEqualToString:path] && ![watchedPath hasPrefix:prefix]) continue;
+
+		inotify_rm_watch(_descriptor, [watch intValue]);
+		[_watchedPaths removeObjectForKey:watch];
+	}
+}
+
+- (void)waitForEventsWithTimeout:(int)timeout
+{
+	struct pollfd descriptors[2] = { { _descriptor, POLLIN, 0 }, { _wakePipe[0], POLLIN, 0 } };
+	if (poll(descriptors, 2, timeout) <= 0) return;
+
+	if (descriptors[0].revents & POLLIN) [self readEvents];
+}
+
+- (void)readEvents
+{
+	char buffer[PathWatcherEventBufferSize] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+	while (YES)
+	{
+		ssize_t length = read(_descriptor, buffer, sizeof(buffer));
+		if (length < 0 && errno == EINTR) continue;
+		if (length <= 0) return;
+
+		for (char *position = buffer; position < buffer + length; )
+		{
+			const struct inotify_event *event = (const struct inotify_event *)position;
+			[self handleEvent:event];
+			position += sizeof(struct inotify_event) + event->len;
+		}
+	}
+}
+
+- (void)handleEvent:(const struct inotify_event *)event
+{
+	uint32_t mask = event->mask;
+
+	if (mask & IN_Q_OVERFLOW)
+	{
+		[self recordChangeAtPath:_rootPath isDirectory:(_fileName == nil) kinds:PathChangeRescanRequired];
+
+		// Subdirectories created while events were being dropped have no watch yet
+		if (_recursive && ![self watchTreeAtPath:_rootPath reportingContents:NO])
+			NSLog(@"%@", [NSError errorWithPOSIXCode:errno description:@"Could not watch directory at path %@", _rootPath]);
+		return;
+	}
+
+	NSNumber *watch = @(event->wd);
+	NSString *directory = _watchedPaths[watch];
+	if (directory == nil) return;
+
+	if (mask & IN_IGNORED)
+	{
+		[_watchedPaths removeObjectForKey:watch];
+		return;
+	}
+
+	if (event->len == 0)
+	{
+		// Subdirectories are reported by their parent: only the top directory's own events matter
+		if (![directory isEqualToString:[self watchedDirectoryPath]]) return;
+
+		if (mask & (IN_DELETE_SELF | IN_MOVE_SELF))
+			[self recordChangeAtPath:_rootPath isDirectory:(_fileName == nil) kinds:PathChangeRemoved | ((mask & IN_MOVE_SELF) ? PathChangeRenamed : 0)];
+		else if ((mask & IN_ATTRIB) && _fileName == nil)
+			[self recordChangeAtPath:_rootPath isDirectory:YES kinds:PathChangeAttributesChanged];
+
+		return;
+	}
+
+	NSString *name = [[NSFileManager defaultManager] stringWithFileSystemRepresentation:event->name length:strlen(event->name)];
+	if (_fileName && ![name isEqualToString:_fileName]) return;
+
+	NSString *path = [directory stringByAppendingPathComponent:name];
+	BOOL isDirectory = ((mask & IN_ISDIR) != 0);
+
+	[self recordChangeAtPath:path isDirectory:isDirectory kinds:PathWatcherKindsForMask(mask)];
+
+	if (!isDirectory || !_recursive) return;
+
+	if (mask & (IN_CREATE | IN_MOVED_TO))
+	{
+		// Items created in the new directory before its watch was added would otherwise go unnoticed
+		if (![self watchTreeAtPath:path reportingContents:YES] && errno != ENOENT && errno != ENOTDIR)
+			NSLog(@"%@", [NSError errorWithPOSIXCode:errno description:@"Could not watch directory at path %@", path]);
+	}
+	else if (mask & IN_MOVED_FROM)
+	{
+		[self unwatchTreeAtPath:path];
+	}
+}
+
+#elif defined(__APPLE__)
+
+- (BOOL)openBackend
+{
+	_descriptor = kqueue();
+	if (_descriptor < 0) return NO;
+	fcntl(_descriptor, F_SETFD, FD_CLOEXEC);
+
+	_nodes = [NSMutableDictionary dictionary];
+	_retiredNodes = [NSMutableArray array];
+
+	struct kevent change;
+	EV_SET(&change, _wakePipe[0], EVFILT_READ, EV_ADD, 0, 0, NULL);
+	if (kevent(_descriptor, &change, 1, NULL, 0, NULL) != 0) return NO;
+
+	if (![self watchTreeAtPath:[self watchedDirectoryPath] reportingContents:NO]) return NO;
+
+	// Writes to a file don't change its directory: the file needs its own descriptor
+	return (_fileName == nil || [self addNodeForPath:_rootPath isDirectory:NO] != nil);
+}
+
+- (PathWatcherNode *)addNodeForPath:(NSString *)path isDirectory:(BOOL)isDirectory
+{
+	int descriptor = open([path fileSystemRepresentation], O_EVTONLY | O_CLOEXEC | (isDirectory ? O_DIRECTORY : 0));
+	if (descriptor < 0) return nil;
+
+	PathWatcherNode *node = [[PathWatcherNode alloc] initWithDescriptor:descriptor path:path isDirectory:isDirectory];
+
+	struct kevent change;
+	EV_SET(&change, descriptor, EVFILT_VNODE, EV_ADD | EV_CLEAR, PathWatcherVnodeEvents, 0, (__bridge void *)node);
+	if (kevent(_descriptor, &change, 1, NULL, 0, NULL) != 0) return nil;
+
+	[self retireNode:_nodes[path]];
+	_nodes[path] = node;
+
+	return node;
+}
+
+// Nodes are kept alive until the current batch of events is handled, since later events can still refer to them
+- (void)retireNode:(PathWatcherNode *)node
+{
+	if (node == nil || node->_descriptor < 0) return;
+
+	close(node->_descriptor);
+	node->_descriptor = -1;
+
+	if (_nodes[node->_path] == node) [_nodes removeObjectForKey:node->_path];
+	[_retiredNodes addObject:node];
+}
+
+- (void)retireTreeAtPath:(NSString *)path
+{
+	NSString *prefix = [path stringByAppendingString:@"/"];
+
+	for (PathWatcherNode *node in [_nodes allValues])
+		if ([node->_path isEqualToString:path] || [node->_path hasPrefix:prefix]) [self retireNode:node];
+}
+
+- (BOOL)watchTreeAtPath:(NSString *)path reportingContents:(BOOL)reportContents
+{
+	NSMutableArray<NSString *> *pendingPaths = [NSMutableArray arrayWithObject:path];
+	BOOL isTop = YES;
+
+	while ([pendingPaths count] > 0)
+	{
+		NSString *directory = [pendingPaths lastObject];
+		[pendingPaths removeLastObject];
+
+		PathWatcherNode *node = [self addNodeForPath:directory isDirectory:YES];
+
+		if (node == nil)
+		{
+			if (isTop || (errno != ENOENT && errno != ENOTDIR)) return NO;
+			continue;
+		}
+
+		isTop = NO;
+		node->_entries = [self entriesOfNode:node];
+
+		for (NSString *name in node->_entries)
+		{
+			NSString *itemPath = [directory stringByAppendingPathComponent:name];
+			BOOL isDirectory = [node->_entries[name][1] boolValue];
+
+			if (reportContents) [self recordChangeAtPath:itemPath isDirectory:isDirectory kinds:PathChangeCreated];
+			if (isDirectory && _recursive) [pendingPaths addObject:itemPath];
+		}
+	}
+
+	return YES;
+}
+
+// The signature of an entry is its inode, whether it is a directory, then its size and modification time
+// (left out for directories, which change whenever their contents do)
+- (NSDictionary<NSString *, NSArray<NSNumber *> *> *)entriesOfNode:(PathWatcherNode *)node
+{
+	NSMutableDictionary *entries = [NSMutableDictionary dictionary];
+	BOOL isFileParent = (_fileName != nil);
+
+	int descriptor = openat(node->_descriptor, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	DIR *stream = (descriptor >= 0 ? fdopendir(descriptor) : NULL);
+
+	if (stream == NULL)
+	{
+		if (descriptor >= 0) close(descriptor);
+		return entries;
+	}
+
+	NSFileManager *manager = [NSFileManager defaultManager];
+	struct dirent *entry;
+
+	while (YES)
+	{
+		errno = 0;
+		if ((entry = readdir(stream)) == NULL)
+		{
+			int code = errno;
+			if (code == 0) break;
+
+			closedir(stream);
+			[self reportUnreadableDirectoryAtPath:node->_path code:code];
+			return nil;
+		}
+
+		const char *name = entry->d_name;
+		if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+
+		NSString *itemName = [manager stringWithFileSystemRepresentation:name length:strlen(name)];
+		if (isFileParent && ![itemName isEqualToString:_fileName]) continue;
+
+		struct stat info;
+		if (fstatat(dirfd(stream), name, &info, AT_SYMLINK_NOFOLLOW) != 0) continue;
+
+		BOOL isDirectory = S_ISDIR(info.st_mode);
+		long long modificationTime = (isDirectory ? 0 : (long long)info.st_mtimespec.tv_sec * 1000000000LL + info.st_mtimespec.tv_nsec);
+
+		entries[itemName] = @[@((unsigned long long)info.st_ino), @(isDirectory), @(isDirectory ? 0 : (long long)info.st_size), @(modificationTime)];
+	}
+
+	closedir(stream);
+	return entries;
+}
+
+- (void)waitForEventsWithTimeout:(int)timeout
+{
+	struct kevent events[PathWatcherEventBatchSize];
+	struct timespec interval = { timeout / 1000, (timeout % 1000) * 1000000L };
+
+	int count = kevent(_descriptor, NULL, 0, events, PathWatcherEventBatchSize, (timeout >= 0 ? &interval : NULL));
+
+	for (int i = 0; i < count; i++)
+		if (events[i].filter == EVFILT_VNODE) [self handleEvent:&events[i]];
+
+	[_retiredNodes removeAllObjects];
+}
+
+- (void)handleEvent:(const struct kevent *)event
+{
+	PathWatcherNode *node = (__bridge PathWatcherNode *)event->udata;
+	if (node->_descriptor < 0) return;
+
+	u_int flags = event->fflags;
+	BOOL isTop = [node->_path isEqualToString:_rootPath] || [node->_path isEqualToString:[self watchedDirectoryPath]];
+	BOOL isFileParent = (_fileName != nil && node->_isDirectory);
+
+	if (flags & (NOTE_DELETE | NOTE_RENAME | NOTE_REVOKE))
+	{
+		// Other items are reported by their parent directory, which changes at the same time
+		if (isTop) [self recordChangeAtPath:_rootPath isDirectory:(_fileName == nil) kinds:PathChangeRemoved | ((flags & NOTE_RENAME) ? PathChangeRenamed : 0)];
+		[self retireNode:node];
+		return;
+	}
+
+	if ((flags & NOTE_ATTRIB) && !isFileParent)
+		[self recordChangeAtPath:node->_path isDirectory:node->_isDirectory kinds:PathChangeAttributesChanged];
+
+	if (flags & (NOTE_WRITE | NOTE_EXTEND))
+	{
+		if (node->_isDirectory)
+			[self updateEntriesOfNode:node];
+		else
+			[self recordChangeAtPath:node->_path isDirectory:NO kinds:PathChangeModified];
+	}
+}
+
+- (void)updateEntriesOfNode:(PathWatcherNode *)node
+{
+	NSDictionary<NSString *, NSArray<NSNumber *> *> *previousEntries = node->_entries;
+	NSDictionary<NSString *, NSArray<NSNumber *> *> *entries = [self entriesOfNode:node];
+	if (entries == nil) return;
+	node->_entries = entries;
+
+	for (NSString *name in entries)
+	{
+		NSArray<NSNumber *> *signature = entries[name];
+		NSArray<NSNumber *> *previousSignature = previousEntries[name];
+		if ([signature isEqualToArray:previousSignature]) continue;
+
+		NSString *path = [node->_path stringByAppendingPathComponent:name];
+		BOOL isDirectory = [signature[1] boolValue];
+		BOOL isNewItem = (previousSignature == nil || ![signature[0] isEqual:previousSignature[0]] || ![signature[1] isEqual:previousSignature[1]]);
+
+		[self recordChangeAtPath:path isDirectory:isDirectory kinds:(isNewItem ? PathChangeCreated : PathChangeModified)];
+		if (!isNewItem) continue;
+
+		if (isDirectory && _recursive)
+			[self watchTreeAtPath:path reportingContents:YES];
+		else if (_fileName != nil && !isDirectory)
+			[self addNodeForPath:path isDirectory:NO];
+	}
+
+	for (NSString *name in previousEntries)
+	{
+		if (entries[name] != nil) continue;
+
+		NSString *path = [node->_path stringByAppendingPathComponent:name];
+		BOOL isDirectory = [previousEntries[name][1] boolValue];
+
+		[self recordChangeAtPath:path isDirectory:isDirectory kinds:PathChangeRemoved];
+		[self retireTreeAtPath:path];
+	}
+}
+
+#endif
+
+@end
+
+#pragma mark - Path Watcher
+
+@implementation PathWatcher
+{
+	PathWatcherState *_state;
+}
+
+#pragma mark Lifetime
+
+- (id)initWithItem:(Path *)item options:(PathWatcherOptions)options
+{
+	if (item == nil) @throw [NSException exceptionWithReason:@"Item is nil"];
+
+	self = [super init];
+	if (self)
+	{
+		_item = item;
+		_options = options;
+		_coalescingInterval = PathWatcherDefaultCoalescingInterval;
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	[self stop];
+}
+
+#pragma mark Watching
+
+- (BOOL)startWithHandler:(void (^)(NSArray<PathChange *> *changes))handler error:(NSError **)error
+{
+	if (handler == nil) @throw [NSException exceptionWithReason:@"Handler is nil"];
+	if (_state != nil) @throw [NSException exceptionWithReason:@"Already watching item at path %@", [_item absolutePath]];
+
+	NSString *path = [_item absolutePath];
+
+	struct stat info;
+	PathWatcherState *state = nil;
+
+	if (stat([path fileSystemRepresentation], &info) == 0)
+	{
+		state = [[PathWatcherState alloc] initWithPath:path isDirectory:S_ISDIR(info.st_mode) options:_options];
+		state->_coalescingInterval = _coalescingInterval;
+		state->_queue = _queue;
+		state->_handler = [handler copy];
+	}
+
+	if (state == nil || ![state start])
+	{
+		int code = errno;
+		if (error) *error = [NSError errorWithPOSIXCode:code description:@"Could not watch item at path %@", path];
+		return NO;
+	}
+
+	_state = state;
+	return YES;
+}
+
+- (void)stop
+{
+	[_state stop];
+	_state = nil;
+}
+
+@end
+
+#pragma mark - Event Primitives
+
+#if defined(__linux__)
+static PathChangeKind PathWatcherKindsForMask(uint32_t mask)
+{
+	PathChangeKind kinds = 0;
+
+	if (mask & IN_CREATE) kinds |= PathChangeCreated;
+	if (mask & IN_MOVED_TO) kinds |= PathChangeCreated | PathChangeRenamed;
+	if (mask & IN_DELETE) kinds |= PathChangeRemoved;
+	if (mask & IN_MOVED_FROM) kinds |= PathChangeRemoved | PathChangeRenamed;
+	if (mask & IN_MODIFY) kinds |= PathChangeModified;
+	if (mask & IN_ATTRIB) kinds |= PathChangeAttributesChanged;
+
+	return kinds;
+}
+#endif
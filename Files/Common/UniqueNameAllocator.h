@@ -0,0 +1,38 @@
+//
+//  UniqueNameAllocator.h
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+//  Description: Finds names with a numeric suffix ("Report.pdf", "Report1.pdf", "Report2.pdf"...) that are
+//               free in a directory. The directory is scanned for the highest suffix in use, which is then
+//               cached so that each new name costs a single probe. The directory is scanned again when its
+//               device, inode or modification time changes. Not part of the public interface.
+//
+
+#import <Foundation/Foundation.h>
+
+@interface UniqueNameAllocator : NSObject
+
+/**
+ An allocator shared by the whole process, so that its threads never race for the same suffix.
+ */
++ (UniqueNameAllocator *)sharedAllocator;
+
+/**
+ Returns the name if nothing exists with that name in the directory, or else the name with a suffix above
+ the highest one in use. Changes made within the file system's timestamp granularity of the last scan can go
+ unnoticed, in which case the suffix is above the highest one seen by this process instead. The name is not
+ reserved: another thread or process can create it first.
+ */
+- (NSString *)availableName:(NSString *)name inDirectoryAtPath:(NSString *)directoryPath;
+
+/**
+ Creates an empty file (or a directory) named like -availableName:inDirectoryAtPath: would, atomically with
+ O_CREAT | O_EXCL (or mkdir) so that it is never shared with another thread or process. Collisions with items
+ created concurrently are retried with the next suffix. Returns the name of the created item.
+ */
+- (NSString *)claimName:(NSString *)name inDirectoryAtPath:(NSString *)directoryPath directory:(BOOL)directory error:(NSError **)error;
+
+@end
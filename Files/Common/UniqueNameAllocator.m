@@ -0,0 +1,326 @@
+//
+//  UniqueNameAllocator.m
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+
+#import <dirent.h>
+#import <errno.h>
+#import <fcntl.h>
+#import <pthread.h>
+#import <string.h>
+#import <sys/stat.h>
+#import <unistd.h>
+#import "UniqueNameAllocator.h"
+#import "NSError+FilesAdditions.h"
+#import "NSException+FilesAdditions.h"
+
+#if defined(__APPLE__)
+#define UniqueNameAllocatorModificationTime(info) ((info).st_mtimespec)
+#else
+#define UniqueNameAllocatorModificationTime(info) ((info).st_mtim)
+#endif
+
+// Suffixes are cached for this many names (directory, base name and extension) before the cache starts over
+#define UniqueNameAllocatorMaximumCacheCount 1024
+
+// Longer digit sequences could overflow and are not considered suffixes
+#define UniqueNameAllocatorMaximumSuffixDigits 18
+
+static UniqueNameAllocator *UniqueNameAllocatorShared;
+static pthread_once_t UniqueNameAllocatorSharedOnce = PTHREAD_ONCE_INIT;
+
+static void UniqueNameAllocatorCreateShared(void)
+{
+	UniqueNameAllocatorShared = [[UniqueNameAllocator alloc] init];
+}
+
+static BOOL UniqueNameAllocatorItemExists(NSString *path)
+{
+	struct stat info;
+	return (lstat([path fileSystemRepresentation], &info) == 0);
+}
+
+/**
+ Creates the item at the path exclusively. Returns NO with errno set, EEXIST if something is already there.
+ */
+static BOOL UniqueNameAllocatorCreateItem(NSString *path, BOOL directory)
+{
+	if (directory) return (mkdir([path fileSystemRepresentation], 0777) == 0);
+
+	int descriptor = open([path fileSystemRepresentation], O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+	if (descriptor < 0) return NO;
+
+	close(descriptor);
+	return YES;
+}
+
+#pragma mark - Entries
+
+// A cached suffix is only trusted while the directory it was scanned from is unchanged. Items are never
+// found at inode 0, so an entry whose directory couldn't be identified never matches and is scanned again.
+@interface UniqueNameAllocatorEntry : NSObject
+{
+@public
+	unsigned long long _suffix;
+	dev_t _device;
+	ino_t _inode;
+	int64_t _modificationTime;
+}
+@end
+
+@implementation UniqueNameAllocatorEntry
+
+- (void)setDirectoryInfo:(const struct stat *)info
+{
+	_device = info->st_dev;
+	_inode = info->st_ino;
+	_modificationTime = (int64_t)UniqueNameAllocatorModificationTime(*info).tv_sec * 1000000000 + UniqueNameAllocatorModificationTime(*info).tv_nsec;
+}
+
+- (BOOL)matchesDirectoryInfo:(const struct stat *)info
+{
+	int64_t modificationTime = (int64_t)UniqueNameAllocatorModificationTime(*info).tv_sec * 1000000000 + UniqueNameAllocatorModificationTime(*info).tv_nsec;
+	return (_inode != 0 && _device == info->st_dev && _inode == info->st_ino && _modificationTime == modificationTime);
+}
+
+@end
+
+static void UniqueNameAllocatorStatDirectory(NSString *directoryPath, struct stat *info)
+{
+	if (stat([directoryPath fileSystemRepresentation], info) != 0) memset(info, 0, sizeof(*info));
+}
+
+#pragma mark - Allocator
+
+@implementation UniqueNameAllocator
+{
+	pthread_mutex_t _lock;
+	NSMutableDictionary<NSString *, UniqueNameAllocatorEntry *> *_entries;
+}
+
+#pragma mark Lifetime
+
++ (UniqueNameAllocator *)sharedAllocator
+{
+	pthread_once(&UniqueNameAllocatorSharedOnce, UniqueNameAllocatorCreateShared);
+	return UniqueNameAllocatorShared;
+}
+
+- (id)init
+{
+	self = [super init];
+	if (self)
+	{
+		pthread_mutex_init(&_lock, NULL);
+		_entries = [NSMutableDictionary dictionary];
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	pthread_mutex_destroy(&_lock);
+}
+
+#pragma mark Allocating Names
+
+- (NSString *)availableName:(NSString *)name inDirectoryAtPath:(NSString *)directoryPath
+{
+	if (!UniqueNameAllocatorItemExists([directoryPath stringByAppendingPathComponent:name]))
+		return name;
+
+	NSString *basename = [name stringByDeletingPathExtension];
+	NSString *extension = [name pathExtension];
+	NSString *key = [self keyForDirectoryAtPath:directoryPath basename:basename extension:extension];
+
+	unsigned long long suffix = [self highestSuffixForKey:key directoryPath:directoryPath basename:basename extension:extension];
+
+	// The directory is rescanned when it changes, so the cached suffix only misses items created while
+	// probing, each costing one more probe
+	while (YES)
+	{
+		NSString *candidate = [self nameWithBasename:basename suffix:++suffix extension:extension];
+		if (!UniqueNameAllocatorItemExists([directoryPath stringByAppendingPathComponent:candidate])) return candidate;
+
+		[self recordSuffix:suffix forKey:key];
+	}
+}
+
+- (NSString *)claimName:(NSString *)name inDirectoryAtPath:(NSString *)directoryPath directory:(BOOL)directory error:(NSError **)error
+{
+	if ([name length] == 0 || [name rangeOfString:@"/"].location != NSNotFound || [name isEqualToString:@"."] || [name isEqualToString:@".."])
+		@throw [NSException exceptionWithReason:@"Invalid name for a new item: %@", name];
+
+	if (UniqueNameAllocatorCreateItem([directoryPath stringByAppendingPathComponent:name], directory))
+		return name;
+
+	int code = errno;
+	if (code != EEXIST)
+	{
+		if (error) *error = [NSError errorWithPOSIXCode:code description:@"Could not create %@ in %@", name, directoryPath];
+		return nil;
+	}
+
+	NSString *basename = [name stringByDeletingPathExtension];
+	NSString *extension = [name pathExtension];
+	NSString *key = [self keyForDirectoryAtPath:directoryPath basename:basename extension:extension];
+
+	[self highestSuffixForKey:key directoryPath:directoryPath basename:basename extension:extension];
+
+	// Threads of this process each reserve a distinct suffix; collisions only happen with other processes
+	while (YES)
+	{
+		NSString *candidate = [self nameWithBasename:basename suffix:[self reserveSuffixForKey:key] extension:extension];
+
+		if (UniqueNameAllocatorCreateItem([directoryPath stringByAppendingPathComponent:candidate], directory))
+		{
+			[self updateDirectoryInfoForKey:key directoryPath:directoryPath];
+			return candidate;
+		}
+
+		code = errno;
+		if (code != EEXIST)
+		{
+			if (error) *error = [NSError errorWithPOSIXCode:code description:@"Could not create %@ in %@", candidate, directoryPath];
+			return nil;
+		}
+	}
+}
+
+#pragma mark Suffixes
+
+- (NSString *)keyForDirectoryAtPath:(NSString *)directoryPath basename:(NSString *)basename extension:(NSString *)extension
+{
+	// Neither the base name nor the extension contain "/", so keys can't be ambiguous
+	return [NSString stringWithFormat:@"%@/%@/%@", directoryPath, basename, extension];
+}
+
+- (NSString *)nameWithBasename:(NSString *)basename suffix:(unsigned long long)suffix extension:(NSString *)extension
+{
+	if ([extension length] == 0) return [NSString stringWithFormat:@"%@%llu", basename, suffix];
+	return [NSString stringWithFormat:@"%@%llu.%@", basename, suffix, extension];
+}
+
+- (unsigned long long)highestSuffixForKey:(NSString *)key directoryPath:(NSString *)directoryPath basename:(NSString *)basename extension:(NSString *)extension
+{
+	struct stat info;
+	UniqueNameAllocatorStatDirectory(directoryPath, &info);
+
+	pthread_mutex_lock(&_lock);
+	UniqueNameAllocatorEntry *entry = _entries[key];
+	BOOL isValid = [entry matchesDirectoryInfo:&info];
+	unsigned long long cached = (entry ? entry->_suffix : 0);
+	pthread_mutex_unlock(&_lock);
+
+	if (isValid) return cached;
+
+	// Scanned without holding the lock; concurrent scans of the same directory keep the highest result
+	unsigned long long scanned = [self scanHighestSuffixInDirectoryAtPath:directoryPath basename:basename extension:extension];
+
+	pthread_mutex_lock(&_lock);
+
+	entry = _entries[key];
+	if (entry == nil || ![entry matchesDirectoryInfo:&info])
+	{
+		// Items may have been removed since the previous scan, so its suffix is not kept
+		if (entry == nil && [_entries count] >= UniqueNameAllocatorMaximumCacheCount) [_entries removeAllObjects];
+		entry = [[UniqueNameAllocatorEntry alloc] init];
+		[entry setDirectoryInfo:&info];
+		_entries[key] = entry;
+	}
+
+	entry->_suffix = MAX(entry->_suffix, scanned);
+	unsigned long long highest = entry->_suffix;
+
+	pthread_mutex_unlock(&_lock);
+	return highest;
+}
+
+/**
+ Raises the cached suffix to at least the specified one.
+ */
+- (void)recordSuffix:(unsigned long long)suffix forKey:(NSString *)key
+{
+	pthread_mutex_lock(&_lock);
+
+	UniqueNameAllocatorEntry *entry = _entries[key];
+	if (entry) entry->_suffix = MAX(entry->_suffix, suffix);
+
+	pthread_mutex_unlock(&_lock);
+}
+
+- (unsigned long long)reserveSuffixForKey:(NSString *)key
+{
+	pthread_mutex_lock(&_lock);
+
+	UniqueNameAllocatorEntry *entry = _entries[key];
+
+	if (entry == nil)
+	{
+		// Only when the cache started over since the directory was scanned; the entry is scanned again next time
+		entry = [[UniqueNameAllocatorEntry alloc] init];
+		_entries[key] = entry;
+	}
+
+	unsigned long long suffix = ++entry->_suffix;
+
+	pthread_mutex_unlock(&_lock);
+	return suffix;
+}
+
+/**
+ Creating an item changes the directory's modification time. The entry follows it so that items created by this
+ allocator don't cause a rescan; changes made by others at the same time are missed, at the cost of extra probes.
+ */
+- (void)updateDirectoryInfoForKey:(NSString *)key directoryPath:(NSString *)directoryPath
+{
+	struct stat info;
+	UniqueNameAllocatorStatDirectory(directoryPath, &info);
+
+	pthread_mutex_lock(&_lock);
+
+	UniqueNameAllocatorEntry *entry = _entries[key];
+	if (entry && entry->_inode == info.st_ino && entry->_device == info.st_dev) [entry setDirectoryInfo:&info];
+
+	pthread_mutex_unlock(&_lock);
+}
+
+- (unsigned long long)scanHighestSuffixInDirectoryAtPath:(NSString *)directoryPath basename:(NSString *)basename extension:(NSString *)extension
+{
+	DIR *stream = opendir([directoryPath fileSystemRepresentation]);
+	if (stream == NULL) return 0;
+
+	// Names are compared on their raw file system representation, without creating a string per entry
+	NSString *extensionWithDot = ([extension length] > 0 ? [@"." stringByAppendingString:extension] : @"");
+	const char *prefix = ([basename length] > 0 ? [basename fileSystemRepresentation] : "");
+	const char *suffix = ([extensionWithDot length] > 0 ? [extensionWithDot fileSystemRepresentation] : "");
+	size_t prefixLength = strlen(prefix);
+	size_t suffixLength = strlen(suffix);
+
+	unsigned long long highest = 0;
+	struct dirent *entry;
+
+	while ((entry = readdir(stream)) != NULL)
+	{
+		size_t length = strlen(entry->d_name);
+		if (length <= prefixLength + suffixLength || length - prefixLength - suffixLength > UniqueNameAllocatorMaximumSuffixDigits) continue;
+		if (memcmp(entry->d_name, prefix, prefixLength) != 0 || memcmp(entry->d_name + length - suffixLength, suffix, suffixLength) != 0) continue;
+
+		unsigned long long value = 0;
+		const char *digit = entry->d_name + prefixLength;
+		const char *end = entry->d_name + length - suffixLength;
+
+		for (; digit < end && *digit >= '0' && *digit <= '9'; digit++)
+			value = value * 10 + (unsigned long long)(*digit - '0');
+
+		if (digit == end) highest = MAX(highest, value);
+	}
+
+	closedir(stream);
+	return highest;
+}
+
+@end
@@ -0,0 +1,48 @@
+//
+//  WorkerPool.h
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+//  Description: A fixed set of worker threads that each own a queue of tasks and steal
+//               from each other when they run out. Tasks added from within a running task
+//               go to the current worker's own queue, which keeps tree walks depth-first
+//               and cache-friendly while idle workers pick up the remaining branches.
+//
+
+#import <Foundation/Foundation.h>
+
+@interface WorkerPool : NSObject
+
+#pragma mark Lifetime
+
+/**
+ The number of workers used when none is specified (one per active processor).
+ */
++ (NSUInteger)defaultWorkerCount;
+
+/**
+ Creates a pool with the specified number of worker threads. Passing 0 uses +defaultWorkerCount.
+ */
+- (id)initWithWorkerCount:(NSUInteger)workerCount;
+
+#pragma mark Tasks
+
+/**
+ The number of worker threads in the pool.
+ */
+@property (readonly) NSUInteger workerCount;
+
+/**
+ Schedules a task. Can be called from any thread, including from within a task.
+ */
+- (void)addTask:(void (^)(void))task;
+
+/**
+ Blocks until every task (including tasks added by other tasks) has finished running.
+ Must not be called from within a task.
+ */
+- (void)waitUntilAllTasksAreFinished;
+
+@end
@@ -0,0 +1,271 @@
+//
+//  WorkerPool.m
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+
+#import <pthread.h>
+#import "WorkerPool.h"
+
+static pthread_key_t WorkerPoolCurrentQueueKey;
+
+#pragma mark - Worker Queue
+
+@class WorkerPoolState;
+
+@interface WorkerPoolQueue : NSObject
+{
+	@public
+	__unsafe_unretained WorkerPoolState *_state;
+	pthread_mutex_t _lock;
+	NSMutableArray *_tasks;
+}
+
+@end
+
+@implementation WorkerPoolQueue
+
+- (id)initWithState:(WorkerPoolState *)state
+{
+	self = [super init];
+	if (self)
+	{
+		_state = state;
+		_tasks = [NSMutableArray array];
+		pthread_mutex_init(&_lock, NULL);
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	pthread_mutex_destroy(&_lock);
+}
+
+- (void)pushTask:(void (^)(void))task
+{
+	pthread_mutex_lock(&_lock);
+	[_tasks addObject:task];
+	pthread_mutex_unlock(&_lock);
+}
+
+// The owning worker takes its most recent task (depth-first), thieves take the oldest one (breadth-first)
+- (void (^)(void))takeTaskFromBack:(BOOL)fromBack
+{
+	void (^task)(void) = nil;
+
+	pthread_mutex_lock(&_lock);
+	if ([_tasks count] > 0)
+	{
+		NSUInteger index = (fromBack ? [_tasks count] - 1 : 0);
+		task = _tasks[index];
+		[_tasks removeObjectAtIndex:index];
+	}
+	pthread_mutex_unlock(&_lock);
+
+	return task;
+}
+
+@end
+
+#pragma mark - Shared State
+
+// Worker threads retain this object rather than the pool itself so that releasing the pool stops them.
+@interface WorkerPoolState : NSObject
+{
+	@public
+	NSArray<WorkerPoolQueue *> *_queues;
+	pthread_mutex_t _lock;
+	pthread_cond_t _workAvailable;
+	pthread_cond_t _allTasksFinished;
+	NSInteger _queuedTaskCount;
+	NSUInteger _unfinishedTaskCount;
+	NSUInteger _nextQueueIndex;
+	BOOL _stopped;
+}
+
+@end
+
+@implementation WorkerPoolState
+
+- (id)initWithWorkerCount:(NSUInteger)workerCount
+{
+	self = [super init];
+	if (self)
+	{
+		NSMutableArray *queues = [NSMutableArray arrayWithCapacity:workerCount];
+		for (NSUInteger i = 0; i < workerCount; i++)
+			[queues addObject:[[WorkerPoolQueue alloc] initWithState:self]];
+		_queues = queues;
+
+		pthread_mutex_init(&_lock, NULL);
+		pthread_cond_init(&_workAvailable, NULL);
+		pthread_cond_init(&_allTasksFinished, NULL);
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	pthread_cond_destroy(&_allTasksFinished);
+	pthread_cond_destroy(&_workAvailable);
+	pthread_mutex_destroy(&_lock);
+}
+
+- (void)addTask:(void (^)(void))task
+{
+	WorkerPoolQueue *queue = (__bridge WorkerPoolQueue *)pthread_getspecific(WorkerPoolCurrentQueueKey);
+
+	pthread_mutex_lock(&_lock);
+	_unfinishedTaskCount++;
+	if (queue == nil || queue->_state != self) queue = _queues[_nextQueueIndex++ % [_queues count]];
+	pthread_mutex_unlock(&_lock);
+
+	[queue pushTask:task];
+
+	pthread_mutex_lock(&_lock);
+	_queuedTaskCount++;
+	pthread_cond_signal(&_workAvailable);
+	pthread_mutex_unlock(&_lock);
+}
+
+- (void)waitUntilAllTasksAreFinished
+{
+	pthread_mutex_lock(&_lock);
+	while (_unfinishedTaskCount > 0) pthread_cond_wait(&_allTasksFinished, &_lock);
+	pthread_mutex_unlock(&_lock);
+}
+
+- (void)stop
+{
+	pthread_mutex_lock(&_lock);
+	_stopped = YES;
+	pthread_cond_broadcast(&_workAvailable);
+	pthread_mutex_unlock(&_lock);
+}
+
+#pragma mark Workers
+
+- (void)runWorkerWithQueue:(WorkerPoolQueue *)queue
+{
+	pthread_setspecific(WorkerPoolCurrentQueueKey, (__bridge void *)queue);
+
+	NSUInteger index = [_queues indexOfObjectIdenticalTo:queue];
+	BOOL running = YES;
+
+	while (running)
+	{
+		@autoreleasepool
+		{
+			void (^task)(void) = [self takeTaskForWorkerAtIndex:index];
+
+			if (task)
+			{
+				task();
+				[self finishTask];
+			}
+			else
+			{
+				running = [self waitForWork];
+			}
+		}
+	}
+
+	pthread_setspecific(WorkerPoolCurrentQueueKey, NULL);
+}
+
+- (void (^)(void))takeTaskForWorkerAtIndex:(NSUInteger)index
+{
+	NSUInteger count = [_queues count];
+	void (^task)(void) = [_queues[index] takeTaskFromBack:YES];
+
+	for (NSUInteger offset = 1; task == nil && offset < count; offset++)
+		task = [_queues[(index + offset) % count] takeTaskFromBack:NO];
+
+	if (task)
+	{
+		pthread_mutex_lock(&_lock);
+		_queuedTaskCount--;
+		pthread_mutex_unlock(&_lock);
+	}
+
+	return task;
+}
+
+- (BOOL)waitForWork
+{
+	pthread_mutex_lock(&_lock);
+	while (_queuedTaskCount <= 0 && !_stopped) pthread_cond_wait(&_workAvailable, &_lock);
+	BOOL running = !_stopped;
+	pthread_mutex_unlock(&_lock);
+
+	return running;
+}
+
+- (void)finishTask
+{
+	pthread_mutex_lock(&_lock);
+	if (--_unfinishedTaskCount == 0) pthread_cond_broadcast(&_allTasksFinished);
+	pthread_mutex_unlock(&_lock);
+}
+
+@end
+
+#pragma mark - Worker Pool
+
+@implementation WorkerPool
+{
+	WorkerPoolState *_state;
+}
+
+#pragma mark Lifetime
+
++ (void)initialize
+{
+	if (self == [WorkerPool class]) pthread_key_create(&WorkerPoolCurrentQueueKey, NULL);
+}
+
++ (NSUInteger)defaultWorkerCount
+{
+	return MAX([[NSProcessInfo processInfo] activeProcessorCount], (NSUInteger)1);
+}
+
+- (id)init
+{
+	return [self initWithWorkerCount:0];
+}
+
+- (id)initWithWorkerCount:(NSUInteger)workerCount
+{
+	self = [super init];
+	if (self)
+	{
+		_workerCount = (workerCount > 0 ? workerCount : [WorkerPool defaultWorkerCount]);
+		_state = [[WorkerPoolState alloc] initWithWorkerCount:_workerCount];
+
+		for (WorkerPoolQueue *queue in _state->_queues)
+			[NSThread detachNewThreadSelector:@selector(runWorkerWithQueue:) toTarget:_state withObject:queue];
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	[_state stop];
+}
+
+#pragma mark Tasks
+
+- (void)addTask:(void (^)(void))task
+{
+	[_state addTask:[task copy]];
+}
+
+- (void)waitUntilAllTasksAreFinished
+{
+	[_state waitUntilAllTasksAreFinished];
+}
+
+@end
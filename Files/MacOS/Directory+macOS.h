@@ -112,7 +112,7 @@
 - (BOOL)isApplicationBundle;
 
 /**
- Returns all files that conform to the specified UTI.
+ Returns all files that conform to the specified UTI, as determined by their extension.
  */
 - (NSArray<File *> *)filesConformingToType:(CFStringRef)type;
 
@@ -7,7 +7,6 @@
 //
 
 #import "Directory+macOS.h"
-#import "NSArray+FilesAdditions.h"
 
 @implementation Directory (OSX)
 
@@ -122,7 +121,35 @@
 
 - (NSArray<File *> *)filesConformingToType:(CFStringRef)type
 {
-	return [[self files] files_where:^BOOL(File *file) { return [file conformsToType:type]; }];
+	// The type of a file comes from its extension, so each extension is resolved once and names are tested as they are read
+	NSMutableDictionary<NSString *, NSNumber *> *conformingExtensions = [NSMutableDictionary dictionary];
+	PathMatcher *matcher = [[PathMatcher alloc] initWithPattern:nil options:PathMatcherOptionsNone];
+	
+	[matcher setNameTest:^BOOL(const char *name, size_t length)
+	{
+		size_t dot = length;
+		while (dot > 1 && name[dot - 1] != '.') dot--;
+		
+		NSString *extension = (dot > 1 ? [[NSString alloc] initWithBytes:name + dot length:length - dot encoding:NSUTF8StringEncoding] : nil);
+		if (extension == nil) extension = @"";
+		
+		NSNumber *conforms = conformingExtensions[extension];
+		
+		if (conforms == nil)
+		{
+			CFStringRef extensionType = UTTypeCreatePreferredIdentifierForTag(kUTTagClassFilenameExtension, (__bridge CFStringRef)extension, NULL);
+			conforms = @(extensionType != NULL && UTTypeConformsTo(extensionType, type));
+			if (extensionType) CFRelease(extensionType);
+			conformingExtensions[extension] = conforms;
+		}
+		
+		return [conforms boolValue];
+	}];
+	
+	DirectoryEnumerator *enumerator = [self enumeratorForItemsMatching:matcher kind:[File class] options:DirectoryEnumerationOptionsNone];
+	NSArray<File *> *files = [enumerator allObjects];
+	
+	return ([enumerator error] ? nil : files);
 }
 
 @end
@@ -0,0 +1,160 @@
+//
+//  DirectoryPerformanceTests.m
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+
+#import "DirectoryPerformanceTests.h"
+#import "Directory.h"
+#import "File.h"
+#import "TestEnvironmentHelpers.h"
+
+#define DirectoryPerformanceTestsFolderCount 200
+#define DirectoryPerformanceTestsFilesPerFolder 100
+
+@implementation DirectoryPerformanceTests
+{
+	Directory *_tree;
+}
+
+#pragma mark SetUp and TearDown
+
+- (void)setUp
+{
+	_tree = [[TestEnvironmentHelpers testDirectory] subdirectory:@"Performance Tree"];
+	[_tree delete];
+	
+	NSData *contents = [NSData dataWithBytes:"0123456789abcdef" length:16];
+	
+	for (NSUInteger i = 0; i < DirectoryPerformanceTestsFolderCount; i++)
+	{
+		@autoreleasepool
+		{
+			Directory *folder = [_tree subdirectory:[NSString stringWithFormat:@"Folder %lu/Nested", (unsigned long)i]];
+			[folder create];
+			
+			for (NSUInteger j = 0; j < DirectoryPerformanceTestsFilesPerFolder; j++)
+				[contents writeToFile:[[folder file:[NSString stringWithFormat:@"File %lu", (unsigned long)j]] absolutePath] atomically:NO];
+		}
+	}
+}
+
+- (void)tearDown
+{
+	[_tree delete];
+}
+
+#pragma mark Disk Usage
+
+- (void)testPerformanceOfSerialDiskUsage
+{
+	[self measureBlock:^
+	{
+		XCTAssertEqual([[_tree diskUsageWithOptions:DiskUsageOptionsNone workerCount:1] fileCount], (unsigned long long)(DirectoryPerformanceTestsFolderCount * DirectoryPerformanceTestsFilesPerFolder));
+	}];
+}
+
+- (void)testPerformanceOfParallelDiskUsage
+{
+	[self measureBlock:^
+	{
+		XCTAssertEqual([[_tree diskUsage] fileCount], (unsigned long long)(DirectoryPerformanceTestsFolderCount * DirectoryPerformanceTestsFilesPerFolder));
+	}];
+}
+
+#pragma mark Small File Reads
+
+- (void)testPerformanceOfSynchronousSmallFileReads
+{
+	NSArray<File *> *files = [self treeFiles];
+	
+	[self measureBlock:^
+	{
+		for (File *file in files) XCTAssertNotNil([file readData]);
+	}];
+}
+
+- (void)testPerformanceOfQueuedSmallFileReads
+{
+	NSArray<File *> *files = [self treeFiles];
+	FileIOQueue *queue = [[FileIOQueue alloc] initWithWorkerCount:0];
+	
+	[self measureBlock:^
+	{
+		__block int32_t readCount = 0;
+		for (File *file in files) [queue readDataOfFile:file completion:^(NSData *data, NSError *error) { if (data) __sync_fetch_and_add(&readCount, 1); }];
+		[queue waitUntilAllOperationsAreFinished];
+		XCTAssertEqual(readCount, (int32_t)[files count]);
+	}];
+}
+
+- (NSArray<File *> *)treeFiles
+{
+	NSMutableArray<File *> *files = [NSMutableArray array];
+	
+	for (NSUInteger i = 0; i < DirectoryPerformanceTestsFolderCount; i++)
+	{
+		Directory *folder = [_tree subdirectory:[NSString stringWithFormat:@"Folder %lu/Nested", (unsigned long)i]];
+		for (NSUInteger j = 0; j < DirectoryPerformanceTestsFilesPerFolder; j++)
+			[files addObject:[folder file:[NSString stringWithFormat:@"File %lu", (unsigned long)j]]];
+	}
+	
+	return files;
+}
+
+#pragma mark Copy
+
+- (void)testPerformanceOfSerialCopy
+{
+	[self measureCopyWithWorkerCount:1];
+}
+
+- (void)testPerformanceOfParallelCopy
+{
+	[self measureCopyWithWorkerCount:0];
+}
+
+- (void)measureCopyWithWorkerCount:(NSUInteger)workerCount
+{
+	Directory *destination = [[TestEnvironmentHelpers testDirectory] subdirectory:@"Performance Tree (Copy)"];
+	CopyEngine *engine = [[CopyEngine alloc] initWithWorkerCount:workerCount];
+	[engine setOverwrite:YES];
+	
+	[self measureBlock:^
+	{
+		XCTAssertTrue([engine copyContentsOfDirectory:_tree toDirectory:destination error:nil]);
+	}];
+	
+	[destination delete];
+}
+
+#pragma mark Delete
+
+- (void)testPerformanceOfSerialDelete
+{
+	[self measureDeleteWithWorkerCount:1];
+}
+
+- (void)testPerformanceOfParallelDelete
+{
+	[self measureDeleteWithWorkerCount:0];
+}
+
+- (void)measureDeleteWithWorkerCount:(NSUInteger)workerCount
+{
+	Directory *copy = [[TestEnvironmentHelpers testDirectory] subdirectory:@"Performance Tree (Delete)"];
+	DeleteEngine *engine = [[DeleteEngine alloc] initWithWorkerCount:workerCount];
+	
+	[self measureMetrics:[[self class] defaultPerformanceMetrics] automaticallyStartMeasuring:NO forBlock:^
+	{
+		XCTAssertNotNil([_tree copyContentsTo:copy overwrite:YES]);
+		
+		[self startMeasuring];
+		XCTAssertTrue([engine deleteItem:copy error:nil]);
+		[self stopMeasuring];
+	}];
+}
+
+@end
@@ -6,9 +6,14 @@
 //  Copyright (c) 2013 irradiated.net. All rights reserved.
 //
 
+#import <errno.h>
+#import <unistd.h>
+#import <sys/stat.h>
 #import "Directory.h"
 #import "DirectoryTests.h"
 #import "File.h"
+#import "FileInfo.h"
+#import "NSError+FilesAdditions.h"
 #import "NSException+FilesAdditions.h"
 #import "TestEnvironmentHelpers.h"
 
@@ -505,6 +510,52 @@
 	XCTAssertFalse([dir deleteContents]);
 }
 
+- (void)testDeleteContentsReportsEveryItemThatCouldNotBeDeleted
+{
+	// Permissions don't stop root from deleting anything
+	if (geteuid() == 0) return;
+	
+	Directory *locked = [_testDirectory subdirectory:@"Folder B/Subfolder 1"];
+	chmod([[locked absolutePath] fileSystemRepresentation], S_IRUSR | S_IXUSR);
+	
+	NSError *error = nil;
+	BOOL deleted = [[_testDirectory subdirectory:@"Folder B"] deleteContents:&error];
+	chmod([[locked absolutePath] fileSystemRepresentation], S_IRWXU);
+	
+	XCTAssertFalse(deleted);
+	XCTAssertEqual([[error userInfo][FilesUnderlyingErrorsKey] count], (NSUInteger)2, @"Each file in the locked folder should be reported once");
+	XCTAssertTrue([locked exists]);
+	XCTAssertFalse([[_testDirectory file:@"Folder B/File 4"] exists], @"Items outside the locked folder should still be deleted");
+}
+
+- (void)testDeleteEngineReportsStatistics
+{
+	DeleteEngine *engine = [[DeleteEngine alloc] initWithWorkerCount:2];
+	Directory *directory = [_testDirectory subdirectory:@"Folder B"];
+	
+	XCTAssertTrue([engine deleteItem:directory error:nil]);
+	XCTAssertFalse([directory exists]);
+	XCTAssertEqual([engine deletedItemCount], (unsigned long long)7, @"Five files and two directories");
+	XCTAssertEqual([[engine errors] count], (NSUInteger)0);
+}
+
+- (void)testDeleteInBackgroundFreesPathImmediately
+{
+	Directory *directory = [_testDirectory subdirectory:@"Folder B"];
+	DeleteEngine *engine = [[DeleteEngine alloc] initWithWorkerCount:0];
+	__block NSError *deletionError = [NSError errorWithDescription:@"Not called"];
+	
+	XCTAssertTrue([engine deleteItemInBackground:directory completion:^(NSError *error) { deletionError = error; } error:nil]);
+	XCTAssertFalse([directory exists]);
+	XCTAssertNotNil([directory create], @"The path should be reusable right away");
+	
+	[engine waitUntilBackgroundDeletionsAreFinished];
+	XCTAssertNil(deletionError);
+	
+	for (NSString *name in [self contentsAtPath:[_testDirectory absolutePath]])
+		XCTAssertFalse([name hasPrefix:@".Folder B"], @"The renamed directory should be gone");
+}
+
 #if !TARGET_OS_IPHONE
 
 - (void)testCanMoveToTrashIfPathExists
@@ -669,6 +720,418 @@
 	XCTAssertEqualObjects([items[0] name], @"Subfolder 1");
 }
 
+#pragma mark Tests for enumeration
+
+- (void)testEnumeratorReturnsSameItemsAsItems
+{
+	Directory *dir = [_testDirectory subdirectory:@"Folder B"];
+	NSArray *enumerated = [[dir enumerator] allObjects];
+	
+	XCTAssertEqualObjects([NSSet setWithArray:enumerated], [NSSet setWithArray:[dir items]]);
+}
+
+- (void)testRecursiveEnumeratorDescendsIntoSubdirectories
+{
+	Directory *dir = [_testDirectory subdirectory:@"Folder B"];
+	NSArray *files = [[dir enumeratorForItemsOfKind:[File class] options:DirectoryEnumerationRecursive] allObjects];
+	
+	XCTAssertTrue([files count] == 5);
+	XCTAssertTrue([files containsObject:[dir file:@"Subfolder 1/File 6"]]);
+	XCTAssertTrue([files containsObject:[dir file:@"Subfolder 1/File 7"]]);
+}
+
+- (void)testRecursiveEnumerationCanSkipDescendants
+{
+	Directory *dir = [_testDirectory subdirectory:@"Folder B"];
+	NSMutableArray *items = [NSMutableArray array];
+	
+	BOOL success = [dir enumerateItemsOfKind:nil options:DirectoryEnumerationRecursive usingBlock:^(Path *item, BOOL *skipDescendants, BOOL *stop)
+	{
+		[items addObject:item];
+		if ([item isKindOfClass:[Directory class]]) *skipDescendants = YES;
+	} error:nil];
+	
+	XCTAssertTrue(success);
+	XCTAssertTrue([items count] == 4);
+	XCTAssertTrue([items containsObject:[dir subdirectory:@"Subfolder 1"]]);
+	XCTAssertFalse([items containsObject:[dir file:@"Subfolder 1/File 6"]]);
+}
+
+- (void)testFilesWithExtensionOnlyReturnsMatchingFiles
+{
+	Directory *dir = [[_testDirectory subdirectory:@"Patterns"] create];
+	for (NSString *name in @[@"a.log", @"b.log", @"c.LOG", @"d.txt", @".log", @"e.log.old", @".cache.log"]) [[dir file:name] create];
+	[[dir subdirectory:@"f.log"] create];
+	
+	NSArray<File *> *files = [dir filesWithExtension:@"log"];
+	
+	XCTAssertEqualObjects([NSSet setWithArray:[files valueForKey:@"name"]], ([NSSet setWithArray:@[@"a.log", @"b.log", @".cache.log"]]), @"Hidden files with the extension should be returned");
+	XCTAssertEqualObjects([dir filesWithExtension:@""], @[]);
+}
+
+- (void)testFilesMatchingPathPatternSearchesSubdirectories
+{
+	Directory *dir = [[_testDirectory subdirectory:@"Patterns"] create];
+	[[dir file:@"top.json"] create];
+	[[[[dir subdirectory:@"a/b"] create] file:@"deep.json"] create];
+	[[[[dir subdirectory:@"a"] create] file:@"other.txt"] create];
+	
+	NSArray<File *> *files = [dir filesMatching:@"**/*.json"];
+	
+	XCTAssertEqualObjects([NSSet setWithArray:[files valueForKey:@"name"]], ([NSSet setWithArray:@[@"top.json", @"deep.json"]]));
+	XCTAssertEqualObjects([[dir filesMatching:@"a/b/*"] valueForKey:@"name"], @[@"deep.json"]);
+	XCTAssertEqualObjects([[dir filesMatching:@"*.json"] valueForKey:@"name"], @[@"top.json"]);
+}
+
+- (void)testMatcherOptionsAndPredicates
+{
+	Directory *dir = [[_testDirectory subdirectory:@"Patterns"] create];
+	[[dir file:@"Small.TXT"] writeData:[NSData dataWithBytes:"1" length:1]];
+	[[dir file:@"large.txt"] writeData:[NSMutableData dataWithLength:1000]];
+	
+	PathMatcher *matcher = [[PathMatcher alloc] initWithPattern:@"*.txt" options:PathMatcherCaseInsensitive];
+	XCTAssertEqual([[[dir enumeratorForItemsMatching:matcher kind:nil options:DirectoryEnumerationOptionsNone] allObjects] count], (NSUInteger)2);
+	
+	[matcher setMinimumSize:100];
+	NSArray *items = [[dir enumeratorForItemsMatching:matcher kind:nil options:DirectoryEnumerationOptionsNone] allObjects];
+	XCTAssertEqualObjects([items valueForKey:@"name"], @[@"large.txt"]);
+	
+	[matcher setMinimumSize:0];
+	[matcher setModifiedAfter:[NSDate dateWithTimeIntervalSinceNow:3600]];
+	XCTAssertEqual([[[dir enumeratorForItemsMatching:matcher kind:nil options:DirectoryEnumerationOptionsNone] allObjects] count], (NSUInteger)0);
+}
+
+- (void)testMatcherSupportsCharacterClassesAndEscapes
+{
+	XCTAssertTrue([[PathMatcher matcherWithPattern:@"[a-c]?.txt"] matchesPath:@"b1.txt"]);
+	XCTAssertFalse([[PathMatcher matcherWithPattern:@"[!a-c]?.txt"] matchesPath:@"b1.txt"]);
+	XCTAssertTrue([[PathMatcher matcherWithPattern:[PathMatcher escapedPattern:@"what?[1].txt"]] matchesPath:@"what?[1].txt"]);
+	XCTAssertFalse([[PathMatcher matcherWithPattern:@"*"] matchesPath:@".hidden"]);
+	XCTAssertTrue([[[PathMatcher alloc] initWithPattern:@"*" options:PathMatcherMatchHidden] matchesPath:@".hidden"]);
+	XCTAssertThrows([PathMatcher matcherWithPattern:@"[abc"]);
+}
+
+- (void)testEnumerationReturnsErrorIfPathIsNotADirectory
+{
+	NSError *error;
+	Directory *dir = [_testDirectory subdirectory:@"Folder A/File 1"];
+	BOOL success = [dir enumerateItemsOfKind:nil options:DirectoryEnumerationOptionsNone usingBlock:^(Path *item, BOOL *skipDescendants, BOOL *stop) {} error:&error];
+	
+	XCTAssertFalse(success);
+	XCTAssertNotNil(error);
+}
+
+#pragma mark Tests for item information
+
+- (void)testItemInfosContainsInformationForEveryItem
+{
+	Directory *dir = [_testDirectory subdirectory:@"Folder B"];
+	NSDictionary<NSString *, FileInfo *> *infos = [dir itemInfos];
+	
+	XCTAssertTrue([infos count] == 4);
+	XCTAssertTrue([infos[@"File 3"] isFile]);
+	XCTAssertTrue([infos[@"Subfolder 1"] isDirectory]);
+	XCTAssertEqual([infos[@"File 3"] size], [[dir file:@"File 3"] size]);
+}
+
+- (void)testItemInfosReturnsNilIfPathIsNotADirectory
+{
+	Directory *dir = [_testDirectory subdirectory:@"Folder A/File 1"];
+	XCTAssertNil([dir itemInfos]);
+}
+
+#pragma mark Tests for open
+
+- (void)testOpenedDirectoryPerformsOperationsRelativeToItself
+{
+	NSError *error = nil;
+	DirectoryHandle *handle = [_testDirectory open:&error];
+	XCTAssertNotNil(handle, @"%@", error);
+	
+	XCTAssertTrue([[handle itemNames:nil] containsObject:@"Folder A"]);
+	XCTAssertTrue([[handle infoForItemNamed:@"Folder A" error:nil] isDirectory]);
+	
+	DirectoryHandle *subdirectory = [handle createSubdirectoryNamed:@"Handle" error:&error];
+	XCTAssertNotNil(subdirectory, @"%@", error);
+	XCTAssertNotNil([handle createSubdirectoryNamed:@"Handle" error:nil], @"Creating an existing directory should open it");
+	
+	[[_testDirectory file:@"Handle/Original"] writeData:[@"Contents" dataUsingEncoding:NSUTF8StringEncoding]];
+	XCTAssertTrue([subdirectory moveItemNamed:@"Original" toDirectory:handle newName:@"Moved" overwrite:NO error:&error], @"%@", error);
+	XCTAssertEqualObjects([handle readDataOfFileNamed:@"Moved" error:nil], [@"Contents" dataUsingEncoding:NSUTF8StringEncoding]);
+	
+	XCTAssertTrue([handle removeItemNamed:@"Handle" error:&error], @"%@", error);
+	XCTAssertFalse([[_testDirectory subdirectory:@"Handle"] exists]);
+	XCTAssertFalse([handle removeItemNamed:@"Handle" error:&error]);
+	XCTAssertEqual([error code], ENOENT);
+}
+
+- (void)testOpenedDirectoryKeepsReferringToMovedDirectory
+{
+	Directory *original = [[_testDirectory subdirectory:@"Original"] create];
+	DirectoryHandle *handle = [original open:nil];
+	
+	XCTAssertNotNil([original moveTo:[_testDirectory subdirectory:@"Renamed"]]);
+	XCTAssertNotNil([handle createSubdirectoryNamed:@"Child" error:nil]);
+	XCTAssertTrue([[_testDirectory subdirectory:@"Renamed/Child"] exists]);
+}
+
+- (void)testOpenedDirectoryRejectsNamesWithSeveralComponents
+{
+	DirectoryHandle *handle = [_testDirectory open:nil];
+	
+	XCTAssertThrows([handle removeItemNamed:@"Folder A/File 1" error:nil]);
+	XCTAssertThrows([handle removeItemNamed:@".." error:nil]);
+	XCTAssertThrows([handle infoForItemNamed:@"" error:nil]);
+}
+
+- (void)testOpenFailsForMissingDirectory
+{
+	NSError *error = nil;
+	XCTAssertNil([[_testDirectory subdirectory:@"Missing"] open:&error]);
+	XCTAssertNotNil(error);
+}
+
+- (void)testDeleteContentsRemovesNestedDirectoriesAndLinks
+{
+	Directory *directory = [_testDirectory subdirectory:@"Folder B"];
+	symlink("Subfolder 1", [[[directory file:@"Link"] absolutePath] fileSystemRepresentation]);
+	
+	XCTAssertTrue([directory deleteContents]);
+	XCTAssertTrue([directory exists]);
+	XCTAssertTrue([directory isEmpty]);
+}
+
+#pragma mark Tests for watching
+
+- (void)testWatcherReportsItemsCreatedInNewSubdirectories
+{
+	// Serial, since the handler mutates the dictionary
+	NSOperationQueue *queue = [[NSOperationQueue alloc] init];
+	[queue setMaxConcurrentOperationCount:1];
+	
+	NSMutableDictionary<NSString *, NSNumber *> *kinds = [NSMutableDictionary dictionary];
+	XCTestExpectation *expectation = [self expectationWithDescription:@"Nested file reported"];
+	NSString *nestedPath = [[_testDirectory absolutePath] stringByAppendingPathComponent:@"Watched/Nested/File"];
+	__block BOOL reported = NO;
+	
+	PathWatcher *watcher = [_testDirectory watchWithQueue:queue handler:^(NSArray<PathChange *> *changes)
+	{
+		for (PathChange *change in changes)
+		{
+			kinds[[change path]] = @([kinds[[change path]] unsignedIntegerValue] | [change kinds]);
+			if ([[change path] isEqualToString:nestedPath] && !reported) { reported = YES; [expectation fulfill]; }
+		}
+	} error:nil];
+	
+	XCTAssertNotNil(watcher);
+	[[_testDirectory subdirectory:@"Watched/Nested"] create];
+	[[_testDirectory file:@"Watched/Nested/File"] writeData:[NSData dataWithBytes:"x" length:1]];
+	
+	[self waitForExpectationsWithTimeout:5 handler:nil];
+	[watcher stop];
+	[queue waitUntilAllOperationsAreFinished];
+	
+	XCTAssertTrue([kinds[nestedPath] unsignedIntegerValue] & PathChangeCreated);
+}
+
+- (void)testFileWatcherOnlyReportsTheWatchedFile
+{
+	File *file = [_testDirectory file:@"Folder A/File 1"];
+	NSMutableArray<PathChange *> *changes = [NSMutableArray array];
+	XCTestExpectation *expectation = [self expectationWithDescription:@"File change reported"];
+	
+	PathWatcher *watcher = [[PathWatcher alloc] initWithItem:file options:PathWatcherOptionsNone];
+	[watcher setCoalescingInterval:0.2];
+	
+	XCTAssertTrue([watcher startWithHandler:^(NSArray<PathChange *> *batch)
+	{
+		[changes addObjectsFromArray:batch];
+		if ([changes count] == [batch count]) [expectation fulfill];
+	} error:nil]);
+	
+	[[_testDirectory file:@"Folder A/File 2"] writeData:[NSData dataWithBytes:"sibling" length:7] overwrite:YES];
+	[file writeData:[NSData dataWithBytes:"first" length:5] overwrite:YES];
+	[file writeData:[NSData dataWithBytes:"second" length:6] overwrite:YES];
+	
+	[self waitForExpectationsWithTimeout:5 handler:nil];
+	[watcher stop];
+	
+	XCTAssertEqual([changes count], (NSUInteger)1, @"Both writes should be coalesced into one change: %@", changes);
+	XCTAssertEqualObjects([[changes firstObject] path], [file absolutePath]);
+	XCTAssertFalse([[changes firstObject] isDirectory]);
+}
+
+- (void)testWatcherFailsForMissingItem
+{
+	NSError *error = nil;
+	XCTAssertNil([[_testDirectory subdirectory:@"Missing"] watchWithQueue:nil handler:^(NSArray<PathChange *> *changes) {} error:&error]);
+	XCTAssertEqual([error code], ENOENT);
+}
+
+#pragma mark Tests for disk usage
+
+- (void)testDiskUsageCountsEveryItemInTree
+{
+	Directory *dir = [_testDirectory subdirectory:@"Folder B"];
+	DiskUsage *usage = [dir diskUsage];
+	
+	XCTAssertTrue([[usage errors] count] == 0);
+	XCTAssertEqual([usage fileCount], (unsigned long long)5);
+	XCTAssertEqual([usage directoryCount], (unsigned long long)1);
+}
+
+- (void)testDiskUsageIncludesSizeOfFiles
+{
+	DiskUsage *usage = [_testDirectory diskUsage];
+	XCTAssertTrue([usage apparentSize] >= 207490);
+	XCTAssertTrue([usage allocatedSize] > 0);
+}
+
+- (void)testDiskUsageIsTheSameWithOneOrManyWorkers
+{
+	DiskUsage *serial = [_testDirectory diskUsageWithOptions:DiskUsageOptionsNone workerCount:1];
+	DiskUsage *parallel = [_testDirectory diskUsageWithOptions:DiskUsageOptionsNone workerCount:8];
+	
+	XCTAssertEqual([serial apparentSize], [parallel apparentSize]);
+	XCTAssertEqual([serial fileCount], [parallel fileCount]);
+	XCTAssertEqual([serial directoryCount], [parallel directoryCount]);
+}
+
+- (void)testDiskUsageCountsHardLinkedFilesOnce
+{
+	Directory *dir = [_testDirectory subdirectory:@"Folder B"];
+	NSString *original = [[dir file:@"File 3"] absolutePath];
+	NSString *link = [[dir file:@"File 3 (Link)"] absolutePath];
+	XCTAssertTrue([_fileManager linkItemAtPath:original toPath:link error:nil]);
+	
+	XCTAssertEqual([[dir diskUsage] fileCount], (unsigned long long)5);
+}
+
+- (void)testDiskUsageReportsErrorIfPathIsNotReadable
+{
+	DiskUsage *usage = [[_testDirectory subdirectory:@"Nonexistent Folder"] diskUsage];
+	XCTAssertTrue([[usage errors] count] == 1);
+	XCTAssertEqual([usage fileCount], (unsigned long long)0);
+}
+
+#pragma mark Tests for snapshots
+
+- (void)testSnapshotRecordsEveryItemSortedByPath
+{
+	DirectorySnapshot *snapshot = [[_testDirectory subdirectory:@"Folder B"] snapshot:nil];
+	
+	XCTAssertNotNil(snapshot);
+	XCTAssertTrue([[snapshot errors] count] == 0);
+	XCTAssertEqual([snapshot count], (NSUInteger)6);
+	XCTAssertEqualObjects([[snapshot entryAtIndex:0] path], @"File 3");
+	XCTAssertEqualObjects([[snapshot entryAtIndex:3] path], @"Subfolder 1");
+	XCTAssertEqual([[snapshot entryAtIndex:3] type], DirectorySnapshotItemTypeDirectory);
+	XCTAssertEqualObjects([[snapshot entryAtIndex:5] path], @"Subfolder 1/File 7");
+	XCTAssertEqual([[snapshot entryForPath:@"Subfolder 1/File 6"] type], DirectorySnapshotItemTypeFile);
+	XCTAssertNil([snapshot entryForPath:@"Subfolder 1/File 8"]);
+}
+
+- (void)testSnapshotCanBeSavedAndLoaded
+{
+	DirectorySnapshot *snapshot = [[_testDirectory subdirectory:@"Folder B"] snapshot:nil];
+	File *file = [_testDirectory file:@"Snapshot"];
+	
+	XCTAssertTrue([snapshot writeToFile:file error:nil]);
+	DirectorySnapshot *loaded = [DirectorySnapshot snapshotWithContentsOfFile:file error:nil];
+	
+	XCTAssertEqual([loaded count], [snapshot count]);
+	XCTAssertEqualObjects([[loaded entryAtIndex:4] path], [[snapshot entryAtIndex:4] path]);
+	XCTAssertEqual([[loaded entryAtIndex:4] inode], [[snapshot entryAtIndex:4] inode]);
+	XCTAssertTrue([[loaded differenceFromSnapshot:snapshot] isEmpty]);
+}
+
+- (void)testSnapshotFailsToLoadInvalidFile
+{
+	NSError *error = nil;
+	XCTAssertNil([DirectorySnapshot snapshotWithContentsOfFile:[_testDirectory file:@"image.jpg"] error:&error]);
+	XCTAssertNotNil(error);
+}
+
+- (void)testSnapshotDifferenceReportsEveryKindOfChange
+{
+	Directory *dir = [_testDirectory subdirectory:@"Folder B"];
+	DirectorySnapshot *before = [dir snapshot:nil];
+	
+	XCTAssertTrue([[dir file:@"File 3"] delete]);
+	XCTAssertTrue([[dir file:@"File 8"] writeData:[NSData dataWithBytes:"new" length:3]]);
+	XCTAssertTrue([[dir file:@"File 4"] writeData:[NSData dataWithBytes:"changed contents" length:16] overwrite:YES]);
+	XCTAssertTrue([_fileManager moveItemAtPath:[[dir file:@"File 5"] absolutePath] toPath:[[dir file:@"File 5 (Renamed)"] absolutePath] error:nil]);
+	
+	DirectorySnapshotDiff *diff = [[dir snapshot:nil] differenceFromSnapshot:before];
+	
+	XCTAssertEqualObjects([[diff addedEntries] valueForKey:@"path"], @[@"File 8"]);
+	XCTAssertEqualObjects([[diff removedEntries] valueForKey:@"path"], @[@"File 3"]);
+	XCTAssertEqualObjects([[diff modifiedEntries] valueForKey:@"path"], @[@"File 4"]);
+	XCTAssertEqual([[diff renamedEntries] count], (NSUInteger)1);
+	XCTAssertEqualObjects([[[[diff renamedEntries] firstObject] source] path], @"File 5");
+	XCTAssertEqualObjects([[[[diff renamedEntries] firstObject] destination] path], @"File 5 (Renamed)");
+}
+
+- (void)testSnapshotFailsIfDirectoryDoesNotExist
+{
+	NSError *error = nil;
+	XCTAssertNil([[_testDirectory subdirectory:@"Nonexistent Folder"] snapshot:&error]);
+	XCTAssertEqual([error code], ENOENT);
+}
+
+#pragma mark Tests for hashing
+
+- (void)testDigestsOfFilesCoversEveryFileInTree
+{
+	Directory *dir = [_testDirectory subdirectory:@"Folder B"];
+	NSArray<NSError *> *errors = nil;
+	NSDictionary<NSString *, NSData *> *digests = [dir digestsOfFilesWithAlgorithm:FileHashAlgorithmXXH64 concurrentReads:2 errors:&errors];
+	
+	XCTAssertTrue([errors count] == 0);
+	XCTAssertEqual([digests count], (NSUInteger)5);
+	XCTAssertEqualObjects(digests[@"Subfolder 1/File 6"], [[dir file:@"Subfolder 1/File 6"] digestWithAlgorithm:FileHashAlgorithmXXH64 error:nil]);
+}
+
+- (void)testDigestsOfFilesFailsIfDirectoryDoesNotExist
+{
+	NSArray<NSError *> *errors = nil;
+	XCTAssertNil([[_testDirectory subdirectory:@"Nonexistent Folder"] digestsOfFilesWithAlgorithm:FileHashAlgorithmSHA256 concurrentReads:0 errors:&errors]);
+	XCTAssertTrue([errors count] == 1);
+}
+
+- (void)testDuplicateFilesGroupsIdenticalFiles
+{
+	Directory *dir = [[_testDirectory subdirectory:@"Duplicates"] create];
+	NSMutableData *large = [NSMutableData dataWithLength:64 * 1024];
+	NSMutableData *largeWithDifferentMiddle = [large mutableCopy];
+	((char *)[largeWithDifferentMiddle mutableBytes])[32 * 1024] = 1;
+	
+	[[dir file:@"a"] writeData:[NSData dataWithBytes:"same" length:4]];
+	[[dir file:@"b"] writeData:[NSData dataWithBytes:"same" length:4]];
+	[[dir file:@"c"] writeData:[NSData dataWithBytes:"diff" length:4]];
+	[[dir file:@"Large 1"] writeData:large];
+	[[[[dir subdirectory:@"Nested"] create] file:@"Large 2"] writeData:large];
+	[[dir file:@"Large 3"] writeData:largeWithDifferentMiddle];
+	[_fileManager linkItemAtPath:[[dir file:@"a"] absolutePath] toPath:[[dir file:@"a (Link)"] absolutePath] error:nil];
+	
+	DuplicateFinder *finder = [[DuplicateFinder alloc] initWithWorkerCount:2];
+	NSArray<NSArray<File *> *> *groups = [finder duplicatesInDirectory:dir error:nil];
+	
+	XCTAssertEqual([groups count], (NSUInteger)2);
+	XCTAssertEqualObjects([groups[0] valueForKey:@"name"], (@[@"Large 1", @"Large 2"]));
+	XCTAssertEqualObjects([groups[1] valueForKey:@"name"], (@[@"a", @"b"]));
+	XCTAssertEqual([finder partiallyHashedFileCount], (unsigned long long)6);
+	XCTAssertEqual([finder fullyHashedFileCount], (unsigned long long)3);
+	XCTAssertTrue([[finder errors] count] == 0);
+}
+
+- (void)testDuplicateFilesFailsIfDirectoryDoesNotExist
+{
+	NSError *error = nil;
+	XCTAssertNil([[_testDirectory subdirectory:@"Nonexistent Folder"] duplicateFiles:&error]);
+	XCTAssertNotNil(error);
+}
+
 #pragma mark Tests for subdirectory: and file:
 
 - (void)testCanCreateNewInstanceByAppendingSubdirectoryNamePathComponent
@@ -690,6 +1153,103 @@
 	XCTAssertEqualObjects([file pathComponents][2], @"SomeFile.jpg");
 }
 
+- (void)testCanCreateManyFilesAndSubdirectoriesAtOnce
+{
+	NSArray *files = [_testDirectory filesNamed:@[@"File A", @"File B.txt"]];
+	NSArray *subdirectories = [_testDirectory subdirectoriesNamed:@[@"Folder X", @"Folder Y/Folder Z"]];
+	
+	XCTAssertEqualObjects(files, (@[[_testDirectory file:@"File A"], [_testDirectory file:@"File B.txt"]]));
+	XCTAssertEqualObjects(subdirectories, (@[[_testDirectory subdirectory:@"Folder X"], [_testDirectory subdirectory:@"Folder Y/Folder Z"]]));
+}
+
+- (void)testChildrenCreatedFromRelativeComponentsAreStandardized
+{
+	Directory *directory = [Directory directoryWithPath:@"/Folder1/Folder2"];
+	XCTAssertEqualObjects([[directory subdirectory:@".."] absolutePath], @"/Folder1");
+	XCTAssertEqualObjects([[directory file:@"./SomeFile"] absolutePath], @"/Folder1/Folder2/SomeFile");
+}
+
+#pragma mark Tests for numeric suffixes
+
+- (void)testNumericSuffixIsOnlyAddedIfNameIsTaken
+{
+	XCTAssertEqualObjects([[_testDirectory fileWithNumberSuffixIfExists:@"Unused.pdf"] name], @"Unused.pdf");
+	XCTAssertEqualObjects([[_testDirectory subdirectoryWithNumericSuffixIfExists:@"Folder A"] name], @"Folder A1");
+}
+
+- (void)testNumericSuffixFollowsHighestExistingSuffix
+{
+	for (NSString *name in @[@"Report.pdf", @"Report2.pdf", @"Report7.pdf", @"Report9.txt", @"Report1x.pdf"])
+		[[_testDirectory file:name] writeData:[NSData data]];
+	
+	XCTAssertEqualObjects([[_testDirectory fileWithNumberSuffixIfExists:@"Report.pdf"] name], @"Report8.pdf");
+	XCTAssertEqualObjects([[_testDirectory fileWithNumberSuffixIfExists:@"Report.pdf"] name], @"Report8.pdf", @"Names are not reserved until created");
+	
+	[[_testDirectory file:@"Report8.pdf"] writeData:[NSData data]];
+	XCTAssertEqualObjects([[_testDirectory fileWithNumberSuffixIfExists:@"Report.pdf"] name], @"Report9.pdf");
+}
+
+- (void)testCreatesItemsWithNumericSuffix
+{
+	NSError *error = nil;
+	File *first = [_testDirectory createFileWithNumericSuffixIfExists:@"Created.txt" error:&error];
+	File *second = [_testDirectory createFileWithNumericSuffixIfExists:@"Created.txt" error:&error];
+	Directory *directory = [_testDirectory createSubdirectoryWithNumericSuffixIfExists:@"Folder B" error:&error];
+	
+	XCTAssertNil(error);
+	XCTAssertEqualObjects([first name], @"Created.txt");
+	XCTAssertEqualObjects([second name], @"Created1.txt");
+	XCTAssertTrue([second exists]);
+	XCTAssertEqualObjects([directory name], @"Folder B1");
+	XCTAssertTrue([directory exists]);
+}
+
+- (void)testNumericSuffixIsRescannedWhenDirectoryChanges
+{
+	NSError *error = nil;
+	for (NSUInteger i = 0; i < 3; i++) [_testDirectory createFileWithNumericSuffixIfExists:@"Recycled.txt" error:&error];
+	XCTAssertNil(error);
+	
+	[[_testDirectory file:@"Recycled1.txt"] delete];
+	[[_testDirectory file:@"Recycled2.txt"] delete];
+	
+	// Deleting within the same timestamp tick as the last creation wouldn't change the modification time
+	NSDictionary *attributes = @{NSFileModificationDate: [NSDate dateWithTimeIntervalSinceNow:-3600]};
+	XCTAssertTrue([[NSFileManager defaultManager] setAttributes:attributes ofItemAtPath:[_testDirectory absolutePath] error:&error]);
+	
+	XCTAssertEqualObjects([[_testDirectory createFileWithNumericSuffixIfExists:@"Recycled.txt" error:&error] name], @"Recycled1.txt");
+	XCTAssertEqualObjects([[_testDirectory fileWithNumberSuffixIfExists:@"Recycled.txt"] name], @"Recycled2.txt");
+}
+
+- (void)testCreatingItemsWithNumericSuffixFailsIfDirectoryDoesNotExist
+{
+	NSError *error = nil;
+	File *file = [[_testDirectory subdirectory:@"Missing"] createFileWithNumericSuffixIfExists:@"File" error:&error];
+	
+	XCTAssertNil(file);
+	XCTAssertEqualObjects([error domain], NSPOSIXErrorDomain);
+	XCTAssertEqual([error code], ENOENT);
+}
+
+- (void)testItemsCreatedWithNumericSuffixAreDistinctAcrossThreads
+{
+	NSMutableSet *names = [NSMutableSet set];
+	NSLock *lock = [[NSLock alloc] init];
+	
+	dispatch_apply(200, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t index)
+	{
+		File *file = [_testDirectory createFileWithNumericSuffixIfExists:@"Concurrent.log" error:nil];
+		
+		[lock lock];
+		if (file) [names addObject:[file name]];
+		[lock unlock];
+	});
+	
+	XCTAssertEqual([names count], (NSUInteger)200);
+	XCTAssertTrue([names containsObject:@"Concurrent.log"]);
+	XCTAssertTrue([names containsObject:@"Concurrent199.log"]);
+}
+
 #pragma mark Tests for create and createAndOverwrite:
 
 - (void)testCanCreateDirectoryIfPathDoesntExist
@@ -814,6 +1374,36 @@
 	XCTAssertThrows([_testDirectory copyContentsTo:nil]);
 }
 
+- (void)testCopyContentsReportsEveryItemThatCouldNotBeCopied
+{
+	Directory *source = [_testDirectory subdirectory:@"Folder B"];
+	Directory *destination = [_testDirectory subdirectory:@"Folder B (Copy)"];
+	
+	NSError *error;
+	Directory *result = [source copyContentsTo:destination overwrite:NO error:&error];
+	
+	XCTAssertNil(result);
+	XCTAssertTrue([error.userInfo[FilesUnderlyingErrorsKey] count] == 3, @"File 4, File 5 and Subfolder 1 already exist in the destination");
+	XCTAssertTrue([[destination file:@"File 3"] isFile], @"Items that don't exist in the destination should still be copied");
+}
+
+- (void)testCopyEngineReportsStatistics
+{
+	Directory *source = [_testDirectory subdirectory:@"Folder B"];
+	Directory *destination = [_testDirectory subdirectory:@"Folder Z"];
+	CopyEngine *engine = [[CopyEngine alloc] initWithWorkerCount:2];
+	[[NSData dataWithBytes:"0123456789abcdef" length:16] writeToFile:[[source file:@"File 3"] absolutePath] atomically:NO];
+	
+	NSError *error;
+	BOOL success = [engine copyContentsOfDirectory:source toDirectory:destination error:&error];
+	
+	XCTAssertTrue(success);
+	XCTAssertNil(error);
+	XCTAssertEqual([engine copiedItemCount], (unsigned long long)6);
+	XCTAssertEqual([engine copiedByteCount], (unsigned long long)16);
+	XCTAssertTrue([[engine errors] count] == 0);
+}
+
 - (void)testCopyCreatesIntermediaryDirectories
 {
 	Directory *destinationDir = [_testDirectory subdirectory:@"Folder K/Folder J/Folder M"];
@@ -904,6 +1494,32 @@
 
 #pragma mark Tests for moveTo: and moveTo:andOverwrite:
 
+- (void)testMoveWithinVolumeKeepsTheSameDirectory
+{
+	Directory *source = [_testDirectory subdirectory:@"Folder B"];
+	Directory *destination = [_testDirectory subdirectory:@"Folder Z"];
+	unsigned long long inode = [[source info] inode];
+	
+	Directory *result = [source moveTo:destination];
+	
+	XCTAssertNotNil(result);
+	XCTAssertEqual([[result info] inode], inode, @"A move within a volume should rename the directory rather than copy it");
+}
+
+- (void)testMoveToFailsIfDestinationDirectoryExistsAndNotOverwriting
+{
+	Directory *source = [_testDirectory subdirectory:@"Folder A"];
+	Directory *destination = [_testDirectory subdirectory:@"Folder B"];
+	
+	NSError *error;
+	Directory *result = [source moveTo:destination overwrite:NO error:&error];
+	
+	XCTAssertNil(result);
+	XCTAssertNotNil(error);
+	XCTAssertTrue([[source file:@"File 1"] exists]);
+	XCTAssertTrue([[destination file:@"File 4"] exists]);
+}
+
 - (void)testThrowsIfTryingToMoveToSamePath
 {
 	Directory *sameDirectory = [Directory directoryWithPath:[_testDirectory absolutePath]];
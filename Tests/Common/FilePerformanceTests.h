@@ -0,0 +1,13 @@
+//
+//  FilePerformanceTests.h
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+@interface FilePerformanceTests : XCTestCase
+
+@end
@@ -0,0 +1,195 @@
+//
+//  FilePerformanceTests.m
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+
+#import "FilePerformanceTests.h"
+#import "Directory.h"
+#import "File.h"
+#import "TestEnvironmentHelpers.h"
+
+#define FilePerformanceTestsLargeFileSize (256 * 1024 * 1024)
+#define FilePerformanceTestsRecordCount 1000000
+
+@implementation FilePerformanceTests
+{
+	File *_largeFile;
+	File *_copy;
+}
+
+#pragma mark SetUp and TearDown
+
++ (Directory *)directory
+{
+	return [[TestEnvironmentHelpers testDirectory] subdirectory:@"Performance Files"];
+}
+
++ (void)setUp
+{
+	Directory *directory = [self directory];
+	[directory delete];
+	[directory create];
+	
+	// Written once for the whole class, since none of the tests modify it
+	NSMutableData *data = [NSMutableData dataWithLength:FilePerformanceTestsLargeFileSize];
+	arc4random_buf([data mutableBytes], [data length]);
+	[data writeToFile:[[directory file:@"Large File"] absolutePath] atomically:NO];
+}
+
++ (void)tearDown
+{
+	[[self directory] delete];
+}
+
+- (void)setUp
+{
+	_largeFile = [[[self class] directory] file:@"Large File"];
+	_copy = [[[self class] directory] file:@"Large File (Copy)"];
+}
+
+- (void)tearDown
+{
+	[_copy delete];
+}
+
+#pragma mark Read
+
+- (void)testBaselineReadWithContentsOfFile
+{
+	[self measureBlock:^
+	{
+		NSData *data = [NSData dataWithContentsOfFile:[_largeFile absolutePath]];
+		XCTAssertEqual([data length], (NSUInteger)FilePerformanceTestsLargeFileSize);
+	}];
+}
+
+- (void)testPerformanceOfPlainRead
+{
+	[self measureReadWithOptions:FileReadingOptionsNone];
+}
+
+- (void)testPerformanceOfMappedSequentialRead
+{
+	[self measureReadWithOptions:FileReadingMapped | FileReadingSequential];
+}
+
+- (void)testPerformanceOfReadIntoReusedBuffer
+{
+	NSMutableData *buffer = [NSMutableData data];
+	
+	[self measureBlock:^
+	{
+		XCTAssertTrue([_largeFile readDataIntoBuffer:buffer error:nil]);
+		[self checksumOfData:buffer];
+	}];
+}
+
+- (void)testPerformanceOfChunkedRead
+{
+	[self measureBlock:^
+	{
+		__block unsigned long long byteCount = 0;
+		[_largeFile enumerateChunksOfSize:1024 * 1024 usingBlock:^(NSData *chunk, unsigned long long offset, BOOL *stop) { byteCount += [chunk length]; } error:nil];
+		XCTAssertEqual(byteCount, (unsigned long long)FilePerformanceTestsLargeFileSize);
+	}];
+}
+
+- (void)measureReadWithOptions:(FileReadingOptions)options
+{
+	[self measureBlock:^
+	{
+		// Touching every page makes mapped and copied reads comparable
+		NSData *data = [_largeFile readDataWithOptions:options error:nil];
+		XCTAssertEqual([data length], (NSUInteger)FilePerformanceTestsLargeFileSize);
+		[self checksumOfData:data];
+	}];
+}
+
+- (uint8_t)checksumOfData:(NSData *)data
+{
+	const uint8_t *bytes = [data bytes];
+	uint8_t checksum = 0;
+	for (NSUInteger i = 0; i < [data length]; i += 4096) checksum ^= bytes[i];
+	return checksum;
+}
+
+#pragma mark Append
+
+- (void)testBaselineAppendWithOutputStream
+{
+	[self measureBlock:^
+	{
+		[_copy delete];
+		NSOutputStream *stream = [_copy outputStreamToAppend:YES];
+		[stream open];
+		for (int i = 0; i < FilePerformanceTestsRecordCount; i++) [stream write:(const uint8_t *)"0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcde\n" maxLength:64];
+		[stream close];
+	}];
+}
+
+- (void)testPerformanceOfAppendWithAppender
+{
+	[self measureBlock:^
+	{
+		[_copy delete];
+		FileAppender *appender = [_copy appender:nil];
+		for (int i = 0; i < FilePerformanceTestsRecordCount; i++) [appender appendBytes:"0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcde\n" length:64 error:nil];
+		XCTAssertTrue([appender close:nil]);
+	}];
+}
+
+#pragma mark Copy
+
+- (void)testBaselineCopyWithFileManager
+{
+	[self measureBlock:^
+	{
+		[_copy delete];
+		XCTAssertTrue([[NSFileManager defaultManager] copyItemAtPath:[_largeFile absolutePath] toPath:[_copy absolutePath] error:nil]);
+	}];
+}
+
+- (void)testPerformanceOfCopyWithClone
+{
+	[self measureCopyStartingWithMethod:FileCopyMethodClone];
+}
+
+- (void)testPerformanceOfCopyWithCopyFileRange
+{
+	[self measureCopyStartingWithMethod:FileCopyMethodCopyFileRange];
+}
+
+- (void)testPerformanceOfCopyWithSendFile
+{
+	[self measureCopyStartingWithMethod:FileCopyMethodSendFile];
+}
+
+- (void)testPerformanceOfCopyWithReadWrite
+{
+	[self measureCopyStartingWithMethod:FileCopyMethodReadWrite];
+}
+
+- (void)measureCopyStartingWithMethod:(FileCopyMethod)firstMethod
+{
+	__block FileCopyMethod usedMethod = FileCopyMethodNone;
+	
+	[self measureBlock:^
+	{
+		usedMethod = [FileCopier copyFileAtPath:[_largeFile absolutePath] toPath:[_copy absolutePath] overwrite:YES firstMethod:firstMethod error:nil];
+		XCTAssertNotEqual(usedMethod, FileCopyMethodNone);
+	}];
+	
+	// Cloning depends on the file system; copy_file_range() and sendfile() always work for regular files on Linux
+#if defined(__linux__)
+	FileCopyMethod expectedMethod = firstMethod;
+#else
+	FileCopyMethod expectedMethod = FileCopyMethodReadWrite;
+#endif
+	
+	if (firstMethod != FileCopyMethodClone) XCTAssertEqual(usedMethod, expectedMethod);
+}
+
+@end
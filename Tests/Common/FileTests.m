@@ -10,6 +10,7 @@
 #import "TestEnvironmentHelpers.h"
 #import "Directory.h"
 #import "File.h"
+#import "FileInfo.h"
 #import "XMLValidator.h"
 #import "NSCodingImplementer.h"
 
@@ -98,6 +99,23 @@ File *_imageFile;
 	XCTAssertTrue([date isKindOfClass:[NSDate class]]);
 }
 
+- (void)testCanObtainInfo
+{
+	FileInfo *info = [_imageFile info];
+	XCTAssertNotNil(info);
+	XCTAssertEqual([info type], FileInfoTypeRegular);
+	XCTAssertEqual([info size], (unsigned long long)207490);
+	XCTAssertEqualWithAccuracy([[info modificationDate] timeIntervalSince1970], [[_imageFile attributes][NSFileModificationDate] timeIntervalSince1970], 0.001);
+}
+
+- (void)testInfoReturnsErrorIfItemDoesNotExist
+{
+	NSError *error;
+	FileInfo *info = [[_testDirectory file:@"Nonexistent File"] info:&error];
+	XCTAssertNil(info);
+	XCTAssertNotNil(error);
+}
+
 #pragma mark File System Attributes Tests
 
 - (void)testCanObtainFileSystemAttributes
@@ -209,6 +227,50 @@ File *_imageFile;
 	XCTAssertNotNil(newFile, @"copyTo: did not return an File instance for the new file");
 }
 
+- (void)testCopyToReportsMethodAndPreservesContentsAndDates
+{
+	File *destination = [_testDirectory file:@"image (Copy).jpg"];
+	
+	FileCopyMethod method = FileCopyMethodNone;
+	File *newFile = [_imageFile copyTo:destination overwrite:NO method:&method error:nil];
+	
+	XCTAssertNotNil(newFile);
+	XCTAssertNotEqual(method, FileCopyMethodNone);
+	XCTAssertEqualObjects([newFile readData], [_imageFile readData]);
+	XCTAssertEqualObjects([newFile modificationDate], [_imageFile modificationDate]);
+}
+
+- (void)testEveryCopyMethodProducesTheSameFile
+{
+	for (FileCopyMethod method = FileCopyMethodClone; method <= FileCopyMethodReadWrite; method++)
+	{
+		File *destination = [_testDirectory file:[NSString stringWithFormat:@"image (Method %ld).jpg", (long)method]];
+		FileCopyMethod usedMethod = [FileCopier copyFileAtPath:[_imageFile absolutePath] toPath:[destination absolutePath] overwrite:NO firstMethod:method error:nil];
+		
+		XCTAssertTrue(usedMethod >= method, @"Methods cheaper than the first method should not be tried");
+		XCTAssertEqualObjects([destination readData], [_imageFile readData]);
+	}
+}
+
+- (void)testCopyingPseudoFilesWithANonZeroSizeCopiesTheirContents
+{
+#if defined(__linux__)
+	// sysfs files report a size of one page, but kernel copies of them return nothing (or only what read() returns)
+	File *source = [File fileWithPath:@"/sys/devices/system/cpu/possible"];
+	if (![source exists]) return;
+	
+	for (FileCopyMethod method = FileCopyMethodClone; method <= FileCopyMethodReadWrite; method++)
+	{
+		File *destination = [_testDirectory file:[NSString stringWithFormat:@"possible (Method %ld)", (long)method]];
+		FileCopyMethod usedMethod = [FileCopier copyFileAtPath:[source absolutePath] toPath:[destination absolutePath] overwrite:NO firstMethod:method error:nil];
+		
+		XCTAssertNotEqual(usedMethod, FileCopyMethodNone);
+		XCTAssertTrue([[destination readData] length] > 0, @"The copy should not be truncated");
+		XCTAssertEqualObjects([destination readData], [source readData]);
+	}
+#endif
+}
+
 - (void)testCopyToDirectoryWorks
 {
 	File *copied = [_file1_inFolderA copyTo:[_testDirectory subdirectory:@"Folder B"]];
@@ -255,6 +317,30 @@ File *_imageFile;
 
 #pragma mark Move tests
 
+- (void)testMoveWithinVolumeKeepsTheSameFile
+{
+	unsigned long long inode = [[_file1_inFolderA info] inode];
+	File *newFile = [_file1_inFolderA moveTo:[_testDirectory file:@"Renamed"]];
+	
+	XCTAssertNotNil(newFile);
+	XCTAssertEqual([[newFile info] inode], inode, @"A move within a volume should rename the file rather than copy it");
+}
+
+- (void)testCanExchangeTwoFiles
+{
+	NSData *data1 = [_file1_inFolderA readData];
+	NSData *imageData = [_imageFile readData];
+	
+	NSError *error;
+	BOOL success = [_file1_inFolderA exchangeWith:_imageFile error:&error];
+	
+	if (!success && [error code] == ENOTSUP) return; // Not supported by this system or file system
+	
+	XCTAssertTrue(success);
+	XCTAssertEqualObjects([_file1_inFolderA readData], imageData);
+	XCTAssertEqualObjects([_imageFile readData], data1);
+}
+
 - (void)testThrowsIfTryingToMoveToSamePath
 {
 	File *source = [_testDirectory file:@"Test 1"];
@@ -486,6 +572,136 @@ File *_imageFile;
 	XCTAssertTrue(isDirectory, @"Expected a directory");
 }
 
+- (void)testWriteWithEachDurabilityLeavesNoTemporaryFiles
+{
+	Directory *directory = [_testDirectory subdirectory:@"Durable"];
+	File *file = [directory file:@"config"];
+	
+	for (FileWritingDurability durability = FileWritingDurabilityNone; durability <= FileWritingDurabilityFull; durability++)
+	{
+		NSData *data = [[NSString stringWithFormat:@"durability %ld", (long)durability] dataUsingEncoding:NSUTF8StringEncoding];
+		NSError *error;
+		
+		XCTAssertTrue([file writeData:data overwrite:YES durability:durability error:&error]);
+		XCTAssertNil(error);
+		XCTAssertEqualObjects([file readData], data);
+	}
+	
+	XCTAssertEqualObjects([[NSFileManager defaultManager] contentsOfDirectoryAtPath:[directory absolutePath] error:nil], @[@"config"]);
+}
+
+- (void)testCanWriteAndReadArraysAndDictionaries
+{
+	File *arrayFile = [_testDirectory file:@"array.plist"];
+	File *dictionaryFile = [_testDirectory file:@"dictionary.plist"];
+	
+	XCTAssertTrue([arrayFile writeArray:@[@"a", @1]]);
+	XCTAssertTrue([dictionaryFile writeDictionary:@{ @"key" : @"value" }]);
+	XCTAssertFalse([dictionaryFile writeDictionary:@{ @"key" : @"other" } overwrite:NO]);
+	
+	XCTAssertEqualObjects([arrayFile readArray], (@[@"a", @1]));
+	XCTAssertEqualObjects([dictionaryFile readDictionary], @{ @"key" : @"value" });
+}
+
+- (void)testCanWriteAndReadBinaryPropertyLists
+{
+	File *arrayFile = [_testDirectory file:@"array.plist"];
+	File *dictionaryFile = [_testDirectory file:@"dictionary.plist"];
+	NSArray *array = @[@"a", @1, @-5, @2.5, @YES, [NSData dataWithBytes:"xyz" length:3], @[@"nested"]];
+	NSDictionary *dictionary = @{ @"key" : @"value", @"clé" : @{ @"inner" : @[@1, @2] } };
+	
+	XCTAssertTrue([arrayFile writeArray:array overwrite:YES format:NSPropertyListBinaryFormat_v1_0]);
+	XCTAssertTrue([dictionaryFile writeDictionary:dictionary overwrite:YES format:NSPropertyListBinaryFormat_v1_0]);
+	
+	NSData *header = [[arrayFile readData] subdataWithRange:NSMakeRange(0, 8)];
+	XCTAssertEqualObjects(header, [@"bplist00" dataUsingEncoding:NSASCIIStringEncoding]);
+	
+	XCTAssertEqualObjects([arrayFile readArray], array);
+	XCTAssertEqualObjects([dictionaryFile readDictionary], dictionary);
+	XCTAssertEqualObjects([arrayFile readArrayLazily], array);
+	XCTAssertEqualObjects([dictionaryFile readDictionaryLazily], dictionary);
+}
+
+- (void)testLazilyReadDictionaryLooksUpKeysWithoutDecodingTheWholeFile
+{
+	File *file = [_testDirectory file:@"table.plist"];
+	NSMutableDictionary *table = [NSMutableDictionary dictionary];
+	for (NSUInteger i = 0; i < 1000; i++) table[[NSString stringWithFormat:@"key %lu", (unsigned long)i]] = @{ @"index" : @(i) };
+	table[@"naïve"] = @"unicode";
+	
+	XCTAssertTrue([file writeDictionary:table overwrite:YES format:NSPropertyListBinaryFormat_v1_0]);
+	
+	NSDictionary *dictionary = [file readDictionaryLazily];
+	
+	XCTAssertEqual([dictionary count], (NSUInteger)1001);
+	XCTAssertEqualObjects(dictionary[@"key 742"][@"index"], @742);
+	XCTAssertEqualObjects(dictionary[@"naïve"], @"unicode");
+	XCTAssertNil(dictionary[@"key 1000"]);
+	XCTAssertNil(dictionary[@42]);
+	XCTAssertEqualObjects([NSSet setWithArray:[dictionary allKeys]], [NSSet setWithArray:[table allKeys]]);
+}
+
+- (void)testLazilyReadContainersAreDecodedOnce
+{
+	File *file = [_testDirectory file:@"table.plist"];
+	NSMutableDictionary *section = [NSMutableDictionary dictionary];
+	for (NSUInteger i = 0; i < 100; i++) section[[NSString stringWithFormat:@"key %lu", (unsigned long)i]] = @(i);
+	
+	XCTAssertTrue([file writeDictionary:@{ @"section" : section, @"list" : @[@[@"nested"]] } overwrite:YES format:NSPropertyListBinaryFormat_v1_0]);
+	
+	NSDictionary *dictionary = [file readDictionaryLazily];
+	
+	XCTAssertTrue(dictionary[@"section"] == dictionary[@"section"], @"Nested dictionaries and their key indexes should be reused");
+	XCTAssertTrue(dictionary[@"list"][0] == dictionary[@"list"][0], @"Nested arrays should be reused");
+	XCTAssertEqualObjects(dictionary[@"section"][@"key 42"], @42);
+}
+
+- (void)testLazilyReadSetsThatContainThemselvesAreReportedAsCorrupt
+{
+	// An array holding a set whose only element is the set itself
+	const uint8_t bytes[] =
+	{
+		'b', 'p', 'l', 'i', 's', 't', '0', '0',
+		0xA1, 0x01,
+		0xC1, 0x01,
+		0x08, 0x0A,
+		0, 0, 0, 0, 0, 0, 1, 1,
+		0, 0, 0, 0, 0, 0, 0, 2,
+		0, 0, 0, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 0, 0, 0, 12
+	};
+	
+	File *file = [_testDirectory file:@"cycle.plist"];
+	XCTAssertTrue([file writeData:[NSData dataWithBytes:bytes length:sizeof(bytes)] overwrite:YES error:nil]);
+	
+	NSArray *array = [file readArrayLazily];
+	
+	XCTAssertEqual([array count], (NSUInteger)1);
+	XCTAssertThrows([array objectAtIndex:0]);
+}
+
+- (void)testReadingLazilyFallsBackToParsingXMLPropertyLists
+{
+	File *file = [_testDirectory file:@"array.plist"];
+	
+	XCTAssertTrue([file writeArray:@[@"a", @1]]);
+	XCTAssertEqualObjects([file readArrayLazily], (@[@"a", @1]));
+	XCTAssertNil([file readDictionaryLazily]);
+}
+
+- (void)testReadingLazilyReturnsNilForCorruptBinaryPropertyLists
+{
+	File *file = [_testDirectory file:@"array.plist"];
+	XCTAssertTrue([file writeArray:@[@"a", @1] overwrite:YES format:NSPropertyListBinaryFormat_v1_0]);
+	
+	// Points the offset table past the end of the file
+	NSMutableData *data = [[file readData] mutableCopy];
+	memset((char *)[data mutableBytes] + [data length] - 8, 0xFF, 8);
+	XCTAssertTrue([file writeData:data overwrite:YES error:nil]);
+	
+	XCTAssertNil([file readArrayLazily]);
+}
+
 - (void)testCanReadData
 {
 	NSData *data = [_imageFile readData];
@@ -508,6 +724,291 @@ File *_imageFile;
 	XCTAssertNotNil(error);
 }
 
+- (void)testMappedReadReturnsSameDataAsPlainRead
+{
+	NSMutableData *contents = [NSMutableData dataWithLength:100000];
+	arc4random_buf([contents mutableBytes], [contents length]);
+	File *file = [_testDirectory file:@"mapped"];
+	[file writeData:contents];
+	
+	NSError *error;
+	NSData *mapped = [file readDataWithOptions:FileReadingMapped | FileReadingSequential | FileReadingWillNeed mappingThreshold:0 error:&error];
+	NSData *read = [file readDataWithOptions:FileReadingMapped mappingThreshold:[contents length] + 1 error:nil];
+	
+	XCTAssertNil(error);
+	XCTAssertEqualObjects(mapped, contents);
+	XCTAssertEqualObjects(read, contents);
+}
+
+- (void)testMappedReadOfEmptyFileReturnsEmptyData
+{
+	File *file = [[_testDirectory file:@"empty"] create];
+	NSData *data = [file readDataWithOptions:FileReadingMapped mappingThreshold:0 error:nil];
+	
+	XCTAssertNotNil(data);
+	XCTAssertEqual([data length], (NSUInteger)0);
+}
+
+- (void)testCanReadDataIntoReusedBuffer
+{
+	File *largeFile = [_testDirectory file:@"large"];
+	File *smallFile = [_testDirectory file:@"small"];
+	[largeFile writeData:[NSMutableData dataWithLength:8192]];
+	[smallFile writeData:[@"small" dataUsingEncoding:NSUTF8StringEncoding]];
+	
+	NSMutableData *buffer = [NSMutableData data];
+	XCTAssertTrue([largeFile readDataIntoBuffer:buffer error:nil]);
+	XCTAssertEqual([buffer length], (NSUInteger)8192);
+	
+	XCTAssertTrue([smallFile readDataIntoBuffer:buffer error:nil]);
+	XCTAssertEqualObjects(buffer, [@"small" dataUsingEncoding:NSUTF8StringEncoding]);
+}
+
+- (void)testReadIntoBufferReturnsErrorWhenReadingNonExistingPath
+{
+	NSError *error;
+	BOOL success = [[_testDirectory file:@"NonExistingFile"] readDataIntoBuffer:[NSMutableData data] error:&error];
+	
+	XCTAssertFalse(success);
+	XCTAssertNotNil(error);
+}
+
+#pragma mark Asynchronous tests
+
+- (void)testQueueReadsManyFilesConcurrently
+{
+	FileIOQueue *queue = [[FileIOQueue alloc] initWithWorkerCount:2];
+	NSMutableDictionary *results = [NSMutableDictionary dictionary];
+	NSLock *lock = [[NSLock alloc] init];
+	
+	for (NSUInteger i = 0; i < 500; i++)
+	{
+		File *file = [_testDirectory file:[NSString stringWithFormat:@"Queued/%lu", (unsigned long)i]];
+		[file writeData:[[NSString stringWithFormat:@"contents %lu", (unsigned long)i] dataUsingEncoding:NSUTF8StringEncoding]];
+		
+		[queue readDataOfFile:file completion:^(NSData *data, NSError *error)
+		{
+			[lock lock];
+			results[@(i)] = (data ? [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding] : error);
+			[lock unlock];
+		}];
+	}
+	
+	[queue waitUntilAllOperationsAreFinished];
+	
+	XCTAssertEqual([results count], (NSUInteger)500);
+	XCTAssertEqualObjects(results[@0], @"contents 0");
+	XCTAssertEqualObjects(results[@499], @"contents 499");
+}
+
+- (void)testQueueReportsErrorsForMissingFilesAndDirectories
+{
+	FileIOQueue *queue = [[FileIOQueue alloc] initWithWorkerCount:1];
+	__block NSError *missingError = nil;
+	__block NSError *directoryError = nil;
+	
+	[queue readDataOfFile:[_testDirectory file:@"NonExistingFile"] completion:^(NSData *data, NSError *error) { missingError = error; }];
+	[queue readDataOfFile:[_testDirectory file:@"Folder A"] completion:^(NSData *data, NSError *error) { directoryError = error; }];
+	[queue waitUntilAllOperationsAreFinished];
+	
+	XCTAssertNotNil(missingError);
+	XCTAssertNotNil(directoryError);
+}
+
+- (void)testQueueCanWriteCopyAndObtainInfo
+{
+	FileIOQueue *queue = [[FileIOQueue alloc] initWithWorkerCount:1];
+	File *file = [_testDirectory file:@"queued"];
+	File *copy = [_testDirectory file:@"queued copy"];
+	__block FileInfo *info = nil;
+	
+	[queue writeData:[@"queued" dataUsingEncoding:NSUTF8StringEncoding] toFile:file overwrite:NO completion:^(BOOL success, NSError *error) { XCTAssertTrue(success); }];
+	[queue waitUntilAllOperationsAreFinished];
+	
+	[queue copyFile:file to:copy overwrite:NO completion:^(File *result, NSError *error) { XCTAssertNotNil(result); }];
+	[queue infoForItem:file completion:^(FileInfo *result, NSError *error) { info = result; }];
+	[queue waitUntilAllOperationsAreFinished];
+	
+	XCTAssertEqualObjects([copy readString], @"queued");
+	XCTAssertEqual([info size], (unsigned long long)6);
+}
+
+#pragma mark Streaming tests
+
+- (void)testCanEnumerateChunks
+{
+	File *file = [_testDirectory file:@"chunks"];
+	[file writeData:[@"0123456789" dataUsingEncoding:NSUTF8StringEncoding]];
+	
+	NSMutableArray *chunks = [NSMutableArray array];
+	NSMutableArray *offsets = [NSMutableArray array];
+	
+	BOOL success = [file enumerateChunksOfSize:4 usingBlock:^(NSData *chunk, unsigned long long offset, BOOL *stop)
+	{
+		[chunks addObject:[[NSString alloc] initWithData:chunk encoding:NSUTF8StringEncoding]];
+		[offsets addObject:@(offset)];
+	}
+	error:nil];
+	
+	XCTAssertTrue(success);
+	XCTAssertEqualObjects(chunks, (@[@"0123", @"4567", @"89"]));
+	XCTAssertEqualObjects(offsets, (@[@0, @4, @8]));
+}
+
+- (void)testCanEnumerateLinesWithMixedLineEndings
+{
+	File *file = [_testDirectory file:@"lines"];
+	[file writeData:[@"first\r\nsecond\n\na line longer than the buffer\r\nlast" dataUsingEncoding:NSUTF8StringEncoding]];
+	
+	FileReader *reader = [FileReader readerWithFile:file];
+	[reader setBufferSize:4];
+	
+	NSMutableArray *lines = [NSMutableArray array];
+	BOOL success = [reader enumerateLinesUsingBlock:^(NSString *line, BOOL *stop) { [lines addObject:line]; } error:nil];
+	
+	XCTAssertTrue(success);
+	XCTAssertEqualObjects(lines, (@[@"first", @"second", @"", @"a line longer than the buffer", @"last"]));
+}
+
+- (void)testCanEnumerateLinesInByteRange
+{
+	File *file = [_testDirectory file:@"lines"];
+	[file writeData:[@"one\ntwo\nthree\nfour\n" dataUsingEncoding:NSUTF8StringEncoding]];
+	
+	FileReader *reader = [FileReader readerWithFile:file];
+	[reader setOffset:4];
+	[reader setLength:11];
+	
+	NSMutableArray *lines = [NSMutableArray array];
+	[reader enumerateLinesUsingBlock:^(NSString *line, BOOL *stop) { [lines addObject:line]; } error:nil];
+	
+	XCTAssertEqualObjects(lines, (@[@"two", @"three", @"f"]));
+}
+
+- (void)testEnumeratingLinesReturnsErrorWhenReadingNonExistingPath
+{
+	NSError *error;
+	BOOL success = [[_testDirectory file:@"NonExistingFile"] enumerateLinesUsingBlock:^(NSString *line, BOOL *stop) {} error:&error];
+	
+	XCTAssertFalse(success);
+	XCTAssertNotNil(error);
+}
+
+#pragma mark Hashing tests
+
+- (void)testDigestsMatchReferenceValues
+{
+	File *file = [_testDirectory file:@"abc"];
+	[file writeData:[@"abc" dataUsingEncoding:NSUTF8StringEncoding]];
+	
+	const uint8_t xxh64[8] = { 0x44, 0xbc, 0x2c, 0xf5, 0xad, 0x77, 0x09, 0x99 };
+	const uint8_t sha256[32] = { 0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+	                             0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad };
+	
+	XCTAssertEqualObjects([file digestWithAlgorithm:FileHashAlgorithmXXH64 error:nil], [NSData dataWithBytes:xxh64 length:8]);
+	XCTAssertEqualObjects([file digestWithAlgorithm:FileHashAlgorithmSHA256 error:nil], [NSData dataWithBytes:sha256 length:32]);
+}
+
+- (void)testDigestOfFileLargerThanBufferMatchesDigestOfItsData
+{
+	NSMutableData *data = [NSMutableData dataWithLength:[FileHasher bufferSize] * 2 + 12345];
+	uint8_t *bytes = [data mutableBytes];
+	for (NSUInteger i = 0; i < [data length]; i++) bytes[i] = (uint8_t)(i * 131 + 7);
+	
+	File *file = [_testDirectory file:@"large"];
+	[file writeData:data];
+	
+	for (FileHashAlgorithm algorithm = FileHashAlgorithmXXH64; algorithm <= FileHashAlgorithmSHA256; algorithm++)
+		XCTAssertEqualObjects([file digestWithAlgorithm:algorithm error:nil], [FileHasher digestOfData:data algorithm:algorithm]);
+}
+
+- (void)testHasherGivesTheSameDigestWhateverTheUpdateSizes
+{
+	NSData *data = [@"The quick brown fox jumps over the lazy dog, several times over to fill a few blocks." dataUsingEncoding:NSUTF8StringEncoding];
+	
+	FileHasher *hasher = [[FileHasher alloc] initWithAlgorithm:FileHashAlgorithmXXH64];
+	for (NSUInteger offset = 0; offset < [data length]; offset += 5)
+		[hasher updateWithBytes:(const char *)[data bytes] + offset length:MIN(5, [data length] - offset)];
+	
+	XCTAssertEqualObjects([hasher finish], [FileHasher digestOfData:data algorithm:FileHashAlgorithmXXH64]);
+}
+
+- (void)testDigestReturnsErrorForNonExistingFile
+{
+	NSError *error = nil;
+	XCTAssertNil([[_testDirectory file:@"NonExistingFile"] digestWithAlgorithm:FileHashAlgorithmSHA256 error:&error]);
+	XCTAssertEqual([error code], ENOENT);
+}
+
+#pragma mark Appending tests
+
+- (void)testAppenderAppendsToExistingContents
+{
+	File *file = [_testDirectory file:@"appended"];
+	[file writeData:[@"start " dataUsingEncoding:NSUTF8StringEncoding]];
+	
+	FileAppender *appender = [[FileAppender alloc] initWithFile:file bufferSize:8 error:nil];
+	XCTAssertTrue([appender appendString:@"a " error:nil]);
+	XCTAssertTrue([appender appendString:@"record larger than the buffer" error:nil]);
+	XCTAssertTrue([appender appendString:@" end" error:nil]);
+	XCTAssertTrue([appender close:nil]);
+	
+	XCTAssertEqualObjects([file readString], @"start a record larger than the buffer end");
+}
+
+- (void)testAppenderAppendsStringsWithEmbeddedNULCharacters
+{
+	File *file = [_testDirectory file:@"appended"];
+	NSString *string = [NSString stringWithFormat:@"before%Cafter", (unichar)0];
+	
+	FileAppender *appender = [file appender:nil];
+	XCTAssertTrue([appender appendString:string error:nil]);
+	XCTAssertTrue([appender close:nil]);
+	
+	XCTAssertEqualObjects([file readData], [string dataUsingEncoding:NSUTF8StringEncoding]);
+	XCTAssertEqual([[file readData] length], (NSUInteger)12);
+}
+
+- (void)testAppenderKeepsRecordsWholeWhenSharedBetweenThreads
+{
+	File *file = [_testDirectory file:@"appended"];
+	FileAppender *appender = [[FileAppender alloc] initWithFile:file bufferSize:1000 error:nil];
+	[appender setSyncPolicy:FileAppenderSyncPeriodically];
+	[appender setSyncByteInterval:10000];
+	
+	dispatch_apply(8, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t thread)
+	{
+		for (int i = 0; i < 1000; i++)
+			[appender appendString:[NSString stringWithFormat:@"%zu:%04d\n", thread, i] error:nil];
+	});
+	
+	XCTAssertTrue([appender close:nil]);
+	
+	NSMutableSet *records = [NSMutableSet set];
+	[file enumerateLinesUsingBlock:^(NSString *line, BOOL *stop) { [records addObject:line]; } error:nil];
+	
+	XCTAssertEqual([records count], (NSUInteger)8000);
+	XCTAssertTrue([records containsObject:@"7:0999"]);
+}
+
+- (void)testPreallocationDoesNotChangeFileSize
+{
+	File *file = [_testDirectory file:@"preallocated"];
+	FileAppender *appender = [file appender:nil];
+	
+	NSError *error;
+	if (![appender preallocateLength:1024 * 1024 error:&error])
+	{
+		XCTAssertEqualObjects([error domain], NSPOSIXErrorDomain, @"Only an unsupported file system should make preallocation fail");
+		return;
+	}
+	
+	[appender appendString:@"data" error:nil];
+	[appender close:nil];
+	
+	XCTAssertEqual([[file info] size], (unsigned long long)4);
+}
+
 #pragma mark Tests for archive: and unarchive
 
 - (void)testCanArchiveAndUnarchiveObjectThatImplementsNSCodingInBinaryFormat
@@ -563,6 +1064,237 @@ File *_imageFile;
 	XCTAssertNotNil(error, @"Should return an error");
 }
 
+- (void)testCanArchiveAndUnarchiveCompressedObject
+{
+	NSMutableArray *object = [NSMutableArray array];
+	for (int i = 0; i < 10000; i++) [object addObject:[NSString stringWithFormat:@"Repeated value %d", i % 100]];
+	
+	File *compressed = [_testDirectory file:@"compressed archive"];
+	File *uncompressed = [_testDirectory file:@"uncompressed archive"];
+	
+	NSError *error = nil;
+	XCTAssertTrue([compressed archive:object overwrite:NO compression:FileArchiveCompressionZlib error:&error]);
+	XCTAssertTrue([uncompressed archive:object overwrite:NO compression:FileArchiveCompressionNone error:&error]);
+	XCTAssertNil(error);
+	
+	XCTAssertLessThan([compressed size], [uncompressed size]);
+	XCTAssertEqualObjects([compressed unarchive], object);
+	XCTAssertEqualObjects([uncompressed unarchive], object, @"Archives without a compression header should still unarchive");
+}
+
+- (void)testReturnsNilAndOutputsErrorWhenUnarchivingCorruptCompressedArchive
+{
+	File *file = [_testDirectory file:@"compressed archive"];
+	[file archive:@[@"value"] overwrite:NO compression:FileArchiveCompressionZlib error:nil];
+	
+	NSData *data = [file readData];
+	[file writeData:[data subdataWithRange:NSMakeRange(0, [data length] - 4)] overwrite:YES];
+	
+	NSError *error;
+	id unarchived = [file unarchive:&error];
+	
+	XCTAssertNil(unarchived);
+	XCTAssertEqualObjects([error domain], NSPOSIXErrorDomain);
+}
+
+- (void)testUnarchivingFailsWithoutAllocatingWhenHeaderLengthIsImpossible
+{
+	File *file = [_testDirectory file:@"compressed archive"];
+	[file archive:@[@"value"] overwrite:NO compression:FileArchiveCompressionZlib error:nil];
+	
+	// The inflated length is stored big-endian after the first 8 bytes of the header
+	NSMutableData *data = [[file readData] mutableCopy];
+	unsigned char length[8] = { 0, 0, 0x10, 0, 0, 0, 0, 0 };
+	[data replaceBytesInRange:NSMakeRange(8, 8) withBytes:length];
+	[file writeData:data overwrite:YES];
+	
+	NSError *error;
+	id unarchived = [file unarchive:&error];
+	
+	XCTAssertNil(unarchived);
+	XCTAssertEqualObjects([error domain], NSPOSIXErrorDomain);
+	XCTAssertEqual([error code], EINVAL);
+}
+
+#pragma mark Decode cache tests
+
+- (void)testDecodeCacheReturnsSameObjectUntilFileChanges
+{
+	FileDecodeCache *cache = [[FileDecodeCache alloc] initWithMemoryBudget:1024 * 1024];
+	File *file = [_testDirectory file:@"settings.plist"];
+	[file writeDictionary:@{@"value": @1}];
+	
+	__block int decodeCount = 0;
+	FileDecodeCacheDecoder decoder = ^id(unsigned long long *cost, NSError **error) { decodeCount++; return [file readDictionary]; };
+	
+	id first = [cache objectForFile:file kind:@"dictionary" decoder:decoder error:nil];
+	id second = [cache objectForFile:file kind:@"dictionary" decoder:decoder error:nil];
+	
+	XCTAssertEqualObjects(first, @{@"value": @1});
+	XCTAssertTrue(first == second, @"A hit should return the same instance");
+	XCTAssertEqual(decodeCount, 1);
+	XCTAssertEqual([cache hitCount], 1ULL);
+	XCTAssertEqual([cache missCount], 1ULL);
+	
+	[file writeDictionary:@{@"value": @2} overwrite:YES];
+	
+	XCTAssertEqualObjects([cache objectForFile:file kind:@"dictionary" decoder:decoder error:nil], @{@"value": @2});
+	XCTAssertEqual(decodeCount, 2);
+	XCTAssertEqual([cache objectCount], (NSUInteger)1);
+}
+
+- (void)testDecodeCacheEvictsLeastRecentlyUsedObjects
+{
+	// Each file costs its size plus a small overhead, so two of them fit
+	FileDecodeCache *cache = [[FileDecodeCache alloc] initWithMemoryBudget:3000];
+	NSMutableData *data = [NSMutableData dataWithLength:1000];
+	
+	File *a = [_testDirectory file:@"A"];
+	File *b = [_testDirectory file:@"B"];
+	File *c = [_testDirectory file:@"C"];
+	for (File *file in @[a, b, c]) [file writeData:data];
+	
+	FileDecodeCacheDecoder decoder = ^id(unsigned long long *cost, NSError **error) { return [NSObject new]; };
+	
+	id decodedA = [cache objectForFile:a kind:@"test" decoder:decoder error:nil];
+	[cache objectForFile:b kind:@"test" decoder:decoder error:nil];
+	[cache objectForFile:a kind:@"test" decoder:decoder error:nil];
+	[cache objectForFile:c kind:@"test" decoder:decoder error:nil];
+	
+	XCTAssertEqual([cache evictionCount], 1ULL);
+	XCTAssertEqual([cache objectCount], (NSUInteger)2);
+	XCTAssertTrue([cache objectForFile:a kind:@"test" decoder:decoder error:nil] == decodedA, @"The most recently used object should have been kept");
+	
+	unsigned long long missCount = [cache missCount];
+	[cache objectForFile:b kind:@"test" decoder:decoder error:nil];
+	XCTAssertEqual([cache missCount], missCount + 1, @"The least recently used object should have been evicted");
+}
+
+- (void)testDecodeCacheUsesTheCostReportedByTheDecoder
+{
+	FileDecodeCache *cache = [[FileDecodeCache alloc] initWithMemoryBudget:3000];
+	File *file = [_testDirectory file:@"small"];
+	[file writeData:[NSMutableData dataWithLength:10]];
+	
+	FileDecodeCacheDecoder decoder = ^id(unsigned long long *cost, NSError **error) { *cost = 5000; return [NSObject new]; };
+	
+	XCTAssertNotNil([cache objectForFile:file kind:@"test" decoder:decoder error:nil]);
+	XCTAssertEqual([cache objectCount], (NSUInteger)0, @"An object costing more than the budget should not be kept");
+}
+
+- (void)testDecodeCacheCountsCompressedArchivesAtTheirInflatedSize
+{
+	NSMutableArray *object = [NSMutableArray array];
+	for (int i = 0; i < 10000; i++) [object addObject:[NSString stringWithFormat:@"Repeated value %d", i % 100]];
+	
+	File *file = [_testDirectory file:@"compressed archive"];
+	XCTAssertTrue([file archive:[object copy] overwrite:YES compression:FileArchiveCompressionZlib error:nil]);
+	
+	FileDecodeCache *cache = [FileDecodeCache sharedCache];
+	[cache removeAllObjects];
+	[cache setEnabled:YES];
+	
+	XCTAssertEqualObjects([file unarchive], object);
+	unsigned long long totalCost = [cache totalCost];
+	
+	[cache setEnabled:NO];
+	[cache removeAllObjects];
+	
+	XCTAssertGreaterThan(totalCost, [file size] * 2, @"The cost should be the inflated archive's length, not the file's size");
+}
+
+- (void)testDecodeCacheDoesNotShareMutableArchives
+{
+	File *immutableFile = [_testDirectory file:@"immutable archive"];
+	File *mutableFile = [_testDirectory file:@"mutable archive"];
+	[immutableFile archive:@{@"values": @[@1, @2]}];
+	[mutableFile archive:@{@"values": [NSMutableArray arrayWithObjects:@1, @2, nil]}];
+	
+	FileDecodeCache *cache = [FileDecodeCache sharedCache];
+	[cache removeAllObjects];
+	[cache setEnabled:YES];
+	
+	id immutableFirst = [immutableFile unarchive];
+	id immutableSecond = [immutableFile unarchive];
+	id mutableFirst = [mutableFile unarchive];
+	id mutableSecond = [mutableFile unarchive];
+	NSUInteger objectCount = [cache objectCount];
+	
+	[cache setEnabled:NO];
+	[cache removeAllObjects];
+	
+	XCTAssertTrue(immutableFirst == immutableSecond);
+	XCTAssertEqualObjects(mutableFirst, mutableSecond);
+	XCTAssertFalse(mutableFirst == mutableSecond, @"Objects holding mutable values should be decoded for every caller");
+	XCTAssertEqual(objectCount, (NSUInteger)1);
+}
+
+- (void)testDecodeCacheSharesConcurrentDecodes
+{
+	FileDecodeCache *cache = [[FileDecodeCache alloc] initWithMemoryBudget:1024 * 1024];
+	File *file = [_testDirectory file:@"shared"];
+	[file writeData:[NSMutableData dataWithLength:100]];
+	
+	__block volatile int32_t decodeCount = 0;
+	NSMutableArray *objects = [NSMutableArray array];
+	NSLock *lock = [[NSLock alloc] init];
+	
+	dispatch_apply(8, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t index)
+	{
+		id object = [cache objectForFile:file kind:@"test" decoder:^id(unsigned long long *cost, NSError **error)
+		{
+			__sync_fetch_and_add(&decodeCount, 1);
+			[NSThread sleepForTimeInterval:0.2];
+			return [NSObject new];
+		} error:nil];
+		
+		[lock lock];
+		[objects addObject:object];
+		[lock unlock];
+	});
+	
+	XCTAssertEqual(decodeCount, 1);
+	XCTAssertEqual([[NSSet setWithArray:objects] count], (NSUInteger)1);
+	XCTAssertEqual([cache hitCount] + [cache missCount], 8ULL);
+}
+
+- (void)testDecodeCacheDoesNotCacheFailures
+{
+	FileDecodeCache *cache = [[FileDecodeCache alloc] initWithMemoryBudget:1024 * 1024];
+	__block int decodeCount = 0;
+	
+	for (int i = 0; i < 2; i++)
+	{
+		NSError *error = nil;
+		id object = [cache objectForFile:_imageFile kind:@"archive" decoder:^id(unsigned long long *cost, NSError **decodeError) { decodeCount++; return [_imageFile unarchive:decodeError]; } error:&error];
+		
+		XCTAssertNil(object);
+		XCTAssertNotNil(error);
+	}
+	
+	XCTAssertEqual(decodeCount, 2);
+	XCTAssertEqual([cache objectCount], (NSUInteger)0);
+}
+
+- (void)testReadingUsesSharedDecodeCacheWhenEnabled
+{
+	File *file = [_testDirectory file:@"list.plist"];
+	[file writeArray:@[@"one", @"two"]];
+	
+	FileDecodeCache *cache = [FileDecodeCache sharedCache];
+	[cache setEnabled:YES];
+	
+	NSArray *first = [file readArray];
+	NSArray *second = [file readArray];
+	
+	[cache setEnabled:NO];
+	[cache removeAllObjects];
+	
+	XCTAssertEqualObjects(first, (@[@"one", @"two"]));
+	XCTAssertTrue(first == second, @"The second read should come from the cache");
+	XCTAssertFalse([file readArray] == first, @"A disabled cache should not be used");
+}
+
 #pragma mark Description tests
 
 - (void)testDescriptionIsEqualToAbsolutePath
@@ -0,0 +1,122 @@
+//
+//  PathPerformanceTests.m
+//  Files
+//
+//  Created by Michaël Fortin on 2016-10-18.
+//  Copyright © 2016 irradiated.net. All rights reserved.
+//
+
+#import "PathPerformanceTests.h"
+#import "Directory.h"
+#import "File.h"
+
+#define PathPerformanceTestsItemCount 100000
+#define PathPerformanceTestsCreationCount 1000000
+
+@implementation PathPerformanceTests
+{
+	NSArray<File *> *_files;
+	NSArray<File *> *_equalFiles;
+}
+
+#pragma mark SetUp and TearDown
+
+- (void)setUp
+{
+	NSMutableArray *files = [NSMutableArray array];
+	NSMutableArray *equalFiles = [NSMutableArray array];
+	
+	for (NSUInteger i = 0; i < PathPerformanceTestsItemCount; i++)
+	{
+		[files addObject:[File fileWithPath:[NSString stringWithFormat:@"~/Library/Caches/Index/Item %lu.dat", (unsigned long)i]]];
+		[equalFiles addObject:[File fileWithPath:[[NSString stringWithFormat:@"~/Library/Caches/Index/Item %lu.dat", (unsigned long)i] stringByStandardizingPath]]];
+	}
+	
+	_files = files;
+	_equalFiles = equalFiles;
+}
+
+#pragma mark Construction
+
+- (void)testPerformanceOfCreatingOneMillionPaths
+{
+	[self measureBlock:^
+	{
+		for (NSUInteger i = 0; i < PathPerformanceTestsCreationCount; i++)
+		{
+			@autoreleasepool
+			{
+				XCTAssertNotNil([File fileWithPath:@"/Library/Caches/net.irradiated.Tests/Directory+File/Folder A/File 1"]);
+			}
+		}
+	}];
+}
+
+- (void)testPerformanceOfCreatingOneMillionChildrenInBulk
+{
+	NSMutableArray *names = [NSMutableArray arrayWithCapacity:PathPerformanceTestsCreationCount];
+	for (NSUInteger i = 0; i < PathPerformanceTestsCreationCount; i++)
+		[names addObject:[NSString stringWithFormat:@"File %lu", (unsigned long)i]];
+	
+	Directory *directory = [Directory directoryWithPath:@"/Library/Caches/net.irradiated.Tests/Directory+File"];
+	
+	[self measureBlock:^
+	{
+		@autoreleasepool
+		{
+			XCTAssertEqual([[directory filesNamed:names] count], (NSUInteger)PathPerformanceTestsCreationCount);
+		}
+	}];
+}
+
+#pragma mark Equality and Hashing
+
+// The baseline for these is what the same work cost when every call standardized the path again
+// (see -testBaselineStandardizingPathForEachHash).
+
+- (void)testPerformanceOfHash
+{
+	[self measureBlock:^
+	{
+		NSUInteger accumulator = 0;
+		for (File *file in _files)
+			accumulator ^= [file hash];
+		
+		XCTAssertTrue(accumulator != 0 || [_files count] == 0);
+	}];
+}
+
+- (void)testPerformanceOfIsEqual
+{
+	[self measureBlock:^
+	{
+		for (NSUInteger i = 0; i < [_files count]; i++)
+			XCTAssertTrue([_files[i] isEqual:_equalFiles[i]]);
+	}];
+}
+
+- (void)testPerformanceOfSetMembership
+{
+	[self measureBlock:^
+	{
+		NSSet *set = [NSSet setWithArray:_files];
+		for (File *file in _equalFiles)
+			XCTAssertTrue([set containsObject:file]);
+	}];
+}
+
+- (void)testBaselineStandardizingPathForEachHash
+{
+	NSArray *paths = [_files valueForKey:@"path"];
+	
+	[self measureBlock:^
+	{
+		NSUInteger accumulator = 0;
+		for (NSString *path in paths)
+			accumulator ^= [[path stringByStandardizingPath] hash];
+		
+		XCTAssertTrue(accumulator != 0 || [paths count] == 0);
+	}];
+}
+
+@end